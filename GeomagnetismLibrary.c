@@ -1688,7 +1688,12 @@ MAG_SecVarSummation(MAGtype_LegendreFunction * LegendreFunction,
 	 */
 	int m, n, index;
 	double cos_phi;
-	MagneticModel->SecularVariationUsed = TRUE;
+	/*
+	 * The original library sets MagneticModel->SecularVariationUsed here,
+	 * but nothing ever reads it back, and writing to the model makes
+	 * MAG_Geomag unsafe to call concurrently on a shared model (as done
+	 * by wmm_mag2true/wmm_true2mag on a shared navdb).
+	 */
 	MagneticResults->Bz = 0.0;
 	MagneticResults->By = 0.0;
 	MagneticResults->Bx = 0.0;
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "geom.h"
 #include "airac.h"
@@ -330,6 +331,140 @@ airway_free(airway_t *awy)
 	free(awy);
 }
 
+/*
+ * Links an airway into both hash tables of the airway DB.
+ */
+static void
+airway_db_insert(airway_db_t *db, airway_t *awy)
+{
+	htbl_set(&db->by_awy_name, awy->name, awy);
+	for (size_t i = 0; i < awy->num_segs; i++)
+		htbl_set(&db->by_fix_name, awy->segs[i].endpt[0].name, awy);
+	if (awy->num_segs > 0) {
+		htbl_set(&db->by_fix_name,
+		    awy->segs[awy->num_segs - 1].endpt[1].name, awy);
+	}
+}
+
+/*
+ * Removes one reference to `value' from the multi-value list under `key'.
+ */
+static void
+htbl_unlink_value(htbl_t *htbl, void *key, const void *value)
+{
+	const list_t *list = htbl_lookup_multi(htbl, key);
+
+	ASSERT(list != NULL);
+	for (void *mv = list_head(list); mv != NULL;
+	    mv = list_next(list, mv)) {
+		if (HTBL_VALUE_MULTI(mv) == value) {
+			htbl_remove_multi(htbl, key, mv);
+			return;
+		}
+	}
+	ASSERT(0);
+}
+
+/*
+ * Reverse of airway_db_insert.
+ */
+static void
+airway_db_unlink(airway_db_t *db, airway_t *awy)
+{
+	htbl_unlink_value(&db->by_awy_name, awy->name, awy);
+	for (size_t i = 0; i < awy->num_segs; i++) {
+		htbl_unlink_value(&db->by_fix_name,
+		    awy->segs[i].endpt[0].name, awy);
+	}
+	if (awy->num_segs > 0) {
+		htbl_unlink_value(&db->by_fix_name,
+		    awy->segs[awy->num_segs - 1].endpt[1].name, awy);
+	}
+}
+
+/*
+ * Parses an airway from a string in ATS.txt format (an 'A' line followed by
+ * its 'S' lines, separated by newlines).
+ */
+static airway_t *
+airway_parse_str(const char *str)
+{
+	FILE		*fp;
+	airway_t	*awy;
+	char		*line = NULL;
+	size_t		line_cap = 0, line_num = 0;
+
+	fp = fmemopen((void *)str, strlen(str), "r");
+	if (fp == NULL)
+		return (NULL);
+	awy = calloc(sizeof (*awy), 1);
+	if (parser_get_next_line(fp, &line, &line_cap, &line_num) == -1 ||
+	    !parse_airway_line(line, awy, "(string)", line_num) ||
+	    !parse_airway_segs(fp, awy, "(string)", &line_num)) {
+		free(awy);
+		awy = NULL;
+	}
+	free(line);
+	fclose(fp);
+
+	return (awy);
+}
+
+/*
+ * Adds an airway to an open airway DB.
+ *
+ * @param db The airway DB to modify.
+ * @param str The airway definition in ATS.txt format ('A' line plus the
+ *	following 'S' lines, separated by newlines).
+ *
+ * @return B_TRUE on success, B_FALSE if the definition failed to parse.
+ */
+bool_t
+airway_db_add(airway_db_t *db, const char *str)
+{
+	airway_t *awy = airway_parse_str(str);
+
+	if (awy == NULL)
+		return (B_FALSE);
+	airway_db_insert(db, awy);
+
+	return (B_TRUE);
+}
+
+/*
+ * Removes an airway from an open airway DB. The airway is matched on its
+ * name and all of its segments. See airway_db_add for the format of `str'.
+ *
+ * @return B_TRUE if the airway was found and removed, B_FALSE otherwise.
+ */
+bool_t
+airway_db_remove(airway_db_t *db, const char *str)
+{
+	airway_t	*awy = airway_parse_str(str);
+	const list_t	*list;
+	bool_t		found = B_FALSE;
+
+	if (awy == NULL)
+		return (B_FALSE);
+	list = htbl_lookup_multi(&db->by_awy_name, awy->name);
+	for (void *mv = (list != NULL ? list_head(list) : NULL); mv != NULL;
+	    mv = list_next(list, mv)) {
+		airway_t *old_awy = HTBL_VALUE_MULTI(mv);
+
+		if (old_awy->num_segs == awy->num_segs &&
+		    memcmp(old_awy->segs, awy->segs,
+		    awy->num_segs * sizeof (*awy->segs)) == 0) {
+			airway_db_unlink(db, old_awy);
+			airway_free(old_awy);
+			found = B_TRUE;
+			break;
+		}
+	}
+	airway_free(awy);
+
+	return (found);
+}
+
 airway_db_t *
 airway_db_open(const char *navdata_dir, size_t num_waypoints)
 {
@@ -383,14 +518,7 @@ airway_db_open(const char *navdata_dir, size_t num_waypoints)
 		    !parse_airway_segs(ats_fp, awy, ats_fname, &line_num)) {
 			goto errout;
 		}
-		htbl_set(&db->by_awy_name, awy->name, awy);
-		for (size_t i = 0; i < awy->num_segs; i++)
-			htbl_set(&db->by_fix_name, awy->segs[i].endpt[0].name,
-			    awy);
-		if (awy->num_segs > 0) {
-			htbl_set(&db->by_fix_name,
-			    awy->segs[awy->num_segs - 1].endpt[1].name, awy);
-		}
+		airway_db_insert(db, awy);
 		awy = NULL;
 	}
 
@@ -399,6 +527,7 @@ airway_db_open(const char *navdata_dir, size_t num_waypoints)
 	free(ats_fname);
 	if (awy)
 		airway_free(awy);
+	free(line);
 	return (db);
 errout:
 	if (db)
@@ -408,6 +537,7 @@ errout:
 	free(ats_fname);
 	if (awy)
 		airway_free(awy);
+	free(line);
 	return (NULL);
 }
 
@@ -615,7 +745,7 @@ airway_db_lookup_awy_intersection(const airway_db_t *db, const char *awy1_name,
  * Checks if `wpt' is a starting wpt on any segment of airway `awy'.
  */
 bool_t
-airway_db_fiwpt_on_awy(const airway_db_t *db, const wpt_t *wpt,
+airway_db_wpt_on_awy(const airway_db_t *db, const wpt_t *wpt,
     const char *awyname)
 {
 	const list_t *awy_list;
@@ -631,10 +761,12 @@ airway_db_fiwpt_on_awy(const airway_db_t *db, const wpt_t *wpt,
 
 		if (strcmp(awy->name, awyname) != 0)
 			continue;
-		/* look for the exact start wpt (incl geo pos) */
+		/*
+		 * Look for the exact start wpt (incl geo pos). Airway
+		 * wpts carry no country code, so don't compare that.
+		 */
 		for (unsigned i = 0; i < awy->num_segs; i++) {
-			if (memcmp(&awy->segs[i].endpt[0], wpt, sizeof (*wpt))
-			    == 0)
+			if (WPT_EQ(&awy->segs[i].endpt[0], wpt))
 				return (B_TRUE);
 		}
 	}
@@ -677,7 +809,7 @@ waypoint_db_open(const char *navdata_dir)
 	size_t		line_cap = 0, line_num = 0;
 	char		*line = NULL;
 	uint64_t	num_wpts = 0;
-	wpt_t		*wpt = NULL;
+	wpt_ent_t	*ent = NULL;
 
 	/* Open Waypoints.txt */
 	wpts_fname = malloc(strlen(navdata_dir) +
@@ -717,20 +849,22 @@ waypoint_db_open(const char *navdata_dir)
 	    &line_num)) != -1) {
 		if (line_len == 0 || *line == ',')
 			continue;
-		wpt = calloc(sizeof (*wpt), 1);
-		if (!wpt)
+		ent = calloc(sizeof (*ent), 1);
+		if (!ent)
 			goto errout;
-		if (!parse_waypoint_line(line, wpt))
+		if (!parse_waypoint_line(line, &ent->wpt))
 			goto errout;
-		htbl_set(&db->by_name, wpt->name, wpt);
-		wpt = NULL;
+		ent->pos_v = sph2ecef(GEO2_TO_GEO3(ent->wpt.pos, 0));
+		htbl_set(&db->by_name, ent->wpt.name, ent);
+		ent = NULL;
 	}
 
 	if (wpts_fp)
 		fclose(wpts_fp);
 	free(wpts_fname);
-	if (wpt)
-		free(wpt);
+	if (ent)
+		free(ent);
+	free(line);
 	return (db);
 errout:
 	if (db)
@@ -738,11 +872,65 @@ errout:
 	if (wpts_fp)
 		fclose(wpts_fp);
 	free(wpts_fname);
-	if (wpt)
-		free(wpt);
+	if (ent)
+		free(ent);
+	free(line);
 	return (NULL);
 }
 
+/*
+ * Adds a waypoint, given as a line in Waypoints.txt format, to an open
+ * waypoint DB.
+ *
+ * @return B_TRUE on success, B_FALSE if the line failed to parse.
+ */
+bool_t
+waypoint_db_add(waypoint_db_t *db, const char *line)
+{
+	wpt_ent_t *ent = calloc(sizeof (*ent), 1);
+
+	if (!parse_waypoint_line(line, &ent->wpt)) {
+		free(ent);
+		return (B_FALSE);
+	}
+	ent->pos_v = sph2ecef(GEO2_TO_GEO3(ent->wpt.pos, 0));
+	htbl_set(&db->by_name, ent->wpt.name, ent);
+
+	return (B_TRUE);
+}
+
+/*
+ * Removes a waypoint, given as a line in Waypoints.txt format, from an
+ * open waypoint DB. All fields of the waypoint must match.
+ *
+ * @return B_TRUE if the waypoint was found and removed, B_FALSE otherwise.
+ */
+bool_t
+waypoint_db_remove(waypoint_db_t *db, const char *line)
+{
+	wpt_t		wpt;
+	const list_t	*list;
+
+	memset(&wpt, 0, sizeof (wpt));
+	if (!parse_waypoint_line(line, &wpt))
+		return (B_FALSE);
+	list = htbl_lookup_multi(&db->by_name, wpt.name);
+	if (list == NULL)
+		return (B_FALSE);
+	for (void *mv = list_head(list); mv != NULL;
+	    mv = list_next(list, mv)) {
+		wpt_ent_t *old_ent = HTBL_VALUE_MULTI(mv);
+
+		if (memcmp(&old_ent->wpt, &wpt, sizeof (wpt)) == 0) {
+			htbl_remove_multi(&db->by_name, wpt.name, mv);
+			free(old_ent);
+			return (B_TRUE);
+		}
+	}
+
+	return (B_FALSE);
+}
+
 void
 waypoint_db_close(waypoint_db_t *db)
 {
@@ -783,8 +971,10 @@ parse_navaid_line(const char *line, navaid_t *navaid)
 {
 	char	line_copy[128];
 	char	*comps[11];
-	int	dme;
-	double	freq;
+	int		dme;
+	double		freq;
+	fixed_dec_t	freq_fd;
+	int64_t		freq_hz;
 
 	STRLCPY_CHECK_ERROUT(line_copy, line);
 	if (explode_line(line_copy, ',', comps, 11) != 11) {
@@ -795,21 +985,33 @@ parse_navaid_line(const char *line, navaid_t *navaid)
 	STRLCPY_CHECK_ERROUT(navaid->ID, comps[0]);
 	/* ok to truncate the name */
 	(void) strlcpy(navaid->name, comps[1], sizeof (navaid->name));
-	freq = atof(comps[2]);
+	if (!parse_fixed_dec(comps[2], &freq_fd)) {
+		openfmc_log(OPENFMC_LOG_ERR, "Error parsing navaid: "
+		    "\"%s\" is not a valid frequency.", comps[2]);
+		goto errout;
+	}
+	freq = fixed_dec2dbl(freq_fd);
 	dme = atoi(comps[4]);
-	if (is_valid_ndb_freq(freq)) {
+	/*
+	 * The Hz value is converted straight from the fixed-point input,
+	 * since e.g. 116.8 * 1000000 truncates to 116799999 as a double.
+	 */
+	if (is_valid_ndb_freq(freq) && fixed_dec2int(freq_fd, 3, &freq_hz)) {
 		navaid->type = NAVAID_TYPE_NDB;
-		navaid->freq = freq * 1000;
-	} else if (is_valid_vor_freq(freq)) {
+		navaid->freq = freq_hz;
+	} else if (is_valid_vor_freq(freq) &&
+	    fixed_dec2int(freq_fd, 6, &freq_hz)) {
 		navaid->type = (dme ? NAVAID_TYPE_VORDME : NAVAID_TYPE_VOR);
-		navaid->freq = freq * 1000000;
-	} else if (is_valid_loc_freq(freq)) {
+		navaid->freq = freq_hz;
+	} else if (is_valid_loc_freq(freq) &&
+	    fixed_dec2int(freq_fd, 6, &freq_hz)) {
 		navaid->type = dme ? NAVAID_TYPE_LOCDME : NAVAID_TYPE_LOC;
-		navaid->freq = freq * 1000000;
-	} else if (is_valid_tacan_freq(freq)) {
+		navaid->freq = freq_hz;
+	} else if (is_valid_tacan_freq(freq) &&
+	    fixed_dec2int(freq_fd, 6, &freq_hz)) {
 		navaid->type = NAVAID_TYPE_TACAN;
-		navaid->freq = freq * 1000000;
-	} else if (freq == 0.0 && strcmp(comps[2], "000.00") == 0) {
+		navaid->freq = freq_hz;
+	} else if (freq_fd.mant == 0 && strcmp(comps[2], "000.00") == 0) {
 		navaid->type = NAVAID_TYPE_UNKNOWN;
 	} else {
 		openfmc_log(OPENFMC_LOG_ERR, "Error parsing navaid: "
@@ -823,6 +1025,7 @@ parse_navaid_line(const char *line, navaid_t *navaid)
 		goto errout;
 	}
 	STRLCPY_CHECK_ERROUT(navaid->icao_country_code, comps[9]);
+	navaid->pos_v = sph2ecef(GEO2_TO_GEO3(GEO3_TO_GEO2(navaid->pos), 0));
 
 	return (B_TRUE);
 errout:
@@ -890,6 +1093,7 @@ navaid_db_open(const char *navdata_dir)
 	free(navaids_fname);
 	if (navaid)
 		free(navaid);
+	free(line);
 	return (db);
 errout:
 	if (db)
@@ -899,9 +1103,62 @@ errout:
 	free(navaids_fname);
 	if (navaid)
 		free(navaid);
+	free(line);
 	return (NULL);
 }
 
+/*
+ * Adds a navaid, given as a line in Navaids.txt format, to an open
+ * navaid DB.
+ *
+ * @return B_TRUE on success, B_FALSE if the line failed to parse.
+ */
+bool_t
+navaid_db_add(navaid_db_t *db, const char *line)
+{
+	navaid_t *navaid = calloc(sizeof (*navaid), 1);
+
+	if (!parse_navaid_line(line, navaid)) {
+		free(navaid);
+		return (B_FALSE);
+	}
+	htbl_set(&db->by_id, navaid->ID, navaid);
+
+	return (B_TRUE);
+}
+
+/*
+ * Removes a navaid, given as a line in Navaids.txt format, from an open
+ * navaid DB. All fields of the navaid must match.
+ *
+ * @return B_TRUE if the navaid was found and removed, B_FALSE otherwise.
+ */
+bool_t
+navaid_db_remove(navaid_db_t *db, const char *line)
+{
+	navaid_t	navaid;
+	const list_t	*list;
+
+	memset(&navaid, 0, sizeof (navaid));
+	if (!parse_navaid_line(line, &navaid))
+		return (B_FALSE);
+	list = htbl_lookup_multi(&db->by_id, navaid.ID);
+	if (list == NULL)
+		return (B_FALSE);
+	for (void *mv = list_head(list); mv != NULL;
+	    mv = list_next(list, mv)) {
+		navaid_t *old_navaid = HTBL_VALUE_MULTI(mv);
+
+		if (memcmp(old_navaid, &navaid, sizeof (navaid)) == 0) {
+			htbl_remove_multi(&db->by_id, navaid.ID, mv);
+			free(old_navaid);
+			return (B_TRUE);
+		}
+	}
+
+	return (B_FALSE);
+}
+
 void
 navaid_db_close(navaid_db_t *db)
 {
@@ -1008,7 +1265,7 @@ find_nearest(const char *name, geo_pos3_t refpt, const waypoint_db_t *wptdb,
 }
 
 static bool_t
-proc_navaid_lookup(const char *name, wpt_t *wpt, const airport_t *arpt,
+proc_navaid_lookup(const char *name, wpt_t *wpt, airport_t *arpt,
     const waypoint_db_t *wptdb, const navaid_db_t *navdb, navaid_type_t type)
 {
 	geo_pos2_t	fix_pos = NULL_GEO_POS2, navaid_pos = NULL_GEO_POS2;
@@ -1023,6 +1280,7 @@ proc_navaid_lookup(const char *name, wpt_t *wpt, const airport_t *arpt,
 		openfmc_log(OPENFMC_LOG_ERR, "Error looking up wpt/navaid "
 		    "\"%s\" for arpt %s procedure: no wpt/navaid of type %s "
 		    "found.", name, arpt->icao, navaid_type_name(type));
+		arpt->num_unres_fixes++;
 		return (B_FALSE);
 	} else if (!IS_NULL_GEO_POS(fix_pos) && IS_NULL_GEO_POS(navaid_pos)) {
 		pos = fix_pos;
@@ -1090,12 +1348,29 @@ errout:
 	return (B_FALSE);
 }
 
+/*
+ * Like parse_fixed_dec, but for optional fields: a field that is empty
+ * (or blank) reads as 0, the way atof used to read it.
+ */
+static bool_t
+parse_opt_fixed_dec(const char *str, fixed_dec_t *fd)
+{
+	if (str[strspn(str, " \t")] == 0) {
+		fd->mant = 0;
+		fd->frac_digits = 0;
+		return (B_TRUE);
+	}
+	return (parse_fixed_dec(str, fd));
+}
+
 static bool_t
 parse_rwy_line(const char *line, runway_t *rwy, airport_t *arpt)
 {
-	char	line_copy[128];
-	char	*comps[15];
-	double	loc_freq;
+	char		line_copy[128];
+	char		*comps[15];
+	double		loc_freq;
+	fixed_dec_t	loc_freq_fd, gp_angle_fd;
+	int64_t		loc_freq_hz;
 
 	/* Line must start with "R" keyword */
 	STRLCPY_CHECK_ERROUT(line_copy, line);
@@ -1121,11 +1396,19 @@ parse_rwy_line(const char *line, runway_t *rwy, airport_t *arpt)
 	/* rwy width field is unreliable! */
 	rwy->width = atoi(comps[4]);
 	rwy->loc_avail = atoi(comps[5]);
-	loc_freq = atof(comps[6]);
-	rwy->loc_freq = loc_freq * 1000000;
 	rwy->loc_fcrs = atoi(comps[7]);
-	rwy->gp_angle = atof(comps[11]);
 	rwy->arpt = arpt;
+	/* runways without an ILS may leave the LOC & GP fields empty */
+	if (!parse_opt_fixed_dec(comps[6], &loc_freq_fd) ||
+	    !fixed_dec2int(loc_freq_fd, 6, &loc_freq_hz) ||
+	    !parse_opt_fixed_dec(comps[11], &gp_angle_fd)) {
+		openfmc_log(OPENFMC_LOG_ERR, "Error parsing %s runway line: "
+		    "malformed LOC frequency or GP angle.", arpt->icao);
+		goto errout;
+	}
+	loc_freq = fixed_dec2dbl(loc_freq_fd);
+	rwy->loc_freq = loc_freq_hz;
+	rwy->gp_angle = fixed_dec2dbl(gp_angle_fd);
 	if (!is_valid_hdg(rwy->hdg) ||
 	    rwy->length == 0 || rwy->length > MAX_RWY_LEN ||
 	    (rwy->loc_avail != 0 && rwy->loc_avail != 1) ||
@@ -1444,7 +1727,7 @@ dump_spd_constr(const spd_lim_t *spd, char desc[16])
 
 static bool_t
 parse_AF_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    const airport_t *arpt, const navaid_db_t *db)
+    airport_t *arpt, const navaid_db_t *db)
 {
 	int dir;
 
@@ -1514,7 +1797,7 @@ dump_CA_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 
 static bool_t
 parse_CD_VD_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    const airport_t *arpt, const navaid_db_t *db, bool_t is_CD)
+    airport_t *arpt, const navaid_db_t *db, bool_t is_CD)
 {
 	if (is_CD) {
 		CHECK_NUM_COMPS(18, CD);
@@ -1565,7 +1848,7 @@ dump_VD_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 
 static bool_t
 parse_CF_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    const airport_t *arpt, const navaid_db_t *db)
+    airport_t *arpt, const navaid_db_t *db)
 {
 	CHECK_NUM_COMPS(18, CF);
 	seg->type = NAVPROC_SEG_TYPE_CRS_TO_FIX;
@@ -1605,7 +1888,7 @@ dump_CF_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 
 static bool_t
 parse_CI_CR_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    bool_t is_CI, const airport_t *arpt, const navaid_db_t *db)
+    bool_t is_CI, airport_t *arpt, const navaid_db_t *db)
 {
 	if (is_CI)
 		CHECK_NUM_COMPS(13, CI);
@@ -1738,7 +2021,7 @@ dump_FC_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 
 static bool_t
 parse_FD_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    const airport_t *arpt, const navaid_db_t *db)
+    airport_t *arpt, const navaid_db_t *db)
 {
 	CHECK_NUM_COMPS(18, FD);
 	seg->type = NAVPROC_SEG_TYPE_FIX_TO_DME;
@@ -1869,7 +2152,7 @@ dump_IF_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 
 static bool_t
 parse_PI_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    const airport_t *arpt, const navaid_db_t *db)
+    airport_t *arpt, const navaid_db_t *db)
 {
 	int turn_dir;
 
@@ -1913,7 +2196,7 @@ dump_PI_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 
 static bool_t
 parse_RF_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    const airport_t *arpt, const waypoint_db_t *db)
+    airport_t *arpt, const waypoint_db_t *db)
 {
 	CHECK_NUM_COMPS(16, RF);
 	seg->type = NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX;
@@ -1981,7 +2264,7 @@ dump_VA_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 
 static bool_t
 parse_VI_VM_VR_seg(char **comps, size_t num_comps, navproc_seg_t *seg,
-    navproc_seg_type_t type, const airport_t *arpt, const navaid_db_t *db)
+    navproc_seg_type_t type, airport_t *arpt, const navaid_db_t *db)
 {
 	char *leg_name;
 	if (type == NAVPROC_SEG_TYPE_HDG_TO_INTCP) {
@@ -2054,7 +2337,7 @@ dump_VI_VM_VR_seg(char **result, size_t *result_sz, const navproc_seg_t *seg)
 }
 
 static bool_t
-parse_proc_seg_line(const char *line, navproc_t *proc, const airport_t *arpt,
+parse_proc_seg_line(const char *line, navproc_t *proc, airport_t *arpt,
     const waypoint_db_t *wptdb, const navaid_db_t *navdb)
 {
 	char		*comps[24];
@@ -2295,6 +2578,81 @@ navproc_seg_set_end_wpt(navproc_seg_t *seg, const wpt_t *wpt)
 	}
 }
 
+/*
+ * Collects pointers to all the wpts (fixes & navaids) referenced by `seg'
+ * into `wpts'. Optional wpts which aren't set are skipped.
+ *
+ * @return The number of wpts stored in `wpts'.
+ */
+unsigned
+navproc_seg_get_wpts(navproc_seg_t *seg, wpt_t *wpts[NAVPROC_SEG_MAX_WPTS])
+{
+	unsigned n = 0;
+
+	switch (seg->type) {
+	case NAVPROC_SEG_TYPE_ARC_TO_FIX:
+		wpts[n++] = &seg->leg_cmd.dme_arc.navaid;
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
+		wpts[n++] = &seg->leg_cmd.navaid_crs.navaid;
+		break;
+	case NAVPROC_SEG_TYPE_FIX_TO_DIST:
+	case NAVPROC_SEG_TYPE_FIX_TO_DME:
+	case NAVPROC_SEG_TYPE_FIX_TO_MANUAL:
+		wpts[n++] = &seg->leg_cmd.fix_crs.fix;
+		break;
+	case NAVPROC_SEG_TYPE_INIT_FIX:
+	case NAVPROC_SEG_TYPE_FIX_TO_ALT:
+		wpts[n++] = &seg->leg_cmd.fix;
+		break;
+	case NAVPROC_SEG_TYPE_HOLD_TO_ALT:
+	case NAVPROC_SEG_TYPE_HOLD_TO_FIX:
+	case NAVPROC_SEG_TYPE_HOLD_TO_MANUAL:
+		wpts[n++] = &seg->leg_cmd.hold.wpt;
+		break;
+	case NAVPROC_SEG_TYPE_PROC_TURN:
+		wpts[n++] = &seg->leg_cmd.proc_turn.startpt;
+		wpts[n++] = &seg->leg_cmd.proc_turn.navaid;
+		break;
+	case NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX:
+		wpts[n++] = &seg->leg_cmd.radius_arc.ctr_wpt;
+		break;
+	default:
+		break;
+	}
+	switch (seg->type) {
+	case NAVPROC_SEG_TYPE_ARC_TO_FIX:
+	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
+	case NAVPROC_SEG_TYPE_DIR_TO_FIX:
+	case NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX:
+	case NAVPROC_SEG_TYPE_TRK_TO_FIX:
+	case NAVPROC_SEG_TYPE_HDG_TO_INTCP:
+		wpts[n++] = &seg->term_cond.fix;
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_INTCP:
+	case NAVPROC_SEG_TYPE_CRS_TO_RADIAL:
+	case NAVPROC_SEG_TYPE_HDG_TO_RADIAL:
+		wpts[n++] = &seg->term_cond.radial.navaid;
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_DME:
+	case NAVPROC_SEG_TYPE_FIX_TO_DME:
+	case NAVPROC_SEG_TYPE_HDG_TO_DME:
+		wpts[n++] = &seg->term_cond.dme.navaid;
+		break;
+	default:
+		break;
+	}
+	ASSERT(n <= NAVPROC_SEG_MAX_WPTS);
+	for (unsigned i = 0, m = n; i < m; i++) {
+		if (IS_NULL_WPT(wpts[i]))
+			n--;
+		else
+			wpts[i - (m - n)] = wpts[i];
+	}
+
+	return (n);
+}
+
 /*
  * Returns a malloc'd string describing the specified navproc. The caller
  * is responsible for freeing the string.
@@ -2362,6 +2720,7 @@ parse_proc(FILE *fp, size_t *line_num, navproc_t *proc, airport_t *arpt,
 		;
 	if (line_len == -1) {
 		/* EOF */
+		free(line);
 		return (0);
 	}
 	STRLCPY_CHECK_ERROUT(line_copy, line);
@@ -2421,6 +2780,7 @@ parse_proc_file(FILE *fp, airport_t *arpt, const waypoint_db_t *wptdb,
 	    navdb)) != 0) {
 		if (n == -1) {
 			/* broken procedure, skip over it */
+			arpt->num_bad_procs++;
 			continue;
 		}
 		arpt->num_procs++;
@@ -2431,9 +2791,94 @@ parse_proc_file(FILE *fp, airport_t *arpt, const waypoint_db_t *wptdb,
 	}
 }
 
+/*
+ * Opens an airport and loads its runways and procedures. This scans
+ * Airports.txt from the start for the airport, so when opening many
+ * airports, build an index using airport_index and use airport_open_at.
+ *
+ * @return The airport (free using airport_close), or NULL on error.
+ */
 airport_t *
 airport_open(const char *arpt_icao, const char *navdata_dir,
     const waypoint_db_t *wptdb, const navaid_db_t *navdb)
+{
+	return (airport_open_at(arpt_icao, navdata_dir, 0, wptdb, navdb));
+}
+
+/*
+ * Builds an index of all airports in Airports.txt, so that individual
+ * airports can be opened with airport_open_at without rescanning the
+ * whole file every time.
+ *
+ * @param navdata_dir Navdata directory containing Airports.txt.
+ * @param num_arpts Will be filled with the number of index entries.
+ *
+ * @return The malloc'd index in file order, or NULL on error.
+ */
+arpt_idx_ent_t *
+airport_index(const char *navdata_dir, size_t *num_arpts)
+{
+	arpt_idx_ent_t	*idx = NULL;
+	size_t		idx_cap = 0;
+	FILE		*fp;
+	char		*fname;
+	char		*line = NULL;
+	size_t		line_cap = 0;
+	long		offset = 0;
+
+	fname = malloc(strlen(navdata_dir) + strlen(PATHSEP "Airports.txt") +
+	    1);
+	sprintf(fname, "%s" PATHSEP "Airports.txt", navdata_dir);
+	fp = fopen(fname, "r");
+	if (fp == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't open %s: %s", fname,
+		    strerror(errno));
+		free(fname);
+		return (NULL);
+	}
+	*num_arpts = 0;
+	while (getline(&line, &line_cap, fp) != -1) {
+		char	*comps[10];
+		long	line_start = offset;
+
+		offset = ftell(fp);
+		if (explode_line(line, ',', comps, 10) != 10 ||
+		    strcmp(comps[0], "A") != 0)
+			continue;
+		strip_space(comps[1]);
+		if (strlen(comps[1]) != ICAO_NAME_LEN)
+			continue;
+		if (*num_arpts == idx_cap) {
+			idx_cap = MAX(idx_cap * 2, 1024);
+			idx = realloc(idx, idx_cap * sizeof (*idx));
+		}
+		strcpy(idx[*num_arpts].icao, comps[1]);
+		idx[*num_arpts].offset = line_start;
+		if (geo_pos2_from_str(comps[3], comps[4],
+		    &idx[*num_arpts].refpt)) {
+			idx[*num_arpts].pos_v = sph2ecef(GEO2_TO_GEO3(
+			    idx[*num_arpts].refpt, 0));
+		} else {
+			idx[*num_arpts].refpt = NULL_GEO_POS2;
+			idx[*num_arpts].pos_v = NULL_VECT3;
+		}
+		(*num_arpts)++;
+	}
+	free(line);
+	free(fname);
+	fclose(fp);
+
+	return (idx != NULL ? idx : calloc(sizeof (*idx), 1));
+}
+
+/*
+ * Same as airport_open, but starts scanning Airports.txt at `offset'. Pass
+ * the offset of the airport's line from airport_index to avoid scanning
+ * the file.
+ */
+airport_t *
+airport_open_at(const char *arpt_icao, const char *navdata_dir, long offset,
+    const waypoint_db_t *wptdb, const navaid_db_t *navdb)
 {
 	airport_t	*arpt;
 	FILE		*arpt_fp = NULL, *proc_fp = NULL;
@@ -2446,6 +2891,7 @@ airport_open(const char *arpt_icao, const char *navdata_dir,
 	arpt = calloc(sizeof (*arpt), 1);
 	if (!arpt)
 		return (NULL);
+	arpt->refcnt = 1;
 
 	ASSERT(strlen(arpt_icao) == 4);
 	strcpy(arpt->icao, arpt_icao);
@@ -2460,6 +2906,11 @@ airport_open(const char *arpt_icao, const char *navdata_dir,
 		    strerror(errno));
 		goto errout;
 	}
+	if (offset != 0 && fseek(arpt_fp, offset, SEEK_SET) != 0) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't seek in %s: %s",
+		    arpt_fname, strerror(errno));
+		goto errout;
+	}
 
 	/* Locate airport starting line & parse it */
 	while ((line_len = parser_get_next_line(arpt_fp, &line, &line_cap,
@@ -2528,9 +2979,32 @@ errout:
 	return (NULL);
 }
 
+/*
+ * Takes an additional reference on an airport. Airports are immutable
+ * once opened, so the same airport_t can be shared by several users.
+ *
+ * @return The airport passed in, for convenience.
+ */
+airport_t *
+airport_hold(airport_t *arpt)
+{
+	VERIFY(__atomic_add_fetch(&arpt->refcnt, 1, __ATOMIC_RELAXED) > 1);
+	return (arpt);
+}
+
+/*
+ * Drops a reference on an airport opened with airport_open. The airport
+ * is freed when the last reference is dropped.
+ */
 void
 airport_close(airport_t *arpt)
 {
+	unsigned refcnt = __atomic_sub_fetch(&arpt->refcnt, 1,
+	    __ATOMIC_ACQ_REL);
+
+	ASSERT(refcnt != UINT_MAX);
+	if (refcnt != 0)
+		return;
 	free(arpt->rwys);
 	for (unsigned i = 0; i < arpt->num_procs; i++) {
 		navproc_t *proc = &arpt->procs[i];
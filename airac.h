@@ -75,6 +75,19 @@ typedef struct {
 	htbl_t		by_fix_name;
 } airway_db_t;
 
+/*
+ * Waypoint database entry. The wpt_t comes first, so the values in the
+ * by_name table can be used as plain wpt_t pointers. `pos_v' is the
+ * position on the spherical Earth model (see sph2ecef), precomputed so
+ * that proximity ranking of same-named fixes needs no trigonometry. It is
+ * always taken at elevation 0, so that the ranking only depends on the
+ * lateral position, also between waypoints, navaids and airports.
+ */
+typedef struct {
+	wpt_t		wpt;
+	vect3_t		pos_v;
+} wpt_ent_t;
+
 typedef struct {
 	htbl_t		by_name;
 } waypoint_db_t;
@@ -82,6 +95,8 @@ typedef struct {
 airway_db_t *airway_db_open(const char *navdata_dir, size_t num_waypoints);
 void airway_db_close(airway_db_t *db);
 char *airway_db_dump(const airway_db_t *db, bool_t by_awy_name);
+bool_t airway_db_add(airway_db_t *db, const char *str);
+bool_t airway_db_remove(airway_db_t *db, const char *str);
 
 /* Airway lookup */
 const airway_t *airway_db_lookup(const airway_db_t *db, const char *awyname,
@@ -95,6 +110,8 @@ bool_t airway_db_wpt_on_awy(const airway_db_t *db, const wpt_t *wpt,
 waypoint_db_t *waypoint_db_open(const char *navdata_dir);
 void waypoint_db_close(waypoint_db_t *db);
 char *waypoint_db_dump(const waypoint_db_t *db);
+bool_t waypoint_db_add(waypoint_db_t *db, const char *line);
+bool_t waypoint_db_remove(waypoint_db_t *db, const char *line);
 
 
 /* Navaid structures */
@@ -119,6 +136,7 @@ typedef struct {
 	geo_pos3_t	pos;
 	navaid_type_t	type;
 	unsigned	freq;		/* in Hz */
+	vect3_t		pos_v;		/* pos at elevation 0, see wpt_ent_t */
 } navaid_t;
 
 typedef struct {
@@ -128,6 +146,8 @@ typedef struct {
 navaid_db_t *navaid_db_open(const char *navdata_dir);
 void navaid_db_close(navaid_db_t *db);
 char *navaid_db_dump(const navaid_db_t *db);
+bool_t navaid_db_add(navaid_db_t *db, const char *line);
+bool_t navaid_db_remove(navaid_db_t *db, const char *line);
 
 
 /* Procedure structures */
@@ -310,6 +330,9 @@ const char *navproc_seg_type2str(navproc_seg_type_t type);
 const wpt_t *navproc_seg_get_start_wpt(const navproc_seg_t *seg);
 const wpt_t *navproc_seg_get_end_wpt(const navproc_seg_t *seg);
 void navproc_seg_set_end_wpt(navproc_seg_t *seg, const wpt_t *fix);
+#define	NAVPROC_SEG_MAX_WPTS	2
+unsigned navproc_seg_get_wpts(navproc_seg_t *seg,
+    wpt_t *wpts[NAVPROC_SEG_MAX_WPTS]);
 char *navproc_seg_get_descr(const navproc_seg_t *seg);
 
 wpt_t navproc_get_start_wpt(const navproc_t *proc);
@@ -344,10 +367,27 @@ struct airport_s {
 	unsigned	num_gates;
 	wpt_t		*gates;
 	bool_t		true_hdg;
+
+	/* parse diagnostics, filled in by airport_open */
+	unsigned	num_bad_procs;		/* procs skipped on errors */
+	unsigned	num_unres_fixes;	/* unresolved wpt/navaid refs */
+
+	unsigned	refcnt;		/* see airport_hold */
 };
 
+typedef struct {
+	char		icao[ICAO_NAME_LEN + 1];
+	long		offset;		/* of the 'A' line in Airports.txt */
+	geo_pos2_t	refpt;		/* NULL_GEO_POS2 if unparseable */
+	vect3_t		pos_v;		/* sph2ecef(refpt), see wpt_ent_t */
+} arpt_idx_ent_t;
+
 airport_t *airport_open(const char *arpt_icao, const char *navdata_dir,
     const waypoint_db_t *wptdb, const navaid_db_t *navdb);
+arpt_idx_ent_t *airport_index(const char *navdata_dir, size_t *num_arpts);
+airport_t *airport_open_at(const char *arpt_icao, const char *navdata_dir,
+    long offset, const waypoint_db_t *wptdb, const navaid_db_t *navdb);
+airport_t *airport_hold(airport_t *arpt);
 void airport_close(airport_t *arpt);
 char *airport_dump(const airport_t *arpt);
 
@@ -0,0 +1,814 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "airac_delta.h"
+#include "helpers.h"
+#include "log.h"
+
+/*
+ * AIRAC deltas
+ *
+ * Consecutive AIRAC cycles only differ in a small fraction of their records,
+ * so rather than reparsing a complete new navdata directory on every
+ * changeover, we can compute the set of records which were removed from and
+ * added to each file and apply only those. A changed record is simply
+ * represented as a removal of the old version followed by an addition of
+ * the new one.
+ *
+ * Records are compared in their textual form (after whitespace stripping,
+ * as done by parser_get_next_line), which keeps the diff independent of
+ * the in-memory representation. A delta can be applied either to the
+ * in-memory waypoint, navaid and airway DBs (airports and procedures are
+ * always loaded from disk on demand, so they aren't held in memory), or to
+ * a navdata directory, turning it into the new cycle on disk.
+ *
+ * The delta file format is line-based, like the navdata files themselves:
+ *
+ *	X,1602,04FEB03MAR/16,...	validity line of the new cycle
+ *	<op><code>,<nlines>[,<name>]	record header, followed by
+ *	<line 1>			the `nlines' lines of the record
+ *	...
+ *
+ * <op> is '+' for additions or '-' for removals and <code> is the record
+ * type code from delta_types below. <name> is only present on procedure
+ * records and holds the ICAO code of the airport.
+ */
+
+static const struct {
+	const char	*filename;	/* relative to the navdata dir */
+	char		code;		/* record type code in delta files */
+	bool_t		multiline;	/* record spans an 'A' line + more */
+} delta_types[AIRAC_DELTA_NUM_TYPES] = {
+	{ "Waypoints.txt",	'W',	B_FALSE },	/* AIRAC_DELTA_WPT */
+	{ "Navaids.txt",	'N',	B_FALSE },	/* AIRAC_DELTA_NAVAID */
+	{ "ATS.txt",		'A',	B_TRUE },	/* AIRAC_DELTA_AWY */
+	{ "Airports.txt",	'D',	B_TRUE },	/* AIRAC_DELTA_ARPT */
+	{ "Proc",		'P',	B_FALSE }	/* AIRAC_DELTA_PROC */
+};
+
+/* Sorted set of records (or procedure file names) read from a file. */
+typedef struct {
+	char	**recs;
+	size_t	num;
+	size_t	cap;
+} rec_set_t;
+
+static char *
+mkpath(const char *dir, const char *fname)
+{
+	char *path = malloc(strlen(dir) + strlen(PATHSEP) + strlen(fname) + 1);
+	sprintf(path, "%s" PATHSEP "%s", dir, fname);
+	return (path);
+}
+
+static void
+rec_set_add(rec_set_t *set, char *rec)
+{
+	if (set->num == set->cap) {
+		set->cap = MAX(set->cap * 2, 1024);
+		set->recs = realloc(set->recs, set->cap * sizeof (*set->recs));
+	}
+	set->recs[set->num++] = rec;
+}
+
+static void
+rec_set_free(rec_set_t *set)
+{
+	for (size_t i = 0; i < set->num; i++)
+		free(set->recs[i]);
+	free(set->recs);
+	memset(set, 0, sizeof (*set));
+}
+
+static int
+rec_cmp(const void *a, const void *b)
+{
+	return (strcmp(*(char *const *)a, *(char *const *)b));
+}
+
+static void
+rec_set_sort(rec_set_t *set)
+{
+	qsort(set->recs, set->num, sizeof (*set->recs), rec_cmp);
+}
+
+/*
+ * Reads all records of a navdata file into a sorted record set.
+ *
+ * @param filename Full path of the file to read.
+ * @param type Type of records contained in the file.
+ * @param set Set to which the records are added.
+ * @param x_line If not NULL, will be filled with a malloc'd copy of the
+ *	validity ('X') line of the file.
+ *
+ * @return B_TRUE on success, B_FALSE if the file couldn't be opened.
+ */
+static bool_t
+read_recs(const char *filename, airac_delta_type_t type, rec_set_t *set,
+    char **x_line)
+{
+	FILE	*fp;
+	char	*line = NULL, *rec = NULL;
+	size_t	line_cap = 0, line_num = 0, rec_len = 0;
+	ssize_t	line_len;
+
+	ASSERT(type != AIRAC_DELTA_PROC);
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't open %s: %s", filename,
+		    strerror(errno));
+		return (B_FALSE);
+	}
+	while ((line_len = parser_get_next_line(fp, &line, &line_cap,
+	    &line_num)) != -1) {
+		if (line_len == 0)
+			continue;
+		if (strncmp(line, "X,", 2) == 0) {
+			if (x_line != NULL) {
+				free(*x_line);
+				*x_line = strdup(line);
+			}
+			continue;
+		}
+		/* unnamed waypoints are ignored by waypoint_db_open */
+		if (type == AIRAC_DELTA_WPT && line[0] == ',')
+			continue;
+		if (!delta_types[type].multiline ||
+		    strncmp(line, "A,", 2) == 0) {
+			if (rec != NULL)
+				rec_set_add(set, rec);
+			rec = NULL;
+			rec_len = 0;
+			append_format(&rec, &rec_len, "%s", line);
+		} else if (rec != NULL) {
+			append_format(&rec, &rec_len, "\n%s", line);
+		}
+		/* anything preceding the first 'A' line is ignored */
+	}
+	if (rec != NULL)
+		rec_set_add(set, rec);
+	rec_set_sort(set);
+
+	free(line);
+	fclose(fp);
+
+	return (B_TRUE);
+}
+
+/*
+ * Reads a complete procedure file, returning its lines (including empty
+ * ones) separated by newlines. Returns NULL if the file can't be opened.
+ */
+static char *
+read_proc_file(const char *filename)
+{
+	FILE	*fp;
+	char	*line = NULL, *text = NULL;
+	size_t	line_cap = 0, line_num = 0, text_len = 0;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL)
+		return (NULL);
+	while (parser_get_next_line(fp, &line, &line_cap, &line_num) != -1) {
+		append_format(&text, &text_len, "%s%s",
+		    text != NULL ? "\n" : "", line);
+	}
+	free(line);
+	fclose(fp);
+
+	return (text != NULL ? text : strdup(""));
+}
+
+/*
+ * Lists the airport ICAO codes of all procedure files in a Proc directory
+ * into a sorted set. A missing Proc directory results in an empty set.
+ */
+static void
+read_proc_names(const char *navdata_dir, rec_set_t *set)
+{
+	char		*proc_dir = mkpath(navdata_dir, "Proc");
+	DIR		*dp = opendir(proc_dir);
+	struct dirent	*de;
+
+	free(proc_dir);
+	if (dp == NULL)
+		return;
+	while ((de = readdir(dp)) != NULL) {
+		size_t len = strlen(de->d_name);
+
+		if (len <= 4 || len - 4 >= NAV_NAME_LEN ||
+		    strcmp(&de->d_name[len - 4], ".txt") != 0)
+			continue;
+		rec_set_add(set, strndup(de->d_name, len - 4));
+	}
+	closedir(dp);
+	rec_set_sort(set);
+}
+
+static void
+delta_add_rec(airac_delta_t *delta, airac_delta_type_t type, bool_t add,
+    const char *name, char *text)
+{
+	airac_delta_rec_t *rec = calloc(sizeof (*rec), 1);
+
+	rec->type = type;
+	rec->add = add;
+	if (name != NULL)
+		strlcpy(rec->name, name, sizeof (rec->name));
+	rec->text = text;
+	list_insert_tail(&delta->recs, rec);
+	if (add)
+		delta->num_add[type]++;
+	else
+		delta->num_rm[type]++;
+}
+
+static airac_delta_t *
+delta_alloc(void)
+{
+	airac_delta_t *delta = calloc(sizeof (*delta), 1);
+
+	list_create(&delta->recs, sizeof (airac_delta_rec_t),
+	    offsetof(airac_delta_rec_t, node));
+
+	return (delta);
+}
+
+/*
+ * Merges two sorted record sets and emits the differences into `delta'.
+ */
+static void
+diff_recs(airac_delta_t *delta, airac_delta_type_t type,
+    const rec_set_t *old_set, const rec_set_t *new_set)
+{
+	size_t i = 0, j = 0;
+
+	while (i < old_set->num || j < new_set->num) {
+		int c;
+
+		if (i == old_set->num)
+			c = 1;
+		else if (j == new_set->num)
+			c = -1;
+		else
+			c = strcmp(old_set->recs[i], new_set->recs[j]);
+
+		if (c == 0) {
+			i++;
+			j++;
+		} else if (c < 0) {
+			delta_add_rec(delta, type, B_FALSE, NULL,
+			    strdup(old_set->recs[i++]));
+		} else {
+			delta_add_rec(delta, type, B_TRUE, NULL,
+			    strdup(new_set->recs[j++]));
+		}
+	}
+}
+
+/*
+ * Emits procedure file removals, additions and changes. A changed file is
+ * represented by a single addition which replaces the old file.
+ */
+static void
+diff_procs(airac_delta_t *delta, const char *old_dir, const char *new_dir)
+{
+	rec_set_t	old_set = { NULL, 0, 0 }, new_set = { NULL, 0, 0 };
+	size_t		i = 0, j = 0;
+
+	read_proc_names(old_dir, &old_set);
+	read_proc_names(new_dir, &new_set);
+
+	while (i < old_set.num || j < new_set.num) {
+		const char	*name;
+		char		fname[NAV_NAME_LEN + 16];
+		char		*path, *old_text, *new_text;
+		int		c;
+
+		if (i == old_set.num)
+			c = 1;
+		else if (j == new_set.num)
+			c = -1;
+		else
+			c = strcmp(old_set.recs[i], new_set.recs[j]);
+
+		if (c < 0) {
+			delta_add_rec(delta, AIRAC_DELTA_PROC, B_FALSE,
+			    old_set.recs[i++], NULL);
+			continue;
+		}
+		name = new_set.recs[j];
+		snprintf(fname, sizeof (fname), "Proc" PATHSEP "%s.txt", name);
+		path = mkpath(new_dir, fname);
+		new_text = read_proc_file(path);
+		free(path);
+		if (c == 0) {
+			path = mkpath(old_dir, fname);
+			old_text = read_proc_file(path);
+			free(path);
+			i++;
+		} else {
+			old_text = NULL;
+		}
+		j++;
+		if (new_text == NULL || (old_text != NULL &&
+		    strcmp(old_text, new_text) == 0)) {
+			free(new_text);
+		} else {
+			delta_add_rec(delta, AIRAC_DELTA_PROC, B_TRUE, name,
+			    new_text);
+		}
+		free(old_text);
+	}
+
+	rec_set_free(&old_set);
+	rec_set_free(&new_set);
+}
+
+/*
+ * Computes the delta which turns the navdata in `old_dir' into the navdata
+ * in `new_dir'.
+ *
+ * @return The delta (free using airac_delta_free), or NULL if either of the
+ *	directories couldn't be read.
+ */
+airac_delta_t *
+airac_delta_diff(const char *old_dir, const char *new_dir)
+{
+	airac_delta_t *delta = delta_alloc();
+
+	for (airac_delta_type_t type = 0; type < AIRAC_DELTA_PROC; type++) {
+		rec_set_t	old_set = { NULL, 0, 0 };
+		rec_set_t	new_set = { NULL, 0, 0 };
+		char		*old_fname, *new_fname;
+		bool_t		ok;
+
+		old_fname = mkpath(old_dir, delta_types[type].filename);
+		new_fname = mkpath(new_dir, delta_types[type].filename);
+		ok = read_recs(old_fname, type, &old_set, NULL) &&
+		    read_recs(new_fname, type, &new_set,
+		    type == AIRAC_DELTA_ARPT ? &delta->x_line : NULL);
+		if (ok)
+			diff_recs(delta, type, &old_set, &new_set);
+		rec_set_free(&old_set);
+		rec_set_free(&new_set);
+		free(old_fname);
+		free(new_fname);
+		if (!ok)
+			goto errout;
+	}
+	if (delta->x_line == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Error computing AIRAC delta: "
+		    "%s" PATHSEP "Airports.txt contains no validity line.",
+		    new_dir);
+		goto errout;
+	}
+	diff_procs(delta, old_dir, new_dir);
+
+	return (delta);
+errout:
+	airac_delta_free(delta);
+	return (NULL);
+}
+
+/*
+ * Frees a delta returned from airac_delta_diff or airac_delta_read.
+ */
+void
+airac_delta_free(airac_delta_t *delta)
+{
+	airac_delta_rec_t *rec;
+
+	while ((rec = list_remove_head(&delta->recs)) != NULL) {
+		free(rec->text);
+		free(rec);
+	}
+	list_destroy(&delta->recs);
+	free(delta->x_line);
+	free(delta);
+}
+
+static unsigned
+text_num_lines(const char *text)
+{
+	unsigned n = 1;
+
+	if (text == NULL)
+		return (0);
+	for (const char *p = text; *p != 0; p++) {
+		if (*p == '\n')
+			n++;
+	}
+	return (n);
+}
+
+/*
+ * Writes a delta to a file. See the top of this file for the format.
+ *
+ * @return B_TRUE on success, B_FALSE on I/O error.
+ */
+bool_t
+airac_delta_write(const airac_delta_t *delta, const char *filename)
+{
+	FILE *fp = fopen(filename, "w");
+
+	if (fp == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't open %s for writing: %s",
+		    filename, strerror(errno));
+		return (B_FALSE);
+	}
+	fprintf(fp, "%s\n", delta->x_line);
+	for (const airac_delta_rec_t *rec = list_head(&delta->recs);
+	    rec != NULL; rec = list_next(&delta->recs, rec)) {
+		fprintf(fp, "%c%c,%u", rec->add ? '+' : '-',
+		    delta_types[rec->type].code, text_num_lines(rec->text));
+		if (rec->type == AIRAC_DELTA_PROC)
+			fprintf(fp, ",%s", rec->name);
+		fprintf(fp, "\n");
+		if (rec->text != NULL)
+			fprintf(fp, "%s\n", rec->text);
+	}
+	if (fclose(fp) != 0) {
+		openfmc_log(OPENFMC_LOG_ERR, "Error writing %s: %s",
+		    filename, strerror(errno));
+		return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Reads a delta file written by airac_delta_write.
+ *
+ * @return The delta (free using airac_delta_free), or NULL on error.
+ */
+airac_delta_t *
+airac_delta_read(const char *filename)
+{
+	airac_delta_t	*delta;
+	FILE		*fp;
+	char		*line = NULL;
+	size_t		line_cap = 0, line_num = 0;
+	ssize_t		line_len;
+
+	fp = fopen(filename, "r");
+	if (fp == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't open %s: %s", filename,
+		    strerror(errno));
+		return (NULL);
+	}
+	delta = delta_alloc();
+
+	while ((line_len = parser_get_next_line(fp, &line, &line_cap,
+	    &line_num)) == 0)
+		;
+	if (line_len == -1 || strncmp(line, "X,", 2) != 0) {
+		openfmc_log(OPENFMC_LOG_ERR, "%s:%lu: error parsing AIRAC "
+		    "delta: expected validity line.", filename, line_num);
+		goto errout;
+	}
+	delta->x_line = strdup(line);
+
+	while ((line_len = parser_get_next_line(fp, &line, &line_cap,
+	    &line_num)) != -1) {
+		char			*comps[3];
+		ssize_t			n_comps;
+		airac_delta_type_t	type;
+		bool_t			add;
+		char			*text = NULL;
+		size_t			text_len = 0;
+		unsigned		n_lines;
+
+		if (line_len == 0)
+			continue;
+		n_comps = explode_line(line, ',', comps, 3);
+		if (n_comps < 2 || strlen(comps[0]) != 2 ||
+		    (comps[0][0] != '+' && comps[0][0] != '-')) {
+			openfmc_log(OPENFMC_LOG_ERR, "%s:%lu: error parsing "
+			    "AIRAC delta: malformed record header.",
+			    filename, line_num);
+			goto errout;
+		}
+		add = (comps[0][0] == '+');
+		for (type = 0; type < AIRAC_DELTA_NUM_TYPES; type++) {
+			if (delta_types[type].code == comps[0][1])
+				break;
+		}
+		if (type == AIRAC_DELTA_NUM_TYPES ||
+		    (type == AIRAC_DELTA_PROC) != (n_comps == 3) ||
+		    (n_comps == 3 && strlen(comps[2]) >= NAV_NAME_LEN)) {
+			openfmc_log(OPENFMC_LOG_ERR, "%s:%lu: error parsing "
+			    "AIRAC delta: unknown record type \"%s\".",
+			    filename, line_num, comps[0]);
+			goto errout;
+		}
+		n_lines = atoi(comps[1]);
+		if (n_comps == 3) {
+			char name[NAV_NAME_LEN];
+			unsigned i;
+
+			strlcpy(name, comps[2], sizeof (name));
+			for (i = 0; i < n_lines; i++) {
+				if (parser_get_next_line(fp, &line, &line_cap,
+				    &line_num) == -1)
+					break;
+				append_format(&text, &text_len, "%s%s",
+				    i > 0 ? "\n" : "", line);
+			}
+			if (i != n_lines) {
+				free(text);
+				goto truncated;
+			}
+			delta_add_rec(delta, type, add, name, text);
+			continue;
+		}
+		for (unsigned i = 0; i < n_lines; i++) {
+			if (parser_get_next_line(fp, &line, &line_cap,
+			    &line_num) == -1)
+				break;
+			append_format(&text, &text_len, "%s%s",
+			    i > 0 ? "\n" : "", line);
+		}
+		if (text_num_lines(text) != n_lines || n_lines == 0) {
+			free(text);
+			goto truncated;
+		}
+		delta_add_rec(delta, type, add, NULL, text);
+	}
+
+	free(line);
+	fclose(fp);
+	return (delta);
+truncated:
+	openfmc_log(OPENFMC_LOG_ERR, "%s:%lu: error parsing AIRAC delta: "
+	    "record truncated.", filename, line_num);
+errout:
+	free(line);
+	fclose(fp);
+	airac_delta_free(delta);
+	return (NULL);
+}
+
+/*
+ * Returns a malloc'd human-readable summary of the delta.
+ */
+char *
+airac_delta_dump(const airac_delta_t *delta)
+{
+	char	*result = NULL;
+	size_t	result_sz = 0;
+
+	append_format(&result, &result_sz,
+	    "AIRAC delta to \"%s\":\n"
+	    "  file               added removed\n"
+	    "  ------------------ ----- -------\n", delta->x_line);
+	for (int i = 0; i < AIRAC_DELTA_NUM_TYPES; i++) {
+		append_format(&result, &result_sz, "  %-18s %5u %7u\n",
+		    delta_types[i].filename, delta->num_add[i],
+		    delta->num_rm[i]);
+	}
+
+	return (result);
+}
+
+/*
+ * Applies a delta to the in-memory navigation DBs, so that they match the
+ * new cycle. All removals are done before any additions, so a changed
+ * record never shows up twice. Airports and procedures aren't held in
+ * memory (see airport_open), so their records are skipped here. Any
+ * readers of the DBs must be quiesced while this runs.
+ *
+ * @return B_TRUE on success, B_FALSE if a record failed to parse or a
+ *	removed record couldn't be found (i.e. the delta wasn't made against
+ *	the cycle loaded in the DBs). On failure, the DBs are left partially
+ *	updated and should be reloaded from scratch.
+ */
+bool_t
+airac_delta_apply_db(const airac_delta_t *delta, waypoint_db_t *wptdb,
+    navaid_db_t *navdb, airway_db_t *awydb)
+{
+	for (int add = 0; add < 2; add++) {
+		for (const airac_delta_rec_t *rec = list_head(&delta->recs);
+		    rec != NULL; rec = list_next(&delta->recs, rec)) {
+			bool_t ok;
+
+			if (rec->add != (bool_t)add)
+				continue;
+			switch (rec->type) {
+			case AIRAC_DELTA_WPT:
+				ok = (add ? waypoint_db_add(wptdb, rec->text) :
+				    waypoint_db_remove(wptdb, rec->text));
+				break;
+			case AIRAC_DELTA_NAVAID:
+				ok = (add ? navaid_db_add(navdb, rec->text) :
+				    navaid_db_remove(navdb, rec->text));
+				break;
+			case AIRAC_DELTA_AWY:
+				ok = (add ? airway_db_add(awydb, rec->text) :
+				    airway_db_remove(awydb, rec->text));
+				break;
+			default:
+				ok = B_TRUE;
+				break;
+			}
+			if (!ok) {
+				openfmc_log(OPENFMC_LOG_ERR, "Error applying "
+				    "AIRAC delta: can't %s record \"%s\".",
+				    add ? "add" : "remove", rec->text);
+				return (B_FALSE);
+			}
+		}
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Writes out a file to a temporary name and renames it into place, so that
+ * readers of the directory never see a partially written file.
+ */
+static bool_t
+write_file_atomic(const char *filename, const char *text)
+{
+	char	*tmpname = malloc(strlen(filename) + strlen(".tmp") + 1);
+	FILE	*fp;
+	bool_t	ok;
+
+	sprintf(tmpname, "%s.tmp", filename);
+	fp = fopen(tmpname, "w");
+	if (fp == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't open %s for writing: %s",
+		    tmpname, strerror(errno));
+		free(tmpname);
+		return (B_FALSE);
+	}
+	ok = (fputs(text, fp) != EOF);
+	ok = (fclose(fp) == 0 && ok);
+	if (!ok || rename(tmpname, filename) != 0) {
+		openfmc_log(OPENFMC_LOG_ERR, "Error writing %s: %s",
+		    filename, strerror(errno));
+		(void) unlink(tmpname);
+		ok = B_FALSE;
+	}
+	free(tmpname);
+
+	return (ok);
+}
+
+/*
+ * Rewrites one of the record files of a navdata directory with the
+ * removals and additions of the delta applied.
+ */
+static bool_t
+apply_dir_recs(const airac_delta_t *delta, airac_delta_type_t type,
+    const char *navdata_dir)
+{
+	rec_set_t	set = { NULL, 0, 0 };
+	char		*fname, *text = NULL, *x_line = NULL;
+	size_t		text_len = 0;
+	bool_t		*removed = NULL, ok = B_FALSE;
+	const char	*sep = (delta_types[type].multiline ? "\n\n" : "\n");
+
+	fname = mkpath(navdata_dir, delta_types[type].filename);
+	if (!read_recs(fname, type, &set, &x_line))
+		goto out;
+	removed = calloc(sizeof (*removed), MAX(set.num, 1));
+
+	for (const airac_delta_rec_t *rec = list_head(&delta->recs);
+	    rec != NULL; rec = list_next(&delta->recs, rec)) {
+		char	**found;
+		size_t	i;
+
+		if (rec->type != type || rec->add)
+			continue;
+		found = bsearch(&rec->text, set.recs, set.num,
+		    sizeof (*set.recs), rec_cmp);
+		if (found == NULL) {
+			openfmc_log(OPENFMC_LOG_ERR, "Error applying AIRAC "
+			    "delta to %s: record \"%s\" not found.", fname,
+			    rec->text);
+			goto out;
+		}
+		/* with duplicates, pick the first one not yet removed */
+		for (i = found - set.recs; i > 0 &&
+		    strcmp(set.recs[i - 1], rec->text) == 0; i--)
+			;
+		while (i < set.num && removed[i] &&
+		    strcmp(set.recs[i], rec->text) == 0)
+			i++;
+		if (i == set.num || removed[i] ||
+		    strcmp(set.recs[i], rec->text) != 0) {
+			openfmc_log(OPENFMC_LOG_ERR, "Error applying AIRAC "
+			    "delta to %s: record \"%s\" removed twice.", fname,
+			    rec->text);
+			goto out;
+		}
+		removed[i] = B_TRUE;
+	}
+
+	if (type == AIRAC_DELTA_ARPT)
+		append_format(&text, &text_len, "%s\n\n", delta->x_line);
+	else if (x_line != NULL)
+		append_format(&text, &text_len, "%s\n\n", x_line);
+	for (size_t i = 0; i < set.num; i++) {
+		if (!removed[i])
+			append_format(&text, &text_len, "%s%s", set.recs[i],
+			    sep);
+	}
+	for (const airac_delta_rec_t *rec = list_head(&delta->recs);
+	    rec != NULL; rec = list_next(&delta->recs, rec)) {
+		if (rec->type == type && rec->add)
+			append_format(&text, &text_len, "%s%s", rec->text, sep);
+	}
+	ok = write_file_atomic(fname, text != NULL ? text : "");
+out:
+	rec_set_free(&set);
+	free(removed);
+	free(text);
+	free(x_line);
+	free(fname);
+
+	return (ok);
+}
+
+/*
+ * Applies a delta to a navdata directory on disk, turning it into the new
+ * cycle. Only the files which the delta touches are rewritten, each one
+ * being replaced atomically. However, the directory as a whole isn't
+ * updated atomically, so it shouldn't be in use while this runs.
+ *
+ * @return B_TRUE on success, B_FALSE on failure, in which case the
+ *	directory may be left partially updated.
+ */
+bool_t
+airac_delta_apply_dir(const airac_delta_t *delta, const char *navdata_dir)
+{
+	for (airac_delta_type_t type = 0; type < AIRAC_DELTA_PROC; type++) {
+		/* Airports.txt always changes, it holds the validity line */
+		if (type != AIRAC_DELTA_ARPT && delta->num_add[type] == 0 &&
+		    delta->num_rm[type] == 0)
+			continue;
+		if (!apply_dir_recs(delta, type, navdata_dir))
+			return (B_FALSE);
+	}
+
+	for (const airac_delta_rec_t *rec = list_head(&delta->recs);
+	    rec != NULL; rec = list_next(&delta->recs, rec)) {
+		char	fname[NAV_NAME_LEN + 16];
+		char	*path;
+		bool_t	ok = B_TRUE;
+
+		if (rec->type != AIRAC_DELTA_PROC)
+			continue;
+		snprintf(fname, sizeof (fname), "Proc" PATHSEP "%s.txt",
+		    rec->name);
+		path = mkpath(navdata_dir, fname);
+		if (rec->add) {
+			char	*text = NULL;
+			size_t	text_len = 0;
+
+			append_format(&text, &text_len, "%s\n", rec->text);
+			ok = write_file_atomic(path, text);
+			free(text);
+		} else if (unlink(path) != 0 && errno != ENOENT) {
+			openfmc_log(OPENFMC_LOG_ERR, "Can't remove %s: %s",
+			    path, strerror(errno));
+			ok = B_FALSE;
+		}
+		free(path);
+		if (!ok)
+			return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
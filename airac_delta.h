@@ -0,0 +1,81 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_OPENFMC_AIRAC_DELTA_H_
+#define	_OPENFMC_AIRAC_DELTA_H_
+
+#include "airac.h"
+#include "list.h"
+#include "types.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Kinds of records tracked by an AIRAC delta. The order of this enum must
+ * follow the record type table in airac_delta.c.
+ */
+typedef enum {
+	AIRAC_DELTA_WPT,	/* one Waypoints.txt line */
+	AIRAC_DELTA_NAVAID,	/* one Navaids.txt line */
+	AIRAC_DELTA_AWY,	/* ATS.txt 'A' line + its 'S' lines */
+	AIRAC_DELTA_ARPT,	/* Airports.txt 'A' line + its 'R' lines */
+	AIRAC_DELTA_PROC,	/* complete Proc/<ICAO>.txt file */
+	AIRAC_DELTA_NUM_TYPES
+} airac_delta_type_t;
+
+typedef struct {
+	airac_delta_type_t	type;
+	bool_t			add;	/* B_TRUE: add, B_FALSE: remove */
+	char			name[NAV_NAME_LEN];	/* PROC only: ICAO */
+	char			*text;	/* lines separated by '\n' */
+	list_node_t		node;
+} airac_delta_rec_t;
+
+typedef struct {
+	char		*x_line;	/* Airports.txt validity line, new DB */
+	list_t		recs;
+	unsigned	num_add[AIRAC_DELTA_NUM_TYPES];
+	unsigned	num_rm[AIRAC_DELTA_NUM_TYPES];
+} airac_delta_t;
+
+airac_delta_t *airac_delta_diff(const char *old_dir, const char *new_dir);
+void airac_delta_free(airac_delta_t *delta);
+
+airac_delta_t *airac_delta_read(const char *filename);
+bool_t airac_delta_write(const airac_delta_t *delta, const char *filename);
+char *airac_delta_dump(const airac_delta_t *delta);
+
+bool_t airac_delta_apply_db(const airac_delta_t *delta, waypoint_db_t *wptdb,
+    navaid_db_t *navdb, airway_db_t *awydb);
+bool_t airac_delta_apply_dir(const airac_delta_t *delta,
+    const char *navdata_dir);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _OPENFMC_AIRAC_DELTA_H_ */
@@ -0,0 +1,387 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "helpers.h"
+#include "vnav.h"
+#include "arrsel.h"
+
+/*
+ * Arrival procedure selection
+ *
+ * arrsel_rank flies every combination of arrival procedures on its own
+ * copy of the route. The candidates are all copies of one base route,
+ * which is the input route with its arrival procedures cleared, updated
+ * once up front. Candidates only append procedures to the base, so the
+ * route_update checkpoints they inherit (see route_copy) let each of
+ * them recompute just the procedures, not the whole route. Likewise, the
+ * candidates' VNAV profiles reuse the climb & descent simulated for the
+ * base (see vnav_profile_create_like).
+ *
+ * route_copy only reads the route it copies, so all worker threads take
+ * their candidates' copies from the one base, which is left alone until
+ * the workers are done.
+ */
+
+typedef struct {
+	const acft_perf_t *acft;
+	const flt_perf_t *flt;
+	const route_t	*base;
+	vnav_profile_t	*tmpl;		/* of the base, NULL if unflyable */
+	arrsel_cand_t	*cands;
+	size_t		num_cands;
+	size_t		cap;
+	size_t		next;		/* next candidate to evaluate */
+} arrsel_t;
+
+typedef struct {
+	arrsel_t	*sel;
+	pthread_t	thr;
+} arrsel_thr_t;
+
+static void
+arrsel_add(arrsel_t *sel, const navproc_t *appr, const navproc_t *apprtr,
+    const navproc_t *star, const navproc_t *startr)
+{
+	arrsel_cand_t *cand;
+
+	if (sel->num_cands == sel->cap) {
+		sel->cap = MAX(sel->cap * 2, 16);
+		sel->cands = realloc(sel->cands, sel->cap *
+		    sizeof (*sel->cands));
+	}
+	cand = &sel->cands[sel->num_cands++];
+	memset(cand, 0, sizeof (*cand));
+	cand->appr = appr;
+	cand->apprtr = apprtr;
+	cand->star = star;
+	cand->startr = startr;
+}
+
+/*
+ * Checks if `proc' is a STAR which can be flown to runway `rwy'.
+ */
+static bool_t
+arrsel_star_ok(const navproc_t *proc, const runway_t *rwy)
+{
+	return (proc->type == NAVPROC_TYPE_STAR_COMMON ||
+	    (proc->type == NAVPROC_TYPE_STAR && proc->rwy == rwy));
+}
+
+/*
+ * Checks if a procedure in front of `arpt->procs[i]' goes by the same
+ * name & transition, i.e. if setting it by name would select that one.
+ * `rwy' filters STARs like arrsel_star_ok.
+ */
+static bool_t
+arrsel_dup(const airport_t *arpt, unsigned i, const runway_t *rwy)
+{
+	const navproc_t *proc = &arpt->procs[i];
+
+	for (unsigned j = 0; j < i; j++) {
+		const navproc_t *prev = &arpt->procs[j];
+
+		if (strcmp(prev->name, proc->name) != 0 ||
+		    strcmp(prev->tr_name, proc->tr_name) != 0)
+			continue;
+		if (proc->type == NAVPROC_TYPE_STAR ||
+		    proc->type == NAVPROC_TYPE_STAR_COMMON) {
+			if (arrsel_star_ok(prev, rwy))
+				return (B_TRUE);
+		} else if (prev->type == proc->type) {
+			return (B_TRUE);
+		}
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Adds the combinations of approach `appr' & transition `apprtr' with
+ * each STAR to the approach's runway, and with none.
+ */
+static void
+arrsel_enum_stars(arrsel_t *sel, const airport_t *arpt,
+    const navproc_t *appr, const navproc_t *apprtr)
+{
+	arrsel_add(sel, appr, apprtr, NULL, NULL);
+	for (unsigned i = 0; i < arpt->num_procs; i++) {
+		const navproc_t *star = &arpt->procs[i];
+
+		if (!arrsel_star_ok(star, appr->rwy) ||
+		    arrsel_dup(arpt, i, appr->rwy))
+			continue;
+		arrsel_add(sel, appr, apprtr, star, NULL);
+		for (unsigned j = 0; j < arpt->num_procs; j++) {
+			const navproc_t *startr = &arpt->procs[j];
+
+			if (startr->type == NAVPROC_TYPE_STAR_TRANS &&
+			    strcmp(startr->name, star->name) == 0 &&
+			    !arrsel_dup(arpt, j, NULL))
+				arrsel_add(sel, appr, apprtr, star, startr);
+		}
+	}
+}
+
+/*
+ * Adds all the procedure combinations of `arpt' ending on runway
+ * `rwy_ID' (or on any runway if NULL).
+ */
+static void
+arrsel_enum(arrsel_t *sel, const airport_t *arpt, const char *rwy_ID)
+{
+	for (unsigned i = 0; i < arpt->num_procs; i++) {
+		const navproc_t *appr = &arpt->procs[i];
+
+		if (appr->type != NAVPROC_TYPE_FINAL ||
+		    (rwy_ID != NULL && strcmp(appr->rwy->ID, rwy_ID) != 0) ||
+		    arrsel_dup(arpt, i, NULL))
+			continue;
+		arrsel_enum_stars(sel, arpt, appr, NULL);
+		for (unsigned j = 0; j < arpt->num_procs; j++) {
+			const navproc_t *apprtr = &arpt->procs[j];
+
+			if (apprtr->type == NAVPROC_TYPE_FINAL_TRANS &&
+			    strcmp(apprtr->name, appr->name) == 0 &&
+			    !arrsel_dup(arpt, j, NULL))
+				arrsel_enum_stars(sel, arpt, appr, apprtr);
+		}
+	}
+}
+
+/*
+ * Sets the procedures of `cand' in `route'. The approach goes first, as
+ * it determines which STAR of a name is used.
+ */
+static err_t
+arrsel_set(route_t *route, const arrsel_cand_t *cand)
+{
+	err_t err;
+
+	if ((err = route_set_appr(route, cand->appr->name)) != ERR_OK)
+		return (err);
+	if (cand->apprtr != NULL && (err = route_set_apprtr(route,
+	    cand->apprtr->tr_name)) != ERR_OK)
+		return (err);
+	if (cand->star != NULL && (err = route_set_star(route,
+	    cand->star->name)) != ERR_OK)
+		return (err);
+	if (cand->startr != NULL && (err = route_set_startr(route,
+	    cand->startr->tr_name)) != ERR_OK)
+		return (err);
+	return (ERR_OK);
+}
+
+static void
+arrsel_eval(arrsel_t *sel, arrsel_cand_t *cand)
+{
+	const list_t	*legs;
+	vnav_profile_t	*prof;
+	err_t		err;
+
+	cand->route = route_copy(sel->base);
+	cand->fuel = NAN;
+	/* the candidates already run one route per thread */
+	route_set_update_threads(cand->route, 1);
+	if (arrsel_set(cand->route, cand) != ERR_OK) {
+		/* not a valid combination after all */
+		route_destroy(cand->route);
+		cand->route = NULL;
+		return;
+	}
+	cand->err = route_update(cand->route, sel->acft, sel->flt,
+	    &cand->err_rl);
+	if (cand->err != ERR_OK)
+		return;
+
+	legs = route_get_legs(cand->route);
+	for (const route_leg_t *rl = list_head(legs); rl != NULL;
+	    rl = list_next(legs, rl)) {
+		if (rl->disco)
+			cand->num_disco++;
+	}
+	cand->dist = route_get_dist(cand->route);
+
+	if (sel->tmpl != NULL)
+		prof = vnav_profile_create_like(sel->tmpl, cand->route, &err);
+	else
+		prof = vnav_profile_create(cand->route, sel->acft, sel->flt,
+		    &err);
+	if (prof == NULL)
+		return;
+	/* the last leg ending on the path */
+	for (unsigned i = prof->num_legs; i > 0; i--) {
+		if (!isnan(prof->legs[i - 1].fuel)) {
+			cand->fuel = prof->legs[i - 1].fuel;
+			break;
+		}
+	}
+	vnav_profile_destroy(prof);
+}
+
+static void *
+arrsel_worker(void *arg)
+{
+	arrsel_thr_t	*thr = arg;
+	arrsel_t	*sel = thr->sel;
+
+	for (;;) {
+		size_t i = __atomic_fetch_add(&sel->next, 1,
+		    __ATOMIC_RELAXED);
+
+		if (i >= sel->num_cands)
+			break;
+		arrsel_eval(sel, &sel->cands[i]);
+	}
+
+	return (NULL);
+}
+
+static int
+arrsel_cmp(const void *a, const void *b)
+{
+	const arrsel_cand_t *ca = a, *cb = b;
+
+	if (ca->err != ERR_OK || cb->err != ERR_OK) {
+		if (ca->err == ERR_OK)
+			return (-1);
+		return (cb->err == ERR_OK ? 1 : 0);
+	}
+	if (ca->num_disco != cb->num_disco)
+		return (ca->num_disco < cb->num_disco ? -1 : 1);
+	if (ca->cost != cb->cost)
+		return (ca->cost < cb->cost ? -1 : 1);
+	if (ca->dist != cb->dist)
+		return (ca->dist < cb->dist ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Ranks every combination of arrival procedures at the arrival airport
+ * of `route' which ends on runway `rwy_ID' (NULL for all runways). The
+ * combinations are each approach, with or without each of its
+ * transitions, preceded by no STAR or by each STAR to the approach's
+ * runway, the latter with or without each of its transitions. Any
+ * arrival procedures already in `route' are replaced, `route' itself is
+ * only read to take a copy of it before any worker threads are started
+ * (see route_copy).
+ *
+ * Each combination is set up in a copy of `route' and route_update'd
+ * with `acft' & `flt', on a pool of `num_threads' threads (0 means one
+ * per online CPU, the calling thread is one of them). The candidates are
+ * returned best first:
+ *
+ * 1) those which route_update'd without error
+ * 2) those with the fewest discontinuities, i.e. which join the rest of
+ *	the route the best
+ * 3) those with the lowest `cost', which is the fuel burned in kg if
+ *	VNAV predictions (see vnav_profile_create) are available for all
+ *	candidates, otherwise the route's distance in meters.
+ *
+ * The candidates (and their routes) must be freed with arrsel_free.
+ *
+ * @return The candidates, with their number in `num_cands', or NULL if
+ *	the route has no arrival airport or it has no approaches to the
+ *	runway.
+ */
+arrsel_cand_t *
+arrsel_rank(const route_t *route, const char *rwy_ID,
+    const acft_perf_t *acft, const flt_perf_t *flt, unsigned num_threads,
+    size_t *num_cands)
+{
+	arrsel_t	sel = { .acft = acft, .flt = flt };
+	arrsel_thr_t	*thr;
+	route_t		*base = route_copy(route);
+	route_leg_t	*err_rl;
+	err_t		err;
+	size_t		n;
+	bool_t		by_fuel = B_TRUE;
+	double		fuel = (flt->fuel != 0 ? flt->fuel :
+	    acft->max_gw - flt->zfw);
+
+	*num_cands = 0;
+	if (route_get_arr_arpt(base) != NULL)
+		arrsel_enum(&sel, route_get_arr_arpt(base), rwy_ID);
+	if (sel.num_cands == 0) {
+		route_destroy(base);
+		return (NULL);
+	}
+
+	VERIFY(route_set_star(base, NULL) == ERR_OK);
+	VERIFY(route_set_appr(base, NULL) == ERR_OK);
+	/* errors are the candidates' to report */
+	(void) route_update(base, acft, flt, &err_rl);
+	sel.tmpl = vnav_profile_create(base, acft, flt, &err);
+	sel.base = base;
+
+	if (num_threads == 0)
+		num_threads = route_num_cpus();
+	num_threads = MAX(MIN(num_threads, sel.num_cands), 1);
+	thr = calloc(sizeof (*thr), num_threads);
+	for (unsigned i = 0; i < num_threads; i++)
+		thr[i].sel = &sel;
+	for (unsigned i = 1; i < num_threads; i++) {
+		VERIFY(pthread_create(&thr[i].thr, NULL, arrsel_worker,
+		    &thr[i]) == 0);
+	}
+	(void) arrsel_worker(&thr[0]);
+	for (unsigned i = 1; i < num_threads; i++)
+		VERIFY(pthread_join(thr[i].thr, NULL) == 0);
+	route_destroy(base);
+	free(thr);
+	if (sel.tmpl != NULL)
+		vnav_profile_destroy(sel.tmpl);
+
+	/* drop the combinations the route didn't accept */
+	n = 0;
+	for (size_t i = 0; i < sel.num_cands; i++) {
+		if (sel.cands[i].route == NULL)
+			continue;
+		sel.cands[n++] = sel.cands[i];
+		if (sel.cands[i].err == ERR_OK && isnan(sel.cands[i].fuel))
+			by_fuel = B_FALSE;
+	}
+	for (size_t i = 0; i < n; i++) {
+		arrsel_cand_t *cand = &sel.cands[i];
+
+		cand->cost = (by_fuel ? fuel - cand->fuel : cand->dist);
+	}
+	qsort(sel.cands, n, sizeof (*sel.cands), arrsel_cmp);
+
+	*num_cands = n;
+	return (sel.cands);
+}
+
+void
+arrsel_free(arrsel_cand_t *cands, size_t num_cands)
+{
+	for (size_t i = 0; i < num_cands; i++)
+		route_destroy(cands[i].route);
+	free(cands);
+}
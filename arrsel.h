@@ -0,0 +1,71 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+
+#ifndef	_OPENFMC_ARRSEL_H_
+#define	_OPENFMC_ARRSEL_H_
+
+#include <stddef.h>
+
+#include "airac.h"
+#include "err.h"
+#include "perf.h"
+#include "route.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * One combination of arrival procedures, flown on its own copy of the
+ * route. `star' is the STAR or STAR_COMMON procedure going by the STAR's
+ * name. The transitions and the STAR may be NULL when the combination
+ * doesn't use them.
+ */
+typedef struct {
+	const navproc_t	*appr;
+	const navproc_t	*apprtr;
+	const navproc_t	*star;
+	const navproc_t	*startr;
+
+	route_t		*route;		/* updated copy, owned by the caller */
+	err_t		err;		/* of route_update */
+	route_leg_t	*err_rl;	/* see route_update */
+	unsigned	num_disco;	/* discontinuities left in the route */
+	double		dist;		/* route_get_dist, meters */
+	double		fuel;		/* kg remaining at the end, or NAN */
+	double		cost;		/* ranking key, see arrsel_rank */
+} arrsel_cand_t;
+
+arrsel_cand_t *arrsel_rank(const route_t *route, const char *rwy_ID,
+    const acft_perf_t *acft, const flt_perf_t *flt, unsigned num_threads,
+    size_t *num_cands);
+void arrsel_free(arrsel_cand_t *cands, size_t num_cands);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _OPENFMC_ARRSEL_H_ */
@@ -44,7 +44,8 @@ static const char *err_name_tbl[NUM_ERRS] = {
 	"INVALID FINAL",
 	"INVALID TRANS",
 	"NOT IN DATABASE",
-	"UNABLE NEXT ALT"
+	"UNABLE NEXT ALT",
+	"INVALID ROUTE DATA"
 };
 
 const char *
@@ -44,6 +44,7 @@ typedef enum {
 	ERR_INVALID_TRANS,
 	ERR_NOT_IN_DATABASE,
 	ERR_UNABLE_NEXT_ALT,
+	ERR_INVALID_ROUTE_DATA,
 	NUM_ERRS
 } err_t;
 
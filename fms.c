@@ -24,13 +24,17 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 #include <xlocale.h>
 #include <time.h>
 #include <errno.h>
-#include <regex.h>
+#include <unistd.h>
+#include <pthread.h>
 
+#include "helpers.h"
 #include "log.h"
 #include "fms.h"
 
@@ -146,123 +150,44 @@ errout:
 }
 
 /*
- * Allocates the internal regex structures of fms_t.
- */
-static bool_t
-fms_alloc_regex(fms_t *fms)
-{
-	int err;
-
-#define	COMPILE_REGEX(preg, pattern) \
-	do { \
-		ASSERT((preg) == NULL); \
-		(preg) = malloc(sizeof (regex_t)); \
-		VERIFY((preg) != NULL); \
-		if ((err = regcomp((preg), (pattern), REG_EXTENDED)) != 0) { \
-			openfmc_log(OPENFMC_LOG_ERR, "Error compiling regex " \
-			    "\"%s\": compile error %d", (pattern), err); \
-			free((preg)); \
-			return (B_FALSE); \
-		} \
-	} while (0)
-
-	/* "DOT", "ALPHA"; 1 match (wptname) */
-	COMPILE_REGEX(fms->regex.wptname, "^([A-Z0-9]{1,5})$");
-	/* "KJFK", "KMIA"; 1 match (arpticao) */
-	COMPILE_REGEX(fms->regex.arpticao, "^([A-Z]{4})$");
-	/* 5010N, 50N10; 2 matches (lat, lon) */
-	COMPILE_REGEX(fms->regex.geo_nw_blw100, "^([0-9]{2})([0-9]{2})N$");
-	COMPILE_REGEX(fms->regex.geo_nw_abv100, "^([0-9]{2})N([0-9]{2})$");
-	/* 5010E, 50E10; 2 matches (lat, lon) */
-	COMPILE_REGEX(fms->regex.geo_ne_blw100, "^([0-9]{2})([0-9]{2})E$");
-	COMPILE_REGEX(fms->regex.geo_ne_abv100, "^([0-9]{2})E([0-9]{2})$");
-	/* 5010W, 50W10; 2 matches (lat, lon) */
-	COMPILE_REGEX(fms->regex.geo_sw_blw100, "^([0-9]{2})([0-9]{2})W$");
-	COMPILE_REGEX(fms->regex.geo_sw_abv100, "^([0-9]{2})W([0-9]{2})$");
-	/* 5010S, 50S10; 2 matches (lat, lon) */
-	COMPILE_REGEX(fms->regex.geo_se_blw100, "^([0-9]{2})([0-9]{2})S$");
-	COMPILE_REGEX(fms->regex.geo_se_abv100, "^([0-9]{2})S([0-9]{2})$");
-	/* N47W008; 4 matches ('N|S', lat, 'W|E', lon) */
-	COMPILE_REGEX(fms->regex.geo_long,
-	    "^([NS])([0-9]{2,2})([WE])([0-9]{3,3})$");
-	/* N4715.4W00803.4; 6 matches ('N|S', lat, min.0, 'W|E', lon, min.0) */
-	COMPILE_REGEX(fms->regex.geo_detailed,
-	    "^([NS])([0-9]{2})([0-9]{2}\\.[0-9])([WE])([0-9]{3})"
-	    "([0-9]{2}\\.[0-9])$");
-	/* W060-10; 3 matches ('N|S|W|E', lat/lon, lat/lon-increment) */
-	COMPILE_REGEX(fms->regex.geo_report,
-	    "^([NSEW])([0-9]{2,3})-([0-9]{1,2})$");
-	/* SEA330/10; 3 matches (wptname, radial, DME) */
-	COMPILE_REGEX(fms->regex.radial_dme,
-	    "^([A-Z]{1,5})([0-9]{3})/([0-9]{1,3})$");
-	/* SEA330/OLM020; 4 matches (wptname1, radial1, wptname2, radial2) */
-	COMPILE_REGEX(fms->regex.radial_isect,
-	    "^([A-Z]{1,5})([0-9]{3})/([A-Z]{1,5})([0-9]{3})$");
-	/* VAMPS/25, ELN/-30; 2 matches (wptname, [-]DME) */
-	COMPILE_REGEX(fms->regex.along_trk, "^([A-Z]{1,5})/([-]?[0-9]{1,3})$");
-
-#undef	COMPILE_REGEX
-
-	return (B_TRUE);
-}
-
-/*
- * Frees the internal regex structures of fms_t.
+ * Constructs a new FMS object with its own private navigational database.
+ *
+ * @param navdata_dir Directory holding to the navigational database.
+ * @param wmm_file Path to the World Magnetic Model file.
+ * @param acft_perf_file Path to the aircraft performance file.
  */
-static void
-fms_free_regex(fms_t *fms)
+fms_t *
+fms_new(const char *navdata_dir, const char *wmm_file,
+    const char *acft_perf_file)
 {
-#define	DESTROY_REGEX(preg) \
-	do { \
-		if ((preg) != NULL) { \
-			regfree((preg)); \
-			free((preg)); \
-			(preg) = NULL; \
-		} \
-	} while (0)
-
-	DESTROY_REGEX(fms->regex.wptname);
-	DESTROY_REGEX(fms->regex.arpticao);
-
-	DESTROY_REGEX(fms->regex.geo_nw_blw100);
-	DESTROY_REGEX(fms->regex.geo_nw_abv100);
-	DESTROY_REGEX(fms->regex.geo_ne_blw100);
-	DESTROY_REGEX(fms->regex.geo_ne_abv100);
-	DESTROY_REGEX(fms->regex.geo_sw_blw100);
-	DESTROY_REGEX(fms->regex.geo_sw_abv100);
-	DESTROY_REGEX(fms->regex.geo_se_blw100);
-	DESTROY_REGEX(fms->regex.geo_se_abv100);
-
-	DESTROY_REGEX(fms->regex.geo_long);
-	DESTROY_REGEX(fms->regex.geo_detailed);
-	DESTROY_REGEX(fms->regex.geo_report);
-
-	DESTROY_REGEX(fms->regex.radial_dme);
-	DESTROY_REGEX(fms->regex.radial_isect);
+	fms_navdb_t *navdb;
+	fms_t *fms;
 
-	DESTROY_REGEX(fms->regex.along_trk);
+	navdb = fms_navdb_open(navdata_dir, wmm_file);
+	if (navdb == NULL)
+		return (NULL);
+	fms = fms_new_navdb(navdb, acft_perf_file);
+	fms_navdb_close(navdb);
 
-#undef	DESTROY_REGEX
+	return (fms);
 }
 
 /*
- * Constructs a new FMS object.
+ * Constructs a new FMS object using an existing navigational database.
+ * The FMS takes its own reference on the navdb (see fms_navdb_hold), so
+ * the caller may drop its reference as soon as this returns. Any number
+ * of FMS instances, running in any number of threads, can share a single
+ * navdb this way.
  *
- * @param navdata_dir Directory holding to the navigational database.
- * @param wmm_file Path to the World Magnetic Model file.
+ * @param navdb Navigational database to use.
  * @param acft_perf_file Path to the aircraft performance file.
  */
 fms_t *
-fms_new(const char *navdata_dir, const char *wmm_file,
-    const char *acft_perf_file)
+fms_new_navdb(fms_navdb_t *navdb, const char *acft_perf_file)
 {
 	fms_t *fms = calloc(sizeof (*fms), 1);
 
-	fms->navdb = fms_navdb_open(navdata_dir, wmm_file);
-	if (!fms->navdb)
-		goto errout;
-	if (!fms_alloc_regex(fms))
-		goto errout;
+	fms->navdb = fms_navdb_hold(navdb);
 	if (!(fms->acft = acft_perf_parse(acft_perf_file)))
 		goto errout;
 	fms->flt = flt_perf_new(fms->acft);
@@ -274,14 +199,14 @@ errout:
 }
 
 /*
- * Destroys an fms_t object and frees all associated resources.
+ * Destroys an fms_t object and frees all associated resources. The
+ * navigational database is only freed if this was its last user.
  */
 void
 fms_destroy(fms_t *fms)
 {
 	if (fms->navdb)
 		fms_navdb_close(fms->navdb);
-	fms_free_regex(fms);
 	if (fms->acft)
 		acft_perf_destroy(fms->acft);
 	if (fms->flt)
@@ -289,10 +214,63 @@ fms_destroy(fms_t *fms)
 	free(fms);
 }
 
+static int
+arpt_idx_ent_compar(const void *a, const void *b)
+{
+	const arpt_idx_ent_t *ea = a, *eb = b;
+	return (strcmp(ea->icao, eb->icao));
+}
+
+/*
+ * (Re)loads the navdb's airport index, sorted by ICAO code, so that
+ * airport positions can be looked up without opening Airports.txt.
+ */
+static bool_t
+navdb_arpt_idx_load(fms_navdb_t *navdb, const char *navdata_dir)
+{
+	size_t		num_arpts;
+	arpt_idx_ent_t	*idx = airport_index(navdata_dir, &num_arpts);
+
+	if (idx == NULL)
+		return (B_FALSE);
+	qsort(idx, num_arpts, sizeof (*idx), arpt_idx_ent_compar);
+	free(navdb->arpt_idx);
+	navdb->arpt_idx = idx;
+	navdb->num_arpts = num_arpts;
+	return (B_TRUE);
+}
+
+/*
+ * Looks up an airport in the navdb's airport index. Pass the entry's
+ * offset to airport_open_at to open the airport without scanning
+ * Airports.txt.
+ *
+ * @return The index entry or NULL if the airport doesn't exist.
+ */
+const arpt_idx_ent_t *
+fms_navdb_arpt_lookup(const fms_navdb_t *navdb, const char *icao)
+{
+	arpt_idx_ent_t key;
+
+	if (strlen(icao) != ICAO_NAME_LEN)
+		return (NULL);
+	strcpy(key.icao, icao);
+	return (bsearch(&key, navdb->arpt_idx, navdb->num_arpts,
+	    sizeof (key), arpt_idx_ent_compar));
+}
+
 /*
  * Opens and constructs a navigational database + the world magnetic model.
  * Argument should be self-explanatory.
  *
+ * Once opened, the navdb is immutable (with the exception of
+ * fms_navdb_apply_delta) and all of its lookup paths (waypoint, navaid and
+ * airway lookups, airport_open and the magnetic model) only read from it,
+ * so it can be used concurrently from any number of threads without
+ * locking. Its lifetime is controlled by a reference count: the returned
+ * navdb holds one reference, further ones can be taken using
+ * fms_navdb_hold and each is dropped by fms_navdb_close.
+ *
  * @return The database on success, NULL on failure.
  */
 fms_navdb_t *
@@ -305,6 +283,8 @@ fms_navdb_open(const char *navdata_dir, const char *wmm_file)
 	localtime_r(&t, &now);
 
 	navdb = calloc(sizeof (*navdb), 1);
+	navdb->refcnt = 1;
+	navdb->serial = serial_next();
 	if (!navdata_get_valid(navdata_dir, &navdb->airac_cycle,
 	    &navdb->valid_from, &navdb->valid_to))
 		goto errout;
@@ -320,6 +300,8 @@ fms_navdb_open(const char *navdata_dir, const char *wmm_file)
 	    htbl_count(&navdb->wptdb->by_name));
 	if (navdb->awydb == NULL)
 		goto errout;
+	if (!navdb_arpt_idx_load(navdb, navdata_dir))
+		goto errout;
 
 	navdb->wmm = wmm_open(wmm_file, 1900.0 + now.tm_year +
 	    (now.tm_yday / 365.0));
@@ -333,12 +315,31 @@ errout:
 }
 
 /*
- * Closes a navigational database opened with navdb_open and frees
- * all of its resources.
+ * Takes an additional reference on a navigational database.
+ *
+ * @return The navdb passed in, for convenience.
+ */
+fms_navdb_t *
+fms_navdb_hold(fms_navdb_t *navdb)
+{
+	VERIFY(__atomic_add_fetch(&navdb->refcnt, 1, __ATOMIC_RELAXED) > 1);
+	return (navdb);
+}
+
+/*
+ * Drops a reference on a navigational database opened with
+ * fms_navdb_open. When the last reference is dropped, the database is
+ * closed and all of its resources are freed.
  */
 void
 fms_navdb_close(fms_navdb_t *navdb)
 {
+	unsigned refcnt = __atomic_sub_fetch(&navdb->refcnt, 1,
+	    __ATOMIC_ACQ_REL);
+
+	ASSERT(refcnt != UINT_MAX);
+	if (refcnt != 0)
+		return;
 	free(navdb->navdata_dir);
 	if (navdb->awydb != NULL)
 		airway_db_close(navdb->awydb);
@@ -346,12 +347,56 @@ fms_navdb_close(fms_navdb_t *navdb)
 		waypoint_db_close(navdb->wptdb);
 	if (navdb->navaiddb != NULL)
 		navaid_db_close(navdb->navaiddb);
+	free(navdb->arpt_idx);
 	free(navdb->wmm_file);
 	if (navdb->wmm)
 		wmm_close(navdb->wmm);
 	free(navdb);
 }
 
+/*
+ * Brings an open navigational database up to the next AIRAC cycle by
+ * applying a delta (see airac_delta.c) instead of reloading it from
+ * scratch. `navdata_dir' must be the directory holding the new cycle (e.g.
+ * the old directory after airac_delta_apply_dir), since airports and
+ * procedures are always read from disk on demand. The navdb must not be
+ * shared (i.e. its reference count must be 1) or in use by anybody else
+ * while this runs - for live databases, open a new
+ * navdb and hot-swap it in using fms_navdb_hnd_swap instead.
+ *
+ * @return B_TRUE on success. On failure, the navdb is left in an
+ *	inconsistent state and must be closed.
+ */
+bool_t
+fms_navdb_apply_delta(fms_navdb_t *navdb, const airac_delta_t *delta,
+    const char *navdata_dir)
+{
+	unsigned	cycle;
+	time_t		valid_from, valid_to;
+	char		*dir_copy;
+
+	ASSERT(navdb->refcnt == 1);
+	if (!navdata_get_valid(navdata_dir, &cycle, &valid_from, &valid_to))
+		return (B_FALSE);
+	if (!airac_delta_apply_db(delta, navdb->wptdb, navdb->navaiddb,
+	    navdb->awydb))
+		return (B_FALSE);
+	/* airport positions live in Airports.txt, so reload them */
+	if (!navdb_arpt_idx_load(navdb, navdata_dir))
+		return (B_FALSE);
+	dir_copy = strdup(navdata_dir);
+	if (dir_copy == NULL)
+		return (B_FALSE);
+	free(navdb->navdata_dir);
+	navdb->navdata_dir = dir_copy;
+	navdb->airac_cycle = cycle;
+	navdb->valid_from = valid_from;
+	navdb->valid_to = valid_to;
+	navdb->serial = serial_next();
+
+	return (B_TRUE);
+}
+
 /*
  * Checks if the navigational database is current (i.e. its validity
  * period falls within the current time).
@@ -379,6 +424,257 @@ navdata_is_current(const char *navdata_dir)
 	    from <= now && now <= to);
 }
 
+/*
+ * Hot-swappable navdb handles.
+ *
+ * A long-running process can't just close its fms_navdb_t and open the next
+ * AIRAC cycle, since other threads may be in the middle of a lookup. An
+ * fms_navdb_hnd_t holds the currently published navdb and lets readers pin
+ * it using epoch-based reclamation:
+ *
+ *	1) Each reader thread registers an fms_navdb_rdr_t with the handle.
+ *	   To access the navdb, it calls fms_navdb_rdr_enter, which copies
+ *	   the global epoch into the reader's slot and returns the published
+ *	   navdb. When done, fms_navdb_rdr_exit clears the slot. Neither of
+ *	   these takes any locks, they're just a few atomic loads & stores.
+ *	2) fms_navdb_hnd_swap loads the new cycle without holding any locks
+ *	   (this is the slow part, so it should be called from a background
+ *	   thread), atomically publishes it, advances the global epoch and
+ *	   retires the old navdb, tagging it with the new epoch.
+ *	3) A retired navdb is freed once no reader slot holds an epoch older
+ *	   than its retirement epoch. Any reader which entered after the
+ *	   epoch was advanced is guaranteed to see the new navdb.
+ *
+ * Read sections don't nest and the navdb pointer returned from
+ * fms_navdb_rdr_enter mustn't be used after fms_navdb_rdr_exit.
+ */
+
+#define	RDR_IDLE	0	/* reader isn't in a read section */
+#define	RECLAIM_WAIT_US	1000	/* retired navdb poll interval for swap */
+
+struct fms_navdb_rdr_s {
+	fms_navdb_hnd_t	*hnd;
+	uint64_t	epoch;
+	list_node_t	node;
+};
+
+typedef struct {
+	fms_navdb_t	*navdb;
+	uint64_t	epoch;
+	list_node_t	node;
+} retired_navdb_t;
+
+struct fms_navdb_hnd_s {
+	fms_navdb_t	*navdb;		/* currently published navdb */
+	uint64_t	epoch;		/* global epoch, never RDR_IDLE */
+	char		*wmm_file;
+
+	pthread_mutex_t	lock;		/* protects the fields below */
+	list_t		rdrs;
+	list_t		retired;
+};
+
+/*
+ * Opens a navdb (see fms_navdb_open) and wraps it in a new handle.
+ *
+ * @return The handle on success, NULL on failure.
+ */
+fms_navdb_hnd_t *
+fms_navdb_hnd_open(const char *navdata_dir, const char *wmm_file)
+{
+	fms_navdb_hnd_t *hnd;
+	fms_navdb_t *navdb;
+
+	navdb = fms_navdb_open(navdata_dir, wmm_file);
+	if (navdb == NULL)
+		return (NULL);
+
+	hnd = calloc(sizeof (*hnd), 1);
+	hnd->navdb = navdb;
+	hnd->epoch = RDR_IDLE + 1;
+	hnd->wmm_file = strdup(wmm_file);
+	VERIFY(pthread_mutex_init(&hnd->lock, NULL) == 0);
+	list_create(&hnd->rdrs, sizeof (fms_navdb_rdr_t),
+	    offsetof(fms_navdb_rdr_t, node));
+	list_create(&hnd->retired, sizeof (retired_navdb_t),
+	    offsetof(retired_navdb_t, node));
+
+	return (hnd);
+}
+
+/*
+ * Closes a navdb handle and frees the published navdb and any retired ones.
+ * All readers must have been unregistered before calling this.
+ */
+void
+fms_navdb_hnd_close(fms_navdb_hnd_t *hnd)
+{
+	retired_navdb_t *rn;
+
+	ASSERT(list_head(&hnd->rdrs) == NULL);
+	list_destroy(&hnd->rdrs);
+	while ((rn = list_remove_head(&hnd->retired)) != NULL) {
+		fms_navdb_close(rn->navdb);
+		free(rn);
+	}
+	list_destroy(&hnd->retired);
+	fms_navdb_close(hnd->navdb);
+	pthread_mutex_destroy(&hnd->lock);
+	free(hnd->wmm_file);
+	free(hnd);
+}
+
+/*
+ * Frees any retired navdbs which are no longer pinned by any reader.
+ *
+ * @return B_TRUE if no retired navdbs remain, B_FALSE otherwise.
+ */
+bool_t
+fms_navdb_hnd_reclaim(fms_navdb_hnd_t *hnd)
+{
+	uint64_t min_epoch = UINT64_MAX;
+	retired_navdb_t *rn, *rn_next;
+	bool_t empty;
+
+	pthread_mutex_lock(&hnd->lock);
+	for (fms_navdb_rdr_t *rdr = list_head(&hnd->rdrs); rdr != NULL;
+	    rdr = list_next(&hnd->rdrs, rdr)) {
+		uint64_t epoch = __atomic_load_n(&rdr->epoch,
+		    __ATOMIC_SEQ_CST);
+		if (epoch != RDR_IDLE)
+			min_epoch = MIN(min_epoch, epoch);
+	}
+	for (rn = list_head(&hnd->retired); rn != NULL; rn = rn_next) {
+		rn_next = list_next(&hnd->retired, rn);
+		if (rn->epoch <= min_epoch) {
+			list_remove(&hnd->retired, rn);
+			fms_navdb_close(rn->navdb);
+			free(rn);
+		}
+	}
+	empty = (list_head(&hnd->retired) == NULL);
+	pthread_mutex_unlock(&hnd->lock);
+
+	return (empty);
+}
+
+/*
+ * Loads a new navdb and atomically publishes it in place of the current one.
+ * Readers are never blocked by this. The navdb is loaded in the caller's
+ * thread, so for a changeover without lookup pauses, call this from a
+ * background thread.
+ *
+ * @param hnd The handle to update.
+ * @param navdata_dir Directory holding the new navigational database.
+ *	The WMM file from fms_navdb_hnd_open is reused.
+ * @param wait If B_TRUE, the function only returns once the previous navdb
+ *	has been freed, i.e. after the last reader using it left its read
+ *	section. The calling thread mustn't itself be in a read section.
+ *	If B_FALSE, the old navdb is freed by a later call to
+ *	fms_navdb_hnd_reclaim, fms_navdb_hnd_swap or fms_navdb_hnd_close.
+ *
+ * @return B_TRUE if the new navdb was published, B_FALSE if it failed to
+ *	load (in which case the current navdb remains in place).
+ */
+bool_t
+fms_navdb_hnd_swap(fms_navdb_hnd_t *hnd, const char *navdata_dir, bool_t wait)
+{
+	fms_navdb_t *navdb;
+	retired_navdb_t *rn;
+
+	navdb = fms_navdb_open(navdata_dir, hnd->wmm_file);
+	if (navdb == NULL)
+		return (B_FALSE);
+
+	rn = calloc(sizeof (*rn), 1);
+	pthread_mutex_lock(&hnd->lock);
+	rn->navdb = __atomic_exchange_n(&hnd->navdb, navdb, __ATOMIC_SEQ_CST);
+	rn->epoch = __atomic_add_fetch(&hnd->epoch, 1, __ATOMIC_SEQ_CST);
+	list_insert_tail(&hnd->retired, rn);
+	pthread_mutex_unlock(&hnd->lock);
+
+	while (!fms_navdb_hnd_reclaim(hnd) && wait)
+		usleep(RECLAIM_WAIT_US);
+
+	return (B_TRUE);
+}
+
+/*
+ * Registers a new reader with a navdb handle. Each thread accessing the
+ * navdb needs its own reader.
+ */
+fms_navdb_rdr_t *
+fms_navdb_rdr_register(fms_navdb_hnd_t *hnd)
+{
+	fms_navdb_rdr_t *rdr = calloc(sizeof (*rdr), 1);
+
+	rdr->hnd = hnd;
+	rdr->epoch = RDR_IDLE;
+	pthread_mutex_lock(&hnd->lock);
+	list_insert_tail(&hnd->rdrs, rdr);
+	pthread_mutex_unlock(&hnd->lock);
+
+	return (rdr);
+}
+
+/*
+ * Unregisters and frees a reader. The reader mustn't be in a read section.
+ */
+void
+fms_navdb_rdr_unregister(fms_navdb_rdr_t *rdr)
+{
+	fms_navdb_hnd_t *hnd = rdr->hnd;
+
+	ASSERT(rdr->epoch == RDR_IDLE);
+	pthread_mutex_lock(&hnd->lock);
+	list_remove(&hnd->rdrs, rdr);
+	pthread_mutex_unlock(&hnd->lock);
+	free(rdr);
+}
+
+/*
+ * Enters a read section and returns the currently published navdb. The
+ * navdb is guaranteed to stay valid until fms_navdb_rdr_exit is called.
+ */
+const fms_navdb_t *
+fms_navdb_rdr_enter(fms_navdb_rdr_t *rdr)
+{
+	fms_navdb_hnd_t *hnd = rdr->hnd;
+
+	ASSERT(rdr->epoch == RDR_IDLE);
+	/*
+	 * The epoch must be visible in our slot before we load the navdb
+	 * pointer. If a swapper misses our slot, it must have advanced the
+	 * epoch (and thus published the new navdb) before we stored to it.
+	 */
+	__atomic_store_n(&rdr->epoch, __atomic_load_n(&hnd->epoch,
+	    __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+	return (__atomic_load_n(&hnd->navdb, __ATOMIC_SEQ_CST));
+}
+
+/*
+ * Leaves a read section entered with fms_navdb_rdr_enter.
+ */
+void
+fms_navdb_rdr_exit(fms_navdb_rdr_t *rdr)
+{
+	ASSERT(rdr->epoch != RDR_IDLE);
+	__atomic_store_n(&rdr->epoch, RDR_IDLE, __ATOMIC_RELEASE);
+}
+
+/*
+ * Checks if a name has the form of an airport ICAO code (4 letters).
+ */
+static bool_t
+is_arpt_icao(const char *name)
+{
+	for (int i = 0; i < 4; i++) {
+		if (name[i] < 'A' || name[i] > 'Z')
+			return (B_FALSE);
+	}
+	return (name[4] == 0);
+}
+
 /*
  * Looks up a wpt by name in the FMS nav database. The databases we search are:
  *	1. The waypoint (FIX) database.
@@ -402,7 +698,6 @@ fms_lookup_wpt_by_name(const char *wptname, const fms_t *fms, size_t *num_wpts)
 	wpt_t *wpts = NULL;
 	size_t i = 0, n = 0;
 	const list_t *list;
-	regmatch_t pmatch[2];
 
 	memset(name, 0, sizeof (name));
 	strlcpy(name, wptname, sizeof (name));
@@ -436,15 +731,15 @@ fms_lookup_wpt_by_name(const char *wptname, const fms_t *fms, size_t *num_wpts)
 		}
 	}
 	/* Try matching an airport name. */
-	if (regexec(fms->regex.arpticao, name, 2, pmatch, 0) == 0) {
-		airport_t *arpt = airport_open(wptname, fms->navdb->navdata_dir,
-		    fms->navdb->wptdb, fms->navdb->navaiddb);
-		if (arpt != NULL) {
+	if (is_arpt_icao(name)) {
+		const arpt_idx_ent_t *ent = fms_navdb_arpt_lookup(fms->navdb,
+		    name);
+		if (ent != NULL && !IS_NULL_GEO_POS(ent->refpt)) {
 			n++;
 			wpts = realloc(wpts, n * sizeof (*wpts));
+			memset(&wpts[i], 0, sizeof (*wpts));
 			memcpy(wpts[i].name, name, sizeof (name));
-			wpts[i].pos = GEO3_TO_GEO2(arpt->refpt);
-			airport_close(arpt);
+			wpts[i].pos = ent->refpt;
 			i++;
 		}
 	}
@@ -455,6 +750,178 @@ fms_lookup_wpt_by_name(const char *wptname, const fms_t *fms, size_t *num_wpts)
 	return (wpts);
 }
 
+/*
+ * Bounded heap holding the best `k' candidates seen so far by
+ * fms_lookup_wpt_nearest. Candidates are ranked by the dot product of
+ * their position vector with the reference position vector, which grows
+ * as the great circle distance between them shrinks. The heap is a
+ * min-heap on that, so the root is the farthest candidate kept, i.e. the
+ * one to evict when a closer one comes along.
+ */
+typedef struct {
+	wpt_t		*wpts;
+	double		dots[FMS_WPT_NEAREST_MAX];
+	size_t		n;
+	size_t		k;
+	vect3_t		ref_v;
+} wpt_heap_t;
+
+static void
+wpt_heap_swap(wpt_heap_t *h, size_t a, size_t b)
+{
+	wpt_t	wpt = h->wpts[a];
+	double	dot = h->dots[a];
+
+	h->wpts[a] = h->wpts[b];
+	h->dots[a] = h->dots[b];
+	h->wpts[b] = wpt;
+	h->dots[b] = dot;
+}
+
+static void
+wpt_heap_sift_down(wpt_heap_t *h, size_t i, size_t n)
+{
+	for (;;) {
+		size_t l = 2 * i + 1, r = l + 1, min = i;
+
+		if (l < n && h->dots[l] < h->dots[min])
+			min = l;
+		if (r < n && h->dots[r] < h->dots[min])
+			min = r;
+		if (min == i)
+			return;
+		wpt_heap_swap(h, i, min);
+		i = min;
+	}
+}
+
+/*
+ * Offers a candidate at `pos_v' to the heap. If it makes the cut, returns
+ * the slot which the caller must fill in with the candidate's wpt_t and
+ * then pass to wpt_heap_commit. Otherwise returns NULL.
+ */
+static wpt_t *
+wpt_heap_offer(wpt_heap_t *h, vect3_t pos_v, double *dotp)
+{
+	double dot = (IS_NULL_VECT(pos_v) ? -INFINITY :
+	    vect3_dotprod(h->ref_v, pos_v));
+
+	if (h->n == h->k && dot <= h->dots[0])
+		return (NULL);
+	*dotp = dot;
+	return (h->n < h->k ? &h->wpts[h->n] : &h->wpts[0]);
+}
+
+static void
+wpt_heap_commit(wpt_heap_t *h, double dot)
+{
+	if (h->n < h->k) {
+		/* sift up the new tail */
+		size_t i = h->n++;
+
+		h->dots[i] = dot;
+		while (i > 0 && h->dots[(i - 1) / 2] > h->dots[i]) {
+			wpt_heap_swap(h, i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+	} else {
+		/* replaced the root */
+		h->dots[0] = dot;
+		wpt_heap_sift_down(h, 0, h->n);
+	}
+}
+
+/*
+ * Looks up the `k' wpts named `wptname' closest to `ref'. This searches
+ * the same databases as fms_lookup_wpt_by_name, but it uses precomputed
+ * position vectors and a bounded heap, so it never allocates memory or
+ * touches the disk and only ever copies out the results it returns. This
+ * makes it suitable for disambiguating CDU entries of idents with many
+ * duplicates.
+ *
+ * @param wptname Name of wpt to look for.
+ * @param fms FMS object containing our navigational databases.
+ * @param ref Reference position. Pass NULL_GEO_POS2 to get an arbitrary
+ *	selection of up to `k' matching wpts.
+ * @param k Maximum number of results, at most FMS_WPT_NEAREST_MAX.
+ * @param wpts Array of at least `k' elements which will be filled with
+ *	the results, closest first.
+ *
+ * @return The number of results placed in `wpts'.
+ */
+size_t
+fms_lookup_wpt_nearest(const char *wptname, const fms_t *fms, geo_pos2_t ref,
+    size_t k, wpt_t *wpts)
+{
+	char		name[NAV_NAME_LEN];
+	const list_t	*list;
+	wpt_heap_t	h;
+	wpt_t		*slot;
+	double		dot;
+
+	ASSERT(k <= FMS_WPT_NEAREST_MAX);
+	if (k == 0)
+		return (0);
+	memset(name, 0, sizeof (name));
+	strlcpy(name, wptname, sizeof (name));
+	h.wpts = wpts;
+	h.n = 0;
+	h.k = k;
+	h.ref_v = (IS_NULL_GEO_POS(ref) ? ZERO_VECT3 :
+	    sph2ecef(GEO2_TO_GEO3(ref, 0)));
+
+	list = htbl_lookup_multi(&fms->navdb->wptdb->by_name, name);
+	if (list != NULL) {
+		for (const void *mv = list_head(list); mv != NULL;
+		    mv = list_next(list, mv)) {
+			const wpt_ent_t *ent = HTBL_VALUE_MULTI(mv);
+
+			slot = wpt_heap_offer(&h, ent->pos_v, &dot);
+			if (slot == NULL)
+				continue;
+			*slot = ent->wpt;
+			wpt_heap_commit(&h, dot);
+		}
+	}
+	list = htbl_lookup_multi(&fms->navdb->navaiddb->by_id, name);
+	if (list != NULL) {
+		for (const void *mv = list_head(list); mv != NULL;
+		    mv = list_next(list, mv)) {
+			const navaid_t *navaid = HTBL_VALUE_MULTI(mv);
+
+			slot = wpt_heap_offer(&h, navaid->pos_v, &dot);
+			if (slot == NULL)
+				continue;
+			memcpy(slot->name, name, sizeof (name));
+			memcpy(slot->icao_country_code,
+			    navaid->icao_country_code,
+			    sizeof (navaid->icao_country_code));
+			slot->pos = GEO3_TO_GEO2(navaid->pos);
+			wpt_heap_commit(&h, dot);
+		}
+	}
+	if (is_arpt_icao(name)) {
+		const arpt_idx_ent_t *ent = fms_navdb_arpt_lookup(fms->navdb,
+		    name);
+
+		if (ent != NULL && !IS_NULL_GEO_POS(ent->refpt) &&
+		    (slot = wpt_heap_offer(&h, ent->pos_v, &dot)) != NULL) {
+			memset(slot, 0, sizeof (*slot));
+			memcpy(slot->name, name, sizeof (name));
+			slot->pos = ent->refpt;
+			wpt_heap_commit(&h, dot);
+		}
+	}
+
+	/* heapsort: moving the farthest to the back leaves closest first */
+	for (size_t n = h.n; n > 1; n--) {
+		wpt_heap_swap(&h, 0, n - 1);
+		wpt_heap_sift_down(&h, 0, n - 1);
+	}
+
+	return (h.n);
+}
+
 /*
  * Constructs a geographical wpt with a custom printf-style name specification.
  *
@@ -477,42 +944,174 @@ geowpt(geo_pos2_t pos, const char *namefmt, ...)
 	return (wpt);
 }
 
-#define	GET_MATCH(str, i, param, minlen, maxlen) \
-	do { \
-		CTASSERT(i < MAX_MATCHES); \
-		regoff_t len = pmatch[i].rm_eo - pmatch[i].rm_so; \
-		ASSERT(len >= minlen && len <= maxlen); \
-		memcpy(param, &str[pmatch[i].rm_so], len); \
-		param[len] = 0; \
-	} while (0)
+/*
+ * Waypoint name lexer
+ *
+ * Waypoint names entered by the user are at most 15 characters long and
+ * come in a handful of fixed formats (see fms_wpt_name_decode). Rather
+ * than trying a cascade of regular expressions, we split the name into
+ * tokens in a single pass - runs of letters, runs of digits and the
+ * individual punctuation characters '/', '.' and '-' - and then match the
+ * token sequence against the table of formats below. Fields are extracted
+ * directly from the token offsets, without copying.
+ */
+
+#define	WPT_NAME_MAX_LEN	15
+#define	WPT_SEQ_NUM_MAX		100	/* created wpt names end in 2 digits */
+#define	WPT_NAME_MAX_TOKS	8
+
+typedef enum {
+	WPT_FMT_NONE,
+	WPT_FMT_GEO_BLW100,	/* 5010N = N50 W010 */
+	WPT_FMT_GEO_ABV100,	/* 50N10 = N50 W110 */
+	WPT_FMT_GEO_LONG,	/* N47W008 */
+	WPT_FMT_GEO_DETAILED,	/* N4715.4W00803.4 */
+	WPT_FMT_GEO_REPORT,	/* W060-10 */
+	WPT_FMT_RADIAL_DME,	/* SEA330/10 */
+	WPT_FMT_RADIAL_ISECT,	/* SEA330/OLM020 */
+	WPT_FMT_ALONG_TRK,	/* VAMPS/25, ELN/-30 */
+	WPT_FMT_WPTNAME		/* DOT, ALPHA, KM95S */
+} wpt_fmt_t;
+
+typedef struct {
+	char		cls;	/* 'A' letters, '9' digits, or the punct char */
+	uint8_t		off;
+	uint8_t		len;
+} wpt_tok_t;
+
+typedef struct {
+	char		cls;
+	uint8_t		min_len;
+	uint8_t		max_len;
+	const char	*set;	/* if not NULL, allowed single letters */
+} wpt_tok_pat_t;
+
+#define	TOK(cls, min_len, max_len)	{ (cls), (min_len), (max_len), NULL }
+#define	HEMI(set)			{ 'A', 1, 1, (set) }
+static const struct {
+	wpt_fmt_t	fmt;
+	unsigned	num_toks;
+	wpt_tok_pat_t	toks[WPT_NAME_MAX_TOKS];
+} wpt_fmt_tbl[] = {
+    { WPT_FMT_GEO_BLW100, 2, { TOK('9', 4, 4), HEMI("NEWS") } },
+    { WPT_FMT_GEO_ABV100, 3,
+	{ TOK('9', 2, 2), HEMI("NEWS"), TOK('9', 2, 2) } },
+    { WPT_FMT_GEO_LONG, 4,
+	{ HEMI("NS"), TOK('9', 2, 2), HEMI("WE"), TOK('9', 3, 3) } },
+    { WPT_FMT_GEO_DETAILED, 8,
+	{ HEMI("NS"), TOK('9', 4, 4), TOK('.', 1, 1), TOK('9', 1, 1),
+	HEMI("WE"), TOK('9', 5, 5), TOK('.', 1, 1), TOK('9', 1, 1) } },
+    { WPT_FMT_GEO_REPORT, 4,
+	{ HEMI("NSEW"), TOK('9', 2, 3), TOK('-', 1, 1), TOK('9', 1, 2) } },
+    { WPT_FMT_RADIAL_DME, 4,
+	{ TOK('A', 1, 5), TOK('9', 3, 3), TOK('/', 1, 1), TOK('9', 1, 3) } },
+    { WPT_FMT_RADIAL_ISECT, 5,
+	{ TOK('A', 1, 5), TOK('9', 3, 3), TOK('/', 1, 1), TOK('A', 1, 5),
+	TOK('9', 3, 3) } },
+    { WPT_FMT_ALONG_TRK, 3,
+	{ TOK('A', 1, 5), TOK('/', 1, 1), TOK('9', 1, 3) } },
+    { WPT_FMT_ALONG_TRK, 4,
+	{ TOK('A', 1, 5), TOK('/', 1, 1), TOK('-', 1, 1), TOK('9', 1, 3) } }
+};
+#undef	TOK
+#undef	HEMI
+#define	WPT_FMT_TBL_SZ	(sizeof (wpt_fmt_tbl) / sizeof (wpt_fmt_tbl[0]))
 
 /*
- * Parses a whole-degree lat-lon coordinate specification (the lat/lon values
- *	must be specified in the two-digit format).
+ * Splits a waypoint name into tokens and determines its format.
  *
- * @param str The input string to parse.
- * @param regex Regular expression to match the input string to.
- * @param lat Return parameter which will be filled with the parsed latitude.
- * @param lon Return parameter which will be filled with the parsed latitude.
+ * @param name The waypoint name to classify.
+ * @param toks Will be filled with the name's tokens.
  *
- * @return B_TRUE if parsing succeeded, B_FALSE otherwise.
+ * @return The format of the name or WPT_FMT_NONE if the name doesn't
+ *	conform to any known format.
  */
-static bool_t
-parse_latlon(const char *str, const regex_t *regex, int *lat, int *lon)
+static wpt_fmt_t
+wpt_name_lex(const char *name, wpt_tok_t toks[WPT_NAME_MAX_TOKS])
 {
-#define	MAX_MATCHES	3
-	regmatch_t	pmatch[MAX_MATCHES];
-	char		latstr[3], lonstr[3];
+	unsigned	num_toks = 0, len;
+	bool_t		alnum = B_TRUE;
+
+	for (len = 0; name[len] != 0; len++) {
+		char c = name[len], cls;
+
+		if (len == WPT_NAME_MAX_LEN)
+			return (WPT_FMT_NONE);
+		if (c >= 'A' && c <= 'Z') {
+			cls = 'A';
+		} else if (c >= '0' && c <= '9') {
+			cls = '9';
+		} else if (c == '/' || c == '.' || c == '-') {
+			cls = c;
+			alnum = B_FALSE;
+		} else {
+			return (WPT_FMT_NONE);
+		}
+		/* letter & digit runs extend the previous token */
+		if (num_toks != 0 && toks[num_toks - 1].cls == cls &&
+		    (cls == 'A' || cls == '9')) {
+			toks[num_toks - 1].len++;
+			continue;
+		}
+		if (num_toks == WPT_NAME_MAX_TOKS)
+			return (WPT_FMT_NONE);
+		toks[num_toks++] = (wpt_tok_t){ cls, len, 1 };
+	}
+	if (len == 0)
+		return (WPT_FMT_NONE);
 
-	if (regexec(regex, str, MAX_MATCHES, pmatch, 0) != 0)
-		return (B_FALSE);
-	GET_MATCH(str, 1, latstr, 2, 2);
-	GET_MATCH(str, 2, lonstr, 2, 2);
-	*lat = atoi(latstr);
-	*lon = atoi(lonstr);
+	for (unsigned i = 0; i < WPT_FMT_TBL_SZ; i++) {
+		unsigned j;
 
-	return (B_TRUE);
-#undef	MAX_MATCHES
+		if (wpt_fmt_tbl[i].num_toks != num_toks)
+			continue;
+		for (j = 0; j < num_toks; j++) {
+			const wpt_tok_pat_t *pat = &wpt_fmt_tbl[i].toks[j];
+
+			if (toks[j].cls != pat->cls ||
+			    toks[j].len < pat->min_len ||
+			    toks[j].len > pat->max_len ||
+			    (pat->set != NULL &&
+			    strchr(pat->set, name[toks[j].off]) == NULL))
+				break;
+		}
+		if (j == num_toks)
+			return (wpt_fmt_tbl[i].fmt);
+	}
+	/*
+	 * This needs to come after the geo pos formats, because it covers
+	 * some of them as well (e.g. "5010N").
+	 */
+	if (alnum && len <= 5)
+		return (WPT_FMT_WPTNAME);
+
+	return (WPT_FMT_NONE);
+}
+
+/*
+ * Returns the value of `len' decimal digits at `str'.
+ */
+static unsigned
+wpt_name_digits(const char *str, unsigned len)
+{
+	unsigned val = 0;
+
+	for (unsigned i = 0; i < len; i++)
+		val = val * 10 + (str[i] - '0');
+	return (val);
+}
+
+/*
+ * Copies a letters-only token (an identifier) into a NUL-terminated and
+ * zero-padded name buffer suitable for DB lookups.
+ */
+static void
+wpt_name_tok_cpy(char name[NAV_NAME_LEN], const char *str,
+    const wpt_tok_t *tok)
+{
+	ASSERT(tok->len < NAV_NAME_LEN);
+	memset(name, 0, NAV_NAME_LEN);
+	memcpy(name, &str[tok->off], tok->len);
 }
 
 /*
@@ -520,7 +1119,7 @@ parse_latlon(const char *str, const regex_t *regex, int *lat, int *lon)
  * it can describe.
  *
  * @param name Waypoint name as entered by the user. This must conform to
- *	one of the following formats (parsing order is as listed here):
+ *	one of the following formats (see wpt_name_lex):
  *	1) A 5-character geodetic coordinate combo, one of:
  *		a) "5010N" = N50 W010
  *		b) "50N10" = N50 W110
@@ -542,108 +1141,82 @@ parse_latlon(const char *str, const regex_t *regex, int *lat, int *lon)
  *	   (e.g. "SEA330/OLM020").
  *	7) TODO: along track waypoints.
  *	8) Airport ICAO code
- * @param 
+ * @param fms The FMS whose navdb to use for lookups.
+ * @param num_wpts Will be filled with the number of wpts returned.
+ * @param is_wpt_seq Will be set to B_TRUE if the name denotes a sequence
+ *	of waypoints.
+ *
+ * @return A malloc'd array of the matching wpts, or NULL if none matched.
  */
 wpt_t *
 fms_wpt_name_decode(const char *name, fms_t *fms, size_t *num_wpts,
     bool_t *is_wpt_seq)
 {
-#define	MAX_MATCHES	7
-	regmatch_t pmatch[MAX_MATCHES];
-	int latdeg, londeg;
+	wpt_tok_t	toks[WPT_NAME_MAX_TOKS];
+	const wpt_tok_t	*t = toks;
 
 	*is_wpt_seq = B_FALSE;
 
-	if (parse_latlon(name, fms->regex.geo_nw_blw100, &latdeg, &londeg)) {
-		*num_wpts = 1;
-		return (geowpt(GEO_POS2(latdeg, -londeg), "%s", name));
-	}
-	if (parse_latlon(name, fms->regex.geo_nw_abv100, &latdeg, &londeg)) {
-		*num_wpts = 1;
-		return (geowpt(GEO_POS2(latdeg, -londeg - 100), "%s", name));
-	}
-	if (parse_latlon(name, fms->regex.geo_ne_blw100, &latdeg, &londeg)) {
+	switch (wpt_name_lex(name, toks)) {
+	case WPT_FMT_GEO_BLW100:
+	case WPT_FMT_GEO_ABV100: {
+		/* the letter gives the quadrant, see the format list above */
+		char	quad = name[t[1].off];
+		int	latdeg = wpt_name_digits(name, 2);
+		int	londeg;
+
+		if (t[0].len == 4)
+			londeg = wpt_name_digits(&name[2], 2);
+		else
+			londeg = wpt_name_digits(&name[t[2].off], 2) + 100;
+		if (quad == 'W' || quad == 'S')
+			latdeg = -latdeg;
+		if (quad == 'N' || quad == 'W')
+			londeg = -londeg;
 		*num_wpts = 1;
 		return (geowpt(GEO_POS2(latdeg, londeg), "%s", name));
 	}
-	if (parse_latlon(name, fms->regex.geo_ne_abv100, &latdeg, &londeg)) {
-		*num_wpts = 1;
-		return (geowpt(GEO_POS2(latdeg, londeg + 100), "%s", name));
-	}
-	if (parse_latlon(name, fms->regex.geo_sw_blw100, &latdeg, &londeg)) {
-		*num_wpts = 1;
-		return (geowpt(GEO_POS2(-latdeg, -londeg), "%s", name));
-	}
-	if (parse_latlon(name, fms->regex.geo_sw_abv100, &latdeg, &londeg)) {
-		*num_wpts = 1;
-		return (geowpt(GEO_POS2(-latdeg, -londeg - 100), "%s", name));
-	}
-	if (parse_latlon(name, fms->regex.geo_se_blw100, &latdeg, &londeg)) {
-		*num_wpts = 1;
-		return (geowpt(GEO_POS2(-latdeg, londeg), "%s", name));
-	}
-	if (parse_latlon(name, fms->regex.geo_se_abv100, &latdeg, &londeg)) {
-		*num_wpts = 1;
-		return (geowpt(GEO_POS2(-latdeg, londeg + 100), "%s", name));
-	}
-
-	if (regexec(fms->regex.geo_long, name, 5, pmatch, 0) == 0) {
-		char NS[2], latstr[3], EW[2], lonstr[4];
-		double lat, lon;
-
-		GET_MATCH(name, 1, NS, 1, 1);
-		GET_MATCH(name, 2, latstr, 2, 2);
-		GET_MATCH(name, 3, EW, 1, 1);
-		GET_MATCH(name, 4, lonstr, 3, 3);
-		lat = (NS[0] == 'N' ? atof(latstr) : -atof(latstr));
-		lon = (EW[0] == 'E' ? atof(lonstr) : -atof(lonstr));
-
+	case WPT_FMT_GEO_LONG: {
+		double lat = wpt_name_digits(&name[t[1].off], 2);
+		double lon = wpt_name_digits(&name[t[3].off], 3);
+
+		if (name[t[0].off] == 'S')
+			lat = -lat;
+		if (name[t[2].off] == 'W')
+			lon = -lon;
 		*num_wpts = 1;
 		return (geowpt(GEO_POS2(lat, lon), "%s", name));
 	}
-
-	if (regexec(fms->regex.geo_detailed, name, 7, pmatch, 0) == 0) {
-		char NS[2], latstr[3], latmin[5], EW[2], lonstr[4], lonmin[5];
-		double lat, lon;
-
-		GET_MATCH(name, 1, NS, 1, 1);
-		GET_MATCH(name, 2, latstr, 2, 2);
-		GET_MATCH(name, 3, latmin, 4, 4);
-		GET_MATCH(name, 4, EW, 1, 1);
-		GET_MATCH(name, 5, lonstr, 3, 3);
-		GET_MATCH(name, 6, lonmin, 4, 4);
-		if (NS[0] == 'N')
-			lat = atof(latstr) + (atof(latmin) / 0.6);
-		else
-			lat = -atof(latstr) - (atof(latmin) / 0.6);
-		if (EW[0] == 'E')
-			lon = atof(lonstr) + (atof(lonmin) / 0.6);
-		else
-			lon = -atof(lonstr) - (atof(lonmin) / 0.6);
-
+	case WPT_FMT_GEO_DETAILED: {
+		/* N4715.4W00803.4: deg & whole min, '.', tenths of a min */
+		const char	*latstr = &name[t[1].off];
+		const char	*lonstr = &name[t[5].off];
+		double		lat = wpt_name_digits(latstr, 2) +
+		    (wpt_name_digits(&latstr[2], 2) +
+		    wpt_name_digits(&name[t[3].off], 1) / 10.0) / 60.0;
+		double		lon = wpt_name_digits(lonstr, 3) +
+		    (wpt_name_digits(&lonstr[3], 2) +
+		    wpt_name_digits(&name[t[7].off], 1) / 10.0) / 60.0;
+
+		if (name[t[0].off] == 'S')
+			lat = -lat;
+		if (name[t[4].off] == 'W')
+			lon = -lon;
 		*num_wpts = 1;
-		return (geowpt(GEO_POS2(lat, lon), "%s%s%s%s", NS, latstr, EW,
-		    lonstr));
+		return (geowpt(GEO_POS2(lat, lon), "%c%.2s%c%.3s",
+		    name[t[0].off], latstr, name[t[4].off], lonstr));
 	}
-
-	/*
-	 * This needs to come after geo pos wpt scanning, because it covers
-	 * them as well, but not all geographical wpts are in our wptdb.
-	 */
-	if (regexec(fms->regex.wptname, name, 2, pmatch, 0) == 0)
+	case WPT_FMT_WPTNAME:
 		return (fms_lookup_wpt_by_name(name, fms, num_wpts));
-
-	if (regexec(fms->regex.radial_dme, name, 4, pmatch, 0) == 0) {
-		char wptname[6], radialstr[4], diststr[4];
-		wpt_t *wpts;
-		size_t num;
-		unsigned radial, dist;
-
-		GET_MATCH(name, 1, wptname, 1, 5);
-		GET_MATCH(name, 2, radialstr, 3, 3);
-		GET_MATCH(name, 3, diststr, 1, 3);
-		radial = atoi(radialstr);
-		dist = atoi(diststr);
+	case WPT_FMT_RADIAL_DME: {
+		char		wptname[NAV_NAME_LEN];
+		wpt_t		*wpts;
+		size_t		num;
+		unsigned	radial, dist;
+
+		wpt_name_tok_cpy(wptname, name, &t[0]);
+		radial = wpt_name_digits(&name[t[1].off], 3);
+		dist = wpt_name_digits(&name[t[3].off], t[3].len);
 		if (!is_valid_hdg(radial) || dist == 0)
 			goto errout;
 
@@ -659,25 +1232,22 @@ fms_wpt_name_decode(const char *name, fms_t *fms, size_t *num_wpts,
 			wpts[i].pos = geo_displace_mag(&wgs84, fms->navdb->wmm,
 			    wpts[i].pos, radial, dist);
 		}
-		fms->wpt_seq_num++;
+		fms->wpt_seq_num = (fms->wpt_seq_num + 1) % WPT_SEQ_NUM_MAX;
 
 		*num_wpts = num;
 		return (wpts);
 	}
-
-	if (regexec(fms->regex.radial_isect, name, 5, pmatch, 0) == 0) {
-		char wpt1name[6], radial1str[4], wpt2name[6], radial2str[4];
-		unsigned radial1, radial2;
-		wpt_t *tmp_wpts1, *tmp_wpts2;
-		size_t num_wpts1, num_wpts2, num = 0;
-		wpt_t *wpts;
-
-		GET_MATCH(name, 1, wpt1name, 1, 5);
-		GET_MATCH(name, 2, radial1str, 3, 3);
-		GET_MATCH(name, 3, wpt2name, 1, 5);
-		GET_MATCH(name, 4, radial2str, 3, 3);
-		radial1 = atoi(radial1str);
-		radial2 = atoi(radial2str);
+	case WPT_FMT_RADIAL_ISECT: {
+		char		wpt1name[NAV_NAME_LEN], wpt2name[NAV_NAME_LEN];
+		unsigned	radial1, radial2;
+		wpt_t		*tmp_wpts1, *tmp_wpts2;
+		size_t		num_wpts1, num_wpts2, num = 0;
+		wpt_t		*wpts;
+
+		wpt_name_tok_cpy(wpt1name, name, &t[0]);
+		radial1 = wpt_name_digits(&name[t[1].off], 3);
+		wpt_name_tok_cpy(wpt2name, name, &t[3]);
+		radial2 = wpt_name_digits(&name[t[4].off], 3);
 		if (!is_valid_hdg(radial1) || !is_valid_hdg(radial2) ||
 		    radial1 == radial2)
 			goto errout;
@@ -721,16 +1291,21 @@ fms_wpt_name_decode(const char *name, fms_t *fms, size_t *num_wpts,
 			free(wpts);
 			goto errout;
 		}
-		fms->wpt_seq_num++;
+		fms->wpt_seq_num = (fms->wpt_seq_num + 1) % WPT_SEQ_NUM_MAX;
 
 		*num_wpts = num;
 		return (wpts);
 	}
+	case WPT_FMT_GEO_REPORT:
+	case WPT_FMT_ALONG_TRK:
+		/* TODO: reporting & along track waypoints */
+	case WPT_FMT_NONE:
+		break;
+	}
 
 errout:
 	*num_wpts = 0;
 	return (NULL);
-#undef	MAX_MATCHES
 }
 
 const acft_perf_t *
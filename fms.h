@@ -26,9 +26,9 @@
 #ifndef	_OPENFMC_FMS_H_
 #define	_OPENFMC_FMS_H_
 
-#include <regex.h>
-
 #include "airac.h"
+#include "airac_delta.h"
+#include "list.h"
 #include "perf.h"
 #include "wmm.h"
 
@@ -49,9 +49,14 @@ typedef struct {
 	airway_db_t	*awydb;
 	waypoint_db_t	*wptdb;
 	navaid_db_t	*navaiddb;
+	arpt_idx_ent_t	*arpt_idx;	/* sorted by ICAO code */
+	size_t		num_arpts;
 
 	char		*wmm_file;
 	wmm_t		*wmm;
+
+	unsigned	refcnt;		/* see fms_navdb_hold */
+	uint64_t	serial;		/* see serial_next */
 } fms_navdb_t;
 
 typedef struct {
@@ -59,52 +64,51 @@ typedef struct {
 
 	int		wpt_seq_num;
 
-	struct {
-		regex_t	*wptname;		/* 'DOT', 'ALPHA', etc */
-		regex_t	*arpticao;		/* 'KJFK', 'KMIA', etc */
-
-		regex_t	*geo_nw_blw100;		/* 5010N = N50 W010 */
-		regex_t	*geo_nw_abv100;		/* 50N10 = N50 W110 */
-
-		regex_t	*geo_ne_blw100;		/* 5010E = N50 E010 */
-		regex_t	*geo_ne_abv100;		/* 50E10 = N50 E110 */
-
-		regex_t	*geo_sw_blw100;		/* 5010W = S50 W010 */
-		regex_t	*geo_sw_abv100;		/* 50W10 = S50 W110 */
-
-		regex_t	*geo_se_blw100;		/* 5010S = S50 E010 */
-		regex_t	*geo_se_abv100;		/* 50S10 = S50 E110 */
-
-		regex_t	*geo_long;		/* N47W008 */
-		regex_t	*geo_detailed;		/* N4715.4W00803.4 */
-
-		regex_t	*geo_report;		/* W060-10 */
-
-		/* SEA330/10 = SEA VOR 330 radial, 10 DME */
-		regex_t	*radial_dme;
-		/* SEA330/OLM020 = intersection SEA 330 & OLM 020 radials */
-		regex_t	*radial_isect;
-
-		regex_t	*along_trk;		/* VAMPS/25, ELN/-30 */
-	} regex;
-
 	acft_perf_t	*acft;
 	flt_perf_t	*flt;
 } fms_t;
 
 fms_t *fms_new(const char *navdata_dir, const char *wmm_file,
     const char *acft_perf_file);
+fms_t *fms_new_navdb(fms_navdb_t *navdb, const char *acft_perf_file);
 void fms_destroy(fms_t *fms);
 
 fms_navdb_t *fms_navdb_open(const char *navdata_dir, const char *wmm_file);
+fms_navdb_t *fms_navdb_hold(fms_navdb_t *navdb);
 void fms_navdb_close(fms_navdb_t *navdb);
+bool_t fms_navdb_apply_delta(fms_navdb_t *navdb, const airac_delta_t *delta,
+    const char *navdata_dir);
+const arpt_idx_ent_t *fms_navdb_arpt_lookup(const fms_navdb_t *navdb,
+    const char *icao);
 
 bool_t navdb_is_current(const fms_navdb_t *navdb);
 bool_t navdata_is_current(const char *navdata_dir);
 
+/*
+ * Hot-swappable navdb handle, see fms.c for a description.
+ */
+typedef struct fms_navdb_hnd_s fms_navdb_hnd_t;
+typedef struct fms_navdb_rdr_s fms_navdb_rdr_t;
+
+fms_navdb_hnd_t *fms_navdb_hnd_open(const char *navdata_dir,
+    const char *wmm_file);
+void fms_navdb_hnd_close(fms_navdb_hnd_t *hnd);
+bool_t fms_navdb_hnd_swap(fms_navdb_hnd_t *hnd, const char *navdata_dir,
+    bool_t wait);
+bool_t fms_navdb_hnd_reclaim(fms_navdb_hnd_t *hnd);
+
+fms_navdb_rdr_t *fms_navdb_rdr_register(fms_navdb_hnd_t *hnd);
+void fms_navdb_rdr_unregister(fms_navdb_rdr_t *rdr);
+const fms_navdb_t *fms_navdb_rdr_enter(fms_navdb_rdr_t *rdr);
+void fms_navdb_rdr_exit(fms_navdb_rdr_t *rdr);
+
 wpt_t *fms_wpt_name_decode(const char *name, fms_t *fms, size_t *num,
     bool_t *is_wpt_seq);
 
+#define	FMS_WPT_NEAREST_MAX	32
+size_t fms_lookup_wpt_nearest(const char *wptname, const fms_t *fms,
+    geo_pos2_t ref, size_t k, wpt_t *wpts);
+
 const acft_perf_t *fms_acft_perf(const fms_t *fms);
 flt_perf_t *fms_flt_perf(fms_t *fms);
 
@@ -821,7 +821,7 @@ geo_displace_dir(const ellip_t *ellip, geo_pos2_t pos, vect2_t dir, double dist)
 	if (dist >= M_PI * EARTH_MSL / 2)
 		return (NULL_GEO_POS2);
 	fpp = gnomo_fpp_init(pos, 0, ellip, B_TRUE);
-	dir = vect2_set_abs(dir, tan(dist_r));
+	dir = vect2_set_abs(dir, EARTH_MSL * tan(dist_r));
 
 	return (fpp2geo(dir, &fpp));
 }
@@ -879,21 +879,31 @@ sphere_lon_subdiv(double radius, double lat, double partition_sz)
 	return (ceil((2 * M_PI * r) / partition_sz));
 }
 
+/*
+ * Parses a lat/lon pair in decimal degrees (as found in the navdata files)
+ * into a geo_pos2_t. Parsing is locale-independent (see parse_dec).
+ *
+ * @return B_TRUE if both coordinates were well-formed and in range,
+ *	B_FALSE otherwise.
+ */
 bool_t
 geo_pos2_from_str(const char *lat, const char *lon, geo_pos2_t *pos)
 {
-	pos->lat = atof(lat);
-	pos->lon = atof(lon);
+	if (!parse_dec(lat, &pos->lat) || !parse_dec(lon, &pos->lon))
+		return (B_FALSE);
 	return (is_valid_lat(pos->lat) && is_valid_lon(pos->lon));
 }
 
+/*
+ * Same as geo_pos2_from_str, but also parses an elevation in feet.
+ */
 bool_t
 geo_pos3_from_str(const char *lat, const char *lon, const char *elev,
     geo_pos3_t *pos)
 {
-	pos->lat = atof(lat);
-	pos->lon = atof(lon);
-	pos->elev = atof(elev);
+	if (!parse_dec(lat, &pos->lat) || !parse_dec(lon, &pos->lon) ||
+	    !parse_dec(elev, &pos->elev))
+		return (B_FALSE);
 	return (is_valid_lat(pos->lat) && is_valid_lon(pos->lon) &&
 	    is_valid_elev(pos->elev));
 }
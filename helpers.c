@@ -143,6 +143,151 @@ is_valid_rwy_ID(const char *rwy_ID)
 	return (B_TRUE);
 }
 
+/*
+ * Maximum mantissa accepted by parse_fixed_dec. Any integer up to 2^53 is
+ * exactly representable as a double, which is what makes fixed_dec2dbl
+ * correctly rounded.
+ */
+#define	FIXED_DEC_MANT_MAX	(1llu << 53)
+
+/*
+ * Powers of 10 that are exactly representable both as doubles and as
+ * 64-bit integers.
+ */
+#define	FIXED_DEC_MAX_DIGITS	18
+static const double pow10_dbl[FIXED_DEC_MAX_DIGITS + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+static const int64_t pow10_int[FIXED_DEC_MAX_DIGITS + 1] = {
+	1ll, 10ll, 100ll, 1000ll, 10000ll, 100000ll, 1000000ll, 10000000ll,
+	100000000ll, 1000000000ll, 10000000000ll, 100000000000ll,
+	1000000000000ll, 10000000000000ll, 100000000000000ll,
+	1000000000000000ll, 10000000000000000ll, 100000000000000000ll,
+	1000000000000000000ll
+};
+
+/*
+ * Parses a fixed-point decimal number of the form "[+-]digits[.digits]",
+ * as used for all the coordinates, elevations and frequencies in the
+ * navdata files. Unlike atof/strtod, the decimal separator is always '.'
+ * regardless of the current locale and the digits are accumulated into an
+ * integer mantissa, so no source precision is lost during parsing.
+ * Leading and trailing blanks are ignored, but any other junk causes the
+ * parse to fail.
+ *
+ * @param str The input string to parse.
+ * @param fd Output fixed-point number. Not modified if the parse fails.
+ *
+ * @return B_TRUE if `str' is a well-formed decimal number which fits into
+ *	the mantissa (2^53), B_FALSE otherwise.
+ */
+bool_t
+parse_fixed_dec(const char *str, fixed_dec_t *fd)
+{
+	const char	*p = str;
+	uint64_t	mant = 0;
+	unsigned	digits = 0, frac_digits = 0;
+	bool_t		neg = B_FALSE, frac = B_FALSE;
+
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (*p == '-') {
+		neg = B_TRUE;
+		p++;
+	} else if (*p == '+') {
+		p++;
+	}
+	for (;; p++) {
+		if (*p >= '0' && *p <= '9') {
+			unsigned d = *p - '0';
+
+			if (mant > (FIXED_DEC_MANT_MAX - d) / 10)
+				return (B_FALSE);
+			mant = mant * 10 + d;
+			digits++;
+			if (frac) {
+				if (frac_digits == FIXED_DEC_MAX_DIGITS)
+					return (B_FALSE);
+				frac_digits++;
+			}
+		} else if (*p == '.' && !frac) {
+			frac = B_TRUE;
+		} else {
+			break;
+		}
+	}
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (digits == 0 || *p != 0)
+		return (B_FALSE);
+
+	fd->mant = (neg ? -(int64_t)mant : (int64_t)mant);
+	fd->frac_digits = frac_digits;
+
+	return (B_TRUE);
+}
+
+/*
+ * Converts a fixed-point decimal number to the nearest double. Since both
+ * the mantissa and the power of 10 are exact, the single IEEE division
+ * gives the same correctly rounded result as strtod.
+ */
+double
+fixed_dec2dbl(fixed_dec_t fd)
+{
+	ASSERT(fd.frac_digits <= FIXED_DEC_MAX_DIGITS);
+	return (fd.mant / pow10_dbl[fd.frac_digits]);
+}
+
+/*
+ * Converts a fixed-point decimal number to an integer count of 10^-`scale'
+ * units. For example, a frequency of "116.80" MHz converted with a scale
+ * of 6 yields exactly 116800000 Hz, with none of the truncation issues of
+ * multiplying a double.
+ *
+ * @return B_TRUE if the conversion was exact, B_FALSE if the number has
+ *	non-zero digits below 10^-`scale' or the result overflows.
+ */
+bool_t
+fixed_dec2int(fixed_dec_t fd, unsigned scale, int64_t *val)
+{
+	if (scale >= fd.frac_digits) {
+		int64_t mul;
+
+		if (scale - fd.frac_digits > FIXED_DEC_MAX_DIGITS)
+			return (B_FALSE);
+		mul = pow10_int[scale - fd.frac_digits];
+		if (fd.mant > INT64_MAX / mul || fd.mant < -INT64_MAX / mul)
+			return (B_FALSE);
+		*val = fd.mant * mul;
+	} else {
+		int64_t div = pow10_int[fd.frac_digits - scale];
+
+		if (fd.mant % div != 0)
+			return (B_FALSE);
+		*val = fd.mant / div;
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Locale-independent replacement for atof for the fixed-point formats in
+ * the navdata files. See parse_fixed_dec for the accepted syntax.
+ */
+bool_t
+parse_dec(const char *str, double *val)
+{
+	fixed_dec_t fd;
+
+	if (!parse_fixed_dec(str, &fd))
+		return (B_FALSE);
+	*val = fixed_dec2dbl(fd);
+
+	return (B_TRUE);
+}
+
 /*
  * Grabs the next non-empty, non-comment line from a file, having stripped
  * away all leading and trailing whitespace.
@@ -250,3 +395,18 @@ append_format(char **str, size_t *sz, const char *format, ...)
 	*sz += needed;
 	va_end(ap);
 }
+
+/*
+ * Returns a new serial number, unique within the process (never 0). Data
+ * structures which are looked up by content, such as in a route_cache_t,
+ * carry one which they renew whenever their content changes, so that they
+ * can be told apart even if one is freed and another one allocated at the
+ * same address.
+ */
+uint64_t
+serial_next(void)
+{
+	static uint64_t next = 0;
+
+	return (__atomic_add_fetch(&next, 1, __ATOMIC_RELAXED));
+}
@@ -29,6 +29,7 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #include "airac.h"
 #include "types.h"
@@ -160,6 +161,21 @@ bool_t is_valid_ndb_freq(double freq_khz);
 bool_t is_valid_tacan_freq(double freq_mhz);
 bool_t is_valid_rwy_ID(const char *rwy_ID);
 
+/*
+ * Fixed-point decimal number as it appears in the navdata files. The value
+ * of the number is `mant' / 10^`frac_digits'.
+ */
+typedef struct {
+	int64_t		mant;
+	unsigned	frac_digits;
+} fixed_dec_t;
+
+/* Locale-independent numeric parsing helpers */
+bool_t parse_fixed_dec(const char *str, fixed_dec_t *fd);
+double fixed_dec2dbl(fixed_dec_t fd);
+bool_t fixed_dec2int(fixed_dec_t fd, unsigned scale, int64_t *val);
+bool_t parse_dec(const char *str, double *val);
+
 /* CSV file & string processing helpers */
 ssize_t parser_get_next_line(FILE *fp, char **linep, size_t *linecap,
     size_t *linenum);
@@ -168,6 +184,8 @@ void strip_space(char *line);
 void append_format(char **str, size_t *sz, const char *format, ...)
     PRINTF_ATTR(3);
 
+uint64_t serial_next(void);
+
 #if	defined(__GNUC__) || defined(__clang__)
 #define	highbit64(x)	(64 - __builtin_clzll(x) - 1)
 #define	highbit32(x)	(32 - __builtin_clzll(x) - 1)
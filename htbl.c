@@ -165,9 +165,9 @@ htbl_set(htbl_t *htbl, void *key, void *value)
 		htbl_multi_value_add(htbl, item, value);
 	} else {
 		item->value = value;
+		htbl->num_values++;
 	}
 	list_insert_head(bucket, item);
-	htbl->num_values++;
 }
 
 void
@@ -0,0 +1,330 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "helpers.h"
+#include "lnav.h"
+
+/*
+ * Lateral navigation
+ *
+ * An lnav_path_t is a read-only snapshot of the segments computed by
+ * route_update, with each segment turned into a local frame of unit
+ * vectors on a spherical Earth, set up once. Tracking a position along a
+ * segment then only takes the position's own unit vector (one sin & cos
+ * of its latitude and longitude each), a few dot products and an asin &
+ * atan2, with no projection set up per call:
+ *
+ * *) A direct is a great circle arc from `o' (the start point) with `n'
+ *	the normal of its plane (pointing left of the path) and `t' the
+ *	direction of travel at `o'. The cross-track error comes from the
+ *	position's distance from the plane, the progress along the segment
+ *	from its angle from `o' in the plane.
+ * *) An arc is a small circle around `o' (its center) with angular radius
+ *	`r'. `n' points from the center towards the start and `t' is `n'
+ *	turned 90 degrees counter-clockwise, so that the angle in the
+ *	`n'-`t' plane measures how far around the arc the position is.
+ *
+ * A path is never modified, so any number of aircraft (in any number of
+ * threads) can track along the same one, each with its own lnav_t.
+ */
+
+typedef struct {
+	bool_t		arc;
+	bool_t		cw;
+	vect3_t		o;
+	vect3_t		n;
+	vect3_t		t;
+	double		len;		/* segment angle in radians */
+	double		r;		/* arc angular radius */
+	double		scale;		/* meters per radian of `len' */
+	double		dist_after;	/* from the segment's end to the end */
+} lnav_seg_t;
+
+struct lnav_path_s {
+	lnav_seg_t	*segs;
+	unsigned	num_segs;
+};
+
+/*
+ * Unit vector of `pos' on a spherical Earth.
+ */
+static vect3_t
+lnav_unit(geo_pos2_t pos)
+{
+	double lat = DEG2RAD(pos.lat), lon = DEG2RAD(pos.lon);
+
+	return (VECT3(cos(lat) * cos(lon), cos(lat) * sin(lon), sin(lat)));
+}
+
+/*
+ * Angle in radians of `v' in the plane of the unit vectors `x' & `y'.
+ */
+static double
+lnav_angle(vect3_t v, vect3_t x, vect3_t y)
+{
+	return (atan2(vect3_dotprod(v, y), vect3_dotprod(v, x)));
+}
+
+static void
+lnav_seg_init(lnav_seg_t *ls, const route_seg_t *rs)
+{
+	if (rs->type == ROUTE_SEG_TYPE_DIRECT) {
+		vect3_t end = lnav_unit(rs->direct.end);
+
+		ls->o = lnav_unit(rs->direct.start);
+		ls->n = vect3_unit(vect3_xprod(ls->o, end), NULL);
+		if (IS_NULL_VECT(ls->n)) {
+			/* zero length, any frame will do */
+			ls->n = vect3_unit(vect3_xprod(ls->o, VECT3(0, 0, 1)),
+			    NULL);
+			if (IS_NULL_VECT(ls->n))
+				ls->n = VECT3(0, 1, 0);
+		}
+		ls->t = vect3_xprod(ls->n, ls->o);
+		ls->len = MAX(lnav_angle(end, ls->o, ls->t), 0);
+		ls->scale = EARTH_MSL;
+	} else {
+		vect3_t start = lnav_unit(rs->arc.start);
+		vect3_t end = lnav_unit(rs->arc.end);
+		vect3_t toward;
+
+		ls->arc = B_TRUE;
+		ls->cw = rs->arc.cw;
+		ls->o = lnav_unit(rs->arc.center);
+		ls->r = acos(MIN(vect3_dotprod(ls->o, start), 1));
+		/* the start's direction from the center, flattened */
+		toward = vect3_sub(start, vect3_scmul(ls->o,
+		    vect3_dotprod(start, ls->o)));
+		ls->n = vect3_unit(toward, NULL);
+		ls->t = vect3_xprod(ls->o, ls->n);
+		ls->len = lnav_angle(end, ls->n, ls->t) * (ls->cw ? -1 : 1);
+		if (ls->len < 0)
+			ls->len += 2 * M_PI;
+		ls->scale = EARTH_MSL * sin(ls->r);
+	}
+}
+
+/*
+ * Snapshots the segments of `route' as computed by its last route_update
+ * into a path that aircraft can be tracked along. The path doesn't
+ * reference the route, which can be edited or destroyed afterwards.
+ */
+lnav_path_t *
+lnav_path_create(const route_t *route)
+{
+	lnav_path_t	*path = calloc(sizeof (*path), 1);
+	unsigned	i;
+	double		dist = 0;
+
+	path->num_segs = route_get_num_segs(route);
+	path->segs = calloc(MAX(path->num_segs, 1), sizeof (*path->segs));
+	for (i = 0; i < path->num_segs; i++)
+		lnav_seg_init(&path->segs[i], route_get_seg(route, i));
+	for (i = path->num_segs; i > 0; i--) {
+		lnav_seg_t *ls = &path->segs[i - 1];
+
+		ls->dist_after = dist;
+		dist += ls->len * ls->scale;
+	}
+
+	return (path);
+}
+
+void
+lnav_path_destroy(lnav_path_t *path)
+{
+	free(path->segs);
+	free(path);
+}
+
+unsigned
+lnav_path_get_num_segs(const lnav_path_t *path)
+{
+	return (path->num_segs);
+}
+
+/*
+ * Returns how far along segment `ls' (in radians of its `len') the point
+ * `p' is. Points before the segment's start come out negative.
+ */
+static double
+lnav_seg_progress(const lnav_seg_t *ls, vect3_t p)
+{
+	double a;
+
+	if (!ls->arc)
+		return (lnav_angle(p, ls->o, ls->t));
+	a = lnav_angle(p, ls->n, ls->t) * (ls->cw ? -1 : 1);
+	if (a < 0)
+		a += 2 * M_PI;
+	/* closer to the start going backwards than to the end going on */
+	if (a > ls->len + (2 * M_PI - ls->len) / 2)
+		a -= 2 * M_PI;
+	return (a);
+}
+
+/*
+ * Cross-track error in meters of point `p' from segment `ls', positive
+ * to the right of the direction of travel.
+ */
+static double
+lnav_seg_xtk(const lnav_seg_t *ls, vect3_t p)
+{
+	double d;
+
+	if (!ls->arc)
+		return (-EARTH_MSL * asin(vect3_dotprod(p, ls->n)));
+	d = acos(MIN(MAX(vect3_dotprod(p, ls->o), -1), 1));
+	/* the center is on the right of a clockwise arc */
+	return (EARTH_MSL * (ls->cw ? ls->r - d : d - ls->r));
+}
+
+/*
+ * Checks if `p', while not yet past the end of segment `idx', is already
+ * on the next segment. This happens where a join leaves the segments
+ * meeting at a sharp angle, so that the next segment heads back across
+ * the end of the previous one.
+ */
+static bool_t
+lnav_seq_early(const lnav_path_t *path, unsigned idx, vect3_t p)
+{
+	const lnav_seg_t *ls = &path->segs[idx];
+
+	if (idx + 1 == path->num_segs)
+		return (B_FALSE);
+	return (lnav_seg_progress(ls + 1, p) > 0 &&
+	    ABS(lnav_seg_xtk(ls + 1, p)) < ABS(lnav_seg_xtk(ls, p)));
+}
+
+/*
+ * Starts tracking the aircraft in `lnav' along `path' from its first
+ * segment.
+ */
+void
+lnav_init(lnav_t *lnav, const lnav_path_t *path)
+{
+	lnav->path = path;
+	lnav->active = 0;
+	lnav->done = (path->num_segs == 0);
+}
+
+/*
+ * Makes the segment `pos' is closest to the active one, e.g. after a
+ * direct-to or when picking up tracking mid-route. This is a search of
+ * the whole path, unlike lnav_update. Returns B_FALSE if `pos' isn't
+ * abeam of any of the path's segments.
+ */
+bool_t
+lnav_capture(lnav_t *lnav, geo_pos2_t pos)
+{
+	const lnav_path_t	*path = lnav->path;
+	vect3_t			p = lnav_unit(pos);
+	double			best = INFINITY;
+
+	for (unsigned i = 0; i < path->num_segs; i++) {
+		const lnav_seg_t	*ls = &path->segs[i];
+		double			prog = lnav_seg_progress(ls, p);
+		double			xtk;
+
+		if (prog < 0 || prog > ls->len)
+			continue;
+		xtk = ABS(lnav_seg_xtk(ls, p));
+		if (xtk < best) {
+			best = xtk;
+			lnav->active = i;
+		}
+	}
+	if (isinf(best))
+		return (B_FALSE);
+	lnav->done = B_FALSE;
+
+	return (B_TRUE);
+}
+
+/*
+ * Tracks the aircraft in `lnav' to position `pos' flying true track
+ * `trk', sequencing the active segment once `pos' passes its end, and
+ * fills `out' with the resulting guidance. To keep the time per call
+ * bounded, at most LNAV_MAX_SEQ segments are sequenced at once. Once the
+ * end of the path is passed, the last segment stays active and
+ * LNAV_EVENT_END is returned (only the first time).
+ *
+ * @return The sequencing event, also stored in `out'.
+ */
+lnav_event_t
+lnav_update(lnav_t *lnav, geo_pos2_t pos, double trk, lnav_out_t *out)
+{
+	const lnav_path_t	*path = lnav->path;
+	const lnav_seg_t	*ls;
+	vect3_t			p = lnav_unit(pos);
+	vect3_t			east, north, dir;
+	double			prog;
+	double			lat = DEG2RAD(pos.lat), lon = DEG2RAD(pos.lon);
+
+	out->event = LNAV_EVENT_NONE;
+	if (path->num_segs == 0) {
+		memset(out, 0, sizeof (*out));
+		return (LNAV_EVENT_NONE);
+	}
+	ls = &path->segs[lnav->active];
+	prog = lnav_seg_progress(ls, p);
+	for (int i = 0; i < LNAV_MAX_SEQ && !lnav->done &&
+	    (prog >= ls->len || lnav_seq_early(path, lnav->active, p)); i++) {
+		if (lnav->active + 1 == path->num_segs) {
+			lnav->done = B_TRUE;
+			out->event = LNAV_EVENT_END;
+			break;
+		}
+		lnav->active++;
+		ls++;
+		prog = lnav_seg_progress(ls, p);
+		out->event = LNAV_EVENT_SEQ;
+	}
+
+	/* the direction of the path where it passes abeam of `pos' */
+	if (!ls->arc)
+		dir = vect3_xprod(ls->n, p);
+	else if (ls->cw)
+		dir = vect3_xprod(p, ls->o);
+	else
+		dir = vect3_xprod(ls->o, p);
+	east = VECT3(-sin(lon), cos(lon), 0);
+	north = VECT3(-sin(lat) * cos(lon), -sin(lat) * sin(lon), cos(lat));
+
+	out->active = lnav->active;
+	out->xtk = lnav_seg_xtk(ls, p);
+	out->des_trk = RAD2DEG(lnav_angle(dir, north, east));
+	if (out->des_trk < 0)
+		out->des_trk += 360;
+	out->tae = rel_hdg(out->des_trk, trk);
+	out->dtg = MAX(ls->len - prog, 0) * ls->scale;
+	out->dist_to_end = out->dtg + ls->dist_after;
+
+	return (out->event);
+}
@@ -0,0 +1,87 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+#ifndef	_OPENFMC_LNAV_H_
+#define	_OPENFMC_LNAV_H_
+
+#include "geom.h"
+#include "route.h"
+#include "types.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Most segments lnav_update sequences in one call. A position further
+ * down the path than that needs an lnav_capture.
+ */
+#define	LNAV_MAX_SEQ	4
+
+typedef struct lnav_path_s lnav_path_t;
+
+typedef enum {
+	LNAV_EVENT_NONE,
+	LNAV_EVENT_SEQ,		/* moved on to the next segment */
+	LNAV_EVENT_END		/* passed the end of the last segment */
+} lnav_event_t;
+
+/*
+ * Tracking state of one aircraft along an lnav_path_t.
+ */
+typedef struct {
+	const lnav_path_t	*path;
+	unsigned		active;		/* active segment */
+	bool_t			done;		/* passed the end of the path */
+} lnav_t;
+
+/*
+ * Guidance output of lnav_update. Distances are in meters, angles in
+ * degrees true.
+ */
+typedef struct {
+	lnav_event_t	event;
+	unsigned	active;		/* active segment after sequencing */
+	double		xtk;		/* cross-track error, + right of path */
+	double		des_trk;	/* desired track at the aircraft */
+	double		tae;		/* track angle error, + right of des. */
+	double		dtg;		/* to the end of the active segment */
+	double		dist_to_end;	/* to the end of the path */
+} lnav_out_t;
+
+lnav_path_t *lnav_path_create(const route_t *route);
+void lnav_path_destroy(lnav_path_t *path);
+unsigned lnav_path_get_num_segs(const lnav_path_t *path);
+
+void lnav_init(lnav_t *lnav, const lnav_path_t *path);
+bool_t lnav_capture(lnav_t *lnav, geo_pos2_t pos);
+lnav_event_t lnav_update(lnav_t *lnav, geo_pos2_t pos, double trk,
+    lnav_out_t *out);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _OPENFMC_LNAV_H_ */
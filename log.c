@@ -38,10 +38,19 @@ openfmc_log(openfmc_log_lvl_t lvl, const char *fmt, ...)
 	va_end(ap);
 }
 
+/*
+ * Writes a log message, terminated by a newline. The message and its
+ * newline are written under the stream's lock, so messages logged from
+ * concurrent threads never end up interleaved within a line.
+ */
 void
 openfmc_log_v(openfmc_log_lvl_t lvl, const char *fmt, va_list ap)
 {
-	vfprintf(lvl <= OPENFMC_LOG_WARN ? stderr : stdout, fmt, ap);
-	if (fmt[strlen(fmt) - 1] != '\n')
-		fprintf(lvl <= OPENFMC_LOG_WARN ? stderr : stdout, "\n");
+	FILE *fp = (lvl <= OPENFMC_LOG_WARN ? stderr : stdout);
+
+	flockfile(fp);
+	vfprintf(fp, fmt, ap);
+	if (fmt[0] == 0 || fmt[strlen(fmt) - 1] != '\n')
+		fputc('\n', fp);
+	funlockfile(fp);
 }
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -32,12 +33,20 @@
 #include <ctype.h>
 #include <xlocale.h>
 #include <png.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "helpers.h"
 #include "airac.h"
+#include "airac_delta.h"
 #include "route.h"
+#include "lnav.h"
+#include "vnav.h"
+#include "arrsel.h"
 #include "htbl.h"
 #include "wmm.h"
+#include "wx.h"
 #include "perf.h"
 
 #define	IMGH		1200
@@ -156,6 +165,201 @@ test_arpts(const char *navdata_dir, const char *dump,
 	fclose(arpt_fp);
 }
 
+#define	VALIDATE_SLOWEST	10
+
+typedef struct {
+	const arpt_idx_ent_t	*ent;
+	bool_t			ok;
+	unsigned		num_rwys;
+	unsigned		num_procs;
+	unsigned		num_segs;
+	unsigned		num_bad_procs;
+	unsigned		num_unres_fixes;
+	uint64_t		t_ns;
+} arpt_val_res_t;
+
+typedef struct {
+	const char		*navdata_dir;
+	const waypoint_db_t	*wptdb;
+	const navaid_db_t	*navdb;
+	const arpt_idx_ent_t	*idx;
+	arpt_val_res_t		*res;
+	size_t			num_arpts;
+	size_t			next;		/* next airport to validate */
+} arpt_val_t;
+
+static uint64_t
+mono_ns(void)
+{
+	struct timespec ts;
+	VERIFY(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+	return (ts.tv_sec * 1000000000llu + ts.tv_nsec);
+}
+
+static void *
+test_arpt_validate_worker(void *arg)
+{
+	arpt_val_t *val = arg;
+
+	for (;;) {
+		size_t		i = __atomic_fetch_add(&val->next, 1,
+		    __ATOMIC_RELAXED);
+		arpt_val_res_t	*res;
+		airport_t	*arpt;
+		uint64_t	t_start;
+
+		if (i >= val->num_arpts)
+			break;
+		res = &val->res[i];
+		res->ent = &val->idx[i];
+		t_start = mono_ns();
+		arpt = airport_open_at(res->ent->icao, val->navdata_dir,
+		    res->ent->offset, val->wptdb, val->navdb);
+		if (arpt != NULL) {
+			res->ok = B_TRUE;
+			res->num_rwys = arpt->num_rwys;
+			res->num_procs = arpt->num_procs;
+			for (unsigned j = 0; j < arpt->num_procs; j++)
+				res->num_segs += arpt->procs[j].num_segs;
+			res->num_bad_procs = arpt->num_bad_procs;
+			res->num_unres_fixes = arpt->num_unres_fixes;
+			airport_close(arpt);
+		}
+		res->t_ns = mono_ns() - t_start;
+	}
+
+	return (NULL);
+}
+
+static int
+arpt_val_res_time_cmp(const void *a, const void *b)
+{
+	const arpt_val_res_t *ra = a, *rb = b;
+
+	if (ra->t_ns > rb->t_ns)
+		return (-1);
+	if (ra->t_ns < rb->t_ns)
+		return (1);
+	return (0);
+}
+
+/*
+ * Validates the whole navdata airport & procedure database: every airport
+ * in Airports.txt is opened, together with all of its procedures, on a
+ * pool of `num_threads' workers (0 means one per online CPU). Airports are
+ * located through an index built once up front, so each worker only parses
+ * the airport it's working on. Reports airports which failed to open,
+ * procedures which failed to parse, unresolved waypoint/navaid references,
+ * the slowest airports and overall throughput. With `verbose', timings
+ * are printed for every airport.
+ *
+ * Exits with EXIT_FAILURE if any airport or procedure failed to parse or
+ * referenced a waypoint/navaid missing from the database.
+ */
+void
+test_arpt_validate(const char *navdata_dir, unsigned num_threads,
+    bool_t verbose)
+{
+	arpt_val_t	val;
+	pthread_t	*thr;
+	waypoint_db_t	*wptdb;
+	navaid_db_t	*navdb;
+	uint64_t	t_start, t_idx, t_end;
+	size_t		n_fail = 0;
+	unsigned long	n_procs = 0, n_segs = 0, n_bad = 0, n_unres = 0;
+	double		secs;
+
+	if (num_threads == 0)
+		num_threads = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+	navdb = navaid_db_open(navdata_dir);
+	wptdb = waypoint_db_open(navdata_dir);
+	if (navdb == NULL || wptdb == NULL)
+		exit(EXIT_FAILURE);
+
+	memset(&val, 0, sizeof (val));
+	val.navdata_dir = navdata_dir;
+	val.wptdb = wptdb;
+	val.navdb = navdb;
+
+	t_start = mono_ns();
+	val.idx = airport_index(navdata_dir, &val.num_arpts);
+	if (val.idx == NULL)
+		exit(EXIT_FAILURE);
+	val.res = calloc(sizeof (*val.res), MAX(val.num_arpts, 1));
+	t_idx = mono_ns();
+
+	thr = calloc(sizeof (*thr), num_threads);
+	for (unsigned i = 0; i < num_threads; i++) {
+		VERIFY(pthread_create(&thr[i], NULL, test_arpt_validate_worker,
+		    &val) == 0);
+	}
+	for (unsigned i = 0; i < num_threads; i++)
+		VERIFY(pthread_join(thr[i], NULL) == 0);
+	t_end = mono_ns();
+
+	for (size_t i = 0; i < val.num_arpts; i++) {
+		const arpt_val_res_t *res = &val.res[i];
+
+		if (verbose) {
+			printf("%-4s %s rwys:%3u procs:%4u segs:%5u bad:%3u "
+			    "unres:%3u %8.3f ms\n", res->ent->icao,
+			    res->ok ? "OK  " : "FAIL", res->num_rwys,
+			    res->num_procs, res->num_segs, res->num_bad_procs,
+			    res->num_unres_fixes, res->t_ns / 1000000.0);
+		} else if (!res->ok) {
+			printf("%-4s FAIL\n", res->ent->icao);
+		} else {
+			if (res->num_bad_procs != 0) {
+				printf("%-4s %u bad procedure(s)\n",
+				    res->ent->icao, res->num_bad_procs);
+			}
+			if (res->num_unres_fixes != 0) {
+				printf("%-4s %u unresolved wpt/navaid(s)\n",
+				    res->ent->icao, res->num_unres_fixes);
+			}
+		}
+		if (!res->ok)
+			n_fail++;
+		n_procs += res->num_procs;
+		n_segs += res->num_segs;
+		n_bad += res->num_bad_procs;
+		n_unres += res->num_unres_fixes;
+	}
+
+	qsort(val.res, val.num_arpts, sizeof (*val.res),
+	    arpt_val_res_time_cmp);
+	printf("Slowest airports:\n");
+	for (size_t i = 0; i < MIN(val.num_arpts, VALIDATE_SLOWEST); i++) {
+		printf("  %-4s %8.3f ms (%u procs, %u segs)\n",
+		    val.res[i].ent->icao, val.res[i].t_ns / 1000000.0,
+		    val.res[i].num_procs, val.res[i].num_segs);
+	}
+
+	secs = (t_end - t_idx) / 1000000000.0;
+	printf("Airports:     %lu (%lu failed)\n"
+	    "Procedures:   %lu (+ %lu failed to parse)\n"
+	    "Segments:     %lu\n"
+	    "Unresolved:   %lu wpt/navaid reference(s)\n"
+	    "Threads:      %u\n"
+	    "Index time:   %.3f s\n"
+	    "Parse time:   %.3f s\n"
+	    "Throughput:   %.0f airports/s, %.0f segments/s\n",
+	    (unsigned long)val.num_arpts, (unsigned long)n_fail, n_procs,
+	    n_bad, n_segs, n_unres, num_threads,
+	    (t_idx - t_start) / 1000000000.0, secs,
+	    val.num_arpts / MAX(secs, 1e-9), n_segs / MAX(secs, 1e-9));
+
+	free(thr);
+	free(val.res);
+	free((void *)val.idx);
+	waypoint_db_close(wptdb);
+	navaid_db_close(navdb);
+
+	if (n_fail != 0 || n_bad != 0 || n_unres != 0)
+		exit(EXIT_FAILURE);
+}
+
 void
 test_airac(const char *navdata_dir, const char *dump)
 {
@@ -197,6 +401,697 @@ test_airac(const char *navdata_dir, const char *dump)
 	navaid_db_close(navdb);
 }
 
+#define	NUMPARSE_RWY_DIR	"/tmp/test_numparse"
+
+/*
+ * Runway lines of airports ZZZA-ZZZD. Runways without an ILS may leave the
+ * LOC frequency & GP angle empty, which reads as 0. Junk in either field
+ * rejects the airport.
+ */
+static const struct {
+	const char	*icao;
+	const char	*rwy_line;
+	bool_t		ok;
+	unsigned	loc_freq;
+	double		gp_angle;
+} numparse_rwys[] = {
+    { "ZZZA", "R,09,90,10000,150,0,,0,48.000000,11.000000,1000,,50,1,0",
+	B_TRUE, 0, 0 },
+    { "ZZZB", "R,09,90,10000,150,1,108.300,90,48.000000,11.000000,1000,"
+	"3.00,50,1,0", B_TRUE, 108300000, 3 },
+    { "ZZZC", "R,09,90,10000,150,1,108.300,90,48.000000,11.000000,1000,"
+	"3.O0,50,1,0", B_FALSE, 0, 0 },
+    { "ZZZD", "R,09,90,10000,150,0,1O8.3,0,48.000000,11.000000,1000,,"
+	"50,1,0", B_FALSE, 0, 0 },
+    { NULL, NULL, B_FALSE, 0, 0 }
+};
+
+/*
+ * Opens the airports of numparse_rwys from a scratch navdata directory and
+ * checks how their runway lines parsed.
+ *
+ * @return The number of airports which didn't parse as expected.
+ */
+static unsigned long
+test_numparse_rwys(void)
+{
+	FILE		*fp;
+	unsigned long	n_fail = 0;
+
+	(void) mkdir(NUMPARSE_RWY_DIR, 0755);
+	fp = fopen(NUMPARSE_RWY_DIR PATHSEP "Airports.txt", "w");
+	VERIFY(fp != NULL);
+	for (int i = 0; numparse_rwys[i].icao != NULL; i++) {
+		fprintf(fp, "A,%s,TEST,48.000000,11.000000,1000,5000,0,"
+		    "10000,0\n%s\n\n", numparse_rwys[i].icao,
+		    numparse_rwys[i].rwy_line);
+	}
+	fclose(fp);
+
+	for (int i = 0; numparse_rwys[i].icao != NULL; i++) {
+		airport_t *arpt = airport_open(numparse_rwys[i].icao,
+		    NUMPARSE_RWY_DIR, NULL, NULL);
+
+		if ((arpt != NULL) != numparse_rwys[i].ok ||
+		    (arpt != NULL && (arpt->rwys[0].loc_freq !=
+		    numparse_rwys[i].loc_freq ||
+		    arpt->rwys[0].gp_angle != numparse_rwys[i].gp_angle))) {
+			fprintf(stderr, "runway line \"%s\" misparsed\n",
+			    numparse_rwys[i].rwy_line);
+			n_fail++;
+		}
+		if (arpt != NULL)
+			airport_close(arpt);
+	}
+	(void) unlink(NUMPARSE_RWY_DIR PATHSEP "Airports.txt");
+	(void) rmdir(NUMPARSE_RWY_DIR);
+
+	return (n_fail);
+}
+
+/*
+ * Cross-checks parse_dec against strtod (in the "C" locale) on every
+ * decimal field of the navdata files. Both are correctly rounded, so the
+ * results must compare exactly equal. Also checks the handling of empty
+ * and malformed runway fields, see numparse_rwys.
+ */
+void
+test_numparse(const char *navdata_dir)
+{
+	static const char	*fnames[] = {
+	    "Waypoints.txt", "Navaids.txt", "ATS.txt", "Airports.txt", NULL
+	};
+	locale_t		loc;
+	unsigned long		n_fields = 0, n_fail = 0, n_mismatch = 0;
+
+	loc = newlocale(LC_NUMERIC_MASK, "C", NULL);
+	VERIFY(loc != NULL);
+
+	for (int i = 0; fnames[i] != NULL; i++) {
+		char	*fname, *line = NULL;
+		size_t	linecap = 0, linenum = 0;
+		FILE	*fp;
+
+		fname = malloc(strlen(navdata_dir) + 1 +
+		    strlen(fnames[i]) + 1);
+		sprintf(fname, "%s" PATHSEP "%s", navdata_dir, fnames[i]);
+		fp = fopen(fname, "r");
+		if (fp == NULL) {
+			fprintf(stderr, "Can't open %s: %s\n", fname,
+			    strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		while (parser_get_next_line(fp, &line, &linecap,
+		    &linenum) != -1) {
+			char	*comps[32];
+			ssize_t	n = explode_line(line, ',', comps, 32);
+
+			if (n < 0)
+				n = -n;
+			n = MIN(n, 32);
+			for (ssize_t j = 0; j < n; j++) {
+				char	*end;
+				double	v1, v2;
+
+				if (strchr(comps[j], '.') == NULL)
+					continue;
+				v1 = strtod_l(comps[j], &end, loc);
+				if (end == comps[j] || *end != 0)
+					continue;
+				n_fields++;
+				if (!parse_dec(comps[j], &v2)) {
+					fprintf(stderr, "%s:%lu: failed to "
+					    "parse \"%s\"\n", fname,
+					    (unsigned long)linenum, comps[j]);
+					n_fail++;
+					continue;
+				}
+				if (v1 != v2) {
+					fprintf(stderr, "%s:%lu: \"%s\" "
+					    "mismatch: strtod = %.17g, "
+					    "parse_dec = %.17g\n",
+					    fname, (unsigned long)linenum,
+					    comps[j], v1, v2);
+					n_mismatch++;
+				}
+			}
+		}
+		free(line);
+		fclose(fp);
+		free(fname);
+	}
+	freelocale(loc);
+	n_fail += test_numparse_rwys();
+
+	printf("fields: %lu  failed: %lu  mismatched: %lu\n", n_fields,
+	    n_fail, n_mismatch);
+	if (n_fail != 0 || n_mismatch != 0)
+		exit(EXIT_FAILURE);
+}
+
+#define	SWAP_RDRS	8
+#define	SWAP_CYCLES	10
+
+typedef struct {
+	fms_navdb_hnd_t	*hnd;
+	volatile bool_t	*stop;
+	unsigned long	n_lookups;
+} swap_rdr_arg_t;
+
+static void *
+test_navdb_swap_rdr(void *arg)
+{
+	swap_rdr_arg_t	*ra = arg;
+	fms_navdb_rdr_t	*rdr = fms_navdb_rdr_register(ra->hnd);
+
+	while (!*ra->stop) {
+		const fms_navdb_t *navdb = fms_navdb_rdr_enter(rdr);
+		/* touch the DB to catch any use-after-free */
+		VERIFY(htbl_count(&navdb->wptdb->by_name) != 0);
+		VERIFY(htbl_count(&navdb->navaiddb->by_id) != 0);
+		fms_navdb_rdr_exit(rdr);
+		ra->n_lookups++;
+	}
+	fms_navdb_rdr_unregister(rdr);
+
+	return (NULL);
+}
+
+/*
+ * Repeatedly swaps the navdb under a handle while reader threads keep
+ * pinning it. Meant to be run under valgrind or ASan. The second navdata
+ * directory may be the same as the first.
+ */
+void
+test_navdb_swap(const char *navdata_dir1, const char *navdata_dir2)
+{
+	fms_navdb_hnd_t	*hnd;
+	pthread_t	thr[SWAP_RDRS];
+	swap_rdr_arg_t	args[SWAP_RDRS];
+	volatile bool_t	stop = B_FALSE;
+	unsigned long	n_lookups = 0;
+
+	hnd = fms_navdb_hnd_open(navdata_dir1, "doc/WMM.COF");
+	if (hnd == NULL)
+		exit(EXIT_FAILURE);
+	for (int i = 0; i < SWAP_RDRS; i++) {
+		args[i] = (swap_rdr_arg_t){ .hnd = hnd, .stop = &stop };
+		VERIFY(pthread_create(&thr[i], NULL, test_navdb_swap_rdr,
+		    &args[i]) == 0);
+	}
+	for (int i = 0; i < SWAP_CYCLES; i++) {
+		VERIFY(fms_navdb_hnd_swap(hnd, (i & 1) ? navdata_dir1 :
+		    navdata_dir2, B_TRUE));
+		printf("swap %d done\n", i);
+	}
+	stop = B_TRUE;
+	for (int i = 0; i < SWAP_RDRS; i++) {
+		VERIFY(pthread_join(thr[i], NULL) == 0);
+		n_lookups += args[i].n_lookups;
+	}
+	fms_navdb_hnd_close(hnd);
+	printf("%d swaps, %lu read sections\n", SWAP_CYCLES, n_lookups);
+}
+
+#define	DECODE_BENCH_ITER	100000
+
+/*
+ * Checks fms_wpt_name_decode on every entry format and benchmarks its
+ * latency per format. The built-in samples cover the formats which don't
+ * depend on the navdb; pass waypoint, navaid, airport, radial/DME and
+ * radial intersection names valid in the navdb in `names' to benchmark
+ * those too.
+ */
+void
+test_wpt_decode(const char *navdata_dir, const char **names,
+    size_t num_names)
+{
+	static const struct {
+		const char	*fmt;
+		const char	*name;
+		size_t		num;
+		double		lat, lon;
+	} samples[] = {
+		{ "geo 5010N",		"5010N",		1, 50, -10 },
+		{ "geo 50N10",		"50N10",		1, 50, -110 },
+		{ "geo 5010E",		"5010E",		1, 50, 10 },
+		{ "geo 50E10",		"50E10",		1, 50, 110 },
+		{ "geo 5010W",		"5010W",		1, -50, -10 },
+		{ "geo 50W10",		"50W10",		1, -50, -110 },
+		{ "geo 5010S",		"5010S",		1, -50, 10 },
+		{ "geo 50S10",		"50S10",		1, -50, 110 },
+		{ "geo long",		"N47W008",		1, 47, -8 },
+		{ "geo long",		"S47E108",		1, -47, 108 },
+		{ "geo detailed",	"N4715.4W00803.4",	1,
+		    47 + 15.4 / 60, -8 - 3.4 / 60 },
+		{ "geo detailed",	"S0030.0E17959.9",	1,
+		    -0.5, 179 + 59.9 / 60 },
+		{ "geo report",		"W060-10",		0, 0, 0 },
+		{ "along track",	"VAMPS/25",		0, 0, 0 },
+		{ "along track",	"ELN/-30",		0, 0, 0 },
+		{ "invalid",		"N47X008",		0, 0, 0 },
+		{ "invalid",		"TOOLONGNAME",		0, 0, 0 },
+		{ "invalid",		"alpha",		0, 0, 0 },
+		{ "invalid",		"",			0, 0, 0 }
+	};
+	const size_t	num_samples = sizeof (samples) / sizeof (samples[0]);
+	fms_t		*fms;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+
+	printf("%-16s %-16s %7s %10s\n", "format", "name", "results",
+	    "ns/decode");
+	for (size_t i = 0; i < num_samples + num_names; i++) {
+		const char	*fmt, *name;
+		size_t		num;
+		bool_t		is_seq;
+		wpt_t		*wpts;
+		uint64_t	t_start;
+
+		if (i < num_samples) {
+			fmt = samples[i].fmt;
+			name = samples[i].name;
+		} else {
+			fmt = "navdb";
+			name = names[i - num_samples];
+		}
+		wpts = fms_wpt_name_decode(name, fms, &num, &is_seq);
+		if (i < num_samples) {
+			VERIFY(num == samples[i].num);
+			VERIFY(num == 0 || (fabs(wpts[0].pos.lat -
+			    samples[i].lat) < 1e-9 && fabs(wpts[0].pos.lon -
+			    samples[i].lon) < 1e-9));
+		}
+		free(wpts);
+
+		t_start = mono_ns();
+		for (int j = 0; j < DECODE_BENCH_ITER; j++) {
+			wpts = fms_wpt_name_decode(name, fms, &num, &is_seq);
+			free(wpts);
+		}
+		printf("%-16s %-16s %7lu %10.1f\n", fmt, name,
+		    (unsigned long)num, (mono_ns() - t_start) /
+		    (double)DECODE_BENCH_ITER);
+	}
+
+	fms_destroy(fms);
+}
+
+#define	NEAREST_BENCH_ITER	10000
+
+static vect3_t test_wpt_nearest_ref_v;
+
+/*
+ * Spherical chord distance of `wpt' from the reference position, which
+ * ranks the same as the great circle distance on the spherical model.
+ */
+static double
+test_wpt_nearest_dist(const wpt_t *wpt)
+{
+	return (vect3_abs(vect3_sub(test_wpt_nearest_ref_v,
+	    sph2ecef(GEO2_TO_GEO3(wpt->pos, 0)))));
+}
+
+static int
+test_wpt_nearest_compar(const void *a, const void *b)
+{
+	double da = test_wpt_nearest_dist(a);
+	double db = test_wpt_nearest_dist(b);
+
+	return (da < db ? -1 : (da > db ? 1 : 0));
+}
+
+#define	NEAREST_ELEV_DIR	"/tmp/test_wpt_nearest"
+
+/*
+ * Checks that ranking by distance ignores elevation, both in
+ * fms_lookup_wpt_nearest and in FPL ingestion's ambiguity resolution. Of
+ * two fixes named ZZZ, a navaid at 30000 ft and a waypoint at sea level
+ * 0.1 NM south of it, the one laterally closer must win.
+ */
+static void
+test_wpt_nearest_elev(void)
+{
+	static const char *files[][2] = {
+	    { "Airports.txt", "X,1601,07JAN04FEB/16,x,y\n" },
+	    { "Waypoints.txt", "ZZZ,0.000000,0.000000,ZZ\n" },
+	    { "Navaids.txt", "ZZZ,ZULU VOR,116.800,1,1,195,0.001667,"
+		"0.000000,30000,ZZ,0\n" },
+	    { "ATS.txt", "A,Z1,1\nS,ZZZ,0.000000,0.000000,ZZY,1.000000,"
+		"0.000000,0,0,60.00\n" },
+	    { NULL, NULL }
+	};
+	wpt_t			nearest[2];
+	fms_t			*fms;
+	route_t			*route;
+	const route_leg_group_t	*rlg;
+
+	(void) mkdir(NEAREST_ELEV_DIR, 0755);
+	for (int i = 0; files[i][0] != NULL; i++) {
+		char	fname[64];
+		FILE	*fp;
+
+		snprintf(fname, sizeof (fname), "%s" PATHSEP "%s",
+		    NEAREST_ELEV_DIR, files[i][0]);
+		fp = fopen(fname, "w");
+		VERIFY(fp != NULL);
+		fputs(files[i][1], fp);
+		fclose(fp);
+	}
+	fms = fms_new(NEAREST_ELEV_DIR, "doc/WMM.COF",
+	    "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	VERIFY(fms_lookup_wpt_nearest("ZZZ", fms, GEO_POS2(0, 0), 2,
+	    nearest) == 2);
+	VERIFY(nearest[0].pos.lat == 0 && nearest[1].pos.lat != 0);
+
+	route = route_create(fms->navdb);
+	VERIFY(route_fpl_ingest(route, "0001N00000E ZZZ", NULL) == ERR_OK);
+	rlg = list_tail(route_get_leg_groups(route));
+	VERIFY(rlg != NULL && rlg->end_wpt.pos.lat != 0);
+	route_destroy(route);
+	fms_destroy(fms);
+
+	for (int i = 0; files[i][0] != NULL; i++) {
+		char fname[64];
+
+		snprintf(fname, sizeof (fname), "%s" PATHSEP "%s",
+		    NEAREST_ELEV_DIR, files[i][0]);
+		(void) unlink(fname);
+	}
+	(void) rmdir(NEAREST_ELEV_DIR);
+}
+
+/*
+ * Tests fms_lookup_wpt_nearest against a brute-force ranking of all
+ * matches returned by fms_wpt_name_decode and benchmarks the two. `name'
+ * should be an ident valid in the navdb, ideally one with many
+ * duplicates.
+ */
+void
+test_wpt_nearest(const char *navdata_dir, const char *name, double lat,
+    double lon)
+{
+	geo_pos2_t	ref = GEO_POS2(lat, lon);
+	wpt_t		nearest[FMS_WPT_NEAREST_MAX];
+	wpt_t		*all;
+	size_t		num_all, num;
+	bool_t		is_seq;
+	fms_t		*fms;
+	uint64_t	t_start;
+
+	test_wpt_nearest_elev();
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+
+	all = fms_wpt_name_decode(name, fms, &num_all, &is_seq);
+	VERIFY(all != NULL && !is_seq);
+	test_wpt_nearest_ref_v = sph2ecef(GEO2_TO_GEO3(ref, 0));
+	qsort(all, num_all, sizeof (*all), test_wpt_nearest_compar);
+
+	for (size_t k = 0; k <= FMS_WPT_NEAREST_MAX; k++) {
+		num = fms_lookup_wpt_nearest(name, fms, ref, k, nearest);
+		VERIFY(num == MIN(k, num_all));
+		for (size_t i = 0; i < num; i++) {
+			/* compare distances, equidistant matches may swap */
+			VERIFY(test_wpt_nearest_dist(&nearest[i]) ==
+			    test_wpt_nearest_dist(&all[i]));
+		}
+	}
+	printf("%s: %lu matches, nearest %s (%.6lf x %.6lf) %.1lf nm away\n",
+	    name, (unsigned long)num_all, nearest[0].name, nearest[0].pos.lat,
+	    nearest[0].pos.lon, MET2NM(gc_distance(ref, nearest[0].pos)));
+	free(all);
+
+	t_start = mono_ns();
+	for (int i = 0; i < NEAREST_BENCH_ITER; i++) {
+		all = fms_wpt_name_decode(name, fms, &num_all, &is_seq);
+		free(all);
+	}
+	printf("fms_wpt_name_decode:       %10.1f ns/lookup\n",
+	    (mono_ns() - t_start) / (double)NEAREST_BENCH_ITER);
+	for (size_t k = 1; k <= FMS_WPT_NEAREST_MAX; k *= 2) {
+		t_start = mono_ns();
+		for (int i = 0; i < NEAREST_BENCH_ITER; i++)
+			(void) fms_lookup_wpt_nearest(name, fms, ref, k,
+			    nearest);
+		printf("fms_lookup_wpt_nearest k=%-2lu %9.1f ns/lookup\n",
+		    (unsigned long)k, (mono_ns() - t_start) /
+		    (double)NEAREST_BENCH_ITER);
+	}
+
+	fms_destroy(fms);
+}
+
+#define	SHARE_THREADS	8
+#define	SHARE_FMS	256	/* total FMS instances across all threads */
+#define	SHARE_ROUNDS	20
+
+typedef struct {
+	size_t		num;
+	geo_pos2_t	*pos;
+} share_ref_t;
+
+typedef struct {
+	fms_navdb_t		*navdb;
+	const char		**names;
+	size_t			num_names;
+	const share_ref_t	*refs;
+	unsigned long		n_lookups;
+} share_thr_arg_t;
+
+/*
+ * Decodes a waypoint name and returns the positions of all results. The
+ * names of the results depend on the FMS's waypoint sequence number, so
+ * only the positions are compared between FMS instances.
+ */
+static share_ref_t
+test_navdb_share_decode(fms_t *fms, const char *name)
+{
+	share_ref_t	ref;
+	bool_t		is_wpt_seq;
+	wpt_t		*wpts = fms_wpt_name_decode(name, fms, &ref.num,
+	    &is_wpt_seq);
+
+	ref.pos = calloc(sizeof (*ref.pos), MAX(ref.num, 1));
+	for (size_t i = 0; i < ref.num; i++)
+		ref.pos[i] = wpts[i].pos;
+	free(wpts);
+
+	return (ref);
+}
+
+static void *
+test_navdb_share_thr(void *arg)
+{
+	share_thr_arg_t	*ta = arg;
+	fms_t		*fms[SHARE_FMS / SHARE_THREADS];
+
+	for (int i = 0; i < SHARE_FMS / SHARE_THREADS; i++) {
+		fms[i] = fms_new_navdb(ta->navdb, "doc/perf_sample.csv");
+		VERIFY(fms[i] != NULL);
+	}
+	for (int r = 0; r < SHARE_ROUNDS; r++) {
+		for (int i = 0; i < SHARE_FMS / SHARE_THREADS; i++) {
+			for (size_t j = 0; j < ta->num_names; j++) {
+				share_ref_t res = test_navdb_share_decode(
+				    fms[i], ta->names[j]);
+
+				VERIFY(res.num == ta->refs[j].num);
+				VERIFY(memcmp(res.pos, ta->refs[j].pos,
+				    res.num * sizeof (*res.pos)) == 0);
+				free(res.pos);
+				ta->n_lookups++;
+			}
+		}
+	}
+	for (int i = 0; i < SHARE_FMS / SHARE_THREADS; i++)
+		fms_destroy(fms[i]);
+
+	return (NULL);
+}
+
+/*
+ * Creates SHARE_FMS FMS instances on top of a single navdb and hammers it
+ * with waypoint lookups from SHARE_THREADS threads. Every lookup must
+ * return exactly what a single-threaded lookup returned and the navdb
+ * must end up with only our own reference. Meant to be run under
+ * ThreadSanitizer or helgrind. `names' are the waypoint names to look up
+ * (anything accepted by fms_wpt_name_decode).
+ */
+void
+test_navdb_share(const char *navdata_dir, const char **names,
+    size_t num_names)
+{
+	fms_navdb_t	*navdb;
+	fms_t		*fms;
+	share_ref_t	*refs;
+	pthread_t	thr[SHARE_THREADS];
+	share_thr_arg_t	args[SHARE_THREADS];
+	unsigned long	n_lookups = 0;
+
+	navdb = fms_navdb_open(navdata_dir, "doc/WMM.COF");
+	VERIFY(navdb != NULL);
+
+	refs = calloc(sizeof (*refs), MAX(num_names, 1));
+	fms = fms_new_navdb(navdb, "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	for (size_t i = 0; i < num_names; i++) {
+		refs[i] = test_navdb_share_decode(fms, names[i]);
+		printf("%-16s %lu result(s)\n", names[i], refs[i].num);
+	}
+	fms_destroy(fms);
+
+	for (int i = 0; i < SHARE_THREADS; i++) {
+		args[i] = (share_thr_arg_t){ .navdb = navdb, .names = names,
+		    .num_names = num_names, .refs = refs };
+		VERIFY(pthread_create(&thr[i], NULL, test_navdb_share_thr,
+		    &args[i]) == 0);
+	}
+	for (int i = 0; i < SHARE_THREADS; i++) {
+		VERIFY(pthread_join(thr[i], NULL) == 0);
+		n_lookups += args[i].n_lookups;
+	}
+	VERIFY(navdb->refcnt == 1);
+	fms_navdb_close(navdb);
+
+	for (size_t i = 0; i < num_names; i++)
+		free(refs[i].pos);
+	free(refs);
+	printf("%d FMS instances, %lu lookups OK\n", SHARE_FMS, n_lookups);
+}
+
+static void
+test_airac_delta_wpt(const void *key, void *value, void *arg)
+{
+	const waypoint_db_t *db = arg;
+	const list_t *l = htbl_lookup_multi(&db->by_name, key);
+
+	for (const void *mv = (l != NULL ? list_head(l) : NULL); mv != NULL;
+	    mv = list_next(l, mv)) {
+		if (memcmp(HTBL_VALUE_MULTI(mv), value, sizeof (wpt_t)) == 0)
+			return;
+	}
+	printf("waypoint %s missing after delta\n", (const char *)key);
+	abort();
+}
+
+static void
+test_airac_delta_navaid(const void *key, void *value, void *arg)
+{
+	const navaid_db_t *db = arg;
+	const list_t *l = htbl_lookup_multi(&db->by_id, key);
+
+	for (const void *mv = (l != NULL ? list_head(l) : NULL); mv != NULL;
+	    mv = list_next(l, mv)) {
+		if (memcmp(HTBL_VALUE_MULTI(mv), value,
+		    sizeof (navaid_t)) == 0)
+			return;
+	}
+	printf("navaid %s missing after delta\n", (const char *)key);
+	abort();
+}
+
+static void
+test_airac_delta_awy(const void *key, void *value, void *arg)
+{
+	const airway_db_t *db = arg;
+	const airway_t *awy = value;
+	const list_t *l = htbl_lookup_multi(&db->by_awy_name, key);
+
+	for (const void *mv = (l != NULL ? list_head(l) : NULL); mv != NULL;
+	    mv = list_next(l, mv)) {
+		const airway_t *awy2 = HTBL_VALUE_MULTI(mv);
+		if (awy2->num_segs == awy->num_segs &&
+		    memcmp(awy2->segs, awy->segs,
+		    awy->num_segs * sizeof (*awy->segs)) == 0)
+			return;
+	}
+	printf("airway %s missing after delta\n", (const char *)key);
+	abort();
+}
+
+/*
+ * Computes the delta between two navdata cycles, round-trips it through a
+ * delta file and applies it to the navdb of the old cycle. The result must
+ * match the navdb of the new cycle. If `scratch_dir' is given, it must be
+ * a copy of `old_dir', to which the delta is applied on disk. Diffing it
+ * against `new_dir' afterwards must then yield an empty delta.
+ */
+void
+test_airac_delta(const char *old_dir, const char *new_dir,
+    const char *scratch_dir)
+{
+	airac_delta_t	*delta, *delta2;
+	fms_navdb_t	*old_db, *new_db;
+	char		*dump;
+	FILE		*fp;
+
+	delta = airac_delta_diff(old_dir, new_dir);
+	VERIFY(delta != NULL);
+	dump = airac_delta_dump(delta);
+	fputs(dump, stdout);
+	free(dump);
+
+	VERIFY(airac_delta_write(delta, "airac_delta.txt"));
+	delta2 = airac_delta_read("airac_delta.txt");
+	VERIFY(delta2 != NULL);
+	VERIFY(list_count(&delta2->recs) == list_count(&delta->recs));
+	VERIFY(strcmp(delta2->x_line, delta->x_line) == 0);
+	for (airac_delta_rec_t *r1 = list_head(&delta->recs),
+	    *r2 = list_head(&delta2->recs); r1 != NULL;
+	    r1 = list_next(&delta->recs, r1),
+	    r2 = list_next(&delta2->recs, r2)) {
+		VERIFY(r1->type == r2->type && r1->add == r2->add);
+		VERIFY(strcmp(r1->name, r2->name) == 0);
+		VERIFY((r1->text == NULL && r2->text == NULL) ||
+		    strcmp(r1->text, r2->text) == 0);
+	}
+	airac_delta_free(delta);
+
+	/* a procedure record cut short must fail the read */
+	fp = fopen("airac_delta.txt", "w");
+	VERIFY(fp != NULL);
+	fprintf(fp, "%s\n+P,3,ZZZZ\nSID,A1,ALL,1\n\n", delta2->x_line);
+	fclose(fp);
+	VERIFY(airac_delta_read("airac_delta.txt") == NULL);
+	(void) unlink("airac_delta.txt");
+
+	old_db = fms_navdb_open(old_dir, "doc/WMM.COF");
+	new_db = fms_navdb_open(new_dir, "doc/WMM.COF");
+	VERIFY(old_db != NULL && new_db != NULL);
+	VERIFY(fms_navdb_apply_delta(old_db, delta2, new_dir));
+	VERIFY(old_db->airac_cycle == new_db->airac_cycle);
+	VERIFY(htbl_count(&old_db->wptdb->by_name) ==
+	    htbl_count(&new_db->wptdb->by_name));
+	VERIFY(htbl_count(&old_db->navaiddb->by_id) ==
+	    htbl_count(&new_db->navaiddb->by_id));
+	VERIFY(htbl_count(&old_db->awydb->by_awy_name) ==
+	    htbl_count(&new_db->awydb->by_awy_name));
+	htbl_foreach(&new_db->wptdb->by_name, test_airac_delta_wpt,
+	    old_db->wptdb);
+	htbl_foreach(&new_db->navaiddb->by_id, test_airac_delta_navaid,
+	    old_db->navaiddb);
+	htbl_foreach(&new_db->awydb->by_awy_name, test_airac_delta_awy,
+	    old_db->awydb);
+	fms_navdb_close(old_db);
+	fms_navdb_close(new_db);
+	printf("in-memory delta application OK\n");
+
+	if (scratch_dir != NULL) {
+		VERIFY(airac_delta_apply_dir(delta2, scratch_dir));
+		delta = airac_delta_diff(scratch_dir, new_dir);
+		VERIFY(delta != NULL);
+		VERIFY(list_count(&delta->recs) == 0);
+		VERIFY(strcmp(delta->x_line, delta2->x_line) == 0);
+		airac_delta_free(delta);
+		printf("on-disk delta application OK\n");
+	}
+	airac_delta_free(delta2);
+}
+
 vect2_t
 test_fpp_xy(double lat, double lon, const fpp_t *fpp, double scale)
 {
@@ -556,7 +1451,8 @@ dump_route_legs(const route_t *route)
 		for (const route_leg_t *rl = list_head(&rlg->legs); rl;
 		    rl = list_next(&rlg->legs, rl)) {
 			if (!rl->disco) {
-				char *desc = navproc_seg_get_descr(&rl->seg);
+				char *desc =
+				    navproc_seg_get_descr(&rl->data->seg);
 				printf("%3d%s", i, desc);
 				free(desc);
 			} else {
@@ -570,31 +1466,17 @@ dump_route_legs(const route_t *route)
 const route_leg_group_t *
 find_rlg(route_t *route, int idx)
 {
-	const list_t *leg_groups = route_get_leg_groups(route);
-	int i = 0;
-	const route_leg_group_t *res = NULL;
-
 	if (idx < 0)
 		return (NULL);
-	for (res = list_head(leg_groups), i = 0; res && i < idx;
-	    res = list_next(leg_groups, res), i++)
-		;
-	return (res);
+	return (route_get_leg_group(route, idx));
 }
 
 const route_leg_t *
 find_rl(route_t *route, int idx)
 {
-	const list_t *legs = route_get_legs(route);
-	int i = 0;
-	const route_leg_t *res = NULL;
-
 	if (idx < 0)
 		return (NULL);
-	for (res = list_head(legs), i = 0; res && i < idx;
-	    res = list_next(legs, res), i++)
-		;
-	return (res);
+	return (route_get_leg(route, idx));
 }
 
 wpt_t
@@ -630,199 +1512,2028 @@ find_fix(const char *fix_name, fms_t *fms)
 	}
 	free(fixes);
 
-	return (fix);
+	return (fix);
+}
+
+/*
+ * Creates a route from `dep' to `arr' (either "-" for none) and ingests
+ * the ICAO FPL Item 15 string `item15' into it, unless that is NULL.
+ */
+static route_t *
+build_route(const fms_t *fms, const char *dep, const char *arr,
+    const char *item15)
+{
+	route_t *route = route_create(fms->navdb);
+
+	if (strcmp(dep, "-") != 0)
+		VERIFY(route_set_dep_arpt(route, dep) == ERR_OK);
+	if (strcmp(arr, "-") != 0)
+		VERIFY(route_set_arr_arpt(route, arr) == ERR_OK);
+	if (item15 != NULL)
+		VERIFY(route_fpl_ingest(route, item15, NULL) == ERR_OK);
+
+	return (route);
+}
+
+static void
+strtoupper(char *str)
+{
+	while (*str) {
+		*str = toupper(*str);
+		str++;
+	}
+}
+
+void
+test_route(char *navdata_dir)
+{
+	char			cmd[64];
+	route_t			*route = NULL;
+	fms_t			*fms;
+	fms_navdb_t		*navdb;
+	const acft_perf_t	*acft;
+	flt_perf_t		*flt;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	if (!fms)
+		exit(EXIT_FAILURE);
+	navdb = fms->navdb;
+	acft = fms_acft_perf(fms);
+	flt = fms_flt_perf(fms);
+
+	route = route_create(navdb);
+
+	while (!feof(stdin)) {
+		err_t err = ERR_OK;
+		route_leg_t *err_rl = NULL;
+
+		if (scanf("%63s", cmd) != 1)
+			continue;
+		strtolower(cmd);
+		if (strcmp(cmd, "exit") == 0) {
+			break;
+		}
+#define	SET_RTE_PARAM_CMD(cmdname, func) \
+	do { \
+		if (strcmp(cmd, cmdname) == 0) { \
+			char	param[8]; \
+			if (scanf("%7s", param) != 1) \
+				continue; \
+			strtoupper(param); \
+			if (strcmp(param, "NULL") == 0) \
+				err = func(route, NULL); \
+			else \
+				err = func(route, param); \
+		} \
+	} while (0)
+		SET_RTE_PARAM_CMD("origin", route_set_dep_arpt);
+		SET_RTE_PARAM_CMD("dest", route_set_arr_arpt);
+		SET_RTE_PARAM_CMD("altn1", route_set_altn1_arpt);
+		SET_RTE_PARAM_CMD("altn2", route_set_altn2_arpt);
+		SET_RTE_PARAM_CMD("rwy", route_set_dep_rwy);
+		SET_RTE_PARAM_CMD("sid", route_set_sid);
+		SET_RTE_PARAM_CMD("sidtr", route_set_sidtr);
+		SET_RTE_PARAM_CMD("star", route_set_star);
+		SET_RTE_PARAM_CMD("startr", route_set_startr);
+		SET_RTE_PARAM_CMD("appr", route_set_appr);
+		SET_RTE_PARAM_CMD("apprtr", route_set_apprtr);
+
+		if (strcmp(cmd, "p") == 0) {
+			dump_route(route);
+		} else if (strcmp(cmd, "via") == 0) {
+			int idx;
+			char awy_name[NAV_NAME_LEN];
+			const route_leg_group_t *prev_rlg;
+
+			memset(awy_name, 0, sizeof (awy_name));
+			if (scanf("%7d %7s", &idx, awy_name) != 2)
+				continue;
+			prev_rlg = find_rlg(route, idx - 1);
+			strtoupper(awy_name);
+			err = route_lg_awy_insert(route, awy_name, prev_rlg,
+			    NULL);
+		} else if (strcmp(cmd, "to") == 0) {
+			int idx;
+			char fix_name[32];
+			const route_leg_group_t *rlg;
+
+			memset(fix_name, 0, sizeof (fix_name));
+			if (scanf("%7d %31s", &idx, fix_name) != 2)
+				continue;
+			strtoupper(fix_name);
+			rlg = find_rlg(route, idx);
+			if (!rlg)
+				continue;
+			err = route_lg_awy_set_end_fix(route, rlg, fix_name);
+		} else if (strcmp(cmd, "dir") == 0) {
+			int idx;
+			char fix_name[32];
+			const route_leg_group_t *prev_rlg;
+			wpt_t fix;
+
+			memset(fix_name, 0, sizeof (fix_name));
+			if (scanf("%7d %31s", &idx, fix_name) != 2)
+				continue;
+			strtoupper(fix_name);
+			fix = find_fix(fix_name, fms);
+			if (IS_NULL_WPT(&fix))
+				continue;
+			prev_rlg = find_rlg(route, idx - 1);
+			err = route_lg_direct_insert(route, &fix, prev_rlg,
+			    NULL);
+		} else if (strcmp(cmd, "ldir") == 0) {
+			int idx;
+			char fix_name[32];
+			const route_leg_t *prev_rl;
+			wpt_t fix;
+
+			memset(fix_name, 0, sizeof (fix_name));
+			if (scanf("%7d %31s", &idx, fix_name) != 2)
+				continue;
+			strtoupper(fix_name);
+			fix = find_fix(fix_name, fms);
+			if (IS_NULL_WPT(&fix))
+				continue;
+			prev_rl = find_rl(route, idx - 1);
+			err = route_l_insert(route, &fix, prev_rl, NULL);
+		} else if (strcmp(cmd, "rm") == 0) {
+			int idx;
+			const route_leg_group_t *rlg;
+			if (scanf("%7d", &idx) != 1)
+				continue;
+			rlg = find_rlg(route, idx);
+			if (!rlg)
+				continue;
+			err = route_lg_delete(route, rlg);
+		} else if (strcmp(cmd, "lrm") == 0) {
+			int idx;
+			const route_leg_t *rl;
+			if (scanf("%7d", &idx) != 1)
+				continue;
+			rl = find_rl(route, idx);
+			if (!rl)
+				continue;
+			route_l_delete(route, rl);
+		} else if (strcmp(cmd, "lmv") == 0) {
+			int idx1, idx2;
+			const route_leg_t *rl1, *rl2;
+			if (scanf("%7d %7d", &idx1, &idx2) != 2)
+				continue;
+			rl1 = find_rl(route, idx1);
+			rl2 = find_rl(route, idx2);
+			if (!rl1 || !rl2) {
+				fprintf(stderr, "idx out of rng\n");
+				continue;
+			}
+			route_l_move(route, rl1, rl2);
+		} else if (strcmp(cmd, "r") == 0) {
+			dump_route_leg_groups(route);
+		} else if (strcmp(cmd, "l") == 0) {
+			dump_route_legs(route);
+		} else if (strcmp(cmd, "airac") == 0) {
+			char mon1[5], mon2[5];
+			locale_t loc;
+			struct tm tm_start, tm_end;
+
+			loc = newlocale(LC_TIME_MASK, NULL, LC_GLOBAL_LOCALE);
+			VERIFY(loc != NULL);
+			gmtime_r(&navdb->valid_from, &tm_start);
+			gmtime_r(&navdb->valid_to, &tm_end);
+			strftime_l(mon1, 5, "%b", &tm_start, loc);
+			strftime_l(mon2, 5, "%b", &tm_end, loc);
+			strtoupper(mon1);
+			strtoupper(mon2);
+			printf("CYCLE:%u "
+			    "VALID:%02d%s%02d/%02d%s%02d (%sCURRENT) "
+			    "UNIX:%lu/%lu\n",
+			    navdb->airac_cycle,
+			    tm_start.tm_mday, mon1, tm_start.tm_year % 100,
+			    tm_end.tm_mday, mon2, tm_end.tm_year % 100,
+			    navdb_is_current(navdb) ? "" : "NOT ",
+			    navdb->valid_from, navdb->valid_to);
+			freelocale(loc);
+		}
+
+		if (err == ERR_OK)
+			err = route_update(route, acft, flt, &err_rl);
+
+		if (err != ERR_OK) {
+			fprintf(stderr, "%s\n", err2str(err));
+			continue;
+		}
+	}
+
+	route_destroy(route);
+	fms_destroy(fms);
+}
+
+#define	FPL_BENCH_ITER	10000
+
+/*
+ * Checks ICAO FPL Item 15 ingestion on built-in samples, which don't
+ * depend on the navdb contents. Given a departure & arrival ICAO (or "-"
+ * for none) and an Item 15 string valid in the navdb, also dumps the
+ * resulting route and times importing it.
+ */
+void
+test_fpl_ingest(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	static const struct {
+		const char	*item15;
+		err_t		err;
+		unsigned	err_tok;
+		unsigned	num_rlgs;
+	} samples[] = {
+		{ "N0450F350 4620N07805W DCT 47N008W", ERR_OK, 0, 2 },
+		{ "M082F370 46N078W/N0460F370 IFR 47N008W T 48N",
+		    ERR_OK, 0, 2 },
+		{ "46N078W VFR C/47N008W/N0450F350 47N008W", ERR_OK, 0, 2 },
+		{ "N0450F350 4660N07805W", ERR_INVALID_ENTRY, 1, 0 },
+		{ "N0450F350 46N078W/N04X", ERR_INVALID_ENTRY, 1, 0 },
+		{ "N0450F350 46N078W LONGIDENT", ERR_INVALID_ENTRY, 2, 0 },
+		{ "N0450F350 46N078W NOWHR", ERR_NOT_IN_DATABASE, 2, 0 }
+	};
+	const size_t	num_samples = sizeof (samples) / sizeof (samples[0]);
+	fms_t		*fms;
+	route_t		*route;
+	err_t		err;
+	unsigned	err_tok = 0;
+	uint64_t	t_start, t_ingest = 0;
+	route_leg_t	*err_rl = NULL;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+
+	for (size_t i = 0; i < num_samples; i++) {
+		route = route_create(fms->navdb);
+		err = route_fpl_ingest(route, samples[i].item15, &err_tok);
+		printf("%-44s %s", samples[i].item15, err2str(err));
+		if (err != ERR_OK)
+			printf(" (token %u)", err_tok);
+		printf("\n");
+		VERIFY(err == samples[i].err);
+		VERIFY(err == ERR_OK || err_tok == samples[i].err_tok);
+		VERIFY(list_count(route_get_leg_groups(route)) ==
+		    samples[i].num_rlgs);
+		route_destroy(route);
+	}
+
+	if (item15 == NULL)
+		goto out;
+
+	route = build_route(fms, dep, arr, NULL);
+	err = route_fpl_ingest(route, item15, &err_tok);
+	if (err != ERR_OK) {
+		fprintf(stderr, "%s: %s at token %u\n", item15, err2str(err),
+		    err_tok);
+		route_destroy(route);
+		goto out;
+	}
+	dump_route_leg_groups(route);
+	dump_route_legs(route);
+	/* route_update needs a departure to derive the start position */
+	if (route_get_dep_arpt(route) != NULL) {
+		err = route_update(route, fms_acft_perf(fms),
+		    fms_flt_perf(fms), &err_rl);
+		printf("route_update: %s\n", err2str(err));
+	}
+	route_destroy(route);
+
+	t_start = mono_ns();
+	for (int i = 0; i < FPL_BENCH_ITER; i++) {
+		uint64_t t;
+
+		route = build_route(fms, dep, arr, NULL);
+		t = mono_ns();
+		VERIFY(route_fpl_ingest(route, item15, NULL) == ERR_OK);
+		t_ingest += mono_ns() - t;
+		route_destroy(route);
+	}
+	printf("import: %.0f plans/s/core (ingest only: %.0f plans/s/core)\n",
+	    FPL_BENCH_ITER / ((mono_ns() - t_start) / 1e9),
+	    FPL_BENCH_ITER / (t_ingest / 1e9));
+
+out:
+	fms_destroy(fms);
+}
+
+#define	INCR_BENCH_ITER	1000
+#define	INCR_THREADS	4
+
+/*
+ * Copies the route's segments into a flat array for comparison.
+ */
+static route_seg_t *
+test_route_incr_snap(const route_t *route, size_t *num_segs)
+{
+	route_seg_t *segs = NULL;
+	size_t n = 0;
+
+	for (const route_seg_t *rs; (rs = route_get_seg(route, n)) != NULL;
+	    n++) {
+		segs = realloc(segs, (n + 1) * sizeof (*segs));
+		memcpy(&segs[n], rs, offsetof(route_seg_t, route_segs_node));
+	}
+	*num_segs = n;
+
+	return (segs);
+}
+
+/*
+ * Checks that the positional leg & leg group index matches the lists.
+ */
+static void
+test_route_idx_check(route_t *route)
+{
+	const list_t *legs = route_get_legs(route);
+	const list_t *leg_groups = route_get_leg_groups(route);
+	unsigned i = 0;
+
+	for (const route_leg_t *rl = list_head(legs); rl != NULL;
+	    rl = list_next(legs, rl), i++) {
+		VERIFY(route_get_leg(route, i) == rl);
+		VERIFY(route_l_get_idx(route, rl) == i);
+	}
+	VERIFY(route_get_num_legs(route) == i);
+	VERIFY(route_get_leg(route, i) == NULL);
+	i = 0;
+	for (const route_leg_group_t *rlg = list_head(leg_groups);
+	    rlg != NULL; rlg = list_next(leg_groups, rlg), i++) {
+		VERIFY(route_get_leg_group(route, i) == rlg);
+		VERIFY(route_lg_get_idx(route, rlg) == i);
+	}
+	VERIFY(route_get_num_leg_groups(route) == i);
+	VERIFY(route_get_leg_group(route, i) == NULL);
+}
+
+/*
+ * Runs an incremental route_update and checks that it produced exactly
+ * the same segments as recomputing the whole route, both in parallel and
+ * on a single thread. `acft' and `acft_full' point to identical
+ * performance data; route_update recomputes the whole route when it is
+ * handed a different acft_perf_t than last time.
+ */
+static void
+test_route_incr_check(route_t *route, const char *edit,
+    const acft_perf_t *acft, const acft_perf_t *acft_full,
+    const flt_perf_t *flt)
+{
+	route_leg_t	*err_rl = NULL;
+	route_seg_t	*incr, *full, *serial;
+	size_t		num_incr, num_full, num_serial;
+	err_t		err_incr, err_full, err_serial;
+
+	test_route_idx_check(route);
+	VERIFY(route_update_needed(route));
+	err_incr = route_update(route, acft, flt, &err_rl);
+	VERIFY(!route_update_needed(route));
+	incr = test_route_incr_snap(route, &num_incr);
+
+	err_full = route_update(route, acft_full, flt, &err_rl);
+	full = test_route_incr_snap(route, &num_full);
+
+	/* Going back to `acft' also makes the next check incremental again */
+	route_set_update_threads(route, 1);
+	err_serial = route_update(route, acft, flt, &err_rl);
+	serial = test_route_incr_snap(route, &num_serial);
+	route_set_update_threads(route, INCR_THREADS);
+
+	printf("%-24s %4lu legs %5lu segs  %s\n", edit,
+	    (unsigned long)list_count(route_get_legs(route)),
+	    (unsigned long)num_incr, err2str(err_incr));
+	VERIFY(err_incr == err_full && err_incr == err_serial);
+	VERIFY(num_incr == num_full && num_incr == num_serial);
+	for (size_t i = 0; i < num_incr; i++) {
+		VERIFY(memcmp(&incr[i], &full[i],
+		    offsetof(route_seg_t, route_segs_node)) == 0);
+		VERIFY(memcmp(&incr[i], &serial[i],
+		    offsetof(route_seg_t, route_segs_node)) == 0);
+	}
+	free(incr);
+	free(full);
+	free(serial);
+}
+
+/*
+ * Checks incremental route_update. Applies a series of edits at different
+ * places in the route and checks after each that the incremental update
+ * matches a full recompute.
+ */
+void
+test_route_incr(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	const acft_perf_t	*acft;
+	acft_perf_t		acft_full;
+	const flt_perf_t	*flt;
+	const route_leg_t	*rl, *new_rl;
+	route_leg_t		*err_rl = NULL;
+	wpt_t			fix;
+	alt_lim_t		alt_lim = { .type = ALT_LIM_AT };
+	spd_lim_t		spd_lim = { .type = SPD_LIM_AT, .spd1 = 250 };
+	size_t			num_legs;
+	uint64_t		t_start, t_incr, t_full;
+	uint64_t		num_alloc = 0, num_malloc = 0;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	acft_full = *acft;
+	flt = fms_flt_perf(fms);
+
+	route = build_route(fms, dep, arr, item15);
+	route_set_update_threads(route, INCR_THREADS);
+	(void) route_update(route, acft, flt, &err_rl);
+	num_legs = list_count(route_get_legs(route));
+	VERIFY(num_legs >= 4);
+
+	rl = list_tail(route_get_legs(route));
+	alt_lim.alt1 = 10000;
+	route_l_set_alt_lim(route, rl, alt_lim);
+	test_route_incr_check(route, "alt lim on last leg", acft, &acft_full,
+	    flt);
+
+	rl = find_rl(route, num_legs / 4);
+	route_l_set_spd_lim(route, rl, spd_lim);
+	test_route_incr_check(route, "spd lim at 1/4", acft, &acft_full, flt);
+
+	rl = find_rl(route, num_legs / 2);
+	fix = *navproc_seg_get_end_wpt(&find_rl(route, 1)->data->seg);
+	VERIFY(route_l_insert(route, &fix, rl, &new_rl) == ERR_OK);
+	test_route_incr_check(route, "insert at 1/2", acft, &acft_full, flt);
+
+	route_l_delete(route, new_rl);
+	test_route_incr_check(route, "delete at 1/2", acft, &acft_full, flt);
+
+	/* Changes the speed carried across the discontinuity left behind */
+	for (rl = list_head(route_get_legs(route)); rl != NULL && !rl->disco;
+	    rl = list_next(route_get_legs(route), rl))
+		;
+	if (rl != NULL && (rl = list_prev(route_get_legs(route), rl)) != NULL) {
+		spd_lim.spd1 = 280;
+		route_l_set_spd_lim(route, rl, spd_lim);
+		test_route_incr_check(route, "spd lim before disco", acft,
+		    &acft_full, flt);
+	}
+
+	route_l_delete(route, list_tail(route_get_legs(route)));
+	test_route_incr_check(route, "delete last leg", acft, &acft_full, flt);
+
+	route_l_delete(route, list_head(route_get_legs(route)));
+	test_route_incr_check(route, "delete first leg", acft, &acft_full,
+	    flt);
+
+	t_incr = 0;
+	rl = list_tail(route_get_legs(route));
+	for (int i = 0; i < INCR_BENCH_ITER; i++) {
+		alt_lim.alt1 = 10000 + (i & 1) * 1000;
+		route_l_set_alt_lim(route, rl, alt_lim);
+		t_start = mono_ns();
+		(void) route_update(route, acft, flt, &err_rl);
+		t_incr += mono_ns() - t_start;
+	}
+	t_full = 0;
+	for (int i = 0; i < INCR_BENCH_ITER; i++) {
+		if (i == 1) {
+			/* the first full update may grow the segment pool */
+			num_alloc = route->rs_pool.num_alloc;
+			num_malloc = route->rs_pool.num_malloc;
+		}
+		t_start = mono_ns();
+		(void) route_update(route, (i & 1) ? acft : &acft_full, flt,
+		    &err_rl);
+		t_full += mono_ns() - t_start;
+	}
+	num_alloc = route->rs_pool.num_alloc - num_alloc;
+	num_malloc = route->rs_pool.num_malloc - num_malloc;
+	printf("last leg edit: incremental %.1f us, full %.1f us\n",
+	    t_incr / 1000.0 / INCR_BENCH_ITER,
+	    t_full / 1000.0 / INCR_BENCH_ITER);
+	printf("full update: %.1f segs allocated, %.1f from malloc\n",
+	    (double)num_alloc / (INCR_BENCH_ITER - 1),
+	    (double)num_malloc / (INCR_BENCH_ITER - 1));
+	VERIFY(num_malloc == 0);
+
+	/* Fetching the legs for the last LEGS page after each edit */
+	num_legs = route_get_num_legs(route);
+	t_start = mono_ns();
+	for (int i = 0; i < INCR_BENCH_ITER; i++) {
+		alt_lim.alt1 = 10000 + (i & 1) * 1000;
+		route_l_set_alt_lim(route, rl, alt_lim);
+		for (size_t j = num_legs - 5; j < num_legs; j++)
+			VERIFY(find_rl(route, j) != NULL);
+	}
+	printf("last LEGS page after edit: %.2f us\n",
+	    (mono_ns() - t_start) / 1000.0 / INCR_BENCH_ITER);
+
+	route_destroy(route);
+	fms_destroy(fms);
+}
+
+#define	COPY_BENCH_BRANCHES	64
+
+/*
+ * Checks that `route' has exactly the segments in `segs'.
+ */
+static bool_t
+test_route_copy_same(const route_t *route, const route_seg_t *segs,
+    size_t num_segs)
+{
+	route_seg_t	*cur;
+	size_t		num_cur;
+	bool_t		same;
+
+	cur = test_route_incr_snap(route, &num_cur);
+	same = (num_cur == num_segs);
+	for (size_t i = 0; same && i < num_segs; i++)
+		same = (memcmp(&cur[i], &segs[i],
+		    offsetof(route_seg_t, route_segs_node)) == 0);
+	free(cur);
+
+	return (same);
+}
+
+/*
+ * Checks route_copy. Copies must match their source, edits to a copy
+ * mustn't leak into the source and vice versa, updating an edited copy
+ * must be incremental and match a full recompute, an edit must only
+ * duplicate the legs & segments it touches and the source must be
+ * destroyable while it still has copies.
+ */
+void
+test_route_copy(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route, *copy, *copy2;
+	route_t			*branches[COPY_BENCH_BRANCHES];
+	const acft_perf_t	*acft;
+	acft_perf_t		acft_full;
+	const flt_perf_t	*flt;
+	route_leg_t		*err_rl = NULL;
+	route_seg_t		*orig, *edited;
+	size_t			num_orig, num_edited, num_legs;
+	alt_lim_t		alt_lim = { .type = ALT_LIM_AT, .alt1 = 10000 };
+	alt_lim_t		branch_lim = {
+		.type = ALT_LIM_AT, .alt1 = 12000
+	};
+	uint64_t		t_start, t_copy, t_edit;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	acft_full = *acft;
+	flt = fms_flt_perf(fms);
+
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, flt, &err_rl);
+	num_legs = list_count(route_get_legs(route));
+	VERIFY(num_legs >= 4);
+	orig = test_route_incr_snap(route, &num_orig);
+
+	/* A fresh copy is identical to its source */
+	copy = route_copy(route);
+	VERIFY(!route_update_needed(copy));
+	VERIFY(route_get_dep_arpt(copy) == route_get_dep_arpt(route));
+	VERIFY(list_count(route_get_legs(copy)) == num_legs);
+	VERIFY(test_route_copy_same(copy, orig, num_orig));
+
+	/* Editing the copy leaves the source alone */
+	route_l_set_alt_lim(copy, list_tail(route_get_legs(copy)), alt_lim);
+	test_route_incr_check(copy, "copy: alt lim on last leg", acft,
+	    &acft_full, flt);
+	VERIFY(!route_update_needed(route));
+	VERIFY(test_route_copy_same(route, orig, num_orig));
+	edited = test_route_incr_snap(copy, &num_edited);
+
+	/* An edit only duplicates what it touches */
+	copy2 = route_copy(route);
+	route_l_set_alt_lim(copy2, list_tail(route_get_legs(copy2)), alt_lim);
+	(void) route_update(copy2, acft, flt, &err_rl);
+	VERIFY(route_get_leg(copy2, 0)->data == route_get_leg(route, 0)->data);
+	VERIFY(route_get_leg(copy2, num_legs - 1)->data !=
+	    route_get_leg(route, num_legs - 1)->data);
+	VERIFY(route_get_seg(copy2, 0) == route_get_seg(route, 0));
+	VERIFY(copy2->rs_pool.num_alloc < num_orig);
+	VERIFY(test_route_copy_same(route, orig, num_orig));
+	VERIFY(test_route_copy_same(copy2, edited, num_edited));
+	route_destroy(copy2);
+
+	/* Editing the source leaves its copies alone */
+	copy2 = route_copy(route);
+	route_l_delete(route, list_tail(route_get_legs(route)));
+	(void) route_update(route, acft, flt, &err_rl);
+	VERIFY(list_count(route_get_legs(route)) == num_legs - 1);
+	VERIFY(list_count(route_get_legs(copy2)) == num_legs);
+	VERIFY(test_route_copy_same(copy2, orig, num_orig));
+	VERIFY(test_route_copy_same(copy, edited, num_edited));
+	route_destroy(copy2);
+
+	/* Copies outlive their source */
+	copy2 = route_copy(route);
+	route_destroy(route);
+	route_l_delete(copy2, list_head(route_get_legs(copy2)));
+	test_route_incr_check(copy2, "orphan: delete first leg", acft,
+	    &acft_full, flt);
+	VERIFY(list_count(route_get_legs(copy2)) == num_legs - 2);
+
+	t_start = mono_ns();
+	for (int i = 0; i < COPY_BENCH_BRANCHES; i++)
+		branches[i] = route_copy(copy);
+	t_copy = mono_ns() - t_start;
+	t_start = mono_ns();
+	for (int i = 0; i < COPY_BENCH_BRANCHES; i++) {
+		route_l_set_alt_lim(branches[i],
+		    list_tail(route_get_legs(branches[i])), branch_lim);
+		(void) route_update(branches[i], acft, flt, &err_rl);
+	}
+	t_edit = mono_ns() - t_start;
+	printf("what-if branch: copy %.2f us, edit & update %.2f us\n",
+	    t_copy / 1000.0 / COPY_BENCH_BRANCHES,
+	    t_edit / 1000.0 / COPY_BENCH_BRANCHES);
+	for (int i = 0; i < COPY_BENCH_BRANCHES; i++)
+		route_destroy(branches[i]);
+
+	free(orig);
+	free(edited);
+	route_destroy(copy);
+	route_destroy(copy2);
+	fms_destroy(fms);
+}
+
+#define	SER_BENCH_ITER		100
+#define	SER_TRUNC_STEPS		64
+
+/*
+ * Checks route_serialize & route_deserialize. A route saved with its
+ * segments must come back identical and up to date, so that route_update
+ * has nothing to do, and its checkpoints must still allow an incremental
+ * update after an edit. A route saved without segments must come back
+ * needing an update which reproduces the same segments. Truncated or
+ * corrupted buffers must be rejected.
+ */
+void
+test_route_ser(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route, *res;
+	const acft_perf_t	*acft;
+	acft_perf_t		acft_full;
+	const flt_perf_t	*flt;
+	route_leg_t		*err_rl = NULL;
+	route_seg_t		*orig;
+	size_t			num_orig, len, len_nosegs;
+	uint8_t			*buf, *buf_nosegs;
+	uint64_t		num_alloc, t_start, t_load, t_build;
+	alt_lim_t		alt_lim = { .type = ALT_LIM_AT, .alt1 = 10000 };
+	err_t			err;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	acft_full = *acft;
+	flt = fms_flt_perf(fms);
+
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, flt, &err_rl);
+	orig = test_route_incr_snap(route, &num_orig);
+	buf = route_serialize(route, B_TRUE, &len);
+	buf_nosegs = route_serialize(route, B_FALSE, &len_nosegs);
+	printf("serialized: %lu bytes, %lu without segments\n",
+	    (unsigned long)len, (unsigned long)len_nosegs);
+
+	/* With segments: restored up to date, nothing to recompute */
+	res = route_deserialize(fms->navdb, acft, buf, len, &err);
+	VERIFY(res != NULL && err == ERR_OK);
+	VERIFY(!route_update_needed(res));
+	VERIFY(route_get_num_legs(res) == route_get_num_legs(route));
+	VERIFY(route_get_num_leg_groups(res) ==
+	    route_get_num_leg_groups(route));
+	VERIFY(route_get_sid(res) == NULL ||
+	    strcmp(route_get_sid(res)->name, route_get_sid(route)->name) == 0);
+	VERIFY(test_route_copy_same(res, orig, num_orig));
+	num_alloc = res->rs_pool.num_alloc;
+	(void) route_update(res, acft, flt, &err_rl);
+	VERIFY(res->rs_pool.num_alloc == num_alloc);
+	VERIFY(test_route_copy_same(res, orig, num_orig));
+	route_l_set_alt_lim(res, list_tail(route_get_legs(res)), alt_lim);
+	test_route_incr_check(res, "restored: alt lim on last leg", acft,
+	    &acft_full, flt);
+	route_destroy(res);
+
+	/* Unknown aircraft performance: restored, but updated in full */
+	res = route_deserialize(fms->navdb, NULL, buf, len, &err);
+	VERIFY(res != NULL && err == ERR_OK);
+	VERIFY(test_route_copy_same(res, orig, num_orig));
+	(void) route_update(res, acft, flt, &err_rl);
+	VERIFY(res->rs_pool.num_alloc != 0);
+	VERIFY(test_route_copy_same(res, orig, num_orig));
+	route_destroy(res);
+
+	/* Without segments: needs an update, which gives the same result */
+	res = route_deserialize(fms->navdb, acft, buf_nosegs, len_nosegs,
+	    &err);
+	VERIFY(res != NULL && err == ERR_OK);
+	VERIFY(route_update_needed(res));
+	(void) route_update(res, acft, flt, &err_rl);
+	VERIFY(test_route_copy_same(res, orig, num_orig));
+	route_destroy(res);
+
+	/* Saved on a different AIRAC cycle: rebound and updated in full */
+	fms->navdb->airac_cycle++;
+	res = route_deserialize(fms->navdb, acft, buf, len, &err);
+	fms->navdb->airac_cycle--;
+	VERIFY(res != NULL && err == ERR_OK);
+	VERIFY(route_update_needed(res));
+	(void) route_update(res, acft, flt, &err_rl);
+	VERIFY(test_route_copy_same(res, orig, num_orig));
+	route_destroy(res);
+
+	/* Broken buffers are rejected */
+	for (size_t l = 0; l < len; l += MAX(len / SER_TRUNC_STEPS, 1)) {
+		VERIFY(route_deserialize(fms->navdb, acft, buf, l, &err) ==
+		    NULL);
+		VERIFY(err != ERR_OK);
+	}
+	buf[0] ^= 0xff;
+	VERIFY(route_deserialize(fms->navdb, acft, buf, len, &err) == NULL);
+	VERIFY(err == ERR_INVALID_ROUTE_DATA);
+	buf[0] ^= 0xff;
+
+	t_start = mono_ns();
+	for (int i = 0; i < SER_BENCH_ITER; i++) {
+		res = route_deserialize(fms->navdb, acft, buf, len, &err);
+		(void) route_update(res, acft, flt, &err_rl);
+		route_destroy(res);
+	}
+	t_load = mono_ns() - t_start;
+	t_start = mono_ns();
+	for (int i = 0; i < SER_BENCH_ITER; i++) {
+		res = build_route(fms, dep, arr, item15);
+		(void) route_update(res, acft, flt, &err_rl);
+		route_destroy(res);
+	}
+	t_build = mono_ns() - t_start;
+	printf("restore: %.1f us, rebuild from flight plan: %.1f us\n",
+	    t_load / 1000.0 / SER_BENCH_ITER,
+	    t_build / 1000.0 / SER_BENCH_ITER);
+
+	free(buf);
+	free(buf_nosegs);
+	free(orig);
+	route_destroy(route);
+	fms_destroy(fms);
+}
+
+#define	CACHE_ROUTES		4	/* route variants */
+#define	CACHE_LOADS		4	/* flight performance variants */
+#define	CACHE_COMBOS		(CACHE_ROUTES * CACHE_LOADS)
+#define	CACHE_SIZE		12
+#define	CACHE_REQUESTS		256
+
+/*
+ * Builds variant `var' of the route for test_route_cache: the route with
+ * its last `var' legs removed.
+ */
+static route_t *
+test_route_cache_build(const fms_t *fms, const char *dep, const char *arr,
+    const char *item15, unsigned var)
+{
+	route_t *route = build_route(fms, dep, arr, item15);
+
+	for (unsigned i = 0; i < var; i++)
+		route_l_delete(route, list_tail(route_get_legs(route)));
+
+	return (route);
+}
+
+/*
+ * Checks the route_update result cache on a dispatch style request mix:
+ * CACHE_REQUESTS route computations spread over CACHE_ROUTES variants of
+ * the route with CACHE_LOADS different zero fuel weights each, the popular
+ * ones requested far more often than the rest. The cache holds fewer
+ * routes than the mix has, so it has to evict. Every result must match
+ * computing the route without the cache, and a route set up from a cache
+ * hit must still update incrementally after an edit.
+ */
+void
+test_route_cache(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	route_cache_t		*cache;
+	route_cache_stats_t	stats;
+	const acft_perf_t	*acft;
+	acft_perf_t		acft_full;
+	flt_perf_t		flt[CACHE_LOADS];
+	route_leg_t		*err_rl = NULL;
+	route_seg_t		*ref[CACHE_COMBOS];
+	size_t			num_ref[CACHE_COMBOS];
+	err_t			err_ref[CACHE_COMBOS];
+	unsigned		reqs[CACHE_REQUESTS];
+	double			weights[CACHE_COMBOS], total = 0;
+	uint32_t		seed = 1;
+	uint64_t		t_upd[2] = { 0, 0 };
+	alt_lim_t		alt_lim = { .type = ALT_LIM_AT, .alt1 = 10000 };
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	acft_full = *acft;
+	for (int i = 0; i < CACHE_LOADS; i++) {
+		flt[i] = *fms_flt_perf(fms);
+		flt[i].zfw += i * 2000;
+	}
+
+	for (int i = 0; i < CACHE_COMBOS; i++) {
+		route = test_route_cache_build(fms, dep, arr, item15,
+		    i / CACHE_LOADS);
+		err_ref[i] = route_update(route, acft, &flt[i % CACHE_LOADS],
+		    &err_rl);
+		ref[i] = test_route_incr_snap(route, &num_ref[i]);
+		route_destroy(route);
+		weights[i] = 1.0 / (i + 1);
+		total += weights[i];
+	}
+	/* a fixed pseudo-random request mix, so that runs are comparable */
+	for (int i = 0; i < CACHE_REQUESTS; i++) {
+		double r;
+
+		seed = seed * 1103515245 + 12345;
+		r = ((seed >> 8) / (double)(1 << 24)) * total;
+		reqs[i] = CACHE_COMBOS - 1;
+		for (int j = 0; j < CACHE_COMBOS; j++) {
+			if (r < weights[j]) {
+				reqs[i] = j;
+				break;
+			}
+			r -= weights[j];
+		}
+	}
+
+	cache = route_cache_create(CACHE_SIZE);
+	for (int use_cache = 0; use_cache < 2; use_cache++) {
+		for (int i = 0; i < CACHE_REQUESTS; i++) {
+			unsigned	c = reqs[i];
+			uint64_t	t_start;
+			err_t		err;
+
+			route = test_route_cache_build(fms, dep, arr, item15,
+			    c / CACHE_LOADS);
+			if (use_cache)
+				route_set_cache(route, cache);
+			t_start = mono_ns();
+			err = route_update(route, acft, &flt[c % CACHE_LOADS],
+			    &err_rl);
+			t_upd[use_cache] += mono_ns() - t_start;
+			VERIFY(err == err_ref[c]);
+			VERIFY(!route_update_needed(route));
+			VERIFY(test_route_copy_same(route, ref[c], num_ref[c]));
+			route_destroy(route);
+		}
+	}
+	stats = route_cache_get_stats(cache);
+	VERIFY(stats.hits + stats.misses == CACHE_REQUESTS);
+	VERIFY(stats.hits != 0 && stats.evictions != 0);
+	VERIFY(stats.num_entries == CACHE_SIZE);
+	printf("cache: %llu hits, %llu misses (%.1f%% hit rate), "
+	    "%llu evictions\n", (unsigned long long)stats.hits,
+	    (unsigned long long)stats.misses,
+	    100.0 * stats.hits / CACHE_REQUESTS,
+	    (unsigned long long)stats.evictions);
+	printf("route_update: %.1f us uncached, %.1f us with cache\n",
+	    t_upd[0] / 1000.0 / CACHE_REQUESTS,
+	    t_upd[1] / 1000.0 / CACHE_REQUESTS);
+
+	/* Edits to a route taken from the cache update incrementally */
+	route = test_route_cache_build(fms, dep, arr, item15, 0);
+	route_set_cache(route, cache);
+	(void) route_update(route, acft, &flt[0], &err_rl);
+	VERIFY(route_cache_get_stats(cache).hits == stats.hits + 1);
+	VERIFY(test_route_copy_same(route, ref[0], num_ref[0]));
+	route_l_set_alt_lim(route, list_tail(route_get_legs(route)), alt_lim);
+	test_route_incr_check(route, "cached: alt lim on last leg", acft,
+	    &acft_full, &flt[0]);
+	route_destroy(route);
+
+	for (int i = 0; i < CACHE_COMBOS; i++)
+		free(ref[i]);
+	route_cache_destroy(cache);
+	fms_destroy(fms);
+}
+
+#define	JOIN_BENCH_ITER		20
+
+/*
+ * Checks the segment join memoization in route_update. A full recompute
+ * of an unchanged route must take all of its joins from the cache and
+ * come out exactly the same as the first one, which had to compute them.
+ * Edits must still update correctly with a warm cache.
+ */
+void
+test_route_join(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	const acft_perf_t	*acft;
+	acft_perf_t		acft_full;
+	const flt_perf_t	*flt;
+	route_leg_t		*err_rl = NULL;
+	route_seg_t		*orig;
+	size_t			num_orig;
+	route_cache_stats_t	cold, warm;
+	alt_lim_t		alt_lim = { .type = ALT_LIM_AT, .alt1 = 10000 };
+	uint64_t		t_start, t_cold = 0, t_warm = 0;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	acft_full = *acft;
+	flt = fms_flt_perf(fms);
+
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, flt, &err_rl);
+	orig = test_route_incr_snap(route, &num_orig);
+	cold = route_get_join_stats(route);
+	VERIFY(cold.misses != 0);
+
+	(void) route_update(route, &acft_full, flt, &err_rl);
+	warm = route_get_join_stats(route);
+	VERIFY(warm.misses == cold.misses);
+	VERIFY(warm.hits - cold.hits == cold.misses);
+	VERIFY(test_route_copy_same(route, orig, num_orig));
+	printf("joins: %llu computed, %llu taken from cache on recompute\n",
+	    (unsigned long long)cold.misses,
+	    (unsigned long long)(warm.hits - cold.hits));
+
+	route_l_set_alt_lim(route, list_tail(route_get_legs(route)), alt_lim);
+	test_route_incr_check(route, "joined: alt lim on last leg", acft,
+	    &acft_full, flt);
+	route_l_delete(route, list_head(route_get_legs(route)));
+	test_route_incr_check(route, "joined: delete first leg", acft,
+	    &acft_full, flt);
+	route_destroy(route);
+
+	for (int i = 0; i < JOIN_BENCH_ITER; i++) {
+		route = build_route(fms, dep, arr, item15);
+		t_start = mono_ns();
+		(void) route_update(route, acft, flt, &err_rl);
+		t_cold += mono_ns() - t_start;
+		t_start = mono_ns();
+		(void) route_update(route, &acft_full, flt, &err_rl);
+		t_warm += mono_ns() - t_start;
+		VERIFY(test_route_copy_same(route, orig, num_orig));
+		route_destroy(route);
+	}
+	printf("full recompute: %.1f us cold, %.1f us with joins cached\n",
+	    t_cold / 1000.0 / JOIN_BENCH_ITER,
+	    t_warm / 1000.0 / JOIN_BENCH_ITER);
+
+	free(orig);
+	fms_destroy(fms);
+}
+
+#define	DIST_QUERIES		10000
+#define	DIST_TOL		1	/* meters */
+#define	DIST_ARC_TOL		0.01	/* fraction of arc radius */
+
+/*
+ * Walks the route's segments to find the one `dist' meters along the
+ * route, with a gc_distance call per segment. This is what finding a
+ * position on the route took without route_get_pos_at_dist, so it serves
+ * as the baseline for test_route_dist (arcs are approximated by their
+ * chords).
+ */
+static const route_seg_t *
+test_route_dist_walk(const route_t *route, double dist)
+{
+	for (unsigned i = 0; i < route_get_num_segs(route); i++) {
+		const route_seg_t *rs = route_get_seg(route, i);
+		double len = (rs->type == ROUTE_SEG_TYPE_DIRECT ?
+		    gc_distance(rs->direct.start, rs->direct.end) :
+		    gc_distance(rs->arc.start, rs->arc.end));
+
+		if (dist <= len)
+			return (rs);
+		dist -= len;
+	}
+	return (NULL);
+}
+
+/*
+ * Checks the along-track distances of route segments. The start & end of
+ * every segment must be at the matching along-track distances, arc points
+ * must stay on their arcs and points off either end of the route must be
+ * rejected. The distances must follow route_update after an edit.
+ */
+void
+test_route_dist(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	const acft_perf_t	*acft;
+	const flt_perf_t	*flt;
+	route_leg_t		*err_rl = NULL;
+	const route_seg_t	*rs_at;
+	double			total, prev = 0;
+	uint64_t		t_start, t_idx, t_walk;
+	uint32_t		seed = 1;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	flt = fms_flt_perf(fms);
+
+	route = route_create(fms->navdb);
+	VERIFY(route_get_dist(route) == 0);
+	VERIFY(IS_NULL_GEO_POS(route_get_pos_at_dist(route, 0, NULL)));
+	route_destroy(route);
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, flt, &err_rl);
+
+	for (int pass = 0; pass < 2; pass++) {
+		total = route_get_dist(route);
+		VERIFY(total > 0);
+		printf("route: %lu segs, %.1f NM\n",
+		    (unsigned long)route_get_num_segs(route), MET2NM(total));
+		prev = 0;
+		for (unsigned i = 0; i < route_get_num_segs(route); i++) {
+			const route_seg_t *rs = route_get_seg(route, i);
+			double		d0 = route_seg_get_dist(route, rs, 0);
+			double		d1 = route_seg_get_dist(route, rs, 1);
+			geo_pos2_t	start = (rs->type ==
+			    ROUTE_SEG_TYPE_DIRECT ? rs->direct.start :
+			    rs->arc.start);
+			geo_pos2_t	end = (rs->type ==
+			    ROUTE_SEG_TYPE_DIRECT ? rs->direct.end :
+			    rs->arc.end);
+			geo_pos2_t	p;
+
+			VERIFY(d0 == prev && d1 >= d0);
+			prev = d1;
+			p = route_get_pos_at_dist(route, d0, &rs_at);
+			VERIFY(gc_distance(p, start) < DIST_TOL);
+			/* just short of `d1', which is the next seg's start */
+			p = route_get_pos_at_dist(route, d0 + (d1 - d0) *
+			    (1 - 1e-9), NULL);
+			VERIFY(gc_distance(p, end) < DIST_TOL);
+			if (rs->type == ROUTE_SEG_TYPE_ARC) {
+				/*
+				 * gc_distance and the projections the arcs
+				 * are built with disagree slightly, so arcs
+				 * aren't perfect circles by gc_distance.
+				 */
+				double r1 = gc_distance(rs->arc.center, start);
+				double r2 = gc_distance(rs->arc.center, end);
+				double r;
+
+				p = route_get_pos_at_dist(route, (d0 + d1) / 2,
+				    &rs_at);
+				r = gc_distance(rs->arc.center, p);
+				VERIFY(rs_at == rs);
+				VERIFY(r > MIN(r1, r2) * (1 - DIST_ARC_TOL) &&
+				    r < MAX(r1, r2) * (1 + DIST_ARC_TOL));
+			}
+		}
+		VERIFY(prev == total);
+		VERIFY(IS_NULL_GEO_POS(route_get_pos_at_dist(route, -1, NULL)));
+		VERIFY(IS_NULL_GEO_POS(route_get_pos_at_dist(route, total + 1,
+		    &rs_at)));
+		VERIFY(rs_at == NULL);
+
+		/* the index follows the segments through an update */
+		route_l_delete(route, list_tail(route_get_legs(route)));
+		(void) route_update(route, acft, flt, &err_rl);
+	}
+
+	total = route_get_dist(route);
+	t_start = mono_ns();
+	for (int i = 0; i < DIST_QUERIES; i++) {
+		seed = seed * 1103515245 + 12345;
+		(void) route_get_pos_at_dist(route, total * (seed >> 8) /
+		    (1 << 24), &rs_at);
+	}
+	t_idx = mono_ns() - t_start;
+	seed = 1;
+	t_start = mono_ns();
+	for (int i = 0; i < DIST_QUERIES; i++) {
+		seed = seed * 1103515245 + 12345;
+		(void) test_route_dist_walk(route, total *
+		    (seed >> 8) / (1 << 24));
+	}
+	t_walk = mono_ns() - t_start;
+	printf("position at distance: %.3f us indexed, walking to its "
+	    "segment: %.3f us\n", t_idx / 1000.0 / DIST_QUERIES,
+	    t_walk / 1000.0 / DIST_QUERIES);
+
+	route_destroy(route);
+	fms_destroy(fms);
+}
+
+#define	LNAV_STEP		1000	/* meters, for the path check */
+#define	LNAV_XTK_TOL		10	/* meters */
+#define	LNAV_OFFSET		500	/* meters */
+#define	LNAV_AIRCRAFT		200
+#define	LNAV_RATE		50	/* Hz */
+#define	LNAV_BENCH_SECS		10
+#define	LNAV_GS			130	/* m/s */
+
+/*
+ * Checks LNAV tracking. Flying along the route in LNAV_STEP increments,
+ * positions on the path must have (almost) no cross-track error, the
+ * active segment must be the one under the aircraft, every segment must
+ * get sequenced in order & the end of the path must be reported once.
+ * Cross-track & track angle errors of an aircraft off the path must come
+ * out right.
+ */
+void
+test_lnav(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	route_leg_t		*err_rl = NULL;
+	const route_seg_t	**seg_arr;
+	lnav_path_t		*path;
+	lnav_t			lnav;
+	lnav_out_t		out;
+	lnav_t			*acft;
+	geo_pos2_t		*traj;
+	unsigned		num_segs, i = 0, num_steps, num_seq = 0;
+	unsigned		num_end = 0, num_off = 0, num_upd;
+	double			total;
+	uint64_t		t_start, t_all, t_max = 0;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, fms_acft_perf(fms), fms_flt_perf(fms),
+	    &err_rl);
+	total = route_get_dist(route);
+	num_segs = route_get_num_segs(route);
+	seg_arr = calloc(num_segs, sizeof (*seg_arr));
+	for (i = 0; i < num_segs; i++)
+		seg_arr[i] = route_get_seg(route, i);
+
+	path = lnav_path_create(route);
+	VERIFY(lnav_path_get_num_segs(path) == num_segs);
+	lnav_init(&lnav, path);
+	for (double d = 0; d <= total + LNAV_STEP; d += LNAV_STEP) {
+		const route_seg_t	*rs;
+		geo_pos2_t		pos = route_get_pos_at_dist(route,
+		    MIN(d, total), &rs);
+		lnav_event_t		ev;
+		unsigned		prev = lnav.active;
+
+		VERIFY(!IS_NULL_GEO_POS(pos));
+		ev = lnav_update(&lnav, pos, 0, &out);
+		num_seq += out.active - prev;
+		num_end += (ev == LNAV_EVENT_END);
+		VERIFY(ev != LNAV_EVENT_SEQ || out.active > prev);
+		VERIFY(ABS(out.xtk) < LNAV_XTK_TOL);
+		/* at a segment boundary, either side will do */
+		VERIFY(seg_arr[out.active] == rs || (out.active > 0 &&
+		    seg_arr[out.active - 1] == rs) || (out.active + 1 <
+		    num_segs && seg_arr[out.active + 1] == rs));
+		if (d < total) {
+			VERIFY(ABS(out.dist_to_end - (total - d)) <
+			    total * 0.005 + LNAV_XTK_TOL);
+		}
+
+		/* off the path to the right, flying 10 degrees right */
+		if (out.dtg > 2 * LNAV_OFFSET && out.active == prev &&
+		    d < total) {
+			lnav_t		l2 = lnav;
+			lnav_out_t	o2;
+
+			pos = geo_displace(&wgs84, pos, out.des_trk + 90,
+			    LNAV_OFFSET);
+			(void) lnav_update(&l2, pos, fmod(out.des_trk + 10,
+			    360), &o2);
+			/* tight turns may put us onto the next segment */
+			if (l2.active == lnav.active) {
+				VERIFY(ABS(o2.xtk - LNAV_OFFSET) <
+				    LNAV_OFFSET / 20);
+				VERIFY(ABS(o2.tae - 10) < 1);
+				num_off++;
+			}
+		}
+	}
+	VERIFY(num_seq == num_segs - 1 && num_end == 1 && num_off != 0);
+	VERIFY(lnav.active == num_segs - 1 && out.dtg == 0);
+	printf("lnav: %u segs, %.1f NM, all sequenced\n", num_segs,
+	    MET2NM(total));
+
+	/* picking up tracking mid-route */
+	lnav_init(&lnav, path);
+	VERIFY(lnav_capture(&lnav, route_get_pos_at_dist(route, total / 2,
+	    NULL)));
+	VERIFY(lnav.active > 0 || num_segs == 1);
+
+	num_steps = LNAV_RATE * LNAV_BENCH_SECS;
+	acft = calloc(LNAV_AIRCRAFT, sizeof (*acft));
+	traj = calloc(LNAV_AIRCRAFT * num_steps, sizeof (*traj));
+	for (i = 0; i < LNAV_AIRCRAFT; i++) {
+		double d0 = (total - LNAV_GS * LNAV_BENCH_SECS) * i /
+		    LNAV_AIRCRAFT;
+
+		for (unsigned j = 0; j < num_steps; j++) {
+			traj[i * num_steps + j] = route_get_pos_at_dist(route,
+			    MAX(d0, 0) + (double)LNAV_GS * j / LNAV_RATE,
+			    NULL);
+		}
+		lnav_init(&acft[i], path);
+		VERIFY(lnav_capture(&acft[i], traj[i * num_steps]));
+	}
+	t_all = mono_ns();
+	for (unsigned j = 0; j < num_steps; j++) {
+		for (i = 0; i < LNAV_AIRCRAFT; i++) {
+			geo_pos2_t pos = traj[i * num_steps + j];
+
+			if (IS_NULL_GEO_POS(pos))
+				continue;
+			t_start = mono_ns();
+			(void) lnav_update(&acft[i], pos, 0, &out);
+			t_max = MAX(t_max, mono_ns() - t_start);
+		}
+	}
+	t_all = mono_ns() - t_all;
+	num_upd = LNAV_AIRCRAFT * num_steps;
+	printf("lnav: %u aircraft at %d Hz: %.3f us/update (max %.3f us), "
+	    "%.2f%% of real time\n", LNAV_AIRCRAFT, LNAV_RATE,
+	    t_all / 1000.0 / num_upd, t_max / 1000.0,
+	    100.0 * t_all / 1e9 / LNAV_BENCH_SECS);
+
+	free(traj);
+	free(acft);
+	free(seg_arr);
+	lnav_path_destroy(path);
+	route_destroy(route);
+	fms_destroy(fms);
+}
+
+#define	VNAV_BENCH_ITER		100
+#define	VNAV_TOL		1	/* feet & knots */
+#define	VNAV_CAP_ALT		15000	/* feet */
+#define	VNAV_CAP_SPD		240	/* knots */
+
+/*
+ * Checks the vertical profile `prof' of `route': T/C no later than T/D,
+ * the legs in order along the path and through the flight phases, all
+ * altitudes between the runways and the cruise level and no altitude or
+ * speed constraint exceeded.
+ */
+static void
+test_vnav_check(route_t *route, const vnav_profile_t *prof)
+{
+	const airport_t	*dep = route_get_dep_arpt(route);
+	const airport_t	*arr = route_get_arr_arpt(route);
+	double		min_alt = MIN(dep != NULL ? dep->refpt.elev : 0,
+	    arr != NULL ? arr->refpt.elev : 0) - VNAV_TOL;
+	double		dist = 0;
+	flt_phase_t	phase = FLT_PHASE_CLB;
+
+	VERIFY(prof->num_legs == route_get_num_legs(route));
+	VERIFY(prof->toc >= 0 && prof->toc <= prof->tod &&
+	    prof->tod <= route_get_dist(route) + 1);
+	for (unsigned i = 0; i < prof->num_legs; i++) {
+		const vnav_leg_t	*vl = &prof->legs[i];
+		const route_leg_t	*rl = route_get_leg(route, i);
+		alt_lim_t		al = route_l_get_alt_lim(rl);
+		spd_lim_t		sl = route_l_get_spd_lim(rl);
+
+		if (isnan(vl->dist))
+			continue;
+		VERIFY(vl->dist >= dist && vl->phase >= phase);
+		VERIFY(vl->alt >= min_alt &&
+		    vl->alt <= prof->crz_alt + VNAV_TOL);
+		VERIFY(vl->kcas > 0);
+		if (al.type == ALT_LIM_AT || al.type == ALT_LIM_AT_OR_BLW ||
+		    al.type == ALT_LIM_BETWEEN)
+			VERIFY(vl->alt <= al.alt1 + VNAV_TOL);
+		if (sl.type == SPD_LIM_AT && vl->phase != FLT_PHASE_CRZ)
+			VERIFY(vl->kcas <= sl.spd1 + VNAV_TOL);
+		dist = vl->dist;
+		phase = vl->phase;
+	}
+}
+
+/*
+ * Checks the VNAV profile of the route as filed and again after capping
+ * the altitude halfway along the route at VNAV_CAP_ALT and limiting the
+ * speed at the first leg to VNAV_CAP_SPD.
+ */
+void
+test_vnav(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	route_leg_t		*err_rl = NULL;
+	const acft_perf_t	*acft;
+	const flt_perf_t	*flt;
+	vnav_profile_t		*prof;
+	unsigned		num_legs;
+	err_t			err;
+	alt_lim_t		alt_lim = {
+		ALT_LIM_AT_OR_BLW, VNAV_CAP_ALT, 0
+	};
+	spd_lim_t		spd_lim = { SPD_LIM_AT, VNAV_CAP_SPD };
+	uint64_t		t;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	flt = fms_flt_perf(fms);
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, flt, &err_rl);
+	num_legs = route_get_num_legs(route);
+	VERIFY(num_legs >= 4);
+
+	prof = vnav_profile_create(route, acft, flt, &err);
+	VERIFY(prof != NULL && err == ERR_OK);
+	test_vnav_check(route, prof);
+	printf("vnav: %u legs, %.1f NM, T/C %.1f NM, T/D %.1f NM, "
+	    "CRZ %.0f ft\n", num_legs, MET2NM(route_get_dist(route)),
+	    MET2NM(prof->toc), MET2NM(prof->tod), prof->crz_alt);
+	vnav_profile_destroy(prof);
+
+	route_l_set_alt_lim(route, find_rl(route, num_legs / 2), alt_lim);
+	route_l_set_spd_lim(route, find_rl(route, 1), spd_lim);
+	(void) route_update(route, acft, flt, &err_rl);
+	prof = vnav_profile_create(route, acft, flt, &err);
+	VERIFY(prof != NULL && err == ERR_OK);
+	test_vnav_check(route, prof);
+	VERIFY(isnan(prof->legs[num_legs / 2].dist) ||
+	    prof->legs[num_legs / 2].alt <= VNAV_CAP_ALT + VNAV_TOL);
+	printf("vnav: capped at %d ft: T/C %.1f NM, T/D %.1f NM\n",
+	    VNAV_CAP_ALT, MET2NM(prof->toc), MET2NM(prof->tod));
+	vnav_profile_destroy(prof);
+
+	t = mono_ns();
+	for (int i = 0; i < VNAV_BENCH_ITER; i++) {
+		prof = vnav_profile_create(route, acft, flt, &err);
+		VERIFY(prof != NULL);
+		vnav_profile_destroy(prof);
+	}
+	t = mono_ns() - t;
+	printf("vnav: %.3f ms/profile\n", t / 1e6 / VNAV_BENCH_ITER);
+
+	route_destroy(route);
+	fms_destroy(fms);
+}
+
+#define	VNAV_PRED_WIND		50	/* knots */
+#define	VNAV_PRED_ZFW		2000	/* kg */
+
+/*
+ * Checks that profiles `a' & `b' predict exactly the same times & fuel.
+ */
+static void
+test_vnav_pred_eq(const vnav_profile_t *a, const vnav_profile_t *b)
+{
+	VERIFY(a->num_legs == b->num_legs);
+	for (unsigned i = 0; i < a->num_legs; i++) {
+		const vnav_leg_t *la = &a->legs[i], *lb = &b->legs[i];
+
+		if (isnan(la->dist)) {
+			VERIFY(isnan(lb->dist));
+			continue;
+		}
+		VERIFY(la->alt == lb->alt && la->kcas == lb->kcas);
+		VERIFY(la->time == lb->time && la->fuel == lb->fuel);
+	}
+}
+
+/*
+ * Checks the VNAV time & fuel predictions. Time has to go up and fuel down
+ * along the legs. A head wind of VNAV_PRED_WIND knots set halfway along
+ * the route must only get the legs from there on refreshed and an added
+ * VNAV_PRED_ZFW kg of payload all of them, both with the same results as
+ * a profile built from scratch.
+ */
+void
+test_vnav_pred(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	route_leg_t		*err_rl = NULL;
+	const route_leg_t	*rl;
+	const acft_perf_t	*acft;
+	flt_perf_t		flt;
+	vnav_profile_t		*prof, *ref;
+	unsigned		num_legs, mid;
+	double			time = 0, fuel;
+	err_t			err;
+	uint64_t		t_wind, t_flt;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	flt = *fms_flt_perf(fms);
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, &flt, &err_rl);
+	num_legs = route_get_num_legs(route);
+	VERIFY(num_legs >= 4);
+	mid = num_legs / 2;
+
+	prof = vnav_profile_create(route, acft, &flt, &err);
+	VERIFY(prof != NULL && err == ERR_OK);
+	VERIFY(prof->pred_first == 0);
+	fuel = flt.fuel;
+	for (unsigned i = 0; i < num_legs; i++) {
+		const vnav_leg_t *vl = &prof->legs[i];
+
+		if (isnan(vl->dist))
+			continue;
+		VERIFY(vl->time >= time && vl->fuel <= fuel && vl->fuel > 0);
+		time = vl->time;
+		fuel = vl->fuel;
+	}
+	printf("vnav_pred: %u legs, %.1f NM, %.0f min, %.0f kg burned\n",
+	    num_legs, MET2NM(route_get_dist(route)), time / 60,
+	    flt.fuel - fuel);
+
+	/* the wind only changes the predictions from its leg onwards */
+	rl = find_rl(route, mid);
+	route_l_set_wind(route, rl, vect2_scmul(vect2_neg(prof->legs[mid].dir),
+	    VNAV_PRED_WIND));
+	if (route_update_needed(route)) {
+		/* wind around an alt-terminated leg, path moved */
+		(void) route_update(route, acft, &flt, &err_rl);
+		vnav_profile_destroy(prof);
+		prof = vnav_profile_create(route, acft, &flt, &err);
+		VERIFY(prof != NULL);
+	} else {
+		time = prof->legs[num_legs - 1].time;
+		VERIFY(vnav_profile_update(prof, route, acft, &flt) == ERR_OK);
+		VERIFY(prof->pred_first == mid);
+		VERIFY(isnan(prof->legs[num_legs - 1].time) ||
+		    prof->legs[num_legs - 1].time > time);
+	}
+	ref = vnav_profile_create(route, acft, &flt, &err);
+	VERIFY(ref != NULL);
+	test_vnav_pred_eq(prof, ref);
+	vnav_profile_destroy(ref);
+
+	/* nothing changed, nothing to refresh */
+	VERIFY(vnav_profile_update(prof, route, acft, &flt) == ERR_OK);
+	VERIFY(prof->pred_first == num_legs);
+
+	/* a heavier aircraft flies a different profile */
+	flt.zfw += VNAV_PRED_ZFW;
+	VERIFY(vnav_profile_update(prof, route, acft, &flt) == ERR_OK);
+	VERIFY(prof->pred_first == 0);
+	ref = vnav_profile_create(route, acft, &flt, &err);
+	VERIFY(ref != NULL);
+	test_vnav_pred_eq(prof, ref);
+	test_vnav_check(route, prof);
+	vnav_profile_destroy(ref);
+
+	t_wind = mono_ns();
+	for (int i = 0; i < VNAV_BENCH_ITER; i++) {
+		route_l_set_wind(route, rl, VECT2(i % 2, 0));
+		VERIFY(vnav_profile_update(prof, route, acft, &flt) ==
+		    ERR_OK);
+	}
+	t_wind = mono_ns() - t_wind;
+	t_flt = mono_ns();
+	for (int i = 0; i < VNAV_BENCH_ITER; i++) {
+		flt.zfw += (i % 2 == 0 ? 1 : -1);
+		VERIFY(vnav_profile_update(prof, route, acft, &flt) ==
+		    ERR_OK);
+	}
+	t_flt = mono_ns() - t_flt;
+	printf("vnav_pred: refresh %.3f ms after a wind change, %.3f ms "
+	    "after a weight change\n", t_wind / 1e6 / VNAV_BENCH_ITER,
+	    t_flt / 1e6 / VNAV_BENCH_ITER);
+
+	vnav_profile_destroy(prof);
+	route_destroy(route);
+	fms_destroy(fms);
+}
+
+#define	WX_FILE			"/tmp/test.ofwx"
+#define	WX_NUM_LAT		21
+#define	WX_NUM_LON		360
+#define	WX_NUM_CHECKS		1000
+#define	WX_BENCH_ITER		1000
+#define	WX_TOL			0.001	/* knots & degrees C */
+
+/*
+ * Fields the test forecast is filled with. They're linear along each
+ * axis, so the grid's interpolation must reproduce them exactly. `t' is
+ * in hours.
+ */
+#define	WX_FIELD_X(lat, lon, alt, t) \
+	(40 + 0.5 * ((lat) - 50) + (alt) / 1000 - 2 * (t))
+#define	WX_FIELD_Y(lat, lon, alt, t) \
+	(0.05 * (lon) - 0.2 * (alt) / 1000)
+#define	WX_FIELD_DEV(lat, lon, alt, t) \
+	(5 - 0.1 * (lat) + (alt) / 10000 + (t))
+
+/*
+ * Checks the forecast grid. A global grid filled with the WX_FIELD_*
+ * fields is written out and read back in, then sampled at WX_NUM_CHECKS
+ * random points, which have to match the fields, and across the
+ * antimeridian. With the forecast attached to the route, route_update &
+ * the VNAV predictions have to pick it up: the tail wind must shorten the
+ * flight time and a profile refreshed after attaching the forecast must
+ * match one built with it.
+ */
+void
+test_wx(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	const double		lvls[] = {
+	    1000, 850, 700, 500, 400, 300, 250, 200, 150
+	};
+	const double		times[] = { 1e9, 1e9 + 6 * 3600 };
+	const unsigned		num_lvl = sizeof (lvls) / sizeof (*lvls);
+	fms_t			*fms;
+	route_t			*route;
+	route_leg_t		*err_rl = NULL;
+	const acft_perf_t	*acft;
+	const flt_perf_t	*flt;
+	vnav_profile_t		*prof, *ref;
+	wx_t			*wx;
+	wx_sample_t		smpl, *smpls;
+	geo_pos3_t		*pos;
+	double			lvl_alt[sizeof (lvls) / sizeof (*lvls)];
+	double			*pos_t, time_isa, dist;
+	unsigned		num_legs, num_pos;
+	err_t			err;
+	uint64_t		t;
+
+	for (unsigned i = 0; i < num_lvl; i++)
+		lvl_alt[i] = press2alt(lvls[i] * 100, ISA_SL_PRESS);
+	/* north to south, like GRIB */
+	wx = wx_create(WX_NUM_LAT, 60, -1, WX_NUM_LON, 0, 1, num_lvl, lvls,
+	    2, times);
+	VERIFY(wx != NULL);
+	for (unsigned lat = 0; lat < WX_NUM_LAT; lat++) {
+		for (unsigned lon = 0; lon < WX_NUM_LON; lon++) {
+			for (unsigned l = 0; l < num_lvl; l++) {
+				for (unsigned i = 0; i < 2; i++) {
+					double y = 60.0 - lat, h = i * 6.0;
+					double a = lvl_alt[l];
+
+					wx_set(wx, lat, lon, l, i, VECT2(
+					    WX_FIELD_X(y, lon, a, h),
+					    WX_FIELD_Y(y, lon, a, h)),
+					    isadev2sat(alt2fl(a, ISA_SL_PRESS),
+					    WX_FIELD_DEV(y, lon, a, h)));
+				}
+			}
+		}
+	}
+	VERIFY(wx_write(wx, WX_FILE));
+	wx_close(wx);
+	wx = wx_open(WX_FILE);
+	VERIFY(wx != NULL);
+	(void) unlink(WX_FILE);
+
+	srand(1);
+	for (int i = 0; i < WX_NUM_CHECKS; i++) {
+		double y = 40 + 20.0 * rand() / RAND_MAX;
+		double x = 1 + 357.0 * rand() / RAND_MAX;
+		double a = wavg(lvl_alt[0], lvl_alt[num_lvl - 1],
+		    (double)rand() / RAND_MAX);
+		double h = 6.0 * rand() / RAND_MAX;
+
+		smpl = wx_sample(wx, GEO_POS3(y, x, a), times[0] + h * 3600);
+		VERIFY(ABS(smpl.wind.x - WX_FIELD_X(y, x, a, h)) < WX_TOL);
+		VERIFY(ABS(smpl.wind.y - WX_FIELD_Y(y, x, a, h)) < WX_TOL);
+		VERIFY(ABS(smpl.isadev - WX_FIELD_DEV(y, x, a, h)) < WX_TOL);
+	}
+	/* halfway between the last longitude and the first */
+	smpl = wx_sample(wx, GEO_POS3(50, -0.5, lvl_alt[0]), times[0]);
+	VERIFY(ABS(smpl.wind.y - AVG(WX_FIELD_Y(50, 359, lvl_alt[0], 0),
+	    WX_FIELD_Y(50, 0, lvl_alt[0], 0))) < WX_TOL);
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	flt = fms_flt_perf(fms);
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, flt, &err_rl);
+	num_legs = route_get_num_legs(route);
+	prof = vnav_profile_create(route, acft, flt, &err);
+	VERIFY(prof != NULL);
+	time_isa = prof->legs[num_legs - 1].time;
+
+	route_set_wx(route, wx, times[0]);
+	if (route_update_needed(route)) {
+		/* alt-terminated legs, path moved */
+		(void) route_update(route, acft, flt, &err_rl);
+		vnav_profile_destroy(prof);
+		prof = vnav_profile_create(route, acft, flt, &err);
+		VERIFY(prof != NULL);
+	} else {
+		VERIFY(vnav_profile_update(prof, route, acft, flt) == ERR_OK);
+		VERIFY(prof->pred_first == 0);
+	}
+	ref = vnav_profile_create(route, acft, flt, &err);
+	VERIFY(ref != NULL);
+	test_vnav_pred_eq(prof, ref);
+	vnav_profile_destroy(ref);
+	for (unsigned i = 0; i < num_legs; i++) {
+		if (!isnan(prof->legs[i].dist))
+			VERIFY(prof->legs[i].wx_wind.x > 0);
+	}
+	VERIFY(isnan(time_isa) || prof->legs[num_legs - 1].time < time_isa);
+	printf("wx: %.0f min in ISA without wind, %.0f min in the forecast\n",
+	    time_isa / 60, prof->legs[num_legs - 1].time / 60);
+	vnav_profile_destroy(prof);
+
+	dist = route_get_dist(route);
+	num_pos = MAX(MET2NM(dist), 1);
+	pos = malloc(num_pos * sizeof (*pos));
+	pos_t = malloc(num_pos * sizeof (*pos_t));
+	smpls = malloc(num_pos * sizeof (*smpls));
+	for (unsigned i = 0; i < num_pos; i++) {
+		pos[i] = GEO2_TO_GEO3(route_get_pos_at_dist(route,
+		    NM2MET(i), NULL), flt->crz_lvl);
+		pos_t[i] = times[0] + i * 8;
+	}
+	t = mono_ns();
+	for (int i = 0; i < WX_BENCH_ITER; i++)
+		wx_sample_n(wx, pos, pos_t, num_pos, smpls);
+	t = mono_ns() - t;
+	printf("wx: %u samples, %.2f us/route, %.1f ns/sample\n", num_pos,
+	    t / 1e3 / WX_BENCH_ITER, (double)t / WX_BENCH_ITER / num_pos);
+
+	free(pos);
+	free(pos_t);
+	free(smpls);
+	route_destroy(route);
+	fms_destroy(fms);
+	wx_close(wx);
+}
+
+#define	ARRSEL_BENCH_ITER	20
+
+static const char *
+test_arrsel_name(const navproc_t *proc, bool_t tr)
+{
+	if (proc == NULL)
+		return ("-");
+	return (tr ? proc->tr_name : proc->name);
 }
 
-static void
-strtoupper(char *str)
+/*
+ * Checks arrsel_rank. The candidates must each have their own procedures
+ * set, be ranked in order, and come out the same on one thread as on all
+ * of them, leaving the input route untouched.
+ */
+void
+test_arrsel(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
 {
-	while (*str) {
-		*str = toupper(*str);
-		str++;
+	fms_t			*fms;
+	route_t			*route;
+	route_leg_t		*err_rl = NULL;
+	const acft_perf_t	*acft;
+	const flt_perf_t	*flt;
+	arrsel_cand_t		*cands, *ref;
+	size_t			num_cands, num_ref, num_legs;
+	uint64_t		t_rank;
+
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	flt = fms_flt_perf(fms);
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, flt, &err_rl);
+	num_legs = route_get_num_legs(route);
+
+	ref = arrsel_rank(route, NULL, acft, flt, 1, &num_ref);
+	VERIFY(ref != NULL && num_ref != 0);
+	cands = arrsel_rank(route, NULL, acft, flt, 0, &num_cands);
+	VERIFY(cands != NULL && num_cands == num_ref);
+	VERIFY(route_get_num_legs(route) == num_legs);
+	for (size_t i = 0; i < num_cands; i++) {
+		const arrsel_cand_t *c = &cands[i];
+
+		VERIFY(route_get_appr(c->route) == c->appr);
+		VERIFY(route_get_apprtr(c->route) == c->apprtr);
+		VERIFY(route_get_startr(c->route) == c->startr);
+		VERIFY(c->err == ref[i].err &&
+		    c->num_disco == ref[i].num_disco);
+		if (c->err != ERR_OK)
+			continue;
+		VERIFY(c->dist == ref[i].dist && c->cost == ref[i].cost);
+		if (i == 0)
+			continue;
+		VERIFY(c[-1].err == ERR_OK);
+		VERIFY(c[-1].num_disco < c->num_disco ||
+		    (c[-1].num_disco == c->num_disco && c[-1].cost <= c->cost));
+	}
+	for (size_t i = 0; i < MIN(num_cands, 3); i++) {
+		const arrsel_cand_t *c = &cands[i];
+
+		printf("arrsel: #%lu %s.%s %s.%s  %u disco, %.1f NM, "
+		    "%.0f kg remaining\n", (unsigned long)i + 1,
+		    test_arrsel_name(c->startr, B_TRUE),
+		    test_arrsel_name(c->star, B_FALSE),
+		    test_arrsel_name(c->apprtr, B_TRUE),
+		    test_arrsel_name(c->appr, B_FALSE), c->num_disco,
+		    MET2NM(c->dist), c->fuel);
+	}
+	arrsel_free(ref, num_ref);
+	arrsel_free(cands, num_cands);
+
+	/* just the approaches to one runway */
+	ref = arrsel_rank(route, "06", acft, flt, 0, &num_ref);
+	for (size_t i = 0; i < num_ref; i++)
+		VERIFY(strcmp(ref[i].appr->rwy->ID, "06") == 0);
+	arrsel_free(ref, num_ref);
+
+	t_rank = mono_ns();
+	for (int i = 0; i < ARRSEL_BENCH_ITER; i++) {
+		cands = arrsel_rank(route, NULL, acft, flt, 0, &num_cands);
+		arrsel_free(cands, num_cands);
 	}
+	t_rank = mono_ns() - t_rank;
+	printf("arrsel: %lu combinations ranked in %.3f ms\n",
+	    (unsigned long)num_cands, t_rank / 1e6 / ARRSEL_BENCH_ITER);
+
+	route_destroy(route);
+	fms_destroy(fms);
 }
 
+#define	PAT_BENCH_ITER		20
+#define	PAT_ZFW_STEP		1000	/* kg */
+
+/*
+ * Checks reusing the layouts of holds & procedure turns from one
+ * route_update to the next (see rl_pat_lookup). A route updated with the
+ * weight changing back & forth, which recomputes all of it, must come out
+ * the same as a fresh route each time.
+ */
 void
-test_route(char *navdata_dir)
+test_route_pat(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
 {
-	char			cmd[64];
-	route_t			*route = NULL;
 	fms_t			*fms;
-	fms_navdb_t		*navdb;
+	route_t			*route;
+	route_leg_t		*err_rl = NULL;
 	const acft_perf_t	*acft;
-	flt_perf_t		*flt;
+	flt_perf_t		flt[2];
+	route_seg_t		*segs[2];
+	size_t			num_segs[2];
+	unsigned		num_pat = 0;
+	uint64_t		t_warm, t_cold;
 
 	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
-	if (!fms)
-		exit(EXIT_FAILURE);
-	navdb = fms->navdb;
+	VERIFY(fms != NULL);
 	acft = fms_acft_perf(fms);
-	flt = fms_flt_perf(fms);
+	for (int i = 0; i < 2; i++) {
+		flt[i] = *fms_flt_perf(fms);
+		flt[i].zfw += i * PAT_ZFW_STEP;
+		route = build_route(fms, dep, arr, item15);
+		(void) route_update(route, acft, &flt[i], &err_rl);
+		segs[i] = test_route_incr_snap(route, &num_segs[i]);
+		route_destroy(route);
+	}
 
-	route = route_create(navdb);
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, &flt[0], &err_rl);
+	VERIFY(test_route_copy_same(route, segs[0], num_segs[0]));
+	for (const route_leg_t *rl = list_head(route_get_legs(route));
+	    rl != NULL; rl = list_next(route_get_legs(route), rl)) {
+		if (rl->pat != NULL && rl->pat->valid)
+			num_pat++;
+	}
+	VERIFY(num_pat != 0);
 
-	while (!feof(stdin)) {
-		err_t err = ERR_OK;
-		route_leg_t *err_rl = NULL;
+	t_warm = mono_ns();
+	for (int i = 1; i <= PAT_BENCH_ITER; i++) {
+		(void) route_update(route, acft, &flt[i % 2], &err_rl);
+		VERIFY(test_route_copy_same(route, segs[i % 2],
+		    num_segs[i % 2]));
+	}
+	t_warm = mono_ns() - t_warm;
+
+	t_cold = 0;
+	for (int i = 1; i <= PAT_BENCH_ITER; i++) {
+		uint64_t t;
+
+		for (route_leg_t *rl = list_head(route_get_legs(route));
+		    rl != NULL; rl = list_next(route_get_legs(route), rl))
+			if (rl->pat != NULL)
+				rl->pat->valid = B_FALSE;
+		t = mono_ns();
+		(void) route_update(route, acft, &flt[i % 2], &err_rl);
+		t_cold += mono_ns() - t;
+		VERIFY(test_route_copy_same(route, segs[i % 2],
+		    num_segs[i % 2]));
+	}
+	printf("route_pat: %u holds & proc turns, full update %.3f ms "
+	    "reusing their layouts, %.3f ms laying them out anew\n",
+	    num_pat, t_warm / 1e6 / PAT_BENCH_ITER,
+	    t_cold / 1e6 / PAT_BENCH_ITER);
 
-		if (scanf("%63s", cmd) != 1)
-			continue;
-		strtolower(cmd);
-		if (strcmp(cmd, "exit") == 0) {
-			break;
-		}
-#define	SET_RTE_PARAM_CMD(cmdname, func) \
-	do { \
-		if (strcmp(cmd, cmdname) == 0) { \
-			char	param[8]; \
-			if (scanf("%7s", param) != 1) \
-				continue; \
-			strtoupper(param); \
-			if (strcmp(param, "NULL") == 0) \
-				err = func(route, NULL); \
-			else \
-				err = func(route, param); \
-		} \
-	} while (0)
-		SET_RTE_PARAM_CMD("origin", route_set_dep_arpt);
-		SET_RTE_PARAM_CMD("dest", route_set_arr_arpt);
-		SET_RTE_PARAM_CMD("altn1", route_set_altn1_arpt);
-		SET_RTE_PARAM_CMD("altn2", route_set_altn2_arpt);
-		SET_RTE_PARAM_CMD("rwy", route_set_dep_rwy);
-		SET_RTE_PARAM_CMD("sid", route_set_sid);
-		SET_RTE_PARAM_CMD("sidtr", route_set_sidtr);
-		SET_RTE_PARAM_CMD("star", route_set_star);
-		SET_RTE_PARAM_CMD("startr", route_set_startr);
-		SET_RTE_PARAM_CMD("appr", route_set_appr);
-		SET_RTE_PARAM_CMD("apprtr", route_set_apprtr);
+	free(segs[0]);
+	free(segs[1]);
+	route_destroy(route);
+	fms_destroy(fms);
+}
 
-		if (strcmp(cmd, "p") == 0) {
-			dump_route(route);
-		} else if (strcmp(cmd, "via") == 0) {
-			int idx;
-			char awy_name[NAV_NAME_LEN];
-			const route_leg_group_t *prev_rlg;
+#define	PROF_BENCH_ITER		20
 
-			memset(awy_name, 0, sizeof (awy_name));
-			if (scanf("%7d %7s", &idx, awy_name) != 2)
-				continue;
-			prev_rlg = find_rlg(route, idx - 1);
-			strtoupper(awy_name);
-			err = route_lg_awy_insert(route, awy_name, prev_rlg,
-			    NULL);
-		} else if (strcmp(cmd, "to") == 0) {
-			int idx;
-			char fix_name[32];
-			const route_leg_group_t *rlg;
+/*
+ * Runs PROF_BENCH_ITER full route_updates of `route' (the weight changing
+ * back & forth), checking each against `segs'. Returns the time taken.
+ */
+static uint64_t
+test_route_prof_run(route_t *route, const acft_perf_t *acft,
+    const flt_perf_t flt[2], route_seg_t *segs[2], size_t num_segs[2])
+{
+	route_leg_t	*err_rl = NULL;
+	uint64_t	t = mono_ns();
 
-			memset(fix_name, 0, sizeof (fix_name));
-			if (scanf("%7d %31s", &idx, fix_name) != 2)
-				continue;
-			strtoupper(fix_name);
-			rlg = find_rlg(route, idx);
-			if (!rlg)
-				continue;
-			err = route_lg_awy_set_end_fix(route, rlg, fix_name);
-		} else if (strcmp(cmd, "dir") == 0) {
-			int idx;
-			char fix_name[32];
-			const route_leg_group_t *prev_rlg;
-			wpt_t fix;
+	for (int i = 1; i <= PROF_BENCH_ITER; i++) {
+		(void) route_update(route, acft, &flt[i % 2], &err_rl);
+		VERIFY(test_route_copy_same(route, segs[i % 2],
+		    num_segs[i % 2]));
+	}
 
-			memset(fix_name, 0, sizeof (fix_name));
-			if (scanf("%7d %31s", &idx, fix_name) != 2)
-				continue;
-			strtoupper(fix_name);
-			fix = find_fix(fix_name, fms);
-			if (IS_NULL_WPT(&fix))
-				continue;
-			prev_rlg = find_rlg(route, idx - 1);
-			err = route_lg_direct_insert(route, &fix, prev_rlg,
-			    NULL);
-		} else if (strcmp(cmd, "ldir") == 0) {
-			int idx;
-			char fix_name[32];
-			const route_leg_t *prev_rl;
-			wpt_t fix;
+	return (mono_ns() - t);
+}
 
-			memset(fix_name, 0, sizeof (fix_name));
-			if (scanf("%7d %31s", &idx, fix_name) != 2)
-				continue;
-			strtoupper(fix_name);
-			fix = find_fix(fix_name, fms);
-			if (IS_NULL_WPT(&fix))
-				continue;
-			prev_rl = find_rl(route, idx - 1);
-			err = route_l_insert(route, &fix, prev_rl, NULL);
-		} else if (strcmp(cmd, "rm") == 0) {
-			int idx;
-			const route_leg_group_t *rlg;
-			if (scanf("%7d", &idx) != 1)
-				continue;
-			rlg = find_rlg(route, idx);
-			if (!rlg)
-				continue;
-			err = route_lg_delete(route, rlg);
-		} else if (strcmp(cmd, "lrm") == 0) {
-			int idx;
-			const route_leg_t *rl;
-			if (scanf("%7d", &idx) != 1)
-				continue;
-			rl = find_rl(route, idx);
-			if (!rl)
-				continue;
-			route_l_delete(route, rl);
-		} else if (strcmp(cmd, "lmv") == 0) {
-			int idx1, idx2;
-			const route_leg_t *rl1, *rl2;
-			if (scanf("%7d %7d", &idx1, &idx2) != 2)
-				continue;
-			rl1 = find_rl(route, idx1);
-			rl2 = find_rl(route, idx2);
-			if (!rl1 || !rl2) {
-				fprintf(stderr, "idx out of rng\n");
-				continue;
-			}
-			route_l_move(route, rl1, rl2);
-		} else if (strcmp(cmd, "r") == 0) {
-			dump_route_leg_groups(route);
-		} else if (strcmp(cmd, "l") == 0) {
-			dump_route_legs(route);
-		} else if (strcmp(cmd, "airac") == 0) {
-			char mon1[5], mon2[5];
-			locale_t loc;
-			struct tm tm_start, tm_end;
+/*
+ * Checks the route_update profiling counters (see route_prof_enable).
+ * Nothing may be counted while profiling is disabled, every leg of the
+ * route must be counted in each update while enabled, and the routes must
+ * come out the same either way. Needs route.c built with ROUTE_PROF.
+ */
+void
+test_route_prof(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_t			*fms;
+	route_t			*route;
+	route_leg_t		*err_rl = NULL;
+	const acft_perf_t	*acft;
+	flt_perf_t		flt[2];
+	route_seg_t		*segs[2];
+	size_t			num_segs[2];
+	route_prof_stat_t	stats[ROUTE_PROF_NUM_CTRS];
+	route_prof_stat_t	stats2[ROUTE_PROF_NUM_CTRS];
+	uint64_t		num_legs = 0, t_off, t_on;
+	char			*dump;
+
+	if (!route_prof_enable(B_FALSE)) {
+		printf("route_prof: route.c wasn't built with ROUTE_PROF\n");
+		return;
+	}
+	route_prof_reset();
 
-			loc = newlocale(LC_TIME_MASK, NULL, LC_GLOBAL_LOCALE);
-			VERIFY(loc != NULL);
-			gmtime_r(&navdb->valid_from, &tm_start);
-			gmtime_r(&navdb->valid_to, &tm_end);
-			strftime_l(mon1, 5, "%b", &tm_start, loc);
-			strftime_l(mon2, 5, "%b", &tm_end, loc);
-			strtoupper(mon1);
-			strtoupper(mon2);
-			printf("CYCLE:%u "
-			    "VALID:%02d%s%02d/%02d%s%02d (%sCURRENT) "
-			    "UNIX:%lu/%lu\n",
-			    navdb->airac_cycle,
-			    tm_start.tm_mday, mon1, tm_start.tm_year % 100,
-			    tm_end.tm_mday, mon2, tm_end.tm_year % 100,
-			    navdb_is_current(navdb) ? "" : "NOT ",
-			    navdb->valid_from, navdb->valid_to);
-			freelocale(loc);
-		}
+	fms = fms_new(navdata_dir, "doc/WMM.COF", "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+	acft = fms_acft_perf(fms);
+	for (int i = 0; i < 2; i++) {
+		flt[i] = *fms_flt_perf(fms);
+		flt[i].zfw += i * PAT_ZFW_STEP;
+		route = build_route(fms, dep, arr, item15);
+		(void) route_update(route, acft, &flt[i], &err_rl);
+		segs[i] = test_route_incr_snap(route, &num_segs[i]);
+		route_destroy(route);
+	}
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, &flt[0], &err_rl);
+	t_off = test_route_prof_run(route, acft, flt, segs, num_segs);
+	route_destroy(route);
+	VERIFY(route_prof_get(stats));
+	for (int i = 0; i < ROUTE_PROF_NUM_CTRS; i++)
+		VERIFY(stats[i].count == 0 && stats[i].ns == 0);
+
+	/*
+	 * Enabled from a fresh route on, so that the joins (which the
+	 * updates after the first one replay from the join cache) show up.
+	 */
+	VERIFY(route_prof_enable(B_TRUE));
+	route = build_route(fms, dep, arr, item15);
+	(void) route_update(route, acft, &flt[0], &err_rl);
+	VERIFY(test_route_copy_same(route, segs[0], num_segs[0]));
+	t_on = test_route_prof_run(route, acft, flt, segs, num_segs);
+	VERIFY(route_prof_enable(B_FALSE));
+	VERIFY(route_prof_get(stats));
+	for (const route_leg_t *rl = list_head(route_get_legs(route));
+	    rl != NULL; rl = list_next(route_get_legs(route), rl)) {
+		if (!rl->disco)
+			num_legs++;
+	}
+	for (int i = ROUTE_PROF_LEG; i < ROUTE_PROF_NUM_CTRS; i++)
+		num_legs -= stats[i].count / (PROF_BENCH_ITER + 1);
+	VERIFY(num_legs == 0);
+
+	/* disabled again, nothing more may be counted */
+	(void) test_route_prof_run(route, acft, flt, segs, num_segs);
+	VERIFY(route_prof_get(stats2));
+	VERIFY(memcmp(stats, stats2, sizeof (stats)) == 0);
+
+	dump = route_prof_dump();
+	VERIFY(dump != NULL);
+	printf("route_prof: counters of %d full updates:\n%s",
+	    PROF_BENCH_ITER + 1, dump);
+	free(dump);
+	route_prof_reset();
+	VERIFY(route_prof_dump() == NULL);
+	printf("route_prof: full update %.3f ms with profiling disabled, "
+	    "%.3f ms enabled\n", t_off / 1e6 / PROF_BENCH_ITER,
+	    t_on / 1e6 / PROF_BENCH_ITER);
+
+	free(segs[0]);
+	free(segs[1]);
+	route_destroy(route);
+	fms_destroy(fms);
+}
 
-		if (err == ERR_OK)
-			err = route_update(route, acft, flt, &err_rl);
+#define	BATCH_ROUTES		256
+#define	BATCH_MIN_THREADS	4
 
-		if (err != ERR_OK) {
-			fprintf(stderr, "%s\n", err2str(err));
-			continue;
+/*
+ * Checks route_batch_compute. Builds BATCH_ROUTES copies of the route,
+ * plus one with an unknown arrival airport, on 1, 2, 4, ... threads up to
+ * the number of online CPUs (at least BATCH_MIN_THREADS). Every run must
+ * produce exactly the routes of the single-threaded one, with the bad spec
+ * failing on its own. Meant to be run under ThreadSanitizer or helgrind.
+ */
+void
+test_route_batch(const char *navdata_dir, const char *dep, const char *arr,
+    const char *item15)
+{
+	fms_navdb_t		*navdb;
+	fms_t			*fms;
+	route_batch_spec_t	specs[BATCH_ROUTES + 1];
+	route_batch_res_t	ref[BATCH_ROUTES + 1];
+	route_batch_res_t	res[BATCH_ROUTES + 1];
+	route_seg_t		*segs;
+	size_t			num_segs;
+	unsigned		max_threads = MAX(sysconf(_SC_NPROCESSORS_ONLN),
+	    BATCH_MIN_THREADS);
+	double			base = 0;
+
+	navdb = fms_navdb_open(navdata_dir, "doc/WMM.COF");
+	VERIFY(navdb != NULL);
+	fms = fms_new_navdb(navdb, "doc/perf_sample.csv");
+	VERIFY(fms != NULL);
+
+	for (int i = 0; i <= BATCH_ROUTES; i++) {
+		specs[i] = (route_batch_spec_t){
+			.dep = dep, .arr = strcmp(arr, "-") != 0 ? arr : NULL,
+			.item15 = item15, .acft = fms_acft_perf(fms),
+			.flt = fms_flt_perf(fms)
+		};
+	}
+	specs[BATCH_ROUTES / 2].arr = "ZZZZ";
+
+	VERIFY(route_batch_compute(navdb, specs, ref, BATCH_ROUTES + 1, 1) ==
+	    BATCH_ROUTES);
+	VERIFY(ref[BATCH_ROUTES / 2].err == ERR_ARPT_NOT_FOUND);
+	segs = test_route_incr_snap(ref[0].route, &num_segs);
+	printf("route: %lu legs, %lu segs\n",
+	    (unsigned long)route_get_num_legs(ref[0].route),
+	    (unsigned long)num_segs);
+
+	for (unsigned n = 1; n <= max_threads; n *= 2) {
+		uint64_t	t_start = mono_ns();
+		size_t		num_ok = route_batch_compute(navdb, specs, res,
+		    BATCH_ROUTES + 1, n);
+		double		secs = (mono_ns() - t_start) / 1000000000.0;
+		double		rate = (BATCH_ROUTES + 1) / MAX(secs, 1e-9);
+
+		VERIFY(num_ok == BATCH_ROUTES);
+		for (int i = 0; i <= BATCH_ROUTES; i++) {
+			VERIFY(res[i].err == ref[i].err);
+			if (res[i].err == ERR_OK) {
+				VERIFY(test_route_copy_same(res[i].route,
+				    segs, num_segs));
+			}
+			route_destroy(res[i].route);
 		}
+		if (n == 1)
+			base = rate;
+		printf("threads: %2u  %8.0f routes/s  speedup %.2fx\n", n,
+		    rate, rate / base);
 	}
 
-	route_destroy(route);
+	for (int i = 0; i <= BATCH_ROUTES; i++)
+		route_destroy(ref[i].route);
+	free(segs);
 	fms_destroy(fms);
+	VERIFY(navdb->refcnt == 1);
+	fms_navdb_close(navdb);
 }
 
 void
@@ -1484,6 +4195,28 @@ main(int argc, char **argv)
 	}
 	test_airac(airac_dir, dump);
 #endif
+#ifdef	TEST_ARPT_VALIDATE
+	unsigned num_threads = 0;
+	bool_t verbose = B_FALSE;
+	int c;
+	while ((c = getopt(argc, argv, "j:v")) != -1) {
+		switch (c) {
+		case 'j':
+			num_threads = atoi(optarg);
+			break;
+		case 'v':
+			verbose = B_TRUE;
+			break;
+		default:
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "Missing navdata_dir argument\n");
+		return (1);
+	}
+	test_arpt_validate(argv[optind], num_threads, verbose);
+#endif
 #ifdef	TEST_LCC
 	test_lcc(40, 30, 50);
 #endif
@@ -1496,6 +4229,70 @@ main(int argc, char **argv)
 #ifdef	TEST_ROUTE
 	test_route(argv[optind]);
 #endif
+#ifdef	TEST_FPL_INGEST
+	if (argc - optind >= 4) {
+		test_fpl_ingest(argv[optind], argv[optind + 1],
+		    argv[optind + 2], argv[optind + 3]);
+	} else {
+		test_fpl_ingest(argv[optind], NULL, NULL, NULL);
+	}
+#endif
+#ifdef	TEST_ROUTE_INCR
+	test_route_incr(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_COPY
+	test_route_copy(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_SER
+	test_route_ser(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_CACHE
+	test_route_cache(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_JOIN
+	test_route_join(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_DIST
+	test_route_dist(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_LNAV
+	test_lnav(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_VNAV
+	test_vnav(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_VNAV_PRED
+	test_vnav_pred(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_WX
+	test_wx(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ARRSEL
+	test_arrsel(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_PAT
+	test_route_pat(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_PROF
+	test_route_prof(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
+#ifdef	TEST_ROUTE_BATCH
+	test_route_batch(argv[optind], argv[optind + 1], argv[optind + 2],
+	    argv[optind + 3]);
+#endif
 #ifdef	TEST_MAGVAR
 	test_magvar();
 #endif
@@ -1508,6 +4305,27 @@ main(int argc, char **argv)
 #ifdef	TEST_ROUTE_SEG
 	test_route_seg();
 #endif
+#ifdef	TEST_NUMPARSE
+	test_numparse(argv[optind]);
+#endif
+#ifdef	TEST_NAVDB_SWAP
+	test_navdb_swap(argv[optind], argv[optind + 1]);
+#endif
+#ifdef	TEST_WPT_DECODE
+	test_wpt_decode(argv[optind], (const char **)&argv[optind + 1],
+	    argc - optind - 1);
+#endif
+#ifdef	TEST_WPT_NEAREST
+	test_wpt_nearest(argv[optind], argv[optind + 1],
+	    atof(argv[optind + 2]), atof(argv[optind + 3]));
+#endif
+#ifdef	TEST_NAVDB_SHARE
+	test_navdb_share(argv[optind], (const char **)&argv[optind + 1],
+	    argc - optind - 1);
+#endif
+#ifdef	TEST_AIRAC_DELTA
+	test_airac_delta(argv[optind], argv[optind + 1], argv[optind + 2]);
+#endif
 
 	return (0);
 }
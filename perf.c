@@ -285,6 +285,7 @@ acft_perf_parse(const char *filename)
 	free(line);
 
 	acft->ref.thr_derate = 1;
+	acft->serial = serial_next();
 
 	return (acft);
 errout:
@@ -338,6 +339,22 @@ flt_perf_destroy(flt_perf_t *flt)
 	free(flt);
 }
 
+/*
+ * Compares two flight performance configurations field by field.
+ */
+bool_t
+flt_perf_eq(const flt_perf_t *a, const flt_perf_t *b)
+{
+	return (a->zfw == b->zfw && a->fuel == b->fuel &&
+	    a->clb_ias == b->clb_ias && a->clb_mach == b->clb_mach &&
+	    a->crz_ias == b->crz_ias && a->crz_mach == b->crz_mach &&
+	    a->crz_lvl == b->crz_lvl &&
+	    a->des_ias == b->des_ias && a->des_mach == b->des_mach &&
+	    a->to_flap == b->to_flap && a->accel_height == b->accel_height &&
+	    a->spd_lim == b->spd_lim && a->spd_lim_alt == b->spd_lim_alt &&
+	    a->thr_derate == b->thr_derate);
+}
+
 /*
  * Estimates maximum available engine thrust in a given flight situation.
  * This takes into account atmospheric conditions as well as any currently
@@ -932,15 +949,123 @@ dist2accelclb(const flt_perf_t *flt, const acft_perf_t *acft,
 	return (dist);
 }
 
-/* TODO:
+/*
+ * Descent counterpart of dist2accelclb. Simulates an idle thrust descent
+ * from `alt' & `kcas' towards `alt_tgt' & `kcas_tgt', stopping once either
+ * the target is reached or `dist_tgt' NM have been covered. `alt' and
+ * `kcas' are updated with the state reached. The speed is held to
+ * `mach_lim' and below `flt->spd_lim_alt' to `flt->spd_lim', decelerating
+ * where needed. The aircraft never accelerates in the descent though, so
+ * `kcas_tgt' only ever acts as a speed limit. ACCEL_THEN_CLB first
+ * decelerates and then descends, ACCEL_AND_CLB does a 50/50 time split.
+ * ACCEL_TAKEOFF isn't meaningful in a descent.
+ *
+ * @return Distance over the ground covered in NM or NAN if the aircraft
+ *	is unable to descend (idle thrust exceeding drag).
+ */
 double
 dist2deceldes(const flt_perf_t *flt, const acft_perf_t *acft, double isadev,
     double qnh, double tp_alt, double fuel, vect2_t dir, double flap_ratio,
     double *alt, double *kcas, vect2_t wind, double alt_tgt, double kcas_tgt,
     double mach_lim, double dist_tgt, accelclb_t type, double *burnp)
 {
+	double dist = 0, burn = 0;
+	double wind_mps = KT2MPS(vect2_dotprod(wind, dir));
+	double kcas_lim = kcas_tgt;
+
+	ASSERT(*alt >= alt_tgt);
+	ASSERT(type != ACCEL_TAKEOFF);
+
+	for (;;) {
+		double tas_mps, rmng, t_rmng, decel_t, des_t, oat, Ps,
+		    ktas_lim_mach, kcas_lim_mach;
+
+		oat = isadev2sat(alt2fl(*alt, qnh), isadev);
+		Ps = alt2press(*alt, qnh);
+		ktas_lim_mach = mach2ktas(mach_lim, oat);
+		kcas_lim_mach = ktas2kcas(ktas_lim_mach, Ps, oat);
+
+		kcas_lim = kcas_tgt;
+		if (*alt < flt->spd_lim_alt + ALT_THRESH &&
+		    kcas_lim > flt->spd_lim)
+			kcas_lim = flt->spd_lim;
+		if (kcas_lim > kcas_lim_mach)
+			kcas_lim = kcas_lim_mach;
+
+		if (dist >= dist_tgt || ((*alt) - alt_tgt <= ALT_THRESH &&
+		    (*kcas) - kcas_lim <= KCAS_THRESH))
+			break;
+
+		tas_mps = KT2MPS(kcas2ktas(*kcas, Ps, oat));
+		rmng = NM2MET(dist_tgt - dist);
+		/* decelerating covers less than `rmng', so don't crawl up */
+		t_rmng = MIN(MAX(rmng / tas_mps, 1), SECS_PER_STEP);
+
+		/*
+		 * Only decelerate when above the limit, spd_chg_step would
+		 * otherwise hand us back the energy for a climb.
+		 */
+		if ((*kcas) - kcas_lim > KCAS_THRESH) {
+			if (type == ACCEL_THEN_CLB)
+				decel_t = t_rmng;
+			else
+				decel_t = t_rmng / 2;
+			if (!spd_chg_step(B_FALSE, isadev, tp_alt, qnh,
+			    B_FALSE, *alt, kcas, kcas_lim, wind_mps,
+			    flt->zfw + fuel - burn, flap_ratio, acft, flt,
+			    &dist, &decel_t, &burn)) {
+				return (NAN);
+			}
+		} else {
+			decel_t = 0;
+		}
+
+		des_t = t_rmng - decel_t;
+		if (des_t > 0 && (*alt) - alt_tgt > ALT_THRESH &&
+		    !alt_chg_step(B_FALSE, isadev, tp_alt, qnh, alt, kcas,
+		    alt_tgt, wind_mps, flt->zfw + fuel - burn, flap_ratio,
+		    acft, flt, &dist, &des_t, &burn)) {
+			return (NAN);
+		}
+	}
+	if (burnp != NULL)
+		*burnp = burn;
+
+	return (dist);
+}
+
+/*
+ * Calculates the fuel flow needed to hold altitude `alt' at calibrated
+ * airspeed `kcas' in level flight, i.e. with the engines' thrust matching
+ * the drag.
+ *
+ * @param acft Aircraft performance tables.
+ * @param isadev ISA temperature deviation in degrees C.
+ * @param qnh QNH in Pa.
+ * @param alt Altitude in feet AMSL.
+ * @param kcas Calibrated airspeed in knots.
+ * @param mass Aircraft total mass in kg.
+ * @param flap_ratio Flap setting between 0 and 1 inclusive.
+ *
+ * @return The fuel flow in kg/hr or NAN if the aircraft can't produce
+ *	enough lift to fly this slow.
+ */
+double
+perf_level_ff(const acft_perf_t *acft, double isadev, double qnh,
+    double alt, double kcas, double mass, double flap_ratio)
+{
+	double Ps = alt2press(alt, qnh);
+	double oat = isadev2sat(alt2fl(alt, qnh), isadev);
+	double ktas = kcas2ktas(kcas, Ps, oat);
+	double Pd = dyn_press(ktas, Ps, oat);
+	double D = air_density(Ps + Pd, oat);
+	double aoa = get_aoa(Pd, mass, flap_ratio, acft);
+
+	if (isnan(aoa))
+		return (NAN);
+	return (acft_get_sfc(acft, get_drag(Pd, aoa, flap_ratio, acft), D,
+	    isadev));
 }
-*/
 
 double
 perf_TO_spd(const flt_perf_t *flt, const acft_perf_t *acft)
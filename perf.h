@@ -26,6 +26,8 @@
 #ifndef	_OPENFMC_PERF_H_
 #define	_OPENFMC_PERF_H_
 
+#include <stdint.h>
+
 #include "geom.h"
 
 #ifdef	__cplusplus
@@ -139,6 +141,13 @@ typedef struct {
 	bezier_t	*cd_flap_curve;
 	double		cl_flap_max_aoa;
 	double		wing_area;
+
+	/*
+	 * Identifies this set of performance data (see serial_next). Code
+	 * which modifies a copy of an acft_perf_t must give the copy a new
+	 * serial, so routes computed with the original aren't reused.
+	 */
+	uint64_t	serial;
 } acft_perf_t;
 
 /* Type of acceleration-climb */
@@ -153,6 +162,7 @@ void acft_perf_destroy(acft_perf_t *perf);
 
 flt_perf_t *flt_perf_new(const acft_perf_t *acft);
 void flt_perf_destroy(flt_perf_t *flt);
+bool_t flt_perf_eq(const flt_perf_t *a, const flt_perf_t *b);
 
 double eng_max_thr_avg(const flt_perf_t *flt, const acft_perf_t *acft,
     double alt1, double alt2, double ktas, double qnh, double isadev,
@@ -176,6 +186,8 @@ double dist2deceldes(const flt_perf_t *flt, const acft_perf_t *acft,
     accelclb_t type, double *burnp);
 
 double perf_TO_spd(const flt_perf_t *flt, const acft_perf_t *acft);
+double perf_level_ff(const acft_perf_t *acft, double isadev, double qnh,
+    double alt, double kcas, double mass, double flap_ratio);
 
 double acft_get_sfc(const acft_perf_t *acft, double thr, double dens,
     double isadev);
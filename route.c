@@ -25,8 +25,12 @@
 
 #include <stdlib.h>
 #include <stddef.h>
+#include <limits.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "math.h"
 #include "perf.h"
@@ -44,6 +48,16 @@
 #define	INTCP_SRCH_DIST		1e9
 
 #define	ARC_START_THRESH	100
+#define	PAT_SPD_BAND		5	/* knots, see rl_pat_lookup */
+
+/*
+ * Minimum number of legs in a route section to hand it to a worker thread.
+ * Queueing a section on the (already running) pool costs about as much as
+ * computing a couple of legs.
+ */
+#define	ROUTE_UPD_SECT_MIN_LEGS	4
+/* Maximum number of threads used by a single route_update */
+#define	ROUTE_UPD_MAX_THREADS	16
 
 static void rlg_connect(route_t *route, route_leg_group_t *prev_rlg,
     route_leg_group_t *next_rlg, bool_t allow_mod, bool_t allow_add_legs);
@@ -52,6 +66,8 @@ static void rlg_bypass(route_t *route, route_leg_group_t *rlg,
 static route_leg_t * last_leg_before_rlg(route_t *route,
     route_leg_group_t *rlg);
 static bool_t navprocs_related(const navproc_t *nv1, const navproc_t *nv2);
+static void route_upd_pool_hold(unsigned num_workers);
+static void route_upd_pool_rele(void);
 
 typedef geo_pos2_t (*leg_intc_func_t)(geo_pos2_t cur_pos,
     const route_leg_t *rl, const list_t *legs, const wmm_t *wmm);
@@ -75,12 +91,21 @@ static bool_t rl_find_leg_seg(const route_leg_t *rl, geo_pos2_t oldpos,
     const route_leg_t *next_rl, const wmm_t *wmm, route_seg_t *seg);
 
 static double calc_arc_radius(double speed, double turn_rate);
-static route_seg_t *rs_new_direct(geo_pos2_t start, geo_pos2_t end,
+static route_seg_t *rs_new_direct(route_pool_t *pool, geo_pos2_t start,
+    geo_pos2_t end, route_seg_join_type_t join_type);
+static route_seg_t *rs_new_arc(route_pool_t *pool, geo_pos2_t start,
+    geo_pos2_t end, geo_pos2_t center, bool_t cw,
     route_seg_join_type_t join_type);
-static route_seg_t *rs_new_arc(geo_pos2_t start, geo_pos2_t end,
-    geo_pos2_t center, bool_t cw, route_seg_join_type_t join_type);
+static route_seg_t *rs_join(route_pool_t *pool, list_t *seglist,
+    route_seg_t *rs1, route_seg_t *rs2, double wpt_rnp, double spd,
+    double turn_rate);
 
 static double arc_seg_get_radius(const route_seg_t *rs);
+static double rs_get_len(const route_seg_t *rs);
+static uint64_t route_cache_hash(const uint8_t *buf, size_t len);
+static void route_join_cache_destroy(route_join_cache_t *jc);
+static err_t route_set_arpt(route_t *route, airport_t **arptp,
+    const char *icao);
 
 /*
  * Functions that compute leg intersections. Order must follow
@@ -113,24 +138,622 @@ static leg_intc_func_t const leg_intc_func_tbl[NAVPROC_SEG_TYPES] = {
 };
 
 /*
- * Destroys and frees a route_seg_t.
+ * Profiling of route_update. With ROUTE_PROF defined (`make route_prof=yes')
+ * the leg handlers, segment joins and the costlier geometry & performance
+ * functions called from this file count their calls and the time spent
+ * in them, once enabled with route_prof_enable. While disabled, each
+ * probe costs one load & branch. Times are inclusive, e.g. a leg handler's
+ * time includes the gc_distance calls made from it. The counters are
+ * global and updated atomically, so they sum up all threads computing
+ * routes. Without ROUTE_PROF the probes compile away entirely.
+ */
+#ifdef	ROUTE_PROF
+
+static bool_t route_prof_on = B_FALSE;
+static route_prof_stat_t route_prof_stats[ROUTE_PROF_NUM_CTRS];
+
+static inline uint64_t
+route_prof_start(void)
+{
+	struct timespec ts;
+
+	if (!__atomic_load_n(&route_prof_on, __ATOMIC_RELAXED))
+		return (0);
+	VERIFY(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+	return (ts.tv_sec * 1000000000llu + ts.tv_nsec);
+}
+
+static inline void
+route_prof_end(route_prof_ctr_t ctr, uint64_t t0)
+{
+	route_prof_stat_t	*stat = &route_prof_stats[ctr];
+	struct timespec		ts;
+
+	if (t0 == 0)
+		return;
+	VERIFY(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+	__atomic_add_fetch(&stat->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stat->ns, ts.tv_sec * 1000000000llu +
+	    ts.tv_nsec - t0, __ATOMIC_RELAXED);
+}
+
+#define	PROF_START(t0)		uint64_t t0 = route_prof_start()
+#define	PROF_END(ctr, t0)	route_prof_end((ctr), (t0))
+
+/*
+ * Probed versions of the functions we profile. Everything below the
+ * #defines calls these instead.
+ */
+static double
+route_prof_wmm_true2mag(const wmm_t *wmm, double t, geo_pos3_t pos)
+{
+	PROF_START(t0);
+	double m = wmm_true2mag(wmm, t, pos);
+	PROF_END(ROUTE_PROF_WMM, t0);
+	return (m);
+}
+
+static double
+route_prof_wmm_mag2true(const wmm_t *wmm, double m, geo_pos3_t pos)
+{
+	PROF_START(t0);
+	double t = wmm_mag2true(wmm, m, pos);
+	PROF_END(ROUTE_PROF_WMM, t0);
+	return (t);
+}
+
+static geo_pos2_t
+route_prof_geo_displace_mag(const ellip_t *ellip, const wmm_t *wmm,
+    geo_pos2_t pos, double maghdg, double dist)
+{
+	PROF_START(t0);
+	geo_pos2_t p = geo_displace_mag(ellip, wmm, pos, maghdg, dist);
+	PROF_END(ROUTE_PROF_GEO_DISPLACE_MAG, t0);
+	return (p);
+}
+
+static double
+route_prof_gc_distance(geo_pos2_t start, geo_pos2_t end)
+{
+	PROF_START(t0);
+	double d = gc_distance(start, end);
+	PROF_END(ROUTE_PROF_GC_DISTANCE, t0);
+	return (d);
+}
+
+static fpp_t
+route_prof_gnomo_fpp_init(geo_pos2_t center, double rot,
+    const ellip_t *ellip, bool_t allow_inv)
+{
+	PROF_START(t0);
+	fpp_t fpp = gnomo_fpp_init(center, rot, ellip, allow_inv);
+	PROF_END(ROUTE_PROF_FPP_INIT, t0);
+	return (fpp);
+}
+
+static double
+route_prof_accelclb2dist(const flt_perf_t *flt, const acft_perf_t *acft,
+    double isadev, double qnh, double tp_alt, double fuel, vect2_t dir,
+    double alt1, double kcas1, vect2_t wind1,
+    double alt2, double kcas2, vect2_t wind2,
+    double flap_ratio, double mach_lim, accelclb_t type, double *burnp)
+{
+	PROF_START(t0);
+	double d = accelclb2dist(flt, acft, isadev, qnh, tp_alt, fuel, dir,
+	    alt1, kcas1, wind1, alt2, kcas2, wind2, flap_ratio, mach_lim,
+	    type, burnp);
+	PROF_END(ROUTE_PROF_ACCELCLB2DIST, t0);
+	return (d);
+}
+
+#define	wmm_true2mag		route_prof_wmm_true2mag
+#define	wmm_mag2true		route_prof_wmm_mag2true
+#define	geo_displace_mag	route_prof_geo_displace_mag
+#define	gc_distance		route_prof_gc_distance
+#define	gnomo_fpp_init		route_prof_gnomo_fpp_init
+#define	accelclb2dist		route_prof_accelclb2dist
+
+#else	/* !ROUTE_PROF */
+
+#define	PROF_START(t0)
+#define	PROF_END(ctr, t0)
+
+#endif	/* !ROUTE_PROF */
+
+/*
+ * Turns profiling of route_update on or off. The counters keep their
+ * values, use route_prof_reset to start over.
+ *
+ * @return B_FALSE if route.c was built without ROUTE_PROF, in which case
+ *	there's nothing to enable.
+ */
+bool_t
+route_prof_enable(bool_t flag)
+{
+#ifdef	ROUTE_PROF
+	__atomic_store_n(&route_prof_on, flag, __ATOMIC_RELAXED);
+	return (B_TRUE);
+#else	/* !ROUTE_PROF */
+	UNUSED(flag);
+	return (B_FALSE);
+#endif	/* !ROUTE_PROF */
+}
+
+/*
+ * Zeroes the profiling counters. Counts racing with this from other
+ * threads may be lost.
+ */
+void
+route_prof_reset(void)
+{
+#ifdef	ROUTE_PROF
+	for (int i = 0; i < ROUTE_PROF_NUM_CTRS; i++) {
+		__atomic_store_n(&route_prof_stats[i].count, 0,
+		    __ATOMIC_RELAXED);
+		__atomic_store_n(&route_prof_stats[i].ns, 0, __ATOMIC_RELAXED);
+	}
+#endif	/* ROUTE_PROF */
+}
+
+/*
+ * Fills `stats' with the profiling counters, indexed by route_prof_ctr_t.
+ *
+ * @return B_FALSE if built without ROUTE_PROF (`stats' is then zeroed).
+ */
+bool_t
+route_prof_get(route_prof_stat_t stats[ROUTE_PROF_NUM_CTRS])
+{
+#ifdef	ROUTE_PROF
+	for (int i = 0; i < ROUTE_PROF_NUM_CTRS; i++) {
+		stats[i].count = __atomic_load_n(&route_prof_stats[i].count,
+		    __ATOMIC_RELAXED);
+		stats[i].ns = __atomic_load_n(&route_prof_stats[i].ns,
+		    __ATOMIC_RELAXED);
+	}
+	return (B_TRUE);
+#else	/* !ROUTE_PROF */
+	memset(stats, 0, sizeof (*stats) * ROUTE_PROF_NUM_CTRS);
+	return (B_FALSE);
+#endif	/* !ROUTE_PROF */
+}
+
+const char *
+route_prof_ctr2str(route_prof_ctr_t ctr)
+{
+	static const char *names[ROUTE_PROF_LEG] = {
+		"join dir", "join reintcp trk", "join reintcp dir", "join arc",
+		"wmm", "geo_displace_mag", "gc_distance", "fpp_init",
+		"accelclb2dist"
+	};
+
+	ASSERT(ctr < ROUTE_PROF_NUM_CTRS);
+	if (ctr < ROUTE_PROF_LEG)
+		return (names[ctr]);
+	return (navproc_seg_type2str(ctr - ROUTE_PROF_LEG));
+}
+
+/*
+ * Returns a malloc'd table of the profiling counters which counted
+ * anything, or NULL if there's nothing to show.
+ */
+char *
+route_prof_dump(void)
+{
+	route_prof_stat_t	stats[ROUTE_PROF_NUM_CTRS];
+	char			*result = NULL;
+	size_t			result_sz = 0;
+
+	if (!route_prof_get(stats))
+		return (NULL);
+	for (int i = 0; i < ROUTE_PROF_NUM_CTRS; i++) {
+		char name[32];
+
+		if (stats[i].count == 0)
+			continue;
+		snprintf(name, sizeof (name), "%s%s",
+		    i >= ROUTE_PROF_LEG ? "leg " : "", route_prof_ctr2str(i));
+		if (result == NULL) {
+			append_format(&result, &result_sz,
+			    "  counter              calls   total ms  avg us\n"
+			    "  ---------------- --------- ---------- "
+			    "-------\n");
+		}
+		append_format(&result, &result_sz,
+		    "  %-16s %9llu %10.3f %7.3f\n", name,
+		    (unsigned long long)stats[i].count, stats[i].ns / 1e6,
+		    stats[i].ns / 1e3 / stats[i].count);
+	}
+
+	return (result);
+}
+
+/*
+ * Allocates a zeroed object of `size' bytes, reusing one from `pool' if
+ * available. A NULL `pool' simply means calloc. All objects in a pool
+ * must be of the same size. Objects are malloc'd individually, so an
+ * object may be released with free() instead of route_pool_free.
+ */
+static void *
+route_pool_alloc(route_pool_t *pool, size_t size)
+{
+	void *obj;
+
+	if (pool == NULL)
+		return (calloc(1, size));
+	ASSERT(size >= sizeof (void *));
+	pool->num_alloc++;
+	if (pool->free != NULL) {
+		obj = pool->free;
+		pool->free = *(void **)obj;
+		pool->num_free--;
+	} else {
+		obj = malloc(size);
+		pool->num_malloc++;
+	}
+	memset(obj, 0, size);
+
+	return (obj);
+}
+
+/*
+ * Returns `obj' to `pool' for reuse (or frees it if `pool' is NULL).
+ */
+static void
+route_pool_free(route_pool_t *pool, void *obj)
+{
+	if (pool == NULL) {
+		free(obj);
+		return;
+	}
+	*(void **)obj = pool->free;
+	pool->free = obj;
+	pool->num_free++;
+}
+
+/*
+ * Frees all objects held on `pool'.
+ */
+static void
+route_pool_destroy(route_pool_t *pool)
+{
+	for (void *obj = pool->free; obj != NULL; obj = pool->free) {
+		pool->free = *(void **)obj;
+		free(obj);
+	}
+	pool->num_free = 0;
+}
+
+/*
+ * Destroys a route_seg_t, returning it to `pool'.
  */
 static inline void
-rs_destroy(route_seg_t *seg)
+rs_destroy(route_pool_t *pool, route_seg_t *seg)
 {
 	ASSERT(!list_link_active(&seg->route_segs_node));
-	free(seg);
+	route_pool_free(pool, seg);
+}
+
+/*
+ * Destroys a list of route_seg_t's along with the segments on it.
+ */
+static void
+seglist_destroy(route_pool_t *pool, list_t *segs)
+{
+	for (route_seg_t *rs = list_head(segs); rs != NULL;
+	    rs = list_head(segs)) {
+		list_remove(segs, rs);
+		rs_destroy(pool, rs);
+	}
+	list_destroy(segs);
+}
+
+/*
+ * Objects shared between a route and its copies (the legs' data & pattern
+ * layouts, route_update checkpoints and segments) carry a reference count.
+ * Copying a route only takes references, so it doesn't write to anything
+ * the source route could be reading meanwhile. A shared object is never
+ * modified, a route wanting to modify one makes a private copy of it.
+ */
+static inline void
+ref_hold(unsigned *refcnt)
+{
+	VERIFY(__atomic_add_fetch(refcnt, 1, __ATOMIC_RELAXED) > 1);
+}
+
+/*
+ * Drops a reference. Returns B_TRUE if it was the last one, in which case
+ * the caller must free the object.
+ */
+static inline bool_t
+ref_rele(unsigned *refcnt)
+{
+	unsigned n = __atomic_sub_fetch(refcnt, 1, __ATOMIC_ACQ_REL);
+
+	ASSERT(n != UINT_MAX);
+	return (n == 0);
+}
+
+/*
+ * Returns B_TRUE if anybody besides the caller holds a reference.
+ */
+static inline bool_t
+ref_shared(unsigned *refcnt)
+{
+	return (__atomic_load_n(refcnt, __ATOMIC_ACQUIRE) > 1);
+}
+
+/*
+ * Drops a reference on a segment computed by route_update. The last one
+ * returns it to `pool' (or frees it if `pool' is NULL).
+ */
+static void
+rs_rele(route_pool_t *pool, route_seg_t *rs)
+{
+	if (ref_rele(&rs->refcnt))
+		route_pool_free(pool, rs);
+}
+
+/*
+ * Allocates a zeroed route_leg_t with zeroed, private data for use in
+ * `route'.
+ */
+static route_leg_t *
+rl_alloc(route_t *route)
+{
+	route_leg_t *rl = route_pool_alloc(&route->rl_pool, sizeof (*rl));
+
+	rl->data = route_pool_alloc(&route->rld_pool, sizeof (*rl->data));
+	rl->data->refcnt = 1;
+
+	return (rl);
+}
+
+/*
+ * route_update state on entry to a leg. route_update can resume from here
+ * instead of recomputing the legs in front of the leg. Segments are
+ * referred to by their count from the start of the route, so that a
+ * checkpoint can be shared by routes holding the same segments. The first
+ * `keep' segments are never modified by this leg or any following it.
+ * `tail' is a copy of the segment after those as it was before this leg
+ * joined onto it. The first `cut' segments end at the most recent
+ * discontinuity (0 if there's none). `err_rl' is the index + 1 of the leg
+ * `err' happened on (0 if none).
+ */
+struct route_leg_upd_s {
+	unsigned	refcnt;
+	geo_pos2_t	pos;
+	double		hdg;
+	double		alt;
+	double		spd;
+	flt_phase_t	phase;
+	err_t		err;
+	unsigned	err_rl;
+	unsigned	keep;
+	unsigned	cut;
+	bool_t		has_tail;
+	route_seg_t	tail;
+};
+
+/*
+ * Drops `upd' (which may be NULL) on behalf of a route using `pool' to
+ * recycle checkpoints.
+ */
+static void
+upd_rele(route_pool_t *pool, route_leg_upd_t *upd)
+{
+	if (upd != NULL && ref_rele(&upd->refcnt))
+		route_pool_free(pool, upd);
 }
 
 /*
- * Destroys and frees a route_leg_t.
+ * Destroys a route_leg_t of `route'.
  */
 static void
-rl_destroy(route_leg_t *rl)
+rl_destroy(route_t *route, route_leg_t *rl)
 {
 	ASSERT(!list_link_active(&rl->leg_group_legs_node));
 	ASSERT(!list_link_active(&rl->route_legs_node));
-	free(rl);
+	if (ref_rele(&rl->data->refcnt))
+		route_pool_free(&route->rld_pool, rl->data);
+	if (rl->pat != NULL && ref_rele(&rl->pat->refcnt))
+		free(rl->pat);
+	upd_rele(&route->upd_pool, rl->upd);
+	route_pool_free(&route->rl_pool, rl);
+}
+
+/*
+ * Must be called before modifying the data of `rl'. If the data is shared
+ * with a copy of the route, `rl' is given a private copy of it.
+ *
+ * @return The data of `rl', for convenience.
+ */
+static route_leg_data_t *
+rl_own(route_t *route, route_leg_t *rl)
+{
+	route_leg_data_t *data = rl->data;
+
+	if (ref_shared(&data->refcnt)) {
+		rl->data = route_pool_alloc(&route->rld_pool, sizeof (*data));
+		*rl->data = *data;
+		rl->data->refcnt = 1;
+		if (ref_rele(&data->refcnt))
+			route_pool_free(&route->rld_pool, data);
+	}
+	return (rl->data);
+}
+
+/*
+ * Records that an edit touched `rl'. The next route_update will recompute
+ * the route starting no later than a couple of legs in front of `rl'.
+ */
+static void
+rl_dirty(route_t *route, route_leg_t *rl)
+{
+	upd_rele(&route->upd_pool, rl->upd);
+	rl->upd = NULL;
+	route->segs_dirty = B_TRUE;
+}
+
+/*
+ * Drops the segments of `route' from the `keep'-th on.
+ */
+static void
+route_segs_truncate(route_t *route, unsigned keep)
+{
+	ASSERT(keep <= route->num_segs);
+	while (route->num_segs > keep)
+		rs_rele(&route->rs_pool, route->segs[--route->num_segs]);
+	route->segs_dist = (keep != 0 ? route->segs[keep - 1]->dist +
+	    rs_get_len(route->segs[keep - 1]) : 0);
+}
+
+/*
+ * Appends the segments on `segs' to the segments of `route', emptying
+ * `segs'. This is where a segment gets its place in the route and becomes
+ * immutable, which is why the along-track distances of the segments are
+ * summed up right here.
+ */
+static void
+route_segs_publish(route_t *route, list_t *segs)
+{
+	unsigned	n = route->num_segs + list_count(segs);
+	double		dist = route->segs_dist;
+
+	if (n > route->segs_cap) {
+		route->segs_cap = MAX(n, 2 * route->segs_cap);
+		route->segs = realloc(route->segs,
+		    route->segs_cap * sizeof (*route->segs));
+	}
+	for (route_seg_t *rs = list_head(segs); rs != NULL;
+	    rs = list_head(segs)) {
+		list_remove(segs, rs);
+		rs->refcnt = 1;
+		rs->idx = route->num_segs;
+		rs->dist = dist;
+		dist += rs_get_len(rs);
+		route->segs[route->num_segs++] = rs;
+	}
+	route->segs_dist = dist;
+}
+
+/*
+ * Inserts `rl' into the positional leg index at `pos' and renumbers the
+ * legs following it.
+ */
+static void
+rl_idx_insert(route_t *route, route_leg_t *rl, size_t pos)
+{
+	ASSERT(pos <= route->num_rl_idx);
+	if (route->num_rl_idx == route->rl_idx_cap) {
+		route->rl_idx_cap = MAX(16, 2 * route->rl_idx_cap);
+		route->rl_idx = realloc(route->rl_idx,
+		    route->rl_idx_cap * sizeof (*route->rl_idx));
+	}
+	memmove(&route->rl_idx[pos + 1], &route->rl_idx[pos],
+	    (route->num_rl_idx - pos) * sizeof (*route->rl_idx));
+	route->rl_idx[pos] = rl;
+	route->num_rl_idx++;
+	for (size_t i = pos; i < route->num_rl_idx; i++)
+		route->rl_idx[i]->idx = i;
+}
+
+/*
+ * Removes `rl' from the positional leg index and renumbers the legs
+ * following it.
+ */
+static void
+rl_idx_remove(route_t *route, route_leg_t *rl)
+{
+	size_t pos = rl->idx;
+
+	ASSERT(pos < route->num_rl_idx && route->rl_idx[pos] == rl);
+	route->num_rl_idx--;
+	memmove(&route->rl_idx[pos], &route->rl_idx[pos + 1],
+	    (route->num_rl_idx - pos) * sizeof (*route->rl_idx));
+	for (size_t i = pos; i < route->num_rl_idx; i++)
+		route->rl_idx[i]->idx = i;
+}
+
+/*
+ * Inserts `rl' into the route leg sequence after `prev_rl' (or at the
+ * start if `prev_rl' is NULL) and marks it dirty.
+ */
+static void
+rl_insert(route_t *route, route_leg_t *prev_rl, route_leg_t *rl)
+{
+	list_insert_after(&route->legs, prev_rl, rl);
+	rl_idx_insert(route, rl, prev_rl != NULL ? prev_rl->idx + 1 : 0);
+	rl_dirty(route, rl);
+}
+
+/*
+ * Removes `rl' from the route leg sequence. Since `rl' itself will no
+ * longer be around at the next route_update, its neighbor is marked dirty
+ * in its place.
+ */
+static void
+rl_remove(route_t *route, route_leg_t *rl)
+{
+	route_leg_t *neigh = list_next(&route->legs, rl);
+
+	if (neigh == NULL)
+		neigh = list_prev(&route->legs, rl);
+	if (neigh != NULL)
+		rl_dirty(route, neigh);
+	else
+		route->segs_dirty = B_TRUE;
+	list_remove(&route->legs, rl);
+	rl_idx_remove(route, rl);
+}
+
+/*
+ * Inserts `rlg' into the positional leg group index at `pos' and
+ * renumbers the leg groups following it.
+ */
+static void
+rlg_idx_insert(route_t *route, route_leg_group_t *rlg, size_t pos)
+{
+	ASSERT(pos <= route->num_rlg_idx);
+	if (route->num_rlg_idx == route->rlg_idx_cap) {
+		route->rlg_idx_cap = MAX(16, 2 * route->rlg_idx_cap);
+		route->rlg_idx = realloc(route->rlg_idx,
+		    route->rlg_idx_cap * sizeof (*route->rlg_idx));
+	}
+	memmove(&route->rlg_idx[pos + 1], &route->rlg_idx[pos],
+	    (route->num_rlg_idx - pos) * sizeof (*route->rlg_idx));
+	route->rlg_idx[pos] = rlg;
+	route->num_rlg_idx++;
+	for (size_t i = pos; i < route->num_rlg_idx; i++)
+		route->rlg_idx[i]->idx = i;
+}
+
+/*
+ * Removes `rlg' from the positional leg group index and renumbers the
+ * leg groups following it.
+ */
+static void
+rlg_idx_remove(route_t *route, route_leg_group_t *rlg)
+{
+	size_t pos = rlg->idx;
+
+	ASSERT(pos < route->num_rlg_idx && route->rlg_idx[pos] == rlg);
+	route->num_rlg_idx--;
+	memmove(&route->rlg_idx[pos], &route->rlg_idx[pos + 1],
+	    (route->num_rlg_idx - pos) * sizeof (*route->rlg_idx));
+	for (size_t i = pos; i < route->num_rlg_idx; i++)
+		route->rlg_idx[i]->idx = i;
+}
+
+/*
+ * Inserts `rlg' into the route's leg groups after `prev_rlg' (or at the
+ * start if `prev_rlg' is NULL).
+ */
+static void
+rlg_insert(route_t *route, route_leg_group_t *prev_rlg,
+    route_leg_group_t *rlg)
+{
+	list_insert_after(&route->leg_groups, prev_rlg, rlg);
+	rlg_idx_insert(route, rlg, prev_rlg != NULL ? prev_rlg->idx + 1 : 0);
 }
 
 /*
@@ -148,14 +771,16 @@ rlg_destroy(route_t *route, route_leg_group_t *rlg)
 	for (route_leg_t *rl = list_head(&rlg->legs); rl != NULL;
 	    rl = list_head(&rlg->legs)) {
 		list_remove(&rlg->legs, rl);
-		list_remove(&route->legs, rl);
-		rl_destroy(rl);
+		rl_remove(route, rl);
+		rl_destroy(route, rl);
 	}
 
-	if (list_link_active(&rlg->route_leg_groups_node))
+	if (list_link_active(&rlg->route_leg_groups_node)) {
 		list_remove(&route->leg_groups, rlg);
+		rlg_idx_remove(route, rlg);
+	}
 	list_destroy(&rlg->legs);
-	free(rlg);
+	route_pool_free(&route->rlg_pool, rlg);
 }
 
 /*
@@ -164,7 +789,8 @@ rlg_destroy(route_t *route, route_leg_group_t *rlg)
 static route_leg_group_t *
 rlg_new(route_leg_group_type_t type, route_t *route)
 {
-	route_leg_group_t *rlg = calloc(sizeof (*rlg), 1);
+	route_leg_group_t *rlg = route_pool_alloc(&route->rlg_pool,
+	    sizeof (*rlg));
 
 	rlg->type = type;
 	rlg->route = route;
@@ -184,16 +810,16 @@ static void
 rlg_new_disco(route_t *route, route_leg_group_t *prev_rlg)
 {
 	route_leg_group_t *rlg = rlg_new(ROUTE_LEG_GROUP_TYPE_DISCO, route);
-	route_leg_t *rl = calloc(sizeof (*rl), 1);
+	route_leg_t *rl = rl_alloc(route);
 
 	/* A disco can't be first or last in the list */
 	ASSERT(prev_rlg != NULL);
 	ASSERT(list_tail(&route->leg_groups) != prev_rlg);
-	list_insert_after(&route->leg_groups, prev_rlg, rlg);
+	rlg_insert(route, prev_rlg, rlg);
 	rl->disco = B_TRUE;
 	rl->rlg = rlg;
 	list_insert_head(&rlg->legs, rl);
-	list_insert_after(&route->legs, last_leg_before_rlg(route, rlg), rl);
+	rl_insert(route, last_leg_before_rlg(route, rlg), rl);
 }
 
 /*
@@ -203,7 +829,8 @@ rlg_new_disco(route_t *route, route_leg_group_t *prev_rlg)
 static const wpt_t *
 leg_get_end_wpt(const route_leg_t *leg)
 {
-	return (!leg->disco ? navproc_seg_get_end_wpt(&leg->seg) : &null_wpt);
+	return (!leg->disco ? navproc_seg_get_end_wpt(&leg->data->seg) :
+	    &null_wpt);
 }
 
 /*
@@ -211,9 +838,9 @@ leg_get_end_wpt(const route_leg_t *leg)
  * take wpts, causes an assertion failure.
  */
 static void
-leg_set_end_wpt(route_leg_t *leg, const wpt_t *wpt)
+leg_set_end_wpt(route_t *route, route_leg_t *leg, const wpt_t *wpt)
 {
-	navproc_seg_set_end_wpt(&leg->seg, wpt);
+	navproc_seg_set_end_wpt(&rl_own(route, leg)->seg, wpt);
 }
 
 static bool_t
@@ -238,9 +865,9 @@ chk_awy_fix_adjacent(route_leg_group_t *rlg, const wpt_t *wpt, bool_t head)
 static route_leg_t *
 rl_new_direct(const wpt_t *fix, route_leg_group_t *rlg)
 {
-	route_leg_t *rl = calloc(sizeof (*rl), 1);
-	rl->seg.type = NAVPROC_SEG_TYPE_DIR_TO_FIX;
-	rl->seg.term_cond.fix = *fix;
+	route_leg_t *rl = rl_alloc(rlg->route);
+	rl->data->seg.type = NAVPROC_SEG_TYPE_DIR_TO_FIX;
+	rl->data->seg.term_cond.fix = *fix;
 	rl->rlg = rlg;
 	return (rl);
 }
@@ -287,16 +914,16 @@ rlg_update_leg(route_t *route, route_leg_group_t *rlg, route_leg_t *rl,
 		/* Route leg doesn't exist, recreate & reinsert. */
 		rl = rl_new_direct(end_wpt, rlg);
 		list_insert_after(&rlg->legs, prev_rlg_rl, rl);
-		list_insert_after(&route->legs, prev_route_rl, rl);
+		rl_insert(route, prev_route_rl, rl);
 	} else {
 		/* Route leg exists, check settings & position in leg list. */
-		ASSERT(rl->seg.type == NAVPROC_SEG_TYPE_DIR_TO_FIX);
+		ASSERT(rl->data->seg.type == NAVPROC_SEG_TYPE_DIR_TO_FIX);
 		ASSERT(rl != prev_rlg_rl);
 		ASSERT(rl != prev_route_rl);
 		if (!WPT_EQ(leg_get_end_wpt(rl), end_wpt)) {
 			/* End fix incorrect, reset */
-			leg_set_end_wpt(rl, end_wpt);
-			route->segs_dirty = B_TRUE;
+			leg_set_end_wpt(route, rl, end_wpt);
+			rl_dirty(route, rl);
 		}
 		ASSERT(prev_rlg_rl == NULL || prev_rlg_rl == prev_route_rl);
 		if (list_prev(&rlg->legs, rl) != prev_rlg_rl) {
@@ -307,9 +934,8 @@ rlg_update_leg(route_t *route, route_leg_group_t *rlg, route_leg_t *rl,
 		}
 		if (list_prev(&route->legs, rl) != prev_route_rl) {
 			/* Position in route leg sequence incorrect, move */
-			list_remove(&route->legs, rl);
-			list_insert_after(&route->legs, prev_route_rl, rl);
-			route->segs_dirty = B_TRUE;
+			rl_remove(route, rl);
+			rl_insert(route, prev_route_rl, rl);
 		}
 	}
 	return (rl);
@@ -346,9 +972,9 @@ rlg_update_awy_legs(route_t *route, route_leg_group_t *rlg, bool_t lookup)
 			return;
 		for (route_leg_t *rl = list_head(&rlg->legs); rl != NULL;
 		    rl = list_head(&rlg->legs)) {
-			list_remove(&route->legs, rl);
+			rl_remove(route, rl);
 			list_remove(&rlg->legs, rl);
-			free(rl);
+			rl_destroy(route, rl);
 		}
 		route->segs_dirty = B_TRUE;
 	} else {
@@ -376,8 +1002,8 @@ rlg_update_awy_legs(route_t *route, route_leg_group_t *rlg, bool_t lookup)
 		for (rl = list_next(&rlg->legs, prev_awy_rl); rl != NULL;
 		    rl = list_next(&rlg->legs, prev_awy_rl)) {
 			list_remove(&rlg->legs, rl);
-			list_remove(&route->legs, rl);
-			free(rl);
+			rl_remove(route, rl);
+			rl_destroy(route, rl);
 			route->segs_dirty = B_TRUE;
 		}
 	}
@@ -478,7 +1104,7 @@ rlg_find_start_fix(const route_leg_group_t *rlg)
 {
 	route_leg_t *rl = list_head(&rlg->legs);
 	ASSERT(rl != NULL);
-	return (*navproc_seg_get_start_wpt(&rl->seg));
+	return (*navproc_seg_get_start_wpt(&rl->data->seg));
 }
 
 static wpt_t
@@ -486,7 +1112,7 @@ rlg_find_end_wpt(const route_leg_group_t *rlg)
 {
 	route_leg_t *rl = list_tail(&rlg->legs);
 	ASSERT(rl != NULL);
-	return (*navproc_seg_get_end_wpt(&rl->seg));
+	return (*navproc_seg_get_end_wpt(&rl->data->seg));
 }
 
 /*
@@ -563,20 +1189,20 @@ rl_complete_seg(const route_leg_t *rl, geo_pos2_t start, const wmm_t *wmm,
 	if (rl->disco)
 		return (B_FALSE);
 
-	switch(rl->seg.type) {
+	switch(rl->data->seg.type) {
 	case NAVPROC_SEG_TYPE_ARC_TO_FIX:
 		seg->type = ROUTE_SEG_TYPE_ARC;
-		seg->arc.center = rl->seg.leg_cmd.dme_arc.navaid.pos;
+		seg->arc.center = rl->data->seg.leg_cmd.dme_arc.navaid.pos;
 		seg->arc.start = geo_displace_mag(&wgs84, wmm,
-		    rl->seg.leg_cmd.dme_arc.navaid.pos,
-		    rl->seg.leg_cmd.dme_arc.start_radial,
-		    NM2MET(rl->seg.leg_cmd.dme_arc.radius));
-		seg->arc.end = rl->seg.term_cond.fix.pos;
+		    rl->data->seg.leg_cmd.dme_arc.navaid.pos,
+		    rl->data->seg.leg_cmd.dme_arc.start_radial,
+		    NM2MET(rl->data->seg.leg_cmd.dme_arc.radius));
+		seg->arc.end = rl->data->seg.term_cond.fix.pos;
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_CRS_TO_ALT:
 		seg->direct.start = start;
 		seg->direct.end = geo_displace_mag(&wgs84, wmm, start,
-		    rl->seg.leg_cmd.hdg.hdg, NM2MET(ALT_GUESS_DISPLACE));
+		    rl->data->seg.leg_cmd.hdg.hdg, NM2MET(ALT_GUESS_DISPLACE));
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_CRS_TO_DME:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
@@ -586,7 +1212,7 @@ rl_complete_seg(const route_leg_t *rl, geo_pos2_t start, const wmm_t *wmm,
 	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
 		seg->direct.start = start;
-		seg->direct.end = rl->seg.term_cond.fix.pos;
+		seg->direct.end = rl->data->seg.term_cond.fix.pos;
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_CRS_TO_INTCP:
 		return (B_FALSE);
@@ -599,26 +1225,27 @@ rl_complete_seg(const route_leg_t *rl, geo_pos2_t start, const wmm_t *wmm,
 	case NAVPROC_SEG_TYPE_DIR_TO_FIX:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
 		seg->direct.start = start;
-		seg->direct.end = rl->seg.term_cond.fix.pos;
+		seg->direct.end = rl->data->seg.term_cond.fix.pos;
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_FIX_TO_ALT:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
-		seg->direct.start = rl->seg.leg_cmd.fix_crs.fix.pos;
+		seg->direct.start = rl->data->seg.leg_cmd.fix_crs.fix.pos;
 		seg->direct.end = geo_displace_mag(&wgs84, wmm,
-		    rl->seg.leg_cmd.fix_crs.fix.pos,
-		    rl->seg.leg_cmd.fix_crs.crs, NM2MET(ALT_GUESS_DISPLACE));
+		    rl->data->seg.leg_cmd.fix_crs.fix.pos,
+		    rl->data->seg.leg_cmd.fix_crs.crs,
+		    NM2MET(ALT_GUESS_DISPLACE));
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_FIX_TO_DIST:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
-		seg->direct.start = rl->seg.leg_cmd.fix_crs.fix.pos;
+		seg->direct.start = rl->data->seg.leg_cmd.fix_crs.fix.pos;
 		seg->direct.end = geo_displace_mag(&wgs84, wmm,
-		    rl->seg.leg_cmd.fix_crs.fix.pos,
-		    rl->seg.leg_cmd.fix_crs.crs,
-		    NM2MET(rl->seg.term_cond.dist));
+		    rl->data->seg.leg_cmd.fix_crs.fix.pos,
+		    rl->data->seg.leg_cmd.fix_crs.crs,
+		    NM2MET(rl->data->seg.term_cond.dist));
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_FIX_TO_DME:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
-		seg->direct.start = rl->seg.leg_cmd.fix_crs.fix.pos;
+		seg->direct.start = rl->data->seg.leg_cmd.fix_crs.fix.pos;
 		seg->direct.end = calc_dist_leg_intc(start, rl, NULL, wmm);
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_FIX_TO_MANUAL:
@@ -628,30 +1255,30 @@ rl_complete_seg(const route_leg_t *rl, geo_pos2_t start, const wmm_t *wmm,
 	case NAVPROC_SEG_TYPE_HOLD_TO_MANUAL:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
 		seg->direct.start = start;
-		seg->direct.end = rl->seg.leg_cmd.hold.wpt.pos;
+		seg->direct.end = rl->data->seg.leg_cmd.hold.wpt.pos;
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_INIT_FIX:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
 		seg->direct.start = start;
-		seg->direct.end = rl->seg.leg_cmd.fix.pos;
+		seg->direct.end = rl->data->seg.leg_cmd.fix.pos;
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_PROC_TURN:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
 		seg->direct.start = start;
-		seg->direct.end = rl->seg.leg_cmd.proc_turn.startpt.pos;
+		seg->direct.end = rl->data->seg.leg_cmd.proc_turn.startpt.pos;
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX:
 		return (B_FALSE);
 	case NAVPROC_SEG_TYPE_TRK_TO_FIX:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
 		seg->direct.start = start;
-		seg->direct.end = rl->seg.term_cond.fix.pos;
+		seg->direct.end = rl->data->seg.term_cond.fix.pos;
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_HDG_TO_ALT:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
 		seg->direct.start = start;
 		seg->direct.end = geo_displace_mag(&wgs84, wmm, start,
-		    rl->seg.leg_cmd.hdg.hdg, NM2MET(ALT_GUESS_DISPLACE));
+		    rl->data->seg.leg_cmd.hdg.hdg, NM2MET(ALT_GUESS_DISPLACE));
 		return (B_TRUE);
 	case NAVPROC_SEG_TYPE_HDG_TO_DME:
 		seg->type = ROUTE_SEG_TYPE_DIRECT;
@@ -689,7 +1316,7 @@ static bool_t
 rl_find_leg_seg(const route_leg_t *rl, geo_pos2_t oldpos,
     const route_leg_t *next_rl, const wmm_t *wmm, route_seg_t *seg)
 {
-	switch (rl->seg.type) {
+	switch (rl->data->seg.type) {
 	case NAVPROC_SEG_TYPE_ARC_TO_FIX:
 	case NAVPROC_SEG_TYPE_FIX_TO_ALT:
 	case NAVPROC_SEG_TYPE_FIX_TO_DIST:
@@ -698,7 +1325,7 @@ rl_find_leg_seg(const route_leg_t *rl, geo_pos2_t oldpos,
 	case NAVPROC_SEG_TYPE_INIT_FIX:
 		if (next_rl == NULL)
 			return (B_FALSE);
-		return (rl_complete_seg(next_rl, rl->seg.leg_cmd.fix.pos,
+		return (rl_complete_seg(next_rl, rl->data->seg.leg_cmd.fix.pos,
 		    wmm, seg));
 	case NAVPROC_SEG_TYPE_PROC_TURN:
 		/* TODO */
@@ -773,8 +1400,8 @@ calc_manual_leg_intc(geo_pos2_t cur_pos, const route_leg_t *rl,
 	UNUSED(legs);
 	UNUSED(wmm);
 
-	ASSERT(rl->seg.type == NAVPROC_SEG_TYPE_FIX_TO_MANUAL ||
-	    rl->seg.type == NAVPROC_SEG_TYPE_HDG_TO_MANUAL);
+	ASSERT(rl->data->seg.type == NAVPROC_SEG_TYPE_FIX_TO_MANUAL ||
+	    rl->data->seg.type == NAVPROC_SEG_TYPE_HDG_TO_MANUAL);
 	return (NULL_GEO_POS2);
 }
 
@@ -786,19 +1413,19 @@ calc_dir_leg_intc(geo_pos2_t cur_pos, const route_leg_t *rl,
 	UNUSED(legs);
 	UNUSED(wmm);
 
-	switch (rl->seg.type) {
+	switch (rl->data->seg.type) {
 	case NAVPROC_SEG_TYPE_ARC_TO_FIX:
 	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
 	case NAVPROC_SEG_TYPE_DIR_TO_FIX:
 	case NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX:
 	case NAVPROC_SEG_TYPE_TRK_TO_FIX:
-		return (rl->seg.term_cond.fix.pos);
+		return (rl->data->seg.term_cond.fix.pos);
 	case NAVPROC_SEG_TYPE_INIT_FIX:
-		return (rl->seg.leg_cmd.fix.pos);
+		return (rl->data->seg.leg_cmd.fix.pos);
 	case NAVPROC_SEG_TYPE_HOLD_TO_ALT:
 	case NAVPROC_SEG_TYPE_HOLD_TO_FIX:
 	case NAVPROC_SEG_TYPE_HOLD_TO_MANUAL:
-		return (rl->seg.leg_cmd.hold.wpt.pos);
+		return (rl->data->seg.leg_cmd.hold.wpt.pos);
 	default:
 		assert(0);
 	}
@@ -816,33 +1443,33 @@ calc_dist_leg_intc(geo_pos2_t cur_pos, const route_leg_t *rl,
 		/* Can't resolve without a starting point */
 		openfmc_log(OPENFMC_LOG_ERR, "Cannot resolve %s leg to "
 		    "%s/%.1lf: missing start pos",
-		    navproc_seg_type2str(rl->seg.type),
-		    rl->seg.term_cond.dme.navaid.name,
-		    rl->seg.term_cond.dme.dist);
+		    navproc_seg_type2str(rl->data->seg.type),
+		    rl->data->seg.term_cond.dme.navaid.name,
+		    rl->data->seg.term_cond.dme.dist);
 		return (NULL_GEO_POS2);
 	}
-	ASSERT(rl->seg.type == NAVPROC_SEG_TYPE_CRS_TO_RADIAL ||
-	    rl->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DIST ||
-	    rl->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DME ||
-	    rl->seg.type == NAVPROC_SEG_TYPE_HDG_TO_DME);
-	if (rl->seg.type == NAVPROC_SEG_TYPE_CRS_TO_DME) {
-		hdg = rl->seg.leg_cmd.hdg.hdg;
-		center = rl->seg.term_cond.dme.navaid.pos;
-		dist = rl->seg.term_cond.dme.dist;
-	} else if (rl->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DIST) {
-		cur_pos = rl->seg.leg_cmd.fix_crs.fix.pos;
-		hdg = rl->seg.leg_cmd.fix_crs.crs;
-		center = rl->seg.leg_cmd.fix_crs.fix.pos;
-		dist = rl->seg.term_cond.dist;
-	} else if (rl->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DME) {
-		cur_pos = rl->seg.leg_cmd.fix_crs.fix.pos;
-		hdg = rl->seg.leg_cmd.fix_crs.crs;
-		center = rl->seg.term_cond.dme.navaid.pos;
-		dist = rl->seg.term_cond.dme.dist;
+	ASSERT(rl->data->seg.type == NAVPROC_SEG_TYPE_CRS_TO_RADIAL ||
+	    rl->data->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DIST ||
+	    rl->data->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DME ||
+	    rl->data->seg.type == NAVPROC_SEG_TYPE_HDG_TO_DME);
+	if (rl->data->seg.type == NAVPROC_SEG_TYPE_CRS_TO_DME) {
+		hdg = rl->data->seg.leg_cmd.hdg.hdg;
+		center = rl->data->seg.term_cond.dme.navaid.pos;
+		dist = rl->data->seg.term_cond.dme.dist;
+	} else if (rl->data->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DIST) {
+		cur_pos = rl->data->seg.leg_cmd.fix_crs.fix.pos;
+		hdg = rl->data->seg.leg_cmd.fix_crs.crs;
+		center = rl->data->seg.leg_cmd.fix_crs.fix.pos;
+		dist = rl->data->seg.term_cond.dist;
+	} else if (rl->data->seg.type == NAVPROC_SEG_TYPE_FIX_TO_DME) {
+		cur_pos = rl->data->seg.leg_cmd.fix_crs.fix.pos;
+		hdg = rl->data->seg.leg_cmd.fix_crs.crs;
+		center = rl->data->seg.term_cond.dme.navaid.pos;
+		dist = rl->data->seg.term_cond.dme.dist;
 	} else {	/* NAVPROC_SEG_TYPE_HDG_TO_DME */
-		hdg = rl->seg.leg_cmd.hdg.hdg;
-		center = rl->seg.term_cond.dme.navaid.pos;
-		dist = rl->seg.term_cond.dme.dist;
+		hdg = rl->data->seg.leg_cmd.hdg.hdg;
+		center = rl->data->seg.term_cond.dme.navaid.pos;
+		dist = rl->data->seg.term_cond.dme.dist;
 	}
 
 	return (find_best_circ_isect(cur_pos, hdg, center, dist, wmm));
@@ -853,16 +1480,16 @@ calc_radial_leg_intc(geo_pos2_t cur_pos, const route_leg_t *rl,
     const list_t *legs, const wmm_t *wmm)
 {
 	fpp_t fpp = gnomo_fpp_init(find_geo_midpoint(cur_pos,
-	    rl->seg.term_cond.radial.navaid.pos), 0, &wgs84, B_TRUE);
+	    rl->data->seg.term_cond.radial.navaid.pos), 0, &wgs84, B_TRUE);
 	vect2_t dir_v, cur_pos_v, navaid_v, radial_dir_v, isect, c2i;
 
 	UNUSED(legs);
-	ASSERT(rl->seg.type == NAVPROC_SEG_TYPE_CRS_TO_RADIAL ||
-	    rl->seg.type == NAVPROC_SEG_TYPE_HDG_TO_RADIAL);
+	ASSERT(rl->data->seg.type == NAVPROC_SEG_TYPE_CRS_TO_RADIAL ||
+	    rl->data->seg.type == NAVPROC_SEG_TYPE_HDG_TO_RADIAL);
 
-	dir_v = DIR_V(rl->seg.leg_cmd.hdg.hdg);
-	radial_dir_v = DIR_V(rl->seg.term_cond.radial.radial);
-	navaid_v = geo2fpp(rl->seg.term_cond.radial.navaid.pos, &fpp);
+	dir_v = DIR_V(rl->data->seg.leg_cmd.hdg.hdg);
+	radial_dir_v = DIR_V(rl->data->seg.term_cond.radial.radial);
+	navaid_v = geo2fpp(rl->data->seg.term_cond.radial.navaid.pos, &fpp);
 	cur_pos_v = geo2fpp(GEO3_TO_GEO2(cur_pos), &fpp);
 
 	isect = vect2vect_isect(dir_v, cur_pos_v, radial_dir_v, navaid_v,
@@ -913,15 +1540,16 @@ calc_vect_leg_intc(const geo_pos2_t cur_pos, const route_leg_t *rl,
 	if (IS_NULL_GEO_POS(cur_pos) || next_rl == NULL)
 		return (NULL_GEO_POS2);
 
-	ASSERT(rl->seg.type == NAVPROC_SEG_TYPE_CRS_TO_INTCP ||
-	    rl->seg.type == NAVPROC_SEG_TYPE_HDG_TO_INTCP);
-	hdg = rl->seg.leg_cmd.hdg.hdg;
+	ASSERT(rl->data->seg.type == NAVPROC_SEG_TYPE_CRS_TO_INTCP ||
+	    rl->data->seg.type == NAVPROC_SEG_TYPE_HDG_TO_INTCP);
+	hdg = rl->data->seg.leg_cmd.hdg.hdg;
 
 	if (!rl_find_leg_seg(next_rl, cur_pos, rl_next_ndisc(legs, next_rl),
 	    wmm, &next_rs))
 		return (NULL_GEO_POS2);
 
-	return (vect_seg_intc(cur_pos, rl->seg.leg_cmd.hdg.hdg, &next_rs, wmm));
+	return (vect_seg_intc(cur_pos, rl->data->seg.leg_cmd.hdg.hdg, &next_rs,
+	    wmm));
 }
 
 static geo_pos2_t
@@ -965,8 +1593,8 @@ calc_leg_start_pos(const route_leg_t *targ_rl, const route_leg_t *rl,
 			cur_pos = NULL_GEO_POS2;
 			continue;
 		}
-		ASSERT(leg_intc_func_tbl[rl->seg.type] != NULL);
-		cur_pos = leg_intc_func_tbl[rl->seg.type](cur_pos, rl,
+		ASSERT(leg_intc_func_tbl[rl->data->seg.type] != NULL);
+		cur_pos = leg_intc_func_tbl[rl->data->seg.type](cur_pos, rl,
 		    legs, route->navdb->wmm);
 	}
 
@@ -1060,9 +1688,9 @@ proc_rlgs_intc(const route_leg_group_t *rlg1, const route_leg_group_t *rlg2)
 	 * rlg1 is even capable of that.
 	 */
 	rl1 = list_tail(&rlg1->legs);
-	if (rl1->seg.type != NAVPROC_SEG_TYPE_CRS_TO_INTCP &&
-	    rl1->seg.type != NAVPROC_SEG_TYPE_HDG_TO_INTCP &&
-	    rl1->seg.type != NAVPROC_SEG_TYPE_PROC_TURN)
+	if (rl1->data->seg.type != NAVPROC_SEG_TYPE_CRS_TO_INTCP &&
+	    rl1->data->seg.type != NAVPROC_SEG_TYPE_HDG_TO_INTCP &&
+	    rl1->data->seg.type != NAVPROC_SEG_TYPE_PROC_TURN)
 		return (B_FALSE);
 
 	/* We'll need an initial route start position. */
@@ -1550,9 +2178,9 @@ rlg_shorten_proc(route_t *route, route_leg_t *lim_rl, bool_t left)
 	    list_next(&rlg->legs, lim_rl); rl != NULL && rl != lim_rl;
 	    rl = left ? list_head(&rlg->legs) :
 	    list_next(&rlg->legs, lim_rl)) {
-		list_remove(&route->legs, rl);
+		rl_remove(route, rl);
 		list_remove(&rlg->legs, rl);
-		free(rl);
+		rl_destroy(route, rl);
 	}
 	if (left)
 		rlg->start_wpt = rlg_find_start_fix(rlg);
@@ -1561,6 +2189,18 @@ rlg_shorten_proc(route_t *route, route_leg_t *lim_rl, bool_t left)
 	rlg_connect_neigh(route, rlg, B_FALSE, B_FALSE);
 }
 
+/*
+ * Creates the lists of an empty route.
+ */
+static void
+route_lists_create(route_t *route)
+{
+	list_create(&route->leg_groups, sizeof (route_leg_group_t),
+	    offsetof(route_leg_group_t, route_leg_groups_node));
+	list_create(&route->legs, sizeof (route_leg_t),
+	    offsetof(route_leg_t, route_legs_node));
+}
+
 /*
  * Creates a new route. The route will derive its navigation data from `navdb'.
  */
@@ -1571,19 +2211,103 @@ route_create(const fms_navdb_t *navdb)
 
 	ASSERT(navdb != NULL);
 	route->navdb = navdb;
-	list_create(&route->leg_groups, sizeof (route_leg_group_t),
-	    offsetof(route_leg_group_t, route_leg_groups_node));
-	list_create(&route->legs, sizeof (route_leg_t),
-	    offsetof(route_leg_t, route_legs_node));
-	list_create(&route->segs, sizeof (route_seg_t),
-	    offsetof(route_seg_t, route_segs_node));
+	route->upd_threads = 1;
+	route_lists_create(route);
 
 	return (route);
 }
 
 /*
- * Destroys and frees all resources used by `route'. Pointers to any resources
- * internal to the route should be considered invalid after this.
+ * Creates a copy of `route', e.g. to evaluate a modification without
+ * touching the active route. Only the leg groups and the handles of the
+ * legs are duplicated. The legs' data, pattern layouts and route_update
+ * checkpoints, as well as the computed segments, are shared with `route'
+ * by reference, and whichever route edits a leg first makes a private
+ * copy of just that leg's data (see rl_own). Updating an edited copy only
+ * recomputes the edited part.
+ *
+ * `route' is only read, so any number of threads may copy the same route
+ * concurrently, as long as nobody modifies it meanwhile.
+ */
+route_t *
+route_copy(const route_t *src)
+{
+	route_t *route = malloc(sizeof (*route));
+
+	*route = *src;
+	route_lists_create(route);
+	memset(&route->rlg_pool, 0, sizeof (route->rlg_pool));
+	memset(&route->rl_pool, 0, sizeof (route->rl_pool));
+	memset(&route->rld_pool, 0, sizeof (route->rld_pool));
+	memset(&route->upd_pool, 0, sizeof (route->upd_pool));
+	memset(&route->rs_pool, 0, sizeof (route->rs_pool));
+	route->rlg_idx = NULL;
+	route->num_rlg_idx = 0;
+	route->rlg_idx_cap = 0;
+	route->rl_idx = NULL;
+	route->num_rl_idx = 0;
+	route->rl_idx_cap = 0;
+	route->join_cache = NULL;
+	if (route->upd_threads != 1)
+		route_upd_pool_hold(0);
+	if (route->dep != NULL)
+		airport_hold(route->dep);
+	if (route->arr != NULL)
+		airport_hold(route->arr);
+	if (route->altn1 != NULL)
+		airport_hold(route->altn1);
+	if (route->altn2 != NULL)
+		airport_hold(route->altn2);
+
+	/* The route leg sequence is the concatenation of the rlg legs */
+	for (const route_leg_group_t *src_rlg = list_head(&src->leg_groups);
+	    src_rlg != NULL; src_rlg = list_next(&src->leg_groups, src_rlg)) {
+		route_leg_group_t *rlg = rlg_new(src_rlg->type, route);
+
+		rlg->awy = src_rlg->awy;
+		rlg->start_wpt = src_rlg->start_wpt;
+		rlg->end_wpt = src_rlg->end_wpt;
+		list_insert_tail(&route->leg_groups, rlg);
+		rlg_idx_insert(route, rlg, route->num_rlg_idx);
+		for (const route_leg_t *src_rl = list_head(&src_rlg->legs);
+		    src_rl != NULL; src_rl = list_next(&src_rlg->legs,
+		    src_rl)) {
+			route_leg_t *rl = route_pool_alloc(&route->rl_pool,
+			    sizeof (*rl));
+
+			rl->disco = src_rl->disco;
+			rl->data = src_rl->data;
+			ref_hold(&rl->data->refcnt);
+			rl->pat = src_rl->pat;
+			if (rl->pat != NULL)
+				ref_hold(&rl->pat->refcnt);
+			rl->upd = src_rl->upd;
+			if (rl->upd != NULL)
+				ref_hold(&rl->upd->refcnt);
+			rl->rlg = rlg;
+			list_insert_tail(&rlg->legs, rl);
+			list_insert_tail(&route->legs, rl);
+			rl_idx_insert(route, rl, route->num_rl_idx);
+		}
+	}
+
+	route->segs = NULL;
+	route->segs_cap = 0;
+	if (src->num_segs != 0) {
+		route->segs_cap = src->num_segs;
+		route->segs = malloc(route->segs_cap * sizeof (*route->segs));
+		for (unsigned i = 0; i < src->num_segs; i++) {
+			route->segs[i] = src->segs[i];
+			ref_hold(&route->segs[i]->refcnt);
+		}
+	}
+
+	return (route);
+}
+
+/*
+ * Destroys and frees all resources used by `route'. Pointers to any resources
+ * internal to the route should be considered invalid after this.
  */
 void
 route_destroy(route_t *route)
@@ -1606,17 +2330,750 @@ route_destroy(route_t *route)
 	 */
 	ASSERT(list_head(&route->legs) == NULL);
 
-	for (route_seg_t *rs = list_head(&route->segs); rs != NULL;
-	    rs = list_head(&route->segs))
-		rs_destroy(rs);
+	for (unsigned i = 0; i < route->num_segs; i++)
+		rs_rele(&route->rs_pool, route->segs[i]);
+	free(route->segs);
 
 	list_destroy(&route->leg_groups);
 	list_destroy(&route->legs);
-	list_destroy(&route->segs);
+	route_pool_destroy(&route->rlg_pool);
+	route_pool_destroy(&route->rl_pool);
+	route_pool_destroy(&route->rld_pool);
+	route_pool_destroy(&route->upd_pool);
+	route_pool_destroy(&route->rs_pool);
+	route_join_cache_destroy(route->join_cache);
+	free(route->rlg_idx);
+	free(route->rl_idx);
+	if (route->upd_threads != 1)
+		route_upd_pool_rele();
 
 	free(route);
 }
 
+/*
+ * Binary route format, see route_serialize. All values are stored in the
+ * host's native byte order and layout, which the header records so that a
+ * route saved by an incompatible build is rejected rather than misread.
+ * The header is followed by:
+ *	1) the route's airports, departure runway and procedures,
+ *	2) if ROUTE_SER_SEGS is set, the route_update inputs & result and
+ *	   the computed segments,
+ *	3) the leg groups, each followed by its legs (and, with
+ *	   ROUTE_SER_SEGS, the legs' route_update checkpoints).
+ * Airports, runways, procedures & airways are stored by name and looked
+ * up again on restore, wpts are stored by value and rebound to the navdb.
+ */
+#define	ROUTE_SER_MAGIC		0x52434d46u	/* "FMCR" (little-endian) */
+#define	ROUTE_SER_VERSION	1
+#define	ROUTE_SER_SEGS		(1 << 0)	/* segments were saved */
+
+#define	ROUTE_SER_NUM_ARPTS	4	/* dep, arr, altn1, altn2 */
+#define	ROUTE_SER_NUM_PROCS	8	/* sid ... appr */
+#define	ROUTE_SER_NO_ARPT	0xff
+#define	ROUTE_SER_RS_SZ		offsetof(route_seg_t, route_segs_node)
+
+typedef struct {
+	uint32_t	magic;
+	uint16_t	version;
+	uint16_t	flags;
+	/* layout of the natively stored structures */
+	uint16_t	wpt_sz;
+	uint16_t	seg_sz;
+	uint16_t	rs_sz;
+	uint16_t	flt_sz;
+	uint32_t	airac_cycle;	/* navdb cycle when saved */
+	uint32_t	num_rlgs;
+	uint32_t	num_rls;
+	uint32_t	num_rss;
+} route_ser_hdr_t;
+
+typedef struct {
+	uint8_t		arpt;		/* 0 - 3 or ROUTE_SER_NO_ARPT */
+	uint8_t		type;
+	uint32_t	idx;		/* in airport_t->procs */
+	char		name[NAV_NAME_LEN];
+	char		tr_name[NAV_NAME_LEN];
+} route_ser_proc_t;
+
+typedef struct {
+	uint8_t			*buf;
+	size_t			len;
+	size_t			cap;
+} route_ser_t;
+
+typedef struct {
+	const uint8_t	*buf;
+	size_t		len;
+	size_t		off;
+	bool_t		ok;
+} route_deser_t;
+
+#define	SER_PUT(ser, x)		ser_put((ser), &(x), sizeof (x))
+#define	DESER_GET(des, x)	deser_get((des), &(x), sizeof (x))
+
+static void
+ser_put(route_ser_t *ser, const void *data, size_t len)
+{
+	if (ser->len + len > ser->cap) {
+		ser->cap = MAX(ser->cap * 2, ser->len + len);
+		ser->buf = realloc(ser->buf, ser->cap);
+	}
+	memcpy(&ser->buf[ser->len], data, len);
+	ser->len += len;
+}
+
+/*
+ * Reads `len' bytes into `data'. Reading past the end of the buffer
+ * zeroes `data' and marks the buffer as bad.
+ */
+static void
+deser_get(route_deser_t *des, void *data, size_t len)
+{
+	if (!des->ok || des->len - des->off < len) {
+		des->ok = B_FALSE;
+		memset(data, 0, len);
+		return;
+	}
+	memcpy(data, &des->buf[des->off], len);
+	des->off += len;
+}
+
+/*
+ * The airports of a route in the order they're serialized in.
+ */
+static airport_t **
+route_ser_arpts(route_t *route, unsigned i)
+{
+	airport_t **arpts[ROUTE_SER_NUM_ARPTS] = {
+		&route->dep, &route->arr, &route->altn1, &route->altn2
+	};
+
+	ASSERT(i < ROUTE_SER_NUM_ARPTS);
+	return (arpts[i]);
+}
+
+static void
+ser_put_proc(route_ser_t *ser, const route_t *route, const navproc_t *proc)
+{
+	route_ser_proc_t sp;
+
+	memset(&sp, 0, sizeof (sp));
+	sp.arpt = ROUTE_SER_NO_ARPT;
+	if (proc != NULL) {
+		for (unsigned i = 0; i < ROUTE_SER_NUM_ARPTS; i++) {
+			if (*route_ser_arpts((route_t *)route, i) ==
+			    proc->arpt)
+				sp.arpt = i;
+		}
+		ASSERT(sp.arpt != ROUTE_SER_NO_ARPT);
+		sp.type = proc->type;
+		sp.idx = proc - proc->arpt->procs;
+		strcpy(sp.name, proc->name);
+		strcpy(sp.tr_name, proc->tr_name);
+	}
+	SER_PUT(ser, sp);
+}
+
+/*
+ * Index + 1 of `proc' segment `seg' is a copy of, or 0 if it isn't one.
+ */
+static uint32_t
+ser_proc_seg_idx(const navproc_t *proc, const navproc_seg_t *seg)
+{
+	for (unsigned i = 0; i < proc->num_segs; i++) {
+		if (memcmp(&proc->segs[i], seg, sizeof (*seg)) == 0)
+			return (i + 1);
+	}
+	return (0);
+}
+
+/*
+ * Writes the route_update checkpoint of `rl'.
+ */
+static void
+ser_put_upd(route_ser_t *ser, const route_leg_t *rl)
+{
+	const route_leg_upd_t *upd = rl->upd;
+	uint8_t		phase = upd->phase;
+	uint8_t		err = upd->err;
+	uint8_t		has_tail = upd->has_tail;
+	uint32_t	err_rl = upd->err_rl;
+	uint32_t	keep = upd->keep;
+	uint32_t	cut = upd->cut;
+
+	SER_PUT(ser, upd->pos);
+	SER_PUT(ser, upd->hdg);
+	SER_PUT(ser, upd->alt);
+	SER_PUT(ser, upd->spd);
+	SER_PUT(ser, phase);
+	SER_PUT(ser, err);
+	SER_PUT(ser, err_rl);
+	SER_PUT(ser, keep);
+	SER_PUT(ser, cut);
+	SER_PUT(ser, has_tail);
+	ser_put(ser, &upd->tail, ROUTE_SER_RS_SZ);
+}
+
+/*
+ * Serializes `route' into a compact, versioned binary form for storage,
+ * e.g. in a company route library or for crash recovery. Leg groups and
+ * legs are stored with their wpts, constraints & overrides. With
+ * `with_segs', the segments computed by the last route_update are stored
+ * as well (provided the route is up to date), so that route_deserialize
+ * can restore the route without recomputing it.
+ *
+ * @param len Filled with the length of the returned buffer.
+ *
+ * @return A malloc'd buffer which the caller is responsible for freeing.
+ */
+void *
+route_serialize(const route_t *route, bool_t with_segs, size_t *len)
+{
+	route_ser_t		ser = { .buf = NULL };
+	route_ser_hdr_t		hdr;
+	char			icao[ICAO_NAME_LEN + 1];
+	char			rwy_ID[RWY_ID_LEN + 1];
+	bool_t			valid = B_TRUE;
+	const navproc_t		*procs[ROUTE_SER_NUM_PROCS] = {
+		route->sid, route->sidcm, route->sidtr, route->startr,
+		route->starcm, route->star, route->apprtr, route->appr
+	};
+
+	with_segs = (with_segs && !route->segs_dirty &&
+	    route->upd_acft != NULL);
+
+	memset(&hdr, 0, sizeof (hdr));
+	hdr.magic = ROUTE_SER_MAGIC;
+	hdr.version = ROUTE_SER_VERSION;
+	hdr.flags = (with_segs ? ROUTE_SER_SEGS : 0);
+	hdr.wpt_sz = sizeof (wpt_t);
+	hdr.seg_sz = sizeof (navproc_seg_t);
+	hdr.rs_sz = ROUTE_SER_RS_SZ;
+	hdr.flt_sz = sizeof (flt_perf_t);
+	hdr.airac_cycle = route->navdb->airac_cycle;
+	hdr.num_rlgs = list_count(&route->leg_groups);
+	hdr.num_rls = list_count(&route->legs);
+	hdr.num_rss = (with_segs ? route->num_segs : 0);
+	SER_PUT(&ser, hdr);
+
+	for (unsigned i = 0; i < ROUTE_SER_NUM_ARPTS; i++) {
+		const airport_t *arpt = *route_ser_arpts((route_t *)route,
+		    i);
+
+		memset(icao, 0, sizeof (icao));
+		if (arpt != NULL)
+			strcpy(icao, arpt->icao);
+		SER_PUT(&ser, icao);
+	}
+	memset(rwy_ID, 0, sizeof (rwy_ID));
+	if (route->dep_rwy != NULL)
+		strcpy(rwy_ID, route->dep_rwy->ID);
+	SER_PUT(&ser, rwy_ID);
+	for (unsigned i = 0; i < ROUTE_SER_NUM_PROCS; i++)
+		ser_put_proc(&ser, route, procs[i]);
+
+	if (with_segs) {
+		uint8_t		err = route->upd_err;
+		uint32_t	err_rl = route->upd_err_rl;
+		uint16_t	type_len = strlen(route->upd_acft->acft_type);
+
+		SER_PUT(&ser, route->upd_flt);
+		SER_PUT(&ser, route->upd_start_pos);
+		SER_PUT(&ser, route->upd_start_hdg);
+		SER_PUT(&ser, err);
+		SER_PUT(&ser, err_rl);
+		SER_PUT(&ser, type_len);
+		ser_put(&ser, route->upd_acft->acft_type, type_len);
+		for (unsigned i = 0; i < route->num_segs; i++)
+			ser_put(&ser, route->segs[i], ROUTE_SER_RS_SZ);
+	}
+
+	for (const route_leg_group_t *rlg = list_head(&route->leg_groups);
+	    rlg != NULL; rlg = list_next(&route->leg_groups, rlg)) {
+		uint8_t		type = rlg->type;
+		uint32_t	num_legs = list_count(&rlg->legs);
+		char		awy[NAV_NAME_LEN];
+
+		SER_PUT(&ser, type);
+		if (rlg->type == ROUTE_LEG_GROUP_TYPE_PROC)
+			ser_put_proc(&ser, route, rlg->proc);
+		memset(awy, 0, sizeof (awy));
+		if (rlg->type == ROUTE_LEG_GROUP_TYPE_AIRWAY)
+			strcpy(awy, rlg->awy->name);
+		SER_PUT(&ser, awy);
+		SER_PUT(&ser, rlg->start_wpt);
+		SER_PUT(&ser, rlg->end_wpt);
+		SER_PUT(&ser, num_legs);
+
+		for (const route_leg_t *rl = list_head(&rlg->legs); rl != NULL;
+		    rl = list_next(&rlg->legs, rl)) {
+			uint8_t		disco = rl->disco;
+			uint8_t		alt_ovrd = rl->data->alt_lim_ovrd;
+			uint8_t		spd_ovrd = rl->data->spd_lim_ovrd;
+			uint8_t		upd_valid;
+			uint32_t	proc_seg = (rlg->type ==
+			    ROUTE_LEG_GROUP_TYPE_PROC ?
+			    ser_proc_seg_idx(rlg->proc, &rl->data->seg) : 0);
+
+			SER_PUT(&ser, disco);
+			SER_PUT(&ser, proc_seg);
+			SER_PUT(&ser, rl->data->seg);
+			SER_PUT(&ser, alt_ovrd);
+			SER_PUT(&ser, rl->data->alt_lim);
+			SER_PUT(&ser, spd_ovrd);
+			SER_PUT(&ser, rl->data->spd_lim);
+			SER_PUT(&ser, rl->data->wind);
+			SER_PUT(&ser, rl->data->alt_est);
+			SER_PUT(&ser, rl->data->spd_est);
+			if (!with_segs)
+				continue;
+
+			/*
+			 * Only the checkpoints up to the first dirty leg can
+			 * be resumed from, the rest might refer to legs
+			 * deleted since the last update.
+			 */
+			valid = (valid && rl->upd != NULL);
+			upd_valid = valid;
+			SER_PUT(&ser, upd_valid);
+			if (valid)
+				ser_put_upd(&ser, rl);
+		}
+	}
+
+	*len = ser.len;
+	return (ser.buf);
+}
+
+/*
+ * Candidate selection for route_rebind_wpt. Keeps the candidate closest
+ * to `wpt' in `best'.
+ *
+ * @return B_TRUE if `cand' is identical to `wpt'.
+ */
+static bool_t
+rebind_pick_cand(const wpt_t *wpt, vect3_t pos_v, const wpt_t *cand,
+    vect3_t cand_v, wpt_t *best, double *best_d)
+{
+	double d = vect3_abs(vect3_sub(cand_v, pos_v));
+
+	if (WPT_EQ(cand, wpt))
+		return (B_TRUE);
+	if (IS_NULL_WPT(best) || d < *best_d) {
+		*best = *cand;
+		*best_d = d;
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Rebinds a wpt stored by route_serialize to the current navdb. If the
+ * navdb has a wpt or navaid of the same name at the same position, the
+ * wpt is left alone. Otherwise, the one of that name closest to the old
+ * position replaces it. Wpts not in the navdb at all (runway thresholds,
+ * user-defined wpts, etc.) are kept as they were.
+ *
+ * @return B_TRUE if the wpt changed, B_FALSE if not.
+ */
+static bool_t
+route_rebind_wpt(const route_t *route, wpt_t *wpt)
+{
+	char		name[NAV_NAME_LEN];
+	vect3_t		pos_v;
+	wpt_t		best = null_wpt;
+	double		best_d = 0;
+	const list_t	*list;
+
+	if (IS_NULL_WPT(wpt))
+		return (B_FALSE);
+	pos_v = sph2ecef(GEO2_TO_GEO3(wpt->pos, 0));
+	memset(name, 0, sizeof (name));
+	(void) strlcpy(name, wpt->name, sizeof (name));
+
+	list = htbl_lookup_multi(&route->navdb->wptdb->by_name, name);
+	if (list != NULL) {
+		for (const void *mv = list_head(list); mv != NULL;
+		    mv = list_next(list, mv)) {
+			const wpt_ent_t *ent = HTBL_VALUE_MULTI(mv);
+
+			if (rebind_pick_cand(wpt, pos_v, &ent->wpt, ent->pos_v,
+			    &best, &best_d))
+				return (B_FALSE);
+		}
+	}
+	list = htbl_lookup_multi(&route->navdb->navaiddb->by_id, name);
+	if (list != NULL) {
+		for (const void *mv = list_head(list); mv != NULL;
+		    mv = list_next(list, mv)) {
+			const navaid_t	*navaid = HTBL_VALUE_MULTI(mv);
+			wpt_t		cand;
+
+			memcpy(cand.name, name, sizeof (cand.name));
+			memcpy(cand.icao_country_code,
+			    navaid->icao_country_code,
+			    sizeof (cand.icao_country_code));
+			cand.pos = GEO3_TO_GEO2(navaid->pos);
+			if (rebind_pick_cand(wpt, pos_v, &cand, navaid->pos_v,
+			    &best, &best_d))
+				return (B_FALSE);
+		}
+	}
+
+	if (IS_NULL_WPT(&best))
+		return (B_FALSE);
+	*wpt = best;
+	return (B_TRUE);
+}
+
+/*
+ * Looks up a procedure stored by ser_put_proc in the route's (already
+ * reopened) airports. The procedure is first looked for at its old
+ * index, then by type & name.
+ */
+static err_t
+deser_get_proc(route_deser_t *des, const route_t *route,
+    const navproc_t **procp)
+{
+	route_ser_proc_t	sp;
+	const airport_t		*arpt;
+
+	DESER_GET(des, sp);
+	*procp = NULL;
+	if (sp.arpt == ROUTE_SER_NO_ARPT)
+		return (ERR_OK);
+	if (sp.arpt >= ROUTE_SER_NUM_ARPTS || sp.type >= NAVPROC_TYPES ||
+	    memchr(sp.name, 0, sizeof (sp.name)) == NULL ||
+	    memchr(sp.tr_name, 0, sizeof (sp.tr_name)) == NULL)
+		return (ERR_INVALID_ROUTE_DATA);
+	arpt = *route_ser_arpts((route_t *)route, sp.arpt);
+	if (arpt == NULL)
+		return (ERR_INVALID_ROUTE_DATA);
+
+	for (unsigned i = 0; i <= arpt->num_procs; i++) {
+		/* try the old index first */
+		unsigned	k = (i == 0 ? sp.idx : i - 1);
+		const navproc_t	*proc;
+
+		if (k >= arpt->num_procs)
+			continue;
+		proc = &arpt->procs[k];
+		if (proc->type != sp.type || strcmp(proc->name, sp.name) != 0 ||
+		    strcmp(proc->tr_name, sp.tr_name) != 0)
+			continue;
+		*procp = proc;
+		return (ERR_OK);
+	}
+
+	switch (sp.type) {
+	case NAVPROC_TYPE_SID:
+	case NAVPROC_TYPE_SID_COMMON:
+		return (ERR_INVALID_SID);
+	case NAVPROC_TYPE_STAR:
+	case NAVPROC_TYPE_STAR_COMMON:
+		return (ERR_INVALID_STAR);
+	case NAVPROC_TYPE_FINAL:
+		return (ERR_INVALID_FINAL);
+	default:
+		return (ERR_INVALID_TRANS);
+	}
+}
+
+/*
+ * Reads the route_update checkpoint of `rls[idx]'.
+ */
+static err_t
+route_deserialize_upd(route_deser_t *des, const route_ser_hdr_t *hdr,
+    route_t *route, route_leg_t *rl, uint32_t idx)
+{
+	route_leg_upd_t	*upd;
+	uint8_t		phase, err, has_tail;
+
+	upd = route_pool_alloc(&route->upd_pool, sizeof (*upd));
+	upd->refcnt = 1;
+	rl->upd = upd;
+	DESER_GET(des, upd->pos);
+	DESER_GET(des, upd->hdg);
+	DESER_GET(des, upd->alt);
+	DESER_GET(des, upd->spd);
+	DESER_GET(des, phase);
+	DESER_GET(des, err);
+	DESER_GET(des, upd->err_rl);
+	DESER_GET(des, upd->keep);
+	DESER_GET(des, upd->cut);
+	DESER_GET(des, has_tail);
+	deser_get(des, &upd->tail, ROUTE_SER_RS_SZ);
+	/* the error, if any, happened on a leg in front of this one */
+	if (!des->ok || phase > FLT_PHASE_GA || err >= NUM_ERRS ||
+	    upd->err_rl > idx || upd->keep > hdr->num_rss ||
+	    upd->cut > hdr->num_rss || upd->tail.type >= ROUTE_SEG_TYPES)
+		return (ERR_INVALID_ROUTE_DATA);
+
+	upd->phase = phase;
+	upd->err = err;
+	upd->has_tail = has_tail;
+
+	return (ERR_OK);
+}
+
+/*
+ * Reads the leg groups & legs of a serialized route.
+ *
+ * @param rls Filled with the restored legs, in route order.
+ * @param changed Set to B_TRUE if any wpt or procedure leg had to be
+ *	rebound to a changed navdb entry.
+ */
+static err_t
+route_deserialize_legs(route_deser_t *des, const route_ser_hdr_t *hdr,
+    route_t *route, route_leg_t **rls, bool_t *changed)
+{
+	uint32_t	n = 0;
+	err_t		err;
+
+	for (uint32_t i = 0; i < hdr->num_rlgs; i++) {
+		route_leg_group_t	*rlg;
+		uint8_t			type;
+		char			awy[NAV_NAME_LEN];
+		uint32_t		num_legs;
+
+		DESER_GET(des, type);
+		if (type >= ROUTE_LEG_GROUP_TYPES)
+			return (ERR_INVALID_ROUTE_DATA);
+		rlg = rlg_new(type, route);
+		list_insert_tail(&route->leg_groups, rlg);
+		rlg_idx_insert(route, rlg, route->num_rlg_idx);
+		if (type == ROUTE_LEG_GROUP_TYPE_PROC) {
+			if ((err = deser_get_proc(des, route, &rlg->proc)) !=
+			    ERR_OK)
+				return (err);
+			if (rlg->proc == NULL)
+				return (ERR_INVALID_ROUTE_DATA);
+		}
+		DESER_GET(des, awy);
+		DESER_GET(des, rlg->start_wpt);
+		DESER_GET(des, rlg->end_wpt);
+		DESER_GET(des, num_legs);
+		if (!des->ok || num_legs > hdr->num_rls - n ||
+		    memchr(awy, 0, sizeof (awy)) == NULL)
+			return (ERR_INVALID_ROUTE_DATA);
+		*changed |= route_rebind_wpt(route, &rlg->start_wpt);
+		*changed |= route_rebind_wpt(route, &rlg->end_wpt);
+		if (type == ROUTE_LEG_GROUP_TYPE_AIRWAY) {
+			bool_t ends = (!IS_NULL_WPT(&rlg->start_wpt) &&
+			    !IS_NULL_WPT(&rlg->end_wpt));
+
+			rlg->awy = airway_db_lookup(route->navdb->awydb, awy,
+			    ends ? &rlg->start_wpt : NULL,
+			    ends ? rlg->end_wpt.name : NULL, NULL);
+			if (rlg->awy == NULL)
+				return (ERR_INVALID_AWY);
+		}
+
+		for (uint32_t j = 0; j < num_legs; j++, n++) {
+			route_leg_t	*rl = rl_alloc(route);
+			uint8_t		disco, alt_ovrd, spd_ovrd;
+			uint32_t	proc_seg;
+			wpt_t		*wpts[NAVPROC_SEG_MAX_WPTS];
+
+			rl->rlg = rlg;
+			list_insert_tail(&rlg->legs, rl);
+			list_insert_tail(&route->legs, rl);
+			rl_idx_insert(route, rl, route->num_rl_idx);
+			rls[n] = rl;
+			DESER_GET(des, disco);
+			DESER_GET(des, proc_seg);
+			DESER_GET(des, rl->data->seg);
+			DESER_GET(des, alt_ovrd);
+			DESER_GET(des, rl->data->alt_lim);
+			DESER_GET(des, spd_ovrd);
+			DESER_GET(des, rl->data->spd_lim);
+			DESER_GET(des, rl->data->wind);
+			DESER_GET(des, rl->data->alt_est);
+			DESER_GET(des, rl->data->spd_est);
+			rl->disco = disco;
+			rl->data->alt_lim_ovrd = alt_ovrd;
+			rl->data->spd_lim_ovrd = spd_ovrd;
+			if (!des->ok || rl->data->seg.type >= NAVPROC_SEG_TYPES)
+				return (ERR_INVALID_ROUTE_DATA);
+
+			if (proc_seg != 0) {
+				/* procedure legs come from the reopened proc */
+				if (proc_seg > rlg->proc->num_segs ||
+				    memcmp(&rlg->proc->segs[proc_seg - 1],
+				    &rl->data->seg,
+				    sizeof (rl->data->seg)) != 0)
+					*changed = B_TRUE;
+				if (proc_seg <= rlg->proc->num_segs) {
+					rl->data->seg =
+					    rlg->proc->segs[proc_seg - 1];
+				}
+			} else {
+				for (unsigned k = 0, m = navproc_seg_get_wpts(
+				    &rl->data->seg, wpts); k < m; k++)
+					*changed |= route_rebind_wpt(route,
+					    wpts[k]);
+			}
+
+			if (hdr->flags & ROUTE_SER_SEGS) {
+				uint8_t valid;
+
+				DESER_GET(des, valid);
+				if (valid && (err = route_deserialize_upd(des,
+				    hdr, route, rl, n)) != ERR_OK)
+					return (err);
+			}
+		}
+	}
+	if (!des->ok || n != hdr->num_rls)
+		return (ERR_INVALID_ROUTE_DATA);
+
+	return (ERR_OK);
+}
+
+/*
+ * Restores a route saved by route_serialize on top of `navdb'. Airports,
+ * procedures and airways are looked up again and all wpts are rebound to
+ * the navdb in a single pass over the route (see route_rebind_wpt). If
+ * the route was saved with its segments and it's unaffected by any
+ * changes to the navdb since it was saved, the segments and route_update
+ * checkpoints are restored as well, so the route needs no recomputing.
+ * Otherwise the route comes back marked for a full route_update.
+ *
+ * @param acft Aircraft performance the route is going to be updated with.
+ *	If it is for the aircraft type the route was last updated for, the
+ *	next route_update with the same flight performance finds the
+ *	restored route up to date. Pass NULL if unknown.
+ * @param err Filled with the reason for a failure.
+ *
+ * @return The restored route, or NULL on failure.
+ */
+route_t *
+route_deserialize(const fms_navdb_t *navdb, const acft_perf_t *acft,
+    const void *buf, size_t len, err_t *err)
+{
+	route_deser_t	des = { .buf = buf, .len = len, .ok = B_TRUE };
+	route_ser_hdr_t	hdr;
+	route_t		*route = route_create(navdb);
+	list_t		segs;
+	route_leg_t	**rls = NULL;
+	char		icao[ICAO_NAME_LEN + 1];
+	char		rwy_ID[RWY_ID_LEN + 1];
+	char		acft_type[64];
+	const navproc_t	**procs[ROUTE_SER_NUM_PROCS] = {
+		&route->sid, &route->sidcm, &route->sidtr, &route->startr,
+		&route->starcm, &route->star, &route->apprtr, &route->appr
+	};
+	uint8_t		upd_err = 0;
+	uint32_t	upd_err_rl = 0;
+	uint16_t	type_len = 0;
+	bool_t		changed;
+
+	list_create(&segs, sizeof (route_seg_t),
+	    offsetof(route_seg_t, route_segs_node));
+	DESER_GET(&des, hdr);
+	if (!des.ok || hdr.magic != ROUTE_SER_MAGIC ||
+	    hdr.version != ROUTE_SER_VERSION ||
+	    (hdr.flags & ~ROUTE_SER_SEGS) != 0 ||
+	    hdr.wpt_sz != sizeof (wpt_t) ||
+	    hdr.seg_sz != sizeof (navproc_seg_t) ||
+	    hdr.rs_sz != ROUTE_SER_RS_SZ || hdr.flt_sz != sizeof (flt_perf_t) ||
+	    hdr.num_rls > len || hdr.num_rss > len) {
+		*err = ERR_INVALID_ROUTE_DATA;
+		goto errout;
+	}
+	changed = (hdr.airac_cycle != navdb->airac_cycle);
+
+	for (unsigned i = 0; i < ROUTE_SER_NUM_ARPTS; i++) {
+		DESER_GET(&des, icao);
+		if (!des.ok || icao[ICAO_NAME_LEN] != 0) {
+			*err = ERR_INVALID_ROUTE_DATA;
+			goto errout;
+		}
+		if (*icao != 0 && (*err = route_set_arpt(route,
+		    route_ser_arpts(route, i), icao)) != ERR_OK)
+			goto errout;
+	}
+	DESER_GET(&des, rwy_ID);
+	if (!des.ok || rwy_ID[RWY_ID_LEN] != 0) {
+		*err = ERR_INVALID_ROUTE_DATA;
+		goto errout;
+	}
+	if (*rwy_ID != 0) {
+		if (route->dep == NULL || (route->dep_rwy =
+		    airport_find_rwy_by_ID(route->dep, rwy_ID)) == NULL) {
+			*err = ERR_INVALID_RWY;
+			goto errout;
+		}
+	}
+	for (unsigned i = 0; i < ROUTE_SER_NUM_PROCS; i++) {
+		if ((*err = deser_get_proc(&des, route, procs[i])) != ERR_OK)
+			goto errout;
+	}
+
+	if (hdr.flags & ROUTE_SER_SEGS) {
+		DESER_GET(&des, route->upd_flt);
+		DESER_GET(&des, route->upd_start_pos);
+		DESER_GET(&des, route->upd_start_hdg);
+		DESER_GET(&des, upd_err);
+		DESER_GET(&des, upd_err_rl);
+		DESER_GET(&des, type_len);
+		if (type_len >= sizeof (acft_type) || upd_err >= NUM_ERRS ||
+		    upd_err_rl > hdr.num_rls) {
+			*err = ERR_INVALID_ROUTE_DATA;
+			goto errout;
+		}
+		deser_get(&des, acft_type, type_len);
+		acft_type[type_len] = 0;
+
+		for (uint32_t i = 0; i < hdr.num_rss && des.ok; i++) {
+			route_seg_t *rs = route_pool_alloc(&route->rs_pool,
+			    sizeof (*rs));
+
+			deser_get(&des, rs, ROUTE_SER_RS_SZ);
+			list_link_init(&rs->route_segs_node);
+			list_insert_tail(&segs, rs);
+			if (rs->type >= ROUTE_SEG_TYPES ||
+			    rs->join_type >= ROUTE_SEG_JOIN_TYPES)
+				des.ok = B_FALSE;
+		}
+	}
+
+	rls = calloc(sizeof (*rls), MAX(hdr.num_rls, 1));
+	if ((*err = route_deserialize_legs(&des, &hdr, route, rls,
+	    &changed)) != ERR_OK)
+		goto errout;
+	if (des.off != des.len) {
+		*err = ERR_INVALID_ROUTE_DATA;
+		goto errout;
+	}
+
+	if ((hdr.flags & ROUTE_SER_SEGS) && !changed) {
+		route->upd_acft = (acft != NULL &&
+		    strcmp(acft->acft_type, acft_type) == 0 ? acft : NULL);
+		route->upd_err = upd_err;
+		route->upd_err_rl = upd_err_rl;
+		route_segs_publish(route, &segs);
+		route->segs_dirty = B_FALSE;
+	} else {
+		for (route_leg_t *rl = list_head(&route->legs); rl != NULL;
+		    rl = list_next(&route->legs, rl)) {
+			upd_rele(&route->upd_pool, rl->upd);
+			rl->upd = NULL;
+		}
+		memset(&route->upd_flt, 0, sizeof (route->upd_flt));
+		route->segs_dirty = B_TRUE;
+	}
+
+	seglist_destroy(&route->rs_pool, &segs);
+	free(rls);
+	*err = ERR_OK;
+	return (route);
+errout:
+	seglist_destroy(&route->rs_pool, &segs);
+	free(rls);
+	route_destroy(route);
+	return (NULL);
+}
+
 static flt_phase_t
 next_flt_phase(flt_phase_t cur_phase, const route_leg_group_t *rlg,
     const route_leg_t *rl)
@@ -1640,18 +3097,15 @@ next_flt_phase(flt_phase_t cur_phase, const route_leg_group_t *rlg,
 			ASSERT(cur_phase <= FLT_PHASE_DES);
 			return (FLT_PHASE_DES);
 		case NAVPROC_TYPE_FINAL: {
-			bool_t go_around = B_TRUE;
-			for (unsigned i = 0;; i++) {
+			unsigned i = 0;
+
+			/* segments past the main ones are the missed appr */
+			while (memcmp(&rlg->proc->segs[i], &rl->data->seg,
+			    sizeof (rl->data->seg)) != 0) {
+				i++;
 				ASSERT(i < rlg->proc->num_segs);
-				if (memcmp(&rlg->proc->segs[i],
-				    &rl->seg, sizeof (rl->seg)) == 0)
-					break;
-				if (i == rlg->proc->num_main_segs) {
-					go_around = B_FALSE;
-					break;
-				}
 			}
-			if (go_around) {
+			if (i >= rlg->proc->num_main_segs) {
 				ASSERT(cur_phase == FLT_PHASE_GA ||
 				    cur_phase == FLT_PHASE_DES);
 				return (FLT_PHASE_GA);
@@ -1676,122 +3130,425 @@ next_join_type(const route_t *route, const route_leg_t *rl)
 
 	if (rl_next == NULL)
 		return (ROUTE_SEG_JOIN_TRACK);
-	if (rl_next->seg.type == NAVPROC_SEG_TYPE_DIR_TO_FIX)
+	if (rl_next->data->seg.type == NAVPROC_SEG_TYPE_DIR_TO_FIX)
 		return (ROUTE_SEG_JOIN_DIRECT);
 	return (ROUTE_SEG_JOIN_TRACK);
 }
 
-static geo_pos2_t
-route_do_turn(route_t *route, route_leg_t *rl, double spd, double turn_rate,
-    geo_pos2_t cur_pos, double cur_hdg, double next_hdg, double rnp,
-    double *turn_len)
-{
-	double r, rhdg;
-	bool_t cw;
-	geo_pos2_t center, end;
-	route_seg_t *rs, *rs_prev;
-	const navproc_seg_t *seg = &rl->seg;
-	turn_t turn;
+/*
+ * A pass of route_update over a run of legs. The pass appends the
+ * segments it computes to `segs', allocating them from `pool', and the
+ * legs' checkpoints from `upd_pool'. `base' is the number of segments in
+ * front of `segs' (see route_leg_upd_s). Sections of the route following
+ * a discontinuity can be computed by a pass of their own on a worker
+ * thread, with its own segment list and pools.
+ */
+typedef struct {
+	route_t			*route;
+	const acft_perf_t	*acft;
+	const flt_perf_t	*flt;
+	double			fuel;
+	list_t			*segs;
+	route_pool_t		*pool;
+	route_pool_t		*upd_pool;
+	unsigned		base;
+	/*
+	 * The last segment in front of the most recent discontinuity. Any
+	 * path after a discontinuity starts afresh, so we never join onto
+	 * this segment. `cut' is NULL unless the segment is on `segs'.
+	 */
+	route_seg_t		*cut;
+	unsigned		cut_n;
+} route_upd_t;
 
-	switch (seg->type) {
-	case NAVPROC_SEG_TYPE_CRS_TO_ALT:
-	case NAVPROC_SEG_TYPE_CRS_TO_DME:
-	case NAVPROC_SEG_TYPE_CRS_TO_INTCP:
-	case NAVPROC_SEG_TYPE_CRS_TO_RADIAL:
-	case NAVPROC_SEG_TYPE_HDG_TO_ALT:
-	case NAVPROC_SEG_TYPE_HDG_TO_DME:
-	case NAVPROC_SEG_TYPE_HDG_TO_INTCP:
-	case NAVPROC_SEG_TYPE_HDG_TO_MANUAL:
-	case NAVPROC_SEG_TYPE_HDG_TO_RADIAL:
-		turn = seg->leg_cmd.hdg.turn;
-		break;
-	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
-		turn = seg->leg_cmd.navaid_crs.turn;
-		break;
-	default:
-		assert(0);
-	}
+/*
+ * State carried from leg to leg by route_update.
+ */
+typedef struct {
+	geo_pos2_t	pos;
+	double		hdg;
+	double		alt;
+	double		spd;
+	flt_phase_t	phase;
+	err_t		err;
+	route_leg_t	*err_rl;
+} route_upd_state_t;
 
-	rhdg = rel_hdg(cur_hdg, next_hdg);
-	if (turn == TURN_ANY || ABS(rhdg) < ARC_JOIN_THR) {
-		if (turn_len != NULL)
-			*turn_len = 0;
-		return (cur_pos);
-	}
-	r = calc_arc_radius(spd, turn_rate);
-	cw = (turn == TURN_RIGHT);
-	center = geo_displace_mag(&wgs84, route->navdb->wmm, cur_pos,
-	    cur_hdg + (cw ? 90 : -90), r);
-	end = geo_displace_mag(&wgs84, route->navdb->wmm, center,
-	    next_hdg - (cw ? 90 : -90), r);
+/*
+ * Most segments a join can leave between the segments preceding & following
+ * its two input segments (see rs_join_dir_reintcp_trk).
+ */
+#define	RS_JOIN_MAX_SEGS	5
+#define	RS_JOIN_CACHE_MIN	256	/* entries */
 
-	rs = rs_new_arc(cur_pos, end, center, cw, ROUTE_SEG_JOIN_TRACK);
-	list_insert_tail(&route->segs, rs);
-	rs_prev = list_prev(&route->segs, rs);
-	if (rs_prev != NULL)
-		route_seg_join(&route->segs, rs_prev, rs, rnp, spd, turn_rate);
+/*
+ * Everything the result of rs_join depends on. The segments are
+ * normalized, so that bytes not belonging to the segment type (which can
+ * be left over from a previous use of the object) don't make otherwise
+ * identical joins differ.
+ */
+typedef struct {
+	route_seg_t	rs[2];
+	double		rnp;
+	double		spd;
+	double		turn_rate;
+} rs_join_key_t;
 
-	if (turn_len != NULL) {
-		double arc_angle;
-		if ((rhdg < 0 && !cw) || (rhdg >= 0 && cw))
-			arc_angle = ABS(rhdg);
-		else
-			arc_angle = 360 - ABS(rhdg);
-		*turn_len = MET2NM(DEG2RAD(arc_angle) * r);
-	}
+/*
+ * The result of a join: the segments it replaced its two input segments
+ * with. `src' tells which of them are input segments updated in place
+ * (1 for the 1st one, 2 for the 2nd one) and which are new (0).
+ */
+typedef struct {
+	uint64_t	hash;
+	rs_join_key_t	key;
+	uint8_t		src[RS_JOIN_MAX_SEGS];
+	unsigned	num_segs;
+	route_seg_t	segs[RS_JOIN_MAX_SEGS];
+	list_node_t	lru_node;
+} rs_join_ent_t;
 
-	return (end);
-}
+/*
+ * Memoized route segment joins of a route, see rs_join_memo. Shared by the
+ * passes of route_update computing the route's sections in parallel.
+ */
+struct route_join_cache_s {
+	pthread_mutex_t		lock;	/* protects everything below */
+	htbl_t			by_hash;
+	list_t			lru;	/* most recently used first */
+	size_t			max_entries;
+	route_cache_stats_t	stats;
+};
+
+static void
+rs_join_key_put(route_seg_t *dst, const route_seg_t *src)
+{
+	dst->type = src->type;
+	dst->join_type = src->join_type;
+	if (src->type == ROUTE_SEG_TYPE_DIRECT) {
+		dst->direct.start = src->direct.start;
+		dst->direct.end = src->direct.end;
+	} else {
+		dst->arc.start = src->arc.start;
+		dst->arc.end = src->arc.end;
+		dst->arc.center = src->arc.center;
+		dst->arc.cw = src->arc.cw;
+	}
+}
+
+/*
+ * Readies the join cache of `route' for a route_update, creating it if
+ * needed. It is sized for a few joins per leg, so that it holds the whole
+ * route, plus room for the joins made obsolete by edits until they age
+ * out.
+ */
+static void
+route_join_cache_prepare(route_t *route)
+{
+	route_join_cache_t *jc = route->join_cache;
+
+	if (jc == NULL) {
+		jc = calloc(sizeof (*jc), 1);
+		VERIFY(pthread_mutex_init(&jc->lock, NULL) == 0);
+		htbl_create(&jc->by_hash, RS_JOIN_CACHE_MIN,
+		    sizeof (uint64_t), 0);
+		list_create(&jc->lru, sizeof (rs_join_ent_t),
+		    offsetof(rs_join_ent_t, lru_node));
+		route->join_cache = jc;
+	}
+	jc->max_entries = MAX(4 * list_count(&route->legs),
+	    RS_JOIN_CACHE_MIN);
+}
+
+static void
+route_join_cache_destroy(route_join_cache_t *jc)
+{
+	rs_join_ent_t *ent;
+
+	if (jc == NULL)
+		return;
+	while ((ent = list_remove_head(&jc->lru)) != NULL)
+		free(ent);
+	htbl_empty(&jc->by_hash, NULL, NULL);
+	htbl_destroy(&jc->by_hash);
+	list_destroy(&jc->lru);
+	pthread_mutex_destroy(&jc->lock);
+	free(jc);
+}
+
+/*
+ * Looks up the join in `key' and if found, replays it onto `rs1' & `rs2'.
+ */
+static bool_t
+rs_join_replay(route_upd_t *ru, route_join_cache_t *jc,
+    const rs_join_key_t *key, uint64_t hash, route_seg_t *rs1,
+    route_seg_t *rs2)
+{
+	rs_join_ent_t	*ent;
+	route_seg_t	*rs = rs1;
+	bool_t		used[2] = { B_FALSE, B_FALSE };
+
+	pthread_mutex_lock(&jc->lock);
+	ent = htbl_lookup(&jc->by_hash, &hash);
+	if (ent == NULL || memcmp(&ent->key, key, sizeof (*key)) != 0) {
+		jc->stats.misses++;
+		pthread_mutex_unlock(&jc->lock);
+		return (B_FALSE);
+	}
+	jc->stats.hits++;
+	list_remove(&jc->lru, ent);
+	list_insert_head(&jc->lru, ent);
+
+	/* new segments always go after `rs1' and before `rs2' */
+	for (unsigned i = 0; i < ent->num_segs; i++) {
+		route_seg_t *rs_new;
+
+		switch (ent->src[i]) {
+		case 1:
+			rs_new = rs1;
+			break;
+		case 2:
+			rs_new = rs2;
+			break;
+		default:
+			rs_new = route_pool_alloc(ru->pool, sizeof (*rs_new));
+			list_insert_after(ru->segs, rs, rs_new);
+			break;
+		}
+		if (ent->src[i] != 0)
+			used[ent->src[i] - 1] = B_TRUE;
+		memcpy(rs_new, &ent->segs[i],
+		    offsetof(route_seg_t, route_segs_node));
+		rs = rs_new;
+	}
+	pthread_mutex_unlock(&jc->lock);
+
+	if (!used[0]) {
+		list_remove(ru->segs, rs1);
+		rs_destroy(ru->pool, rs1);
+	}
+	if (!used[1]) {
+		list_remove(ru->segs, rs2);
+		rs_destroy(ru->pool, rs2);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Stores the join which replaced `rs1' & `rs2' with the segments between
+ * `prev' and `next' (exclusive, NULL meaning the respective end of the
+ * list).
+ */
+static void
+rs_join_record(route_upd_t *ru, route_join_cache_t *jc,
+    const rs_join_key_t *key, uint64_t hash, const route_seg_t *rs1,
+    const route_seg_t *rs2, const route_seg_t *prev, const route_seg_t *next)
+{
+	rs_join_ent_t		*ent = malloc(sizeof (*ent));
+	rs_join_ent_t		*old;
+
+	ent->hash = hash;
+	ent->key = *key;
+	ent->num_segs = 0;
+	for (const route_seg_t *rs = (prev != NULL ?
+	    list_next(ru->segs, prev) : list_head(ru->segs)); rs != next;
+	    rs = list_next(ru->segs, rs)) {
+		ASSERT(ent->num_segs < RS_JOIN_MAX_SEGS);
+		ent->src[ent->num_segs] = (rs == rs1 ? 1 : (rs == rs2 ? 2 : 0));
+		ent->segs[ent->num_segs++] = *rs;
+	}
+	ASSERT(ent->num_segs != 0);
+
+	pthread_mutex_lock(&jc->lock);
+	if ((old = htbl_lookup(&jc->by_hash, &hash)) != NULL) {
+		list_remove(&jc->lru, old);
+		free(old);
+	}
+	htbl_set(&jc->by_hash, &ent->hash, ent);
+	list_insert_head(&jc->lru, ent);
+	while (list_count(&jc->lru) > jc->max_entries) {
+		old = list_remove_tail(&jc->lru);
+		htbl_remove(&jc->by_hash, &old->hash, B_FALSE);
+		free(old);
+		jc->stats.evictions++;
+	}
+	pthread_mutex_unlock(&jc->lock);
+}
+
+/*
+ * rs_join for route_update. Joins only depend on the two segments, speed,
+ * turn rate & RNP, and most of them come out the same on every update of
+ * a route, so they're memoized in the route's join cache: a repeated join
+ * just copies the resulting segments instead of redoing the projections
+ * and circle intersections.
+ */
+static void
+rs_join_memo(route_upd_t *ru, route_seg_t *rs1, route_seg_t *rs2,
+    double rnp, double spd, double turn_rate)
+{
+	route_join_cache_t	*jc = ru->route->join_cache;
+	rs_join_key_t		key;
+	uint64_t		hash;
+	const route_seg_t	*prev, *next;
+
+	ASSERT(list_next(ru->segs, rs1) == rs2);
+	if (rs1->join_type == ROUTE_SEG_JOIN_SIMPLE)
+		return;
+
+	memset(&key, 0, sizeof (key));
+	rs_join_key_put(&key.rs[0], rs1);
+	rs_join_key_put(&key.rs[1], rs2);
+	key.rnp = rnp;
+	key.spd = spd;
+	key.turn_rate = turn_rate;
+	hash = route_cache_hash((const uint8_t *)&key, sizeof (key));
+	if (rs_join_replay(ru, jc, &key, hash, rs1, rs2))
+		return;
+
+	prev = list_prev(ru->segs, rs1);
+	next = list_next(ru->segs, rs2);
+	rs_join(ru->pool, ru->segs, rs1, rs2, rnp, spd, turn_rate);
+	rs_join_record(ru, jc, &key, hash, rs1, rs2, prev, next);
+}
+
+/*
+ * Returns the hit, miss & eviction counters and size of the cache of
+ * segment joins route_update keeps for `route'.
+ */
+route_cache_stats_t
+route_get_join_stats(const route_t *route)
+{
+	route_join_cache_t	*jc = route->join_cache;
+	route_cache_stats_t	stats;
+
+	memset(&stats, 0, sizeof (stats));
+	if (jc == NULL)
+		return (stats);
+	pthread_mutex_lock(&jc->lock);
+	stats = jc->stats;
+	stats.num_entries = list_count(&jc->lru);
+	pthread_mutex_unlock(&jc->lock);
+
+	return (stats);
+}
+
+static geo_pos2_t
+route_do_turn(route_upd_t *ru, route_leg_t *rl, double spd, double turn_rate,
+    geo_pos2_t cur_pos, double cur_hdg, double next_hdg, double rnp,
+    double *turn_len)
+{
+	const route_t *route = ru->route;
+	double r, rhdg;
+	bool_t cw;
+	geo_pos2_t center, end;
+	route_seg_t *rs, *rs_prev;
+	const navproc_seg_t *seg = &rl->data->seg;
+	turn_t turn;
+
+	switch (seg->type) {
+	case NAVPROC_SEG_TYPE_CRS_TO_ALT:
+	case NAVPROC_SEG_TYPE_CRS_TO_DME:
+	case NAVPROC_SEG_TYPE_CRS_TO_INTCP:
+	case NAVPROC_SEG_TYPE_CRS_TO_RADIAL:
+	case NAVPROC_SEG_TYPE_HDG_TO_ALT:
+	case NAVPROC_SEG_TYPE_HDG_TO_DME:
+	case NAVPROC_SEG_TYPE_HDG_TO_INTCP:
+	case NAVPROC_SEG_TYPE_HDG_TO_MANUAL:
+	case NAVPROC_SEG_TYPE_HDG_TO_RADIAL:
+		turn = seg->leg_cmd.hdg.turn;
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
+		turn = seg->leg_cmd.navaid_crs.turn;
+		break;
+	default:
+		assert(0);
+	}
+
+	rhdg = rel_hdg(cur_hdg, next_hdg);
+	if (turn == TURN_ANY || ABS(rhdg) < ARC_JOIN_THR) {
+		if (turn_len != NULL)
+			*turn_len = 0;
+		return (cur_pos);
+	}
+	r = calc_arc_radius(spd, turn_rate);
+	cw = (turn == TURN_RIGHT);
+	center = geo_displace_mag(&wgs84, route->navdb->wmm, cur_pos,
+	    cur_hdg + (cw ? 90 : -90), r);
+	end = geo_displace_mag(&wgs84, route->navdb->wmm, center,
+	    next_hdg - (cw ? 90 : -90), r);
+
+	rs = rs_new_arc(ru->pool, cur_pos, end, center, cw,
+	    ROUTE_SEG_JOIN_TRACK);
+	list_insert_tail(ru->segs, rs);
+	rs_prev = list_prev(ru->segs, rs);
+	if (rs_prev != NULL && rs_prev != ru->cut)
+		rs_join_memo(ru, rs_prev, rs, rnp, spd, turn_rate);
+
+	if (turn_len != NULL) {
+		double arc_angle;
+		if ((rhdg < 0 && !cw) || (rhdg >= 0 && cw))
+			arc_angle = ABS(rhdg);
+		else
+			arc_angle = 360 - ABS(rhdg);
+		*turn_len = MET2NM(DEG2RAD(arc_angle) * r);
+	}
+
+	return (end);
+}
 
 static void
 dir_connect(geo_pos2_t start, geo_pos2_t end, double rnp, double spd,
-    double turn_rate, route_t *route, route_seg_join_type_t join_type)
+    double turn_rate, route_upd_t *ru, route_seg_join_type_t join_type)
 {
 	route_seg_t *rs, *rs_prev;
 
-	rs = rs_new_direct(start, end, join_type);
-	list_insert_tail(&route->segs, rs);
-	rs_prev = list_prev(&route->segs, rs);
-	if (rs_prev != NULL)
-		route_seg_join(&route->segs, rs_prev, rs, rnp, spd, turn_rate);
+	rs = rs_new_direct(ru->pool, start, end, join_type);
+	list_insert_tail(ru->segs, rs);
+	rs_prev = list_prev(ru->segs, rs);
+	if (rs_prev != NULL && rs_prev != ru->cut)
+		rs_join_memo(ru, rs_prev, rs, rnp, spd, turn_rate);
 }
 
 static void
-route_update_AF(route_t *route, route_leg_t *rl, geo_pos2_t *cur_pos,
+route_update_AF(route_upd_t *ru, route_leg_t *rl, geo_pos2_t *cur_pos,
     double *hdgp, double rnp, double spd, double turn_rate)
 {
+	const route_t *route = ru->route;
 	geo_pos2_t start_pos, end_pos;
 	route_seg_t *rs;
 
 	start_pos = geo_displace_mag(&wgs84, route->navdb->wmm,
-	    rl->seg.leg_cmd.dme_arc.navaid.pos,
-	    rl->seg.leg_cmd.dme_arc.start_radial,
-	    NM2MET(rl->seg.leg_cmd.dme_arc.radius));
+	    rl->data->seg.leg_cmd.dme_arc.navaid.pos,
+	    rl->data->seg.leg_cmd.dme_arc.start_radial,
+	    NM2MET(rl->data->seg.leg_cmd.dme_arc.radius));
 	end_pos = geo_displace_mag(&wgs84, route->navdb->wmm,
-	    rl->seg.leg_cmd.dme_arc.navaid.pos,
-	    rl->seg.leg_cmd.dme_arc.end_radial,
-	    NM2MET(rl->seg.leg_cmd.dme_arc.radius));
+	    rl->data->seg.leg_cmd.dme_arc.navaid.pos,
+	    rl->data->seg.leg_cmd.dme_arc.end_radial,
+	    NM2MET(rl->data->seg.leg_cmd.dme_arc.radius));
 	if (gc_distance(*cur_pos, start_pos) > ARC_START_THRESH) {
-		dir_connect(*cur_pos, start_pos, rnp, spd, turn_rate, route,
+		dir_connect(*cur_pos, start_pos, rnp, spd, turn_rate, ru,
 		    ROUTE_SEG_JOIN_TRACK);
 		*cur_pos = start_pos;
 	}
-	rs = rs_new_arc(start_pos, end_pos, rl->seg.leg_cmd.dme_arc.navaid.pos,
-	    rl->seg.leg_cmd.dme_arc.cw, next_join_type(route, rl));
-	list_insert_tail(&route->segs, rs);
+	rs = rs_new_arc(ru->pool, start_pos, end_pos,
+	    rl->data->seg.leg_cmd.dme_arc.navaid.pos,
+	    rl->data->seg.leg_cmd.dme_arc.cw, next_join_type(route, rl));
+	list_insert_tail(ru->segs, rs);
 
 	*cur_pos = end_pos;
-	*hdgp = rl->seg.leg_cmd.dme_arc.end_radial +
-	    (rl->seg.leg_cmd.dme_arc.cw ? 90 : -90);
+	*hdgp = rl->data->seg.leg_cmd.dme_arc.end_radial +
+	    (rl->data->seg.leg_cmd.dme_arc.cw ? 90 : -90);
 }
 
 static bool_t
-route_update_RF(route_t *route, route_leg_t *rl, geo_pos2_t *cur_pos,
+route_update_RF(route_upd_t *ru, route_leg_t *rl, geo_pos2_t *cur_pos,
     double *hdgp, double rnp, double spd, double turn_rate)
 {
+	const route_t *route = ru->route;
 	route_seg_t *rs, next_rs;
 	fpp_t fpp;
-	const navproc_seg_t *seg = &rl->seg;
+	const navproc_seg_t *seg = &rl->data->seg;
 	vect2_t c, s, e, p, o;
 	geo_pos2_t start_pos, end_pos, ctr_pos, out_pos;
 	route_leg_t *next_rl;
@@ -1819,20 +3576,21 @@ route_update_RF(route_t *route, route_leg_t *rl, geo_pos2_t *cur_pos,
 	end_pos = fpp2geo(e, &fpp);
 
 	if (vect2_abs(vect2_sub(s, p)) > ARC_START_THRESH) {
-		dir_connect(*cur_pos, start_pos, rnp, spd, turn_rate, route,
+		dir_connect(*cur_pos, start_pos, rnp, spd, turn_rate, ru,
 		    ROUTE_SEG_JOIN_TRACK);
 		*cur_pos = start_pos;
 	}
 	connect_out = (vect2_abs(vect2_sub(e, o)) > ARC_START_THRESH);
-	rs = rs_new_arc(start_pos, end_pos, ctr_pos, seg->leg_cmd.radius_arc.cw,
+	rs = rs_new_arc(ru->pool, start_pos, end_pos, ctr_pos,
+	    seg->leg_cmd.radius_arc.cw,
 	    connect_out ? ROUTE_SEG_JOIN_DIRECT : next_join_type(route, rl));
-	list_insert_tail(&route->segs, rs);
+	list_insert_tail(ru->segs, rs);
 	*cur_pos = end_pos;
 	*hdgp = wmm_true2mag(route->navdb->wmm, dir2hdg(vect2_norm(vect2_sub(e,
 	    c), seg->leg_cmd.radius_arc.cw)), GEO2_TO_GEO3(*cur_pos, 0));
 
 	if (connect_out) {
-		dir_connect(end_pos, out_pos, rnp, spd, turn_rate, route,
+		dir_connect(end_pos, out_pos, rnp, spd, turn_rate, ru,
 		    next_join_type(route, rl));
 		*cur_pos = out_pos;
 		*hdgp = wmm_true2mag(route->navdb->wmm, gc_point_hdg(end_pos,
@@ -1845,41 +3603,48 @@ route_update_RF(route_t *route, route_leg_t *rl, geo_pos2_t *cur_pos,
 
 static err_t
 route_update_CA_FA_VA(const acft_perf_t *acft, const flt_perf_t *flt,
-    route_t *route, route_leg_t *rl, flt_phase_t phase,
+    route_upd_t *ru, route_leg_t *rl, flt_phase_t phase,
     accelclb_t clbtype, double fuel, double flap, double rnp,
     geo_pos2_t *cur_pos, double *cur_alt, double *cur_hdg, double cur_spd,
     double next_spd, double turn_rate, vect2_t next_wind, bool_t is_FA)
 {
+	const route_t *route = ru->route;
 	double burn, dist, turn_len;
 	geo_pos2_t next_pos;
 	route_seg_t *rs;
-	const navproc_seg_t *seg = &rl->seg;
+	const navproc_seg_t *seg = &rl->data->seg;
 	double hdg = (is_FA ? seg->leg_cmd.fix_crs.crs : seg->leg_cmd.hdg.hdg);
+	wx_sample_t wx = { .wind = ZERO_VECT2, .isadev = 0 };
 
 	ASSERT(seg->type == NAVPROC_SEG_TYPE_CRS_TO_ALT ||
 	    seg->type == NAVPROC_SEG_TYPE_FIX_TO_ALT ||
 	    seg->type == NAVPROC_SEG_TYPE_HDG_TO_ALT);
 	ASSERT(phase <= FLT_PHASE_CLB || phase == FLT_PHASE_GA);
 
-	if (rl->seg.term_cond.alt.alt1 <= *cur_alt)
+	if (rl->data->seg.term_cond.alt.alt1 <= *cur_alt)
 		return (ERR_OK);
 
 	if (is_FA && gc_distance(*cur_pos, seg->leg_cmd.fix_crs.fix.pos) >
 	    ARC_START_THRESH) {
 		dir_connect(*cur_pos, seg->leg_cmd.fix_crs.fix.pos, rnp,
-		    cur_spd, turn_rate, route, ROUTE_SEG_JOIN_TRACK);
+		    cur_spd, turn_rate, ru, ROUTE_SEG_JOIN_TRACK);
 		*cur_pos = seg->leg_cmd.fix_crs.fix.pos;
 	}
 
-	dist = accelclb2dist(flt, acft, 0, ISA_SL_PRESS, ISA_TP_ALT,
-	    fuel, hdg2dir(hdg), *cur_alt, cur_spd, rl->wind,
-	    seg->term_cond.alt.alt1, next_spd, next_wind, flap,
-	    flt->crz_mach, clbtype, &burn);
+	/* see route_set_wx */
+	if (route->wx != NULL) {
+		wx = wx_sample(route->wx, GEO2_TO_GEO3(*cur_pos, *cur_alt),
+		    route->wx_time);
+	}
+	dist = accelclb2dist(flt, acft, wx.isadev, ISA_SL_PRESS, ISA_TP_ALT,
+	    fuel, hdg2dir(hdg), *cur_alt, cur_spd, vect2_add(rl->data->wind,
+	    wx.wind), seg->term_cond.alt.alt1, next_spd, vect2_add(next_wind,
+	    wx.wind), flap, flt->crz_mach, clbtype, &burn);
 	if (isnan(dist))
 		return (ERR_UNABLE_NEXT_ALT);
 
 	if (!is_FA) {
-		*cur_pos = route_do_turn(route, rl, cur_spd, turn_rate,
+		*cur_pos = route_do_turn(ru, rl, cur_spd, turn_rate,
 		    *cur_pos, *cur_hdg, seg->leg_cmd.hdg.hdg, rnp, &turn_len);
 	} else {
 		turn_len = 0;
@@ -1893,31 +3658,33 @@ route_update_CA_FA_VA(const acft_perf_t *acft, const flt_perf_t *flt,
 	dist -= turn_len;
 	next_pos = geo_displace_mag(&wgs84, route->navdb->wmm, *cur_pos, hdg,
 	    NM2MET(dist));
-	rs = rs_new_direct(*cur_pos, next_pos, next_join_type(route, rl));
-	list_insert_tail(&route->segs, rs);
+	rs = rs_new_direct(ru->pool, *cur_pos, next_pos,
+	    next_join_type(route, rl));
+	list_insert_tail(ru->segs, rs);
 
 	return (ERR_OK);
 }
 
 static bool_t
-route_update_CD_FD_VD(route_t *route, route_leg_t *rl, double rnp,
+route_update_CD_FD_VD(route_upd_t *ru, route_leg_t *rl, double rnp,
     geo_pos2_t *cur_pos, double *cur_hdg, double cur_spd, double turn_rate,
     bool_t is_FD)
 {
+	const route_t *route = ru->route;
 	geo_pos2_t new_pos;
-	const navproc_seg_t *seg = &rl->seg;
+	const navproc_seg_t *seg = &rl->data->seg;
 	double hdg = (is_FD ? seg->leg_cmd.fix_crs.crs : seg->leg_cmd.hdg.hdg);
 
 	ASSERT(seg->type == NAVPROC_SEG_TYPE_CRS_TO_DME ||
 	    seg->type == NAVPROC_SEG_TYPE_FIX_TO_DME ||
 	    seg->type == NAVPROC_SEG_TYPE_HDG_TO_DME);
 	if (!is_FD) {
-		*cur_pos = route_do_turn(route, rl, cur_spd, turn_rate,
+		*cur_pos = route_do_turn(ru, rl, cur_spd, turn_rate,
 		    *cur_pos, *cur_hdg, hdg, rnp, NULL);
 	} else if (is_FD && gc_distance(*cur_pos,
 	    seg->leg_cmd.fix_crs.fix.pos) > ARC_START_THRESH) {
 		dir_connect(*cur_pos, seg->leg_cmd.fix_crs.fix.pos, rnp,
-		    cur_spd, turn_rate, route, ROUTE_SEG_JOIN_TRACK);
+		    cur_spd, turn_rate, ru, ROUTE_SEG_JOIN_TRACK);
 		*cur_pos = seg->leg_cmd.fix_crs.fix.pos;
 	}
 
@@ -1926,7 +3693,7 @@ route_update_CD_FD_VD(route_t *route, route_leg_t *rl, double rnp,
 	    route->navdb->wmm);
 	if (IS_NULL_GEO_POS(new_pos))
 		return (B_FALSE);
-	dir_connect(*cur_pos, new_pos, rnp, cur_spd, turn_rate, route,
+	dir_connect(*cur_pos, new_pos, rnp, cur_spd, turn_rate, ru,
 	    next_join_type(route, rl));
 	*cur_pos = new_pos;
 	*cur_hdg = hdg;
@@ -1934,173 +3701,350 @@ route_update_CD_FD_VD(route_t *route, route_leg_t *rl, double rnp,
 	return (B_TRUE);
 }
 
+/*
+ * Holds & procedure turns are laid out from their fix with a handful of
+ * magnetic displacements, each of them a WMM evaluation. Yet the layout
+ * only comes out differently if the leg's fix, course, length, turn
+ * direction, speed or turn rate change, so its points are kept with the
+ * leg (see route_leg_pat_t) and only redone when one of those did. Speeds
+ * are rounded to PAT_SPD_BAND and the pattern laid out at the rounded
+ * speed, so the slight changes of speed that come with e.g. a different
+ * weight don't force a new layout, while the layout stays the same no
+ * matter what speed within the band the leg was first flown at.
+ *
+ * A layout shared with a copy of the route is never modified, a new one
+ * is laid out into a private route_leg_pat_t instead.
+ *
+ * @return B_TRUE if `rl->pat->pts' holds the layout, B_FALSE if the
+ *	caller must lay it out anew. Either way, `spd' is rounded.
+ */
+static bool_t
+rl_pat_lookup(route_leg_t *rl, geo_pos2_t fix, double crs, double len,
+    bool_t turn_right, double *spd, double turn_rate)
+{
+	route_leg_pat_t *pat = rl->pat;
+
+	*spd = MAX(round(*spd / PAT_SPD_BAND), 1) * PAT_SPD_BAND;
+	if (pat != NULL && pat->valid && pat->type == rl->data->seg.type &&
+	    pat->fix.lat == fix.lat && pat->fix.lon == fix.lon &&
+	    pat->crs == crs &&
+	    pat->len == len && pat->turn_right == turn_right &&
+	    pat->spd == *spd && pat->turn_rate == turn_rate)
+		return (B_TRUE);
+	if (pat == NULL || ref_shared(&pat->refcnt)) {
+		/* route_update may run on a worker thread, so no pool */
+		if (pat != NULL && ref_rele(&pat->refcnt))
+			free(pat);
+		pat = calloc(sizeof (*pat), 1);
+		pat->refcnt = 1;
+		rl->pat = pat;
+	}
+	pat->valid = B_TRUE;
+	pat->type = rl->data->seg.type;
+	pat->fix = fix;
+	pat->crs = crs;
+	pat->len = len;
+	pat->turn_right = turn_right;
+	pat->spd = *spd;
+	pat->turn_rate = turn_rate;
+	pat->ok = B_TRUE;
+	return (B_FALSE);
+}
+
 static void
-route_update_hold(route_t *route, route_leg_t *rl, double rnp,
+route_update_hold(route_upd_t *ru, route_leg_t *rl, double rnp,
     geo_pos2_t *cur_pos, double cur_spd, double next_spd, double turn_rate)
 {
-	geo_pos2_t start, center, end;
-	double r;
-	const navproc_seg_t *seg = &rl->seg;
+	const route_t *route = ru->route;
+	const navproc_seg_t *seg = &rl->data->seg;
+	geo_pos2_t start = seg->leg_cmd.hold.wpt.pos;
+	geo_pos2_t *pts;
+	double crs = seg->leg_cmd.hold.inbd_crs;
+	double turn = (seg->leg_cmd.hold.turn_right ? 90 : -90);
+	double pat_spd = next_spd;
+	bool_t laid_out;
 	route_seg_t *rs;
 
 	ASSERT(seg->type == NAVPROC_SEG_TYPE_HOLD_TO_ALT ||
 	    seg->type == NAVPROC_SEG_TYPE_HOLD_TO_FIX ||
 	    seg->type == NAVPROC_SEG_TYPE_HOLD_TO_MANUAL);
 	if (gc_distance(*cur_pos, start) > ARC_START_THRESH) {
-		dir_connect(*cur_pos, start, rnp, cur_spd, turn_rate, route,
+		dir_connect(*cur_pos, start, rnp, cur_spd, turn_rate, ru,
 		    ROUTE_SEG_JOIN_TRACK);
 		*cur_pos = start;
 	}
-	r = calc_arc_radius(next_spd, turn_rate);
+	laid_out = rl_pat_lookup(rl, start, crs, seg->leg_cmd.hold.leg_len,
+	    seg->leg_cmd.hold.turn_right, &pat_spd, turn_rate);
+	pts = rl->pat->pts;
+	if (!laid_out) {
+		const wmm_t *wmm = route->navdb->wmm;
+		double r = calc_arc_radius(pat_spd, turn_rate);
+
+		/* turn centers & the ends of the turns & outbound leg */
+		pts[0] = geo_displace_mag(&wgs84, wmm, start, crs + turn, r);
+		pts[1] = geo_displace_mag(&wgs84, wmm, start, crs + turn,
+		    2 * r);
+		pts[2] = geo_displace_mag(&wgs84, wmm, pts[1], crs + 180,
+		    seg->leg_cmd.hold.leg_len);
+		pts[3] = geo_displace_mag(&wgs84, wmm, pts[2],
+		    crs + 180 + turn, r);
+		pts[4] = geo_displace_mag(&wgs84, wmm, pts[2],
+		    crs + 180 + turn, 2 * r);
+	}
 
 	/* Initial turn onto the outbound course */
-	start = seg->leg_cmd.hold.wpt.pos;
-	center = geo_displace_mag(&wgs84, route->navdb->wmm, start,
-	    seg->leg_cmd.hold.inbd_crs +
-	    (seg->leg_cmd.hold.turn_right ? 90 : -90), r);
-	end = geo_displace_mag(&wgs84, route->navdb->wmm, start,
-	    seg->leg_cmd.hold.inbd_crs +
-	    (seg->leg_cmd.hold.turn_right ? 90 : -90), 2 * r);
-	rs = rs_new_arc(start, end, center, seg->leg_cmd.hold.turn_right,
-	    ROUTE_SEG_JOIN_SIMPLE);
-	list_insert_tail(&route->segs, rs);
+	rs = rs_new_arc(ru->pool, start, pts[1], pts[0],
+	    seg->leg_cmd.hold.turn_right, ROUTE_SEG_JOIN_SIMPLE);
+	list_insert_tail(ru->segs, rs);
 
 	/* Straight segment tracking the outbound course */
-	start = end;
-	end = geo_displace_mag(&wgs84, route->navdb->wmm, start,
-	    seg->leg_cmd.hold.inbd_crs + 180, seg->leg_cmd.hold.leg_len);
-	dir_connect(start, end, rnp, next_spd, turn_rate, route,
+	dir_connect(pts[1], pts[2], rnp, next_spd, turn_rate, ru,
 	    ROUTE_SEG_JOIN_SIMPLE);
 
 	/* Turn back inbound */
-	start = end;
-	center = geo_displace_mag(&wgs84, route->navdb->wmm, start,
-	    seg->leg_cmd.hold.inbd_crs + 180 +
-	    (seg->leg_cmd.hold.turn_right ? 90 : -90), r);
-	end = geo_displace_mag(&wgs84, route->navdb->wmm, start,
-	    seg->leg_cmd.hold.inbd_crs + 180 +
-	    (seg->leg_cmd.hold.turn_right ? 90 : -90), 2 * r);
-	rs = rs_new_arc(start, end, center, seg->leg_cmd.hold.turn_right,
-	    ROUTE_SEG_JOIN_SIMPLE);
-	list_insert_tail(&route->segs, rs);
+	rs = rs_new_arc(ru->pool, pts[2], pts[4], pts[3],
+	    seg->leg_cmd.hold.turn_right, ROUTE_SEG_JOIN_SIMPLE);
+	list_insert_tail(ru->segs, rs);
 
 	/* Track back inbound to the hold fix */
-	start = end;
-	dir_connect(start, *cur_pos, rnp, next_spd, turn_rate, route,
+	dir_connect(pts[4], *cur_pos, rnp, next_spd, turn_rate, ru,
 	    ROUTE_SEG_JOIN_SIMPLE);
 }
 
 static bool_t
-route_update_proc_turn(route_t *route, route_leg_t *rl, geo_pos2_t *cur_pos,
+route_update_proc_turn(route_upd_t *ru, route_leg_t *rl, geo_pos2_t *cur_pos,
     double next_spd, double rnp, double turn_rate)
 {
-	const navproc_seg_t *seg = &rl->seg;
+	const route_t *route = ru->route;
+	const navproc_seg_t *seg = &rl->data->seg;
 	geo_pos2_t start = seg->leg_cmd.proc_turn.startpt.pos;
-	double b, r;
-	vect2_t p2, dr, c, outbd_turn_dir, is[2];
-	unsigned n;
+	double hdg = seg->leg_cmd.proc_turn.outbd_turn_hdg;
+	double pat_spd = next_spd;
+	route_leg_pat_t *pat;
 	geo_pos2_t p2_pos, c_pos, p3_pos, p4_pos;
 	route_seg_t *rs, next_rs;
 	route_leg_t *next_rl;
 
 	if (gc_distance(*cur_pos, start) > ARC_START_THRESH) {
-		dir_connect(*cur_pos, start, rnp, next_spd, turn_rate, route,
+		dir_connect(*cur_pos, start, rnp, next_spd, turn_rate, ru,
 		    ROUTE_SEG_JOIN_TRACK);
 		*cur_pos = start;
 	}
 
-	b = NM2MET(next_spd / 60);
-	r = calc_arc_radius(next_spd, turn_rate);
-	outbd_turn_dir = hdg2dir(seg->leg_cmd.proc_turn.outbd_turn_hdg);
-	p2 = vect2_set_abs(outbd_turn_dir, b);
-	dr = vect2_set_abs(vect2_norm(outbd_turn_dir,
-	    !seg->leg_cmd.proc_turn.turn_right), r);
-	c = vect2_add(p2, dr);
+	if (!rl_pat_lookup(rl, start, hdg,
+	    seg->leg_cmd.proc_turn.max_excrs_dist,
+	    seg->leg_cmd.proc_turn.turn_right, &pat_spd, turn_rate)) {
+		geo_pos2_t *pts = rl->pat->pts;
+		const wmm_t *wmm = route->navdb->wmm;
+		double b = NM2MET(pat_spd / 60);
+		double r = calc_arc_radius(pat_spd, turn_rate);
+		double turn = (seg->leg_cmd.proc_turn.turn_right ? -90 : 90);
+		vect2_t outbd_turn_dir = hdg2dir(hdg);
+		vect2_t p2, dr, c, is[2];
+		unsigned n;
 
-	n = vect2circ_isect(vect2_set_abs(c, INTCP_SRCH_DIST), ZERO_VECT2,
-	    c, r, B_TRUE, is);
-	ASSERT(n != 0);
-	if (n == 2 && vect2_abs(is[0]) < vect2_abs(is[1]))
-		is[0] = is[1];
+		p2 = vect2_set_abs(outbd_turn_dir, b);
+		dr = vect2_set_abs(vect2_norm(outbd_turn_dir,
+		    !seg->leg_cmd.proc_turn.turn_right), r);
+		c = vect2_add(p2, dr);
 
-	if (vect2_abs(is[0]) > seg->leg_cmd.proc_turn.max_excrs_dist)
+		n = vect2circ_isect(vect2_set_abs(c, INTCP_SRCH_DIST),
+		    ZERO_VECT2, c, r, B_TRUE, is);
+		ASSERT(n != 0);
+		if (n == 2 && vect2_abs(is[0]) < vect2_abs(is[1]))
+			is[0] = is[1];
+
+		rl->pat->ok = (vect2_abs(is[0]) <=
+		    seg->leg_cmd.proc_turn.max_excrs_dist);
+		if (rl->pat->ok) {
+			pts[0] = geo_displace_mag(&wgs84, wmm, start, hdg, b);
+			pts[1] = geo_displace_mag(&wgs84, wmm, pts[0],
+			    hdg + turn, r);
+			pts[2] = geo_displace_mag(&wgs84, wmm, pts[0],
+			    hdg + turn, 2 * r);
+		}
+	}
+	pat = rl->pat;
+	if (!pat->ok)
 		return (B_FALSE);
-
-	p2_pos = geo_displace_mag(&wgs84, route->navdb->wmm, start,
-	    seg->leg_cmd.proc_turn.outbd_turn_hdg, b);
-	c_pos = geo_displace_mag(&wgs84, route->navdb->wmm, p2_pos,
-	    seg->leg_cmd.proc_turn.outbd_turn_hdg +
-	    (seg->leg_cmd.proc_turn.turn_right ? -90 : 90), r);
-	p3_pos = geo_displace_mag(&wgs84, route->navdb->wmm, p2_pos,
-	    seg->leg_cmd.proc_turn.outbd_turn_hdg +
-	    (seg->leg_cmd.proc_turn.turn_right ? -90 : 90), 2 * r);
+	p2_pos = pat->pts[0];
+	c_pos = pat->pts[1];
+	p3_pos = pat->pts[2];
 
 	next_rl = rl_next_ndisc(&route->legs, rl);
-	if (next_rl == NULL || !rl_find_leg_seg(next_rl, p4_pos,
+	if (next_rl == NULL || !rl_find_leg_seg(next_rl, p3_pos,
 	    rl_next_ndisc(&route->legs, next_rl), route->navdb->wmm, &next_rs))
 		return (B_FALSE);
 
-	p4_pos = vect_seg_intc(p3_pos, 180 -
-	    seg->leg_cmd.proc_turn.outbd_turn_hdg, &next_rs, route->navdb->wmm);
+	p4_pos = vect_seg_intc(p3_pos, 180 - hdg, &next_rs, route->navdb->wmm);
 	if (IS_NULL_GEO_POS(p4_pos))
 		return (B_FALSE);
 
-	dir_connect(start, p2_pos, rnp, next_spd, turn_rate, route,
+	dir_connect(start, p2_pos, rnp, next_spd, turn_rate, ru,
 	    ROUTE_SEG_JOIN_SIMPLE);
-	rs = rs_new_arc(p2_pos, p3_pos, c_pos,
+	rs = rs_new_arc(ru->pool, p2_pos, p3_pos, c_pos,
 	    !seg->leg_cmd.proc_turn.turn_right, ROUTE_SEG_JOIN_SIMPLE);
-	list_insert_tail(&route->segs, rs);
-	dir_connect(p3_pos, p4_pos, rnp, next_spd, turn_rate, route,
+	list_insert_tail(ru->segs, rs);
+	dir_connect(p3_pos, p4_pos, rnp, next_spd, turn_rate, ru,
 	    ROUTE_SEG_JOIN_TRACK);
 	*cur_pos = p4_pos;
 
 	return (B_TRUE);
 }
 
-err_t
-route_update(route_t *route, const acft_perf_t *acft, const flt_perf_t *flt,
-    route_leg_t **err_rl)
+/*
+ * Picks the leg from which route_update needs to recompute the route. This
+ * is the first leg touched by an edit since the last update, backed off by
+ * two non-DISCO legs, because computing a leg looks at most that far ahead
+ * (see rl_find_leg_seg and next_join_type). Returns NULL if the whole route
+ * must be recomputed. If nothing needs recomputing, returns NULL and sets
+ * `up_to_date'.
+ */
+static route_leg_t *
+route_update_restart_leg(const route_t *route, const acft_perf_t *acft,
+    const flt_perf_t *flt, geo_pos3_t start_pos, double start_hdg,
+    bool_t *up_to_date)
 {
-#define	ENROUTE_RNP		1
-#define	SID_STAR_RNP		0.5
-#define	FINAL_RNP		0.3
-	geo_pos3_t	start_pos;
-	geo_pos2_t	cur_pos;
-	route_leg_t	*rl, *rl_prev, *rl_next;
-	double		cur_spd = 0;
-	double		rnp, cur_hdg, cur_alt;
-	flt_phase_t	phase = FLT_PHASE_TO;
-	double		fuel = flt->fuel;
-	err_t		err = ERR_OK;
+	route_leg_t *rl;
+
+	*up_to_date = B_FALSE;
+	if (acft != route->upd_acft ||
+	    !flt_perf_eq(flt, &route->upd_flt) ||
+	    memcmp(&start_pos, &route->upd_start_pos,
+	    sizeof (start_pos)) != 0 ||
+	    start_hdg != route->upd_start_hdg)
+		return (NULL);
+
+	if (list_is_empty(&route->legs))
+		return (NULL);
+	for (rl = list_head(&route->legs); rl != NULL && rl->upd != NULL;
+	    rl = list_next(&route->legs, rl))
+		;
+	if (rl == NULL) {
+		*up_to_date = B_TRUE;
+		return (NULL);
+	}
+	for (int i = 0; i < 2 && rl != NULL; i++)
+		rl = rl_prev_ndisc((route_t *)route, rl);
 
-	if (fuel == 0)
-		fuel = acft->max_gw - flt->zfw;
+	return (rl);
+}
 
-	for (route_seg_t *rs = list_head(&route->segs); rs != NULL;
-	    rs = list_head(&route->segs))
-		rs_destroy(rs);
+/*
+ * Discards the route segments computed by `rl' and all legs following it
+ * and puts a private copy of the segment `rl' started from on the pass'
+ * segment list, so that route_update can resume from the state saved in
+ * `rl'.
+ */
+static void
+route_update_rewind(route_upd_t *ru, const route_leg_t *rl,
+    route_upd_state_t *st)
+{
+	route_t			*route = ru->route;
+	const route_leg_upd_t	*upd = rl->upd;
+
+	route_segs_truncate(route, upd->keep);
+	ru->base = upd->keep;
+	ru->cut = NULL;
+	ru->cut_n = upd->cut;
+	if (upd->has_tail) {
+		route_seg_t *rs = route_pool_alloc(ru->pool, sizeof (*rs));
+
+		*rs = upd->tail;
+		list_link_init(&rs->route_segs_node);
+		list_insert_tail(ru->segs, rs);
+		if (upd->cut == upd->keep + 1)
+			ru->cut = rs;
+	}
+
+	st->pos = upd->pos;
+	st->hdg = upd->hdg;
+	st->alt = upd->alt;
+	st->spd = upd->spd;
+	st->phase = upd->phase;
+	st->err = upd->err;
+	st->err_rl = (upd->err_rl != 0 ? route->rl_idx[upd->err_rl - 1] :
+	    NULL);
+}
 
-	route_first_start_pos(route, NULL, &start_pos, &cur_hdg, NULL);
-	cur_pos = GEO3_TO_GEO2(start_pos);
-	cur_alt = start_pos.elev;
+/*
+ * Gives `rl' a checkpoint of its own for route_update to fill in.
+ */
+static route_leg_upd_t *
+rl_upd_own(route_upd_t *ru, route_leg_t *rl)
+{
+	if (rl->upd == NULL || ref_shared(&rl->upd->refcnt)) {
+		upd_rele(ru->upd_pool, rl->upd);
+		rl->upd = route_pool_alloc(ru->upd_pool, sizeof (*rl->upd));
+		rl->upd->refcnt = 1;
+	}
+	return (rl->upd);
+}
 
-	for (rl = list_head(&route->legs), rl_prev = NULL; rl != NULL;
-	    rl_prev = rl, rl = rl_next) {
+/*
+ * Computes the legs from `rl' up to (not including) `rl_end', starting in
+ * state `st'. On return, `st' holds the state following the last leg.
+ */
+static void
+route_update_legs(route_upd_t *ru, route_leg_t *rl, const route_leg_t *rl_end,
+    route_upd_state_t *st)
+{
+#define	ENROUTE_RNP		1
+#define	SID_STAR_RNP		0.5
+#define	FINAL_RNP		0.3
+	route_t			*route = ru->route;
+	const acft_perf_t	*acft = ru->acft;
+	const flt_perf_t	*flt = ru->flt;
+	double			fuel = ru->fuel;
+	geo_pos2_t		cur_pos = st->pos;
+	double			cur_hdg = st->hdg;
+	double			cur_alt = st->alt;
+	double			cur_spd = st->spd;
+	flt_phase_t		phase = st->phase;
+	err_t			err = st->err;
+	route_leg_t		*last_err_rl = st->err_rl;
+	route_leg_t		*rl_next;
+	double			rnp;
+
+	for (; rl != rl_end; rl = rl_next) {
 		route_leg_group_t	*rlg = rl->rlg;
 		route_seg_t		*rs, *rs_prev;
+		route_seg_t		*rs_entry = list_tail(ru->segs);
+		route_seg_t		*rs_keep = NULL;
+		route_leg_upd_t		*upd = rl_upd_own(ru, rl);
 		alt_lim_t		alt_lim;
 		spd_lim_t		spd_lim;
 		double			next_alt, next_spd, flap, dist;
 		vect2_t			next_wind;
 		accelclb_t		clbtype = ACCEL_THEN_CLB;
-		const navproc_seg_t	*seg = &rl->seg;
+		const navproc_seg_t	*seg = &rl->data->seg;
 		double			turn_rate = 3;
 
+		/* Save the state on entry, see route_update_rewind */
+		upd->pos = cur_pos;
+		upd->hdg = cur_hdg;
+		upd->alt = cur_alt;
+		upd->spd = cur_spd;
+		upd->phase = phase;
+		upd->err = err;
+		upd->err_rl = (last_err_rl != NULL ? last_err_rl->idx + 1 : 0);
+		upd->cut = ru->cut_n;
+		upd->keep = ru->base + list_count(ru->segs);
+		upd->has_tail = (rs_entry != NULL);
+		if (rs_entry != NULL) {
+			rs_keep = list_prev(ru->segs, rs_entry);
+			upd->keep--;
+			upd->tail = *rs_entry;
+		}
+
 		rl_next = list_next(&route->legs, rl);
-		next_wind = (rl_next != NULL ? rl_next->wind : rl->wind);
+		next_wind = (rl_next != NULL ? rl_next->data->wind :
+		    rl->data->wind);
 
 		if (rl->disco) {
 			cur_pos = NULL_GEO_POS2;
+			ru->cut = list_tail(ru->segs);
+			ru->cut_n = ru->base + list_count(ru->segs);
 			continue;
 		}
 		UNUSED(dist);
@@ -2161,29 +4105,32 @@ route_update(route_t *route, const acft_perf_t *acft, const flt_perf_t *flt,
 		    IS_NULL_GEO_POS(cur_pos))
 			continue;
 
+		PROF_START(t0);
 		switch (seg->type) {
 		case NAVPROC_SEG_TYPE_ARC_TO_FIX:
-			route_update_AF(route, rl, &cur_pos, &cur_hdg, rnp,
+			route_update_AF(ru, rl, &cur_pos, &cur_hdg, rnp,
 			    cur_spd, turn_rate);
 			break;
 		case NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX:
-			if (!route_update_RF(route, rl, &cur_pos, &cur_hdg,
+			if (!route_update_RF(ru, rl, &cur_pos, &cur_hdg,
 			    rnp, next_spd, turn_rate)) {
 				cur_pos = NULL_GEO_POS2;
+				PROF_END(ROUTE_PROF_LEG + seg->type, t0);
 				continue;
 			}
 			break;
 		case NAVPROC_SEG_TYPE_CRS_TO_ALT:
 		case NAVPROC_SEG_TYPE_HDG_TO_ALT:
 		case NAVPROC_SEG_TYPE_FIX_TO_ALT: {
-			err_t err2 = route_update_CA_FA_VA(acft, flt, route,
+			err_t err2 = route_update_CA_FA_VA(acft, flt, ru,
 			    rl, phase, clbtype, fuel, flap, rnp, &cur_pos,
 			    &cur_alt, &cur_hdg, cur_spd, next_spd, turn_rate,
 			    next_wind, seg->type ==
 			    NAVPROC_SEG_TYPE_FIX_TO_ALT);
 			if (err2 != ERR_OK) {
 				err = err2;
-				*err_rl = rl;
+				last_err_rl = rl;
+				PROF_END(ROUTE_PROF_LEG + seg->type, t0);
 				continue;
 			}
 			break;
@@ -2191,19 +4138,20 @@ route_update(route_t *route, const acft_perf_t *acft, const flt_perf_t *flt,
 		case NAVPROC_SEG_TYPE_CRS_TO_DME:
 		case NAVPROC_SEG_TYPE_HDG_TO_DME:
 		case NAVPROC_SEG_TYPE_FIX_TO_DME:
-			if (!route_update_CD_FD_VD(route, rl, rnp, &cur_pos,
+			if (!route_update_CD_FD_VD(ru, rl, rnp, &cur_pos,
 			    &cur_hdg, cur_spd, turn_rate,
 			    seg->type == NAVPROC_SEG_TYPE_FIX_TO_DME)) {
 				cur_pos = NULL_GEO_POS2;
+				PROF_END(ROUTE_PROF_LEG + seg->type, t0);
 				continue;
 			}
 			break;
 		case NAVPROC_SEG_TYPE_CRS_TO_FIX:
 		case NAVPROC_SEG_TYPE_DIR_TO_FIX:
 		case NAVPROC_SEG_TYPE_TRK_TO_FIX:
-			rs = rs_new_direct(cur_pos, seg->term_cond.fix.pos,
-			    next_join_type(route, rl));
-			list_insert_tail(&route->segs, rs);
+			rs = rs_new_direct(ru->pool, cur_pos,
+			    seg->term_cond.fix.pos, next_join_type(route, rl));
+			list_insert_tail(ru->segs, rs);
 			cur_hdg = wmm_true2mag(route->navdb->wmm,
 			    gc_point_hdg(cur_pos, seg->term_cond.fix.pos, 0),
 			    GEO2_TO_GEO3(cur_pos, 0));
@@ -2213,18 +4161,19 @@ route_update(route_t *route, const acft_perf_t *acft, const flt_perf_t *flt,
 		case NAVPROC_SEG_TYPE_HDG_TO_INTCP: {
 			geo_pos2_t new_pos;
 
-			cur_pos = route_do_turn(route, rl, cur_spd, turn_rate,
+			cur_pos = route_do_turn(ru, rl, cur_spd, turn_rate,
 			    cur_pos, cur_hdg, seg->leg_cmd.hdg.hdg, rnp, NULL);
 			cur_hdg = seg->leg_cmd.hdg.hdg;
 			new_pos = calc_vect_leg_intc(cur_pos, rl,
 			    &route->legs, route->navdb->wmm);
 			if (IS_NULL_GEO_POS(new_pos)) {
 				cur_pos = NULL_GEO_POS2;
+				PROF_END(ROUTE_PROF_LEG + seg->type, t0);
 				continue;
 			}
-			rs = rs_new_direct(cur_pos, new_pos,
-			    next_join_type(route, rl));
-			list_insert_tail(&route->segs, rs);
+			rs = rs_new_direct(ru->pool, cur_pos,
+			    new_pos, next_join_type(route, rl));
+			list_insert_tail(ru->segs, rs);
 			cur_pos = new_pos;
 			break;
 		}
@@ -2232,84 +4181,1168 @@ route_update(route_t *route, const acft_perf_t *acft, const flt_perf_t *flt,
 		case NAVPROC_SEG_TYPE_HDG_TO_RADIAL: {
 			geo_pos2_t new_pos;
 
-			cur_pos = route_do_turn(route, rl, cur_spd, turn_rate,
+			cur_pos = route_do_turn(ru, rl, cur_spd, turn_rate,
 			    cur_pos, cur_hdg, seg->leg_cmd.hdg.hdg, rnp, NULL);
 			cur_hdg = seg->leg_cmd.hdg.hdg;
 			new_pos = calc_radial_leg_intc(cur_pos, rl,
 			    &route->legs, route->navdb->wmm);
 			if (IS_NULL_GEO_POS(new_pos)) {
 				cur_pos = NULL_GEO_POS2;
+				PROF_END(ROUTE_PROF_LEG + seg->type, t0);
 				continue;
 			}
-			rs = rs_new_direct(cur_pos, new_pos,
-			    next_join_type(route, rl));
-			list_insert_tail(&route->segs, rs);
+			rs = rs_new_direct(ru->pool, cur_pos,
+			    new_pos, next_join_type(route, rl));
+			list_insert_tail(ru->segs, rs);
 			cur_pos = new_pos;
 			break;
 		}
 		case NAVPROC_SEG_TYPE_FIX_TO_DIST: {
 			geo_pos2_t new_pos;
 
-			new_pos = geo_displace_mag(&wgs84, route->navdb->wmm,
-			    cur_pos, seg->leg_cmd.fix_crs.crs,
-			    NM2MET(seg->term_cond.dist));
-			rs = rs_new_direct(cur_pos, new_pos,
-			    next_join_type(route, rl));
-			list_insert_tail(&route->segs, rs);
-			cur_pos = new_pos;
-			break;
-		}
-		case NAVPROC_SEG_TYPE_FIX_TO_MANUAL:
-		case NAVPROC_SEG_TYPE_HDG_TO_MANUAL: {
-			geo_pos2_t new_pos;
-			double hdg;
+			new_pos = geo_displace_mag(&wgs84, route->navdb->wmm,
+			    cur_pos, seg->leg_cmd.fix_crs.crs,
+			    NM2MET(seg->term_cond.dist));
+			rs = rs_new_direct(ru->pool, cur_pos,
+			    new_pos, next_join_type(route, rl));
+			list_insert_tail(ru->segs, rs);
+			cur_pos = new_pos;
+			break;
+		}
+		case NAVPROC_SEG_TYPE_FIX_TO_MANUAL:
+		case NAVPROC_SEG_TYPE_HDG_TO_MANUAL: {
+			geo_pos2_t new_pos;
+			double hdg;
+
+			if (seg->type == NAVPROC_SEG_TYPE_FIX_TO_MANUAL)
+				hdg = seg->leg_cmd.hdg.hdg;
+			else
+				hdg = seg->leg_cmd.fix_crs.crs;
+			new_pos = geo_displace_mag(&wgs84, route->navdb->wmm,
+			    cur_pos, hdg, INTCP_SRCH_DIST);
+			rs = rs_new_direct(ru->pool, cur_pos,
+			    new_pos, next_join_type(route, rl));
+			list_insert_tail(ru->segs, rs);
+			cur_pos = NULL_GEO_POS2;
+			break;
+		}
+		case NAVPROC_SEG_TYPE_HOLD_TO_ALT:
+		case NAVPROC_SEG_TYPE_HOLD_TO_FIX:
+		case NAVPROC_SEG_TYPE_HOLD_TO_MANUAL:
+			route_update_hold(ru, rl, rnp, &cur_pos, cur_spd,
+			    next_spd, turn_rate);
+			break;
+		case NAVPROC_SEG_TYPE_INIT_FIX:
+			if (IS_NULL_GEO_POS(cur_pos))
+				cur_pos = seg->leg_cmd.fix.pos;
+				break;
+			break;
+		case NAVPROC_SEG_TYPE_PROC_TURN:
+			if (!route_update_proc_turn(ru, rl, &cur_pos,
+			    next_spd, rnp, turn_rate)) {
+				cur_pos = NULL_GEO_POS2;
+				PROF_END(ROUTE_PROF_LEG + seg->type, t0);
+				continue;
+			}
+			break;
+		default:
+			assert(0);
+		}
+		PROF_END(ROUTE_PROF_LEG + seg->type, t0);
+
+		/*
+		 * Join the leg's last segment onto the preceding one. A leg
+		 * which didn't add any segments mustn't reach back into
+		 * segments in front of `keep', or resuming from a later leg
+		 * would no longer reproduce them.
+		 */
+		if ((rs = list_tail(ru->segs)) != NULL &&
+		    (rs_prev = list_prev(ru->segs, rs)) != NULL &&
+		    rs_prev != ru->cut &&
+		    (rs != rs_entry || rs_prev != rs_keep))
+			rs_join_memo(ru, rs_prev, rs, rnp, cur_spd,
+			    turn_rate);
+
+		cur_spd = next_spd;
+		cur_alt = next_alt;
+
+		phase = next_flt_phase(phase, rlg, rl);
+	}
+
+	st->pos = cur_pos;
+	st->hdg = cur_hdg;
+	st->alt = cur_alt;
+	st->spd = cur_spd;
+	st->phase = phase;
+	st->err = err;
+	st->err_rl = last_err_rl;
+}
+
+/*
+ * A section of the route between two discontinuities, computed by its own
+ * route_update pass on a worker thread (see route_upd_pool). The pass
+ * starts from a guess of the state at the discontinuity (see
+ * route_update_skim). If the guess turns out wrong, the section is
+ * recomputed in line.
+ */
+typedef enum {
+	SECT_IDLE,	/* not handed to the pool (yet) */
+	SECT_QUEUED,	/* waiting for a worker */
+	SECT_RUNNING,
+	SECT_DONE
+} route_upd_sect_state_t;
+
+typedef struct {
+	route_upd_t		ru;
+	list_t			segs;
+	route_pool_t		pool;
+	route_leg_t		*rl;		/* the discontinuity */
+	route_leg_t		*rl_end;	/* next discontinuity or NULL */
+	route_upd_state_t	guess;
+	route_upd_state_t	st;
+	route_upd_sect_state_t	state;		/* protected by the pool lock */
+	list_node_t		queue_node;
+} route_upd_sect_t;
+
+/*
+ * Worker threads computing route sections for route_update. A single pool
+ * serves the whole process. Routes which opt in to parallel updates (see
+ * route_set_update_threads) hold a reference to it. The workers are
+ * started as routes ask for them, up to ROUTE_UPD_MAX_THREADS - 1, and
+ * stay around until the last reference is dropped, so a route_update
+ * only pays for queueing its sections.
+ */
+static struct {
+	pthread_mutex_t	life_lock;	/* protects refcnt, thr & num_thr */
+	unsigned	refcnt;
+	pthread_t	thr[ROUTE_UPD_MAX_THREADS - 1];
+	unsigned	num_thr;
+
+	pthread_mutex_t	lock;		/* protects everything below */
+	pthread_cond_t	work_cv;	/* signalled on queue or shutdown */
+	pthread_cond_t	done_cv;	/* signalled when a section is done */
+	list_t		queue;		/* of route_upd_sect_t */
+	bool_t		shutdown;
+} route_upd_pool = {
+	.life_lock = PTHREAD_MUTEX_INITIALIZER,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work_cv = PTHREAD_COND_INITIALIZER,
+	.done_cv = PTHREAD_COND_INITIALIZER
+};
+
+static void *
+route_upd_pool_worker(void *arg)
+{
+	route_upd_sect_t *sect;
+
+	UNUSED(arg);
+	pthread_mutex_lock(&route_upd_pool.lock);
+	for (;;) {
+		while (!route_upd_pool.shutdown &&
+		    list_head(&route_upd_pool.queue) == NULL)
+			pthread_cond_wait(&route_upd_pool.work_cv,
+			    &route_upd_pool.lock);
+		if ((sect = list_remove_head(&route_upd_pool.queue)) == NULL)
+			break;
+		sect->state = SECT_RUNNING;
+		pthread_mutex_unlock(&route_upd_pool.lock);
+
+		route_update_legs(&sect->ru, sect->rl, sect->rl_end,
+		    &sect->st);
+
+		pthread_mutex_lock(&route_upd_pool.lock);
+		sect->state = SECT_DONE;
+		pthread_cond_broadcast(&route_upd_pool.done_cv);
+	}
+	pthread_mutex_unlock(&route_upd_pool.lock);
+
+	return (NULL);
+}
+
+/*
+ * Takes a reference to the worker pool, starting it if need be and making
+ * sure it has at least `num_workers' threads.
+ */
+static void
+route_upd_pool_hold(unsigned num_workers)
+{
+	num_workers = MIN(num_workers, ROUTE_UPD_MAX_THREADS - 1);
+
+	pthread_mutex_lock(&route_upd_pool.life_lock);
+	if (route_upd_pool.refcnt++ == 0) {
+		list_create(&route_upd_pool.queue, sizeof (route_upd_sect_t),
+		    offsetof(route_upd_sect_t, queue_node));
+		route_upd_pool.shutdown = B_FALSE;
+	}
+	for (; route_upd_pool.num_thr < num_workers; route_upd_pool.num_thr++) {
+		VERIFY(pthread_create(
+		    &route_upd_pool.thr[route_upd_pool.num_thr], NULL,
+		    route_upd_pool_worker, NULL) == 0);
+	}
+	pthread_mutex_unlock(&route_upd_pool.life_lock);
+}
+
+/*
+ * Drops a reference to the worker pool. The last one stops the workers.
+ */
+static void
+route_upd_pool_rele(void)
+{
+	pthread_mutex_lock(&route_upd_pool.life_lock);
+	ASSERT(route_upd_pool.refcnt != 0);
+	if (--route_upd_pool.refcnt == 0) {
+		pthread_mutex_lock(&route_upd_pool.lock);
+		ASSERT(list_head(&route_upd_pool.queue) == NULL);
+		route_upd_pool.shutdown = B_TRUE;
+		pthread_cond_broadcast(&route_upd_pool.work_cv);
+		pthread_mutex_unlock(&route_upd_pool.lock);
+		for (unsigned i = 0; i < route_upd_pool.num_thr; i++) {
+			VERIFY(pthread_join(route_upd_pool.thr[i],
+			    NULL) == 0);
+		}
+		route_upd_pool.num_thr = 0;
+		list_destroy(&route_upd_pool.queue);
+	}
+	pthread_mutex_unlock(&route_upd_pool.life_lock);
+}
+
+/*
+ * Hands `sect' to the worker pool, see route_update_run.
+ */
+static void
+route_upd_sect_queue(route_upd_t *ru, route_upd_sect_t *sect)
+{
+	memset(&sect->pool, 0, sizeof (sect->pool));
+	list_create(&sect->segs, sizeof (route_seg_t),
+	    offsetof(route_seg_t, route_segs_node));
+	sect->ru = *ru;
+	sect->ru.segs = &sect->segs;
+	sect->ru.pool = &sect->pool;
+	/* the route's pools aren't ours to use from a worker */
+	sect->ru.upd_pool = NULL;
+	sect->ru.base = 0;
+	sect->ru.cut = NULL;
+	sect->ru.cut_n = 0;
+	sect->st = sect->guess;
+
+	pthread_mutex_lock(&route_upd_pool.lock);
+	sect->state = SECT_QUEUED;
+	list_insert_tail(&route_upd_pool.queue, sect);
+	pthread_cond_signal(&route_upd_pool.work_cv);
+	pthread_mutex_unlock(&route_upd_pool.lock);
+}
+
+/*
+ * Waits for a worker to finish `sect'. A section no worker has picked up
+ * yet is taken back from the queue instead.
+ *
+ * @return B_TRUE if a worker computed the section, B_FALSE if it was
+ *	taken back (or never queued).
+ */
+static bool_t
+route_upd_sect_wait(route_upd_sect_t *sect)
+{
+	bool_t done;
+
+	pthread_mutex_lock(&route_upd_pool.lock);
+	if (sect->state == SECT_QUEUED)
+		list_remove(&route_upd_pool.queue, sect);
+	while (sect->state == SECT_RUNNING)
+		pthread_cond_wait(&route_upd_pool.done_cv,
+		    &route_upd_pool.lock);
+	done = (sect->state == SECT_DONE);
+	pthread_mutex_unlock(&route_upd_pool.lock);
+
+	return (done);
+}
+
+/*
+ * Appends the segments computed by `sect' to the route. The checkpoints
+ * of the section's legs were saved relative to the section's own (empty
+ * at the start) segment list and the section's entry state, so they are
+ * rebased onto what precedes the section in the route.
+ */
+static void
+route_update_sect_splice(route_upd_t *ru, route_upd_sect_t *sect,
+    route_upd_state_t *st)
+{
+	unsigned off = ru->base + list_count(ru->segs);
+
+	/* only the position on entry to the discontinuity wasn't guessed */
+	sect->rl->upd->pos = st->pos;
+	for (route_leg_t *rl = sect->rl; rl != sect->rl_end;
+	    rl = list_next(&ru->route->legs, rl)) {
+		rl->upd->keep += off;
+		rl->upd->cut += off;
+		if (rl->upd->err_rl == 0) {
+			rl->upd->err = st->err;
+			rl->upd->err_rl = (st->err_rl != NULL ?
+			    st->err_rl->idx + 1 : 0);
+		}
+	}
+	ru->cut = list_tail(ru->segs);
+	ru->cut_n = off;
+	list_move_tail(ru->segs, &sect->segs);
+	if (sect->st.err_rl == NULL) {
+		sect->st.err = st->err;
+		sect->st.err_rl = st->err_rl;
+	}
+	*st = sect->st;
+}
+
+/*
+ * Returns the number of online CPUs, the default number of threads used
+ * by route_update and route_batch_compute.
+ */
+unsigned
+route_num_cpus(void)
+{
+	static unsigned num_cpus = 0;
+
+	/* benign race, every thread stores the same value */
+	if (num_cpus == 0)
+		num_cpus = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+	return (num_cpus);
+}
+
+/*
+ * Predicts the heading, altitude, speed & flight phase route_update_legs
+ * will carry from `rl' up to `rl_end', starting in state `st', without
+ * computing any segments. This follows route_update_legs leg by leg, but
+ * only tracks the position where a leg ends in a known fix. A heading
+ * depending on a position that isn't known is left as it was, and a leg
+ * which turns out to be unflyable isn't foreseen. The prediction can
+ * thus be wrong, in which case route_update_run recomputes the section
+ * it was used for.
+ */
+static void
+route_update_skim(const route_upd_t *ru, const route_leg_t *rl,
+    const route_leg_t *rl_end, route_upd_state_t *st)
+{
+	const route_t	*route = ru->route;
+	const wmm_t	*wmm = route->navdb->wmm;
+	geo_pos2_t	pos = st->pos;
+	bool_t		pos_known = B_TRUE;
+
+	for (; rl != rl_end; rl = list_next(&route->legs, rl)) {
+		const navproc_seg_t	*seg = &rl->data->seg;
+		alt_lim_t		alt_lim;
+		spd_lim_t		spd_lim;
+		double			next_alt, next_spd;
+
+		if (rl->disco) {
+			pos = NULL_GEO_POS2;
+			pos_known = B_TRUE;
+			continue;
+		}
+		alt_lim = route_l_get_alt_lim(rl);
+		next_alt = st->alt;
+		switch (alt_lim.type) {
+		case ALT_LIM_NONE:
+			break;
+		case ALT_LIM_AT:
+		case ALT_LIM_AT_OR_ABV:
+		case ALT_LIM_AT_OR_BLW:
+			next_alt = alt_lim.alt1;
+			break;
+		case ALT_LIM_BETWEEN:
+			next_alt = AVG(alt_lim.alt1, alt_lim.alt2);
+			break;
+		}
+		spd_lim = route_l_get_spd_lim(rl);
+		if (st->phase == FLT_PHASE_TO)
+			next_spd = perf_TO_spd(ru->flt, ru->acft);
+		else
+			next_spd = (spd_lim.type == SPD_LIM_AT ? spd_lim.spd1 :
+			    st->spd);
+
+		if (seg->type != NAVPROC_SEG_TYPE_INIT_FIX && pos_known &&
+		    IS_NULL_GEO_POS(pos))
+			continue;
+
+		switch (seg->type) {
+		case NAVPROC_SEG_TYPE_ARC_TO_FIX:
+			st->hdg = seg->leg_cmd.dme_arc.end_radial +
+			    (seg->leg_cmd.dme_arc.cw ? 90 : -90);
+			pos_known = B_FALSE;
+			break;
+		case NAVPROC_SEG_TYPE_CRS_TO_ALT:
+		case NAVPROC_SEG_TYPE_HDG_TO_ALT:
+			if (seg->term_cond.alt.alt1 > st->alt) {
+				st->hdg = seg->leg_cmd.hdg.hdg;
+				pos_known = B_FALSE;
+			}
+			break;
+		case NAVPROC_SEG_TYPE_FIX_TO_ALT:
+			if (seg->term_cond.alt.alt1 > st->alt) {
+				st->hdg = seg->leg_cmd.fix_crs.crs;
+				pos_known = B_FALSE;
+			}
+			break;
+		case NAVPROC_SEG_TYPE_CRS_TO_DME:
+		case NAVPROC_SEG_TYPE_HDG_TO_DME:
+		case NAVPROC_SEG_TYPE_CRS_TO_INTCP:
+		case NAVPROC_SEG_TYPE_HDG_TO_INTCP:
+		case NAVPROC_SEG_TYPE_CRS_TO_RADIAL:
+		case NAVPROC_SEG_TYPE_HDG_TO_RADIAL:
+			st->hdg = seg->leg_cmd.hdg.hdg;
+			pos_known = B_FALSE;
+			break;
+		case NAVPROC_SEG_TYPE_FIX_TO_DME:
+			st->hdg = seg->leg_cmd.fix_crs.crs;
+			pos_known = B_FALSE;
+			break;
+		case NAVPROC_SEG_TYPE_CRS_TO_FIX:
+		case NAVPROC_SEG_TYPE_DIR_TO_FIX:
+		case NAVPROC_SEG_TYPE_TRK_TO_FIX:
+			if (pos_known) {
+				st->hdg = wmm_true2mag(wmm, gc_point_hdg(pos,
+				    seg->term_cond.fix.pos, 0),
+				    GEO2_TO_GEO3(pos, 0));
+			}
+			pos = seg->term_cond.fix.pos;
+			pos_known = B_TRUE;
+			break;
+		case NAVPROC_SEG_TYPE_FIX_TO_MANUAL:
+		case NAVPROC_SEG_TYPE_HDG_TO_MANUAL:
+			pos = NULL_GEO_POS2;
+			pos_known = B_TRUE;
+			break;
+		case NAVPROC_SEG_TYPE_HOLD_TO_ALT:
+		case NAVPROC_SEG_TYPE_HOLD_TO_FIX:
+		case NAVPROC_SEG_TYPE_HOLD_TO_MANUAL:
+			if (!pos_known || gc_distance(pos,
+			    seg->leg_cmd.hold.wpt.pos) > ARC_START_THRESH) {
+				pos = seg->leg_cmd.hold.wpt.pos;
+				pos_known = B_TRUE;
+			}
+			break;
+		case NAVPROC_SEG_TYPE_INIT_FIX:
+			if (pos_known && IS_NULL_GEO_POS(pos))
+				pos = seg->leg_cmd.fix.pos;
+			break;
+		default:
+			/* RF, FC & PI legs end wherever their geometry says */
+			pos_known = B_FALSE;
+			break;
+		}
+
+		st->spd = next_spd;
+		st->alt = next_alt;
+		st->phase = next_flt_phase(st->phase, rl->rlg, rl);
+	}
+	st->pos = (pos_known ? pos : NULL_GEO_POS2);
+}
+
+/*
+ * Computes the legs from `rl' to the end of the route, starting in state
+ * `st'. Each discontinuity restarts the path, so the sections between
+ * them are independent of each other, except for the heading, altitude,
+ * speed and flight phase carried across. If the route was opted in to
+ * parallel updates (see route_set_update_threads), every section of at
+ * least ROUTE_UPD_SECT_MIN_LEGS legs following a discontinuity is handed
+ * to the worker pool, starting from the state route_update_skim predicts
+ * for the discontinuity. At most `upd_threads - 1' sections are in the
+ * pool at a time. The calling thread computes everything else in route
+ * order, appends each section's segments if the prediction was right and
+ * recomputes the section in line if not (or if no worker got to it yet),
+ * so the result is exactly what a serial pass would compute.
+ */
+static void
+route_update_run(route_upd_t *ru, route_leg_t *rl, route_upd_state_t *st)
+{
+	route_t			*route = ru->route;
+	unsigned		max_queued = route->upd_threads;
+	unsigned		num_sects = 0, sects_cap = 0, num_legs = 0;
+	unsigned		num_queued = 0;
+	route_upd_sect_t	*sects = NULL;
+	route_leg_t		*sect_rl = NULL;
+	const route_leg_t	*skim_rl = rl;
+	route_upd_state_t	skim = *st;
+
+	if (max_queued == 1) {
+		route_update_legs(ru, rl, NULL, st);
+		return;
+	}
+	if (max_queued == 0)
+		max_queued = route_num_cpus();
+	max_queued = MIN(max_queued, ROUTE_UPD_MAX_THREADS) - 1;
+
+	for (route_leg_t *rl2 = list_next(&route->legs, rl);;
+	    rl2 = list_next(&route->legs, rl2)) {
+		route_upd_sect_t *sect;
+
+		if (rl2 != NULL && !rl2->disco) {
+			num_legs++;
+			continue;
+		}
+		/* Short sections aren't worth handing to a worker */
+		if (sect_rl != NULL && num_legs >= ROUTE_UPD_SECT_MIN_LEGS) {
+			if (num_sects == sects_cap) {
+				sects_cap = MAX(2 * sects_cap, 8);
+				sects = realloc(sects, sects_cap *
+				    sizeof (*sects));
+			}
+			sect = &sects[num_sects++];
+			sect->rl = sect_rl;
+			sect->rl_end = rl2;
+			sect->state = SECT_IDLE;
+			route_update_skim(ru, skim_rl, sect_rl, &skim);
+			skim_rl = sect_rl;
+			sect->guess = skim;
+			sect->guess.err = ERR_OK;
+			sect->guess.err_rl = NULL;
+		}
+		if (rl2 == NULL)
+			break;
+		sect_rl = rl2;
+		num_legs = 0;
+	}
+
+	for (; num_queued < MIN(num_sects, max_queued); num_queued++)
+		route_upd_sect_queue(ru, &sects[num_queued]);
+
+	for (unsigned i = 0; i < num_sects; i++) {
+		route_upd_sect_t *sect = &sects[i];
+
+		route_update_legs(ru, rl, sect->rl, st);
+		if (route_upd_sect_wait(sect) &&
+		    st->hdg == sect->guess.hdg &&
+		    st->alt == sect->guess.alt &&
+		    st->spd == sect->guess.spd &&
+		    st->phase == sect->guess.phase) {
+			route_update_sect_splice(ru, sect, st);
+			list_destroy(&sect->segs);
+		} else {
+			if (sect->state != SECT_IDLE)
+				seglist_destroy(&sect->pool, &sect->segs);
+			route_update_legs(ru, sect->rl, sect->rl_end, st);
+		}
+		if (sect->state != SECT_IDLE)
+			route_pool_destroy(&sect->pool);
+		if (num_queued < num_sects)
+			route_upd_sect_queue(ru, &sects[num_queued++]);
+		rl = sect->rl_end;
+	}
+	if (rl != NULL)
+		route_update_legs(ru, rl, NULL, st);
+	free(sects);
+}
+
+/*
+ * Result of a full route_update, see route_cache_create. Entries are
+ * immutable once created and are shared by reference between the cache
+ * and the route_update calls currently installing them. The segments &
+ * checkpoints are in turn shared by reference with the routes they were
+ * computed for or installed into. `upd' holds NULL for the legs past
+ * the valid prefix (see route_serialize).
+ */
+typedef struct {
+	uint64_t		hash;
+	uint8_t			*key;		/* see route_cache_key */
+	size_t			key_len;
+	unsigned		refcnt;
+
+	route_seg_t		**segs;
+	uint32_t		num_segs;
+	double			segs_dist;
+	route_leg_upd_t		**upd;
+	uint32_t		num_legs;
+	err_t			err;
+	uint32_t		err_rl;
+
+	list_node_t		lru_node;
+} route_cache_ent_t;
+
+struct route_cache_s {
+	pthread_mutex_t		lock;	/* protects everything below */
+	htbl_t			by_hash;
+	list_t			lru;	/* most recently used first */
+	size_t			max_entries;
+	route_cache_stats_t	stats;
+};
+
+/*
+ * Creates a cache of route_update results holding up to `max_entries'
+ * routes (least recently used ones are evicted first). Routes set to use
+ * the cache (see route_set_cache) look up every full route_update in it:
+ * if a route with identical content was already computed with the same
+ * aircraft & flight performance, its segments & update checkpoints are
+ * copied from the cache instead of being computed again. Incremental
+ * updates after an edit don't use the cache, they are cheaper than the
+ * lookup.
+ *
+ * A cache may be shared by any number of routes in any number of threads.
+ * It must outlive all routes using it.
+ */
+route_cache_t *
+route_cache_create(size_t max_entries)
+{
+	route_cache_t *cache = calloc(sizeof (*cache), 1);
+
+	ASSERT(max_entries != 0);
+	VERIFY(pthread_mutex_init(&cache->lock, NULL) == 0);
+	htbl_create(&cache->by_hash, max_entries, sizeof (uint64_t), 0);
+	list_create(&cache->lru, sizeof (route_cache_ent_t),
+	    offsetof(route_cache_ent_t, lru_node));
+	cache->max_entries = max_entries;
+
+	return (cache);
+}
+
+static void
+route_cache_ent_rele(route_cache_ent_t *ent)
+{
+	if (__atomic_sub_fetch(&ent->refcnt, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	for (uint32_t i = 0; i < ent->num_segs; i++)
+		rs_rele(NULL, ent->segs[i]);
+	for (uint32_t i = 0; i < ent->num_legs; i++)
+		upd_rele(NULL, ent->upd[i]);
+	free(ent->key);
+	free(ent->segs);
+	free(ent->upd);
+	free(ent);
+}
+
+/*
+ * Destroys a route cache. No route may be using it anymore.
+ */
+void
+route_cache_destroy(route_cache_t *cache)
+{
+	route_cache_ent_t *ent;
+
+	while ((ent = list_remove_head(&cache->lru)) != NULL)
+		route_cache_ent_rele(ent);
+	htbl_empty(&cache->by_hash, NULL, NULL);
+	htbl_destroy(&cache->by_hash);
+	list_destroy(&cache->lru);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+/*
+ * Returns the cache's hit, miss & eviction counters and its size.
+ */
+route_cache_stats_t
+route_cache_get_stats(route_cache_t *cache)
+{
+	route_cache_stats_t stats;
+
+	pthread_mutex_lock(&cache->lock);
+	stats = cache->stats;
+	stats.num_entries = list_count(&cache->lru);
+	pthread_mutex_unlock(&cache->lock);
+
+	return (stats);
+}
+
+/*
+ * Makes route_update look up & store its results in `cache' (NULL stops
+ * using a cache). See route_cache_create.
+ */
+void
+route_set_cache(route_t *route, route_cache_t *cache)
+{
+	route->cache = cache;
+}
+
+/*
+ * Helpers of route_cache_key. Every field goes in on its own, so padding
+ * and the unused tails of names never make equal routes look different.
+ */
+static void
+key_put_u32(route_ser_t *ser, uint32_t u)
+{
+	SER_PUT(ser, u);
+}
+
+static void
+key_put_f64(route_ser_t *ser, double d)
+{
+	SER_PUT(ser, d);
+}
+
+static void
+key_put_wpt(route_ser_t *ser, const wpt_t *wpt)
+{
+	uint32_t name_len = strnlen(wpt->name, sizeof (wpt->name));
+	uint32_t cc_len = strnlen(wpt->icao_country_code,
+	    sizeof (wpt->icao_country_code));
+
+	key_put_u32(ser, name_len);
+	ser_put(ser, wpt->name, name_len);
+	key_put_u32(ser, cc_len);
+	ser_put(ser, wpt->icao_country_code, cc_len);
+	key_put_f64(ser, wpt->pos.lat);
+	key_put_f64(ser, wpt->pos.lon);
+}
+
+static void
+key_put_alt_lim(route_ser_t *ser, alt_lim_t lim)
+{
+	key_put_u32(ser, lim.type);
+	key_put_u32(ser, lim.alt1);
+	key_put_u32(ser, lim.alt2);
+}
+
+static void
+key_put_spd_lim(route_ser_t *ser, spd_lim_t lim)
+{
+	key_put_u32(ser, lim.type);
+	key_put_u32(ser, lim.spd1);
+}
+
+/*
+ * Puts the members of the leg_cmd & term_cond unions that are in use for
+ * the segment's type (see navproc_seg_t), plus its generic constraints.
+ */
+static void
+key_put_seg(route_ser_t *ser, const navproc_seg_t *seg)
+{
+	key_put_u32(ser, seg->type);
+
+	switch (seg->type) {
+	case NAVPROC_SEG_TYPE_CRS_TO_ALT:
+	case NAVPROC_SEG_TYPE_CRS_TO_DME:
+	case NAVPROC_SEG_TYPE_CRS_TO_INTCP:
+	case NAVPROC_SEG_TYPE_CRS_TO_RADIAL:
+	case NAVPROC_SEG_TYPE_HDG_TO_ALT:
+	case NAVPROC_SEG_TYPE_HDG_TO_DME:
+	case NAVPROC_SEG_TYPE_HDG_TO_INTCP:
+	case NAVPROC_SEG_TYPE_HDG_TO_MANUAL:
+	case NAVPROC_SEG_TYPE_HDG_TO_RADIAL:
+		key_put_f64(ser, seg->leg_cmd.hdg.hdg);
+		key_put_u32(ser, seg->leg_cmd.hdg.turn);
+		break;
+	case NAVPROC_SEG_TYPE_FIX_TO_ALT:
+	case NAVPROC_SEG_TYPE_FIX_TO_DIST:
+	case NAVPROC_SEG_TYPE_FIX_TO_DME:
+	case NAVPROC_SEG_TYPE_FIX_TO_MANUAL:
+		key_put_wpt(ser, &seg->leg_cmd.fix_crs.fix);
+		key_put_f64(ser, seg->leg_cmd.fix_crs.crs);
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
+		key_put_wpt(ser, &seg->leg_cmd.navaid_crs.navaid);
+		key_put_f64(ser, seg->leg_cmd.navaid_crs.crs);
+		key_put_u32(ser, seg->leg_cmd.navaid_crs.turn);
+		break;
+	case NAVPROC_SEG_TYPE_ARC_TO_FIX:
+		key_put_wpt(ser, &seg->leg_cmd.dme_arc.navaid);
+		key_put_f64(ser, seg->leg_cmd.dme_arc.start_radial);
+		key_put_f64(ser, seg->leg_cmd.dme_arc.end_radial);
+		key_put_f64(ser, seg->leg_cmd.dme_arc.radius);
+		key_put_u32(ser, seg->leg_cmd.dme_arc.cw);
+		break;
+	case NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX:
+		key_put_wpt(ser, &seg->leg_cmd.radius_arc.ctr_wpt);
+		key_put_f64(ser, seg->leg_cmd.radius_arc.radius);
+		key_put_u32(ser, seg->leg_cmd.radius_arc.cw);
+		break;
+	case NAVPROC_SEG_TYPE_INIT_FIX:
+		key_put_wpt(ser, &seg->leg_cmd.fix);
+		break;
+	case NAVPROC_SEG_TYPE_HOLD_TO_ALT:
+	case NAVPROC_SEG_TYPE_HOLD_TO_FIX:
+	case NAVPROC_SEG_TYPE_HOLD_TO_MANUAL:
+		key_put_wpt(ser, &seg->leg_cmd.hold.wpt);
+		key_put_f64(ser, seg->leg_cmd.hold.inbd_crs);
+		key_put_f64(ser, seg->leg_cmd.hold.leg_len);
+		key_put_u32(ser, seg->leg_cmd.hold.turn_right);
+		break;
+	case NAVPROC_SEG_TYPE_PROC_TURN:
+		key_put_wpt(ser, &seg->leg_cmd.proc_turn.startpt);
+		key_put_f64(ser, seg->leg_cmd.proc_turn.outbd_radial);
+		key_put_f64(ser, seg->leg_cmd.proc_turn.outbd_turn_hdg);
+		key_put_f64(ser, seg->leg_cmd.proc_turn.max_excrs_dist);
+		key_put_f64(ser, seg->leg_cmd.proc_turn.max_excrs_time);
+		key_put_u32(ser, seg->leg_cmd.proc_turn.turn_right);
+		key_put_wpt(ser, &seg->leg_cmd.proc_turn.navaid);
+		break;
+	default:
+		/* DF & TF have no leg command */
+		break;
+	}
+
+	switch (seg->type) {
+	case NAVPROC_SEG_TYPE_ARC_TO_FIX:
+	case NAVPROC_SEG_TYPE_CRS_TO_FIX:
+	case NAVPROC_SEG_TYPE_DIR_TO_FIX:
+	case NAVPROC_SEG_TYPE_RADIUS_ARC_TO_FIX:
+	case NAVPROC_SEG_TYPE_TRK_TO_FIX:
+	case NAVPROC_SEG_TYPE_HDG_TO_INTCP:
+		key_put_wpt(ser, &seg->term_cond.fix);
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_ALT:
+	case NAVPROC_SEG_TYPE_FIX_TO_ALT:
+	case NAVPROC_SEG_TYPE_HOLD_TO_ALT:
+	case NAVPROC_SEG_TYPE_HDG_TO_ALT:
+		key_put_alt_lim(ser, seg->term_cond.alt);
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_RADIAL:
+	case NAVPROC_SEG_TYPE_CRS_TO_INTCP:
+	case NAVPROC_SEG_TYPE_HDG_TO_RADIAL:
+		key_put_wpt(ser, &seg->term_cond.radial.navaid);
+		key_put_f64(ser, seg->term_cond.radial.radial);
+		break;
+	case NAVPROC_SEG_TYPE_CRS_TO_DME:
+	case NAVPROC_SEG_TYPE_FIX_TO_DME:
+	case NAVPROC_SEG_TYPE_HDG_TO_DME:
+		key_put_wpt(ser, &seg->term_cond.dme.navaid);
+		key_put_f64(ser, seg->term_cond.dme.dist);
+		break;
+	case NAVPROC_SEG_TYPE_FIX_TO_DIST:
+		key_put_f64(ser, seg->term_cond.dist);
+		break;
+	default:
+		break;
+	}
+
+	key_put_spd_lim(ser, seg->spd_lim);
+	key_put_alt_lim(ser, seg->alt_lim);
+	key_put_u32(ser, seg->ovrfly);
+}
+
+static void
+key_put_flt(route_ser_t *ser, const flt_perf_t *flt)
+{
+	key_put_f64(ser, flt->zfw);
+	key_put_f64(ser, flt->fuel);
+	key_put_f64(ser, flt->clb_ias);
+	key_put_f64(ser, flt->clb_mach);
+	key_put_f64(ser, flt->crz_ias);
+	key_put_f64(ser, flt->crz_mach);
+	key_put_f64(ser, flt->crz_lvl);
+	key_put_f64(ser, flt->des_ias);
+	key_put_f64(ser, flt->des_mach);
+	key_put_f64(ser, flt->to_flap);
+	key_put_f64(ser, flt->accel_height);
+	key_put_f64(ser, flt->spd_lim);
+	key_put_f64(ser, flt->spd_lim_alt);
+	key_put_f64(ser, flt->thr_derate);
+}
 
-			if (seg->type == NAVPROC_SEG_TYPE_FIX_TO_MANUAL)
-				hdg = seg->leg_cmd.hdg.hdg;
-			else
-				hdg = seg->leg_cmd.fix_crs.crs;
-			new_pos = geo_displace_mag(&wgs84, route->navdb->wmm,
-			    cur_pos, hdg, INTCP_SRCH_DIST);
-			rs = rs_new_direct(cur_pos, new_pos,
-			    next_join_type(route, rl));
-			list_insert_tail(&route->segs, rs);
-			cur_pos = NULL_GEO_POS2;
-			break;
-		}
-		case NAVPROC_SEG_TYPE_HOLD_TO_ALT:
-		case NAVPROC_SEG_TYPE_HOLD_TO_FIX:
-		case NAVPROC_SEG_TYPE_HOLD_TO_MANUAL:
-			route_update_hold(route, rl, rnp, &cur_pos, cur_spd,
-			    turn_rate, next_spd);
-			break;
-		case NAVPROC_SEG_TYPE_INIT_FIX:
-			if (IS_NULL_GEO_POS(cur_pos))
-				cur_pos = seg->leg_cmd.fix.pos;
-				break;
-			break;
-		case NAVPROC_SEG_TYPE_PROC_TURN:
-			if (!route_update_proc_turn(route, rl, &cur_pos,
-			    next_spd, turn_rate, rnp)) {
-				cur_pos = NULL_GEO_POS2;
-				continue;
+/*
+ * Builds the cache key of a full route_update of `route': everything the
+ * result depends on. That is the navdb, aircraft & flight performance,
+ * start position (which covers the departure airport & runway), forecast,
+ * the leg groups and the legs with their constraints and winds. The
+ * navdb, aircraft & forecast go in by their serial numbers rather than
+ * their addresses, so that a freed object replaced by another one at the
+ * same address, or an object modified in place, doesn't hit stale
+ * entries. Airports are opened separately by every route, so of a
+ * procedure only the parts route_update looks at go in.
+ */
+static uint8_t *
+route_cache_key(const route_t *route, const acft_perf_t *acft,
+    const flt_perf_t *flt, geo_pos3_t start_pos, double start_hdg,
+    size_t *len)
+{
+	route_ser_t ser = { .buf = NULL };
+
+	SER_PUT(&ser, route->navdb->serial);
+	SER_PUT(&ser, acft->serial);
+	key_put_flt(&ser, flt);
+	key_put_f64(&ser, start_pos.lat);
+	key_put_f64(&ser, start_pos.lon);
+	key_put_f64(&ser, start_pos.elev);
+	key_put_f64(&ser, start_hdg);
+	if (route->wx != NULL) {
+		uint64_t wx_serial = wx_get_serial(route->wx);
+
+		SER_PUT(&ser, wx_serial);
+		key_put_f64(&ser, route->wx_time);
+	} else {
+		uint64_t wx_serial = 0;
+
+		SER_PUT(&ser, wx_serial);
+	}
+	for (const route_leg_group_t *rlg = list_head(&route->leg_groups);
+	    rlg != NULL; rlg = list_next(&route->leg_groups, rlg)) {
+		key_put_u32(&ser, rlg->type);
+		key_put_wpt(&ser, &rlg->start_wpt);
+		key_put_wpt(&ser, &rlg->end_wpt);
+		key_put_u32(&ser, list_count(&rlg->legs));
+		if (rlg->type == ROUTE_LEG_GROUP_TYPE_PROC) {
+			const navproc_t *proc = rlg->proc;
+
+			key_put_u32(&ser, proc->type);
+			/* see next_flt_phase */
+			if (proc->type == NAVPROC_TYPE_FINAL) {
+				unsigned n = MIN(proc->num_segs,
+				    proc->num_main_segs + 1);
+
+				key_put_u32(&ser, proc->num_main_segs);
+				for (unsigned i = 0; i < n; i++)
+					key_put_seg(&ser, &proc->segs[i]);
 			}
-			break;
-		default:
-			assert(0);
 		}
+		for (const route_leg_t *rl = list_head(&rlg->legs); rl != NULL;
+		    rl = list_next(&rlg->legs, rl)) {
+			key_put_u32(&ser, rl->disco);
+			if (!rl->disco)
+				key_put_seg(&ser, &rl->data->seg);
+			key_put_u32(&ser, rl->data->alt_lim_ovrd);
+			key_put_alt_lim(&ser, rl->data->alt_lim);
+			key_put_u32(&ser, rl->data->spd_lim_ovrd);
+			key_put_spd_lim(&ser, rl->data->spd_lim);
+			key_put_f64(&ser, rl->data->wind.x);
+			key_put_f64(&ser, rl->data->wind.y);
+		}
+	}
 
-		if ((rs = list_tail(&route->segs)) != NULL &&
-		    (rs_prev = list_prev(&route->segs, rs)) != NULL)
-			route_seg_join(&route->segs, rs_prev, rs, rnp, cur_spd,
-			    turn_rate);
+	*len = ser.len;
+	return (ser.buf);
+}
 
-		cur_spd = next_spd;
-		cur_alt = next_alt;
+/*
+ * 64-bit FNV-1a over `len' bytes of `buf', taken a word at a time.
+ */
+static uint64_t
+route_cache_hash(const uint8_t *buf, size_t len)
+{
+	uint64_t	h = 0xcbf29ce484222325llu;
+	size_t		i = 0;
 
-		phase = next_flt_phase(phase, rlg, rl);
+	for (; i + sizeof (uint64_t) <= len; i += sizeof (uint64_t)) {
+		uint64_t w;
+
+		memcpy(&w, &buf[i], sizeof (w));
+		h = (h ^ w) * 0x100000001b3llu;
 	}
+	for (; i < len; i++)
+		h = (h ^ buf[i]) * 0x100000001b3llu;
 
-	return (err);
+	return (h);
+}
+
+/*
+ * Looks up the entry for `key' in `cache'. On a hit, the entry is returned
+ * with a reference held, which the caller must drop using
+ * route_cache_ent_rele.
+ */
+static route_cache_ent_t *
+route_cache_lookup(route_cache_t *cache, uint64_t hash, const uint8_t *key,
+    size_t key_len)
+{
+	route_cache_ent_t *ent;
+
+	pthread_mutex_lock(&cache->lock);
+	ent = htbl_lookup(&cache->by_hash, &hash);
+	if (ent != NULL && (ent->key_len != key_len ||
+	    memcmp(ent->key, key, key_len) != 0))
+		ent = NULL;
+	if (ent != NULL) {
+		list_remove(&cache->lru, ent);
+		list_insert_head(&cache->lru, ent);
+		__atomic_add_fetch(&ent->refcnt, 1, __ATOMIC_RELAXED);
+		cache->stats.hits++;
+	} else {
+		cache->stats.misses++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return (ent);
+}
+
+/*
+ * Stores the result of a full route_update of `route' in `cache' under
+ * `key', which the cache takes ownership of.
+ */
+static void
+route_cache_insert(route_cache_t *cache, const route_t *route, uint64_t hash,
+    uint8_t *key, size_t key_len)
+{
+	route_cache_ent_t	*ent = calloc(sizeof (*ent), 1);
+	route_cache_ent_t	*old;
+	uint32_t		i = 0;
+
+	ent->hash = hash;
+	ent->key = key;
+	ent->key_len = key_len;
+	ent->refcnt = 1;
+	ent->num_segs = route->num_segs;
+	ent->segs = malloc(MAX(ent->num_segs, 1) * sizeof (*ent->segs));
+	for (i = 0; i < route->num_segs; i++) {
+		ent->segs[i] = route->segs[i];
+		ref_hold(&ent->segs[i]->refcnt);
+	}
+	ent->segs_dist = route->segs_dist;
+	ent->num_legs = list_count(&route->legs);
+	ent->upd = calloc(MAX(ent->num_legs, 1), sizeof (*ent->upd));
+	i = 0;
+	for (const route_leg_t *rl = list_head(&route->legs);
+	    rl != NULL && rl->upd != NULL; rl = list_next(&route->legs, rl)) {
+		ent->upd[i] = rl->upd;
+		ref_hold(&ent->upd[i++]->refcnt);
+	}
+	ent->err = route->upd_err;
+	ent->err_rl = route->upd_err_rl;
+
+	pthread_mutex_lock(&cache->lock);
+	if ((old = htbl_lookup(&cache->by_hash, &hash)) != NULL) {
+		list_remove(&cache->lru, old);
+		route_cache_ent_rele(old);
+	}
+	htbl_set(&cache->by_hash, &ent->hash, ent);
+	list_insert_head(&cache->lru, ent);
+	while (list_count(&cache->lru) > cache->max_entries) {
+		old = list_remove_tail(&cache->lru);
+		htbl_remove(&cache->by_hash, &old->hash, B_FALSE);
+		route_cache_ent_rele(old);
+		cache->stats.evictions++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+/*
+ * Replaces the segments & update checkpoints of `route' with those in
+ * `ent', which must have been computed for a route of identical content.
+ */
+static void
+route_cache_install(route_t *route, const route_cache_ent_t *ent)
+{
+	uint32_t i = 0;
+
+	ASSERT(ent->num_legs == list_count(&route->legs));
+	route_segs_truncate(route, 0);
+	if (ent->num_segs > route->segs_cap) {
+		route->segs_cap = ent->num_segs;
+		route->segs = realloc(route->segs,
+		    route->segs_cap * sizeof (*route->segs));
+	}
+	for (i = 0; i < ent->num_segs; i++) {
+		route->segs[i] = ent->segs[i];
+		ref_hold(&route->segs[i]->refcnt);
+	}
+	route->num_segs = ent->num_segs;
+	route->segs_dist = ent->segs_dist;
+	i = 0;
+	for (route_leg_t *rl = list_head(&route->legs); rl != NULL;
+	    rl = list_next(&route->legs, rl), i++) {
+		upd_rele(&route->upd_pool, rl->upd);
+		rl->upd = ent->upd[i];
+		if (rl->upd != NULL)
+			ref_hold(&rl->upd->refcnt);
+	}
+}
+
+/*
+ * Recomputes the route segments of `route'. Only the part of the route
+ * following the earliest edit since the last call is recomputed, the
+ * segments in front of it are kept. Changing `acft', `flt' or anything
+ * affecting the route's start position recomputes the whole route.
+ * Whole-route recomputes are looked up in the route's cache, if it has
+ * one (see route_set_cache).
+ */
+err_t
+route_update(route_t *route, const acft_perf_t *acft, const flt_perf_t *flt,
+    route_leg_t **err_rl)
+{
+	geo_pos3_t		start_pos;
+	double			start_hdg;
+	route_leg_t		*rl;
+	list_t			segs;
+	route_upd_t		ru = {
+	    .route = route, .acft = acft, .flt = flt, .fuel = flt->fuel,
+	    .segs = &segs, .pool = &route->rs_pool,
+	    .upd_pool = &route->upd_pool, .base = 0, .cut = NULL, .cut_n = 0
+	};
+	route_upd_state_t	st = { .spd = 0, .phase = FLT_PHASE_TO,
+	    .err = ERR_OK, .err_rl = NULL };
+	bool_t			up_to_date;
+	uint8_t			*key = NULL;
+	size_t			key_len = 0;
+	uint64_t		hash = 0;
+
+	if (ru.fuel == 0)
+		ru.fuel = acft->max_gw - flt->zfw;
+
+	route_first_start_pos(route, NULL, &start_pos, &start_hdg, NULL);
+	rl = route_update_restart_leg(route, acft, flt, start_pos, start_hdg,
+	    &up_to_date);
+	if (up_to_date) {
+		st.err = route->upd_err;
+		st.err_rl = (route->upd_err_rl != 0 ?
+		    route->rl_idx[route->upd_err_rl - 1] : NULL);
+		goto out;
+	}
+	if (rl == NULL && route->cache != NULL &&
+	    !list_is_empty(&route->legs)) {
+		route_cache_ent_t *ent;
+
+		key = route_cache_key(route, acft, flt, start_pos, start_hdg,
+		    &key_len);
+		hash = route_cache_hash(key, key_len);
+		ent = route_cache_lookup(route->cache, hash, key, key_len);
+		if (ent != NULL) {
+			route_cache_install(route, ent);
+			st.err = ent->err;
+			st.err_rl = (ent->err_rl != 0 ?
+			    route->rl_idx[ent->err_rl - 1] : NULL);
+			route_cache_ent_rele(ent);
+			free(key);
+			key = NULL;
+			goto done;
+		}
+	}
+
+	list_create(&segs, sizeof (route_seg_t),
+	    offsetof(route_seg_t, route_segs_node));
+	if (rl != NULL) {
+		route_update_rewind(&ru, rl, &st);
+	} else {
+		route_segs_truncate(route, 0);
+		rl = list_head(&route->legs);
+		st.pos = GEO3_TO_GEO2(start_pos);
+		st.hdg = start_hdg;
+		st.alt = start_pos.elev;
+	}
+	if (rl != NULL) {
+		route_join_cache_prepare(route);
+		route_update_run(&ru, rl, &st);
+	}
+	route_segs_publish(route, &segs);
+	list_destroy(&segs);
+done:
+	route->upd_acft = acft;
+	route->upd_flt = *flt;
+	route->upd_start_pos = start_pos;
+	route->upd_start_hdg = start_hdg;
+	route->upd_err = st.err;
+	route->upd_err_rl = (st.err_rl != NULL ? st.err_rl->idx + 1 : 0);
+	if (key != NULL)
+		route_cache_insert(route->cache, route, hash, key, key_len);
+out:
+	route->segs_dirty = B_FALSE;
+	if (st.err != ERR_OK)
+		*err_rl = st.err_rl;
+
+	return (st.err);
+}
+
+/*
+ * Sets how many threads route_update may use to compute the route in
+ * parallel. Sections of the route separated by discontinuities can be
+ * computed concurrently (see route_update_run). 1 (the default) means
+ * route_update only ever runs on the calling thread, 0 means one thread
+ * per online CPU. The calling thread counts as one, the others come from
+ * a pool of worker threads shared by all routes, which is started when
+ * the first route opts in and stopped once none is opted in anymore.
+ */
+void
+route_set_update_threads(route_t *route, unsigned num_threads)
+{
+	unsigned old = route->upd_threads;
+
+	if (num_threads != 1) {
+		route_upd_pool_hold(MIN(num_threads != 0 ? num_threads :
+		    route_num_cpus(), ROUTE_UPD_MAX_THREADS) - 1);
+	}
+	route->upd_threads = num_threads;
+	if (old != 1)
+		route_upd_pool_rele();
 }
 
 /*
@@ -2321,6 +5354,112 @@ route_update_needed(const route_t *route)
 	return (route->segs_dirty);
 }
 
+/*
+ * Shared state of a route_batch_compute run.
+ */
+typedef struct {
+	const fms_navdb_t		*navdb;
+	const route_batch_spec_t	*specs;
+	route_batch_res_t		*res;
+	size_t				num_specs;
+	size_t				next;	/* next spec to compute */
+	size_t				num_ok;
+} route_batch_t;
+
+/*
+ * Builds and updates the route described by `spec', stopping at the first
+ * error. The route is kept in `res' even if that happens.
+ */
+static err_t
+route_batch_one(const fms_navdb_t *navdb, const route_batch_spec_t *spec,
+    route_batch_res_t *res)
+{
+	route_t *route = route_create(navdb);
+
+	res->route = route;
+	res->err_tok = 0;
+	res->err_rl = NULL;
+
+	if (spec->dep != NULL &&
+	    (res->err = route_set_dep_arpt(route, spec->dep)) != ERR_OK)
+		return (res->err);
+	if (spec->arr != NULL &&
+	    (res->err = route_set_arr_arpt(route, spec->arr)) != ERR_OK)
+		return (res->err);
+	if (spec->item15 != NULL && (res->err = route_fpl_ingest(route,
+	    spec->item15, &res->err_tok)) != ERR_OK)
+		return (res->err);
+	res->err = route_update(route, spec->acft, spec->flt, &res->err_rl);
+
+	return (res->err);
+}
+
+static void *
+route_batch_worker(void *arg)
+{
+	route_batch_t	*batch = arg;
+	size_t		num_ok = 0;
+
+	for (;;) {
+		size_t i = __atomic_fetch_add(&batch->next, 1,
+		    __ATOMIC_RELAXED);
+
+		if (i >= batch->num_specs)
+			break;
+		if (route_batch_one(batch->navdb, &batch->specs[i],
+		    &batch->res[i]) == ERR_OK)
+			num_ok++;
+	}
+	__atomic_add_fetch(&batch->num_ok, num_ok, __ATOMIC_RELAXED);
+
+	return (NULL);
+}
+
+/*
+ * Builds and route_update's a batch of routes on a pool of `num_threads'
+ * threads (0 means one per online CPU, the calling thread is one of them).
+ * For each spec in `specs', a new route is created on `navdb', its airports
+ * set, the spec's flight plan ingested (see route_fpl_ingest) and the route
+ * updated with the spec's aircraft & flight performance. The outcome goes
+ * to the same index in `res'.
+ *
+ * The routes only ever read from the navdb, which is immutable once open
+ * (see fms_navdb_open), so the threads share it without any locking. Each
+ * route is built by a single thread and no state is shared between the
+ * routes, other than the navdb and the caller's performance data, which
+ * is read-only. The returned routes belong to the caller, who must destroy
+ * them (even those which failed) before closing the navdb. As any route,
+ * each may only be used by one thread at a time.
+ *
+ * @return The number of routes which were computed without error.
+ */
+size_t
+route_batch_compute(const fms_navdb_t *navdb, const route_batch_spec_t *specs,
+    route_batch_res_t *res, size_t num_specs, unsigned num_threads)
+{
+	route_batch_t	batch = {
+		.navdb = navdb, .specs = specs, .res = res,
+		.num_specs = num_specs
+	};
+	pthread_t	*thr;
+
+	if (num_threads == 0)
+		num_threads = route_num_cpus();
+	num_threads = MAX(MIN(num_threads, num_specs), 1);
+
+	thr = calloc(sizeof (*thr), num_threads);
+	for (unsigned i = 1; i < num_threads; i++) {
+		VERIFY(pthread_create(&thr[i], NULL, route_batch_worker,
+		    &batch) == 0);
+	}
+	(void) route_batch_worker(&batch);
+	for (unsigned i = 1; i < num_threads; i++)
+		VERIFY(pthread_join(thr[i], NULL) == 0);
+	free(thr);
+
+	return (batch.num_ok);
+}
+
 /*
  * Generic airport setter for a route. Takes a route, a pointer to an airport
  * POINTER (i.e. the field in the route_t which is the airport pointer which
@@ -2332,7 +5471,8 @@ route_update_needed(const route_t *route)
 static err_t
 route_set_arpt(route_t *route, airport_t **arptp, const char *icao)
 {
-	airport_t *narpt = NULL;
+	airport_t		*narpt = NULL;
+	const arpt_idx_ent_t	*ent;
 
 	if (icao != NULL) {
 		/* Don't replace the same airport - just return OK */
@@ -2340,8 +5480,11 @@ route_set_arpt(route_t *route, airport_t **arptp, const char *icao)
 			return (ERR_OK);
 
 		/* Try to open new airport */
-		narpt = airport_open(icao, route->navdb->navdata_dir,
-		    route->navdb->wptdb, route->navdb->navaiddb);
+		ent = fms_navdb_arpt_lookup(route->navdb, icao);
+		if (ent == NULL)
+			return (ERR_ARPT_NOT_FOUND);
+		narpt = airport_open_at(icao, route->navdb->navdata_dir,
+		    ent->offset, route->navdb->wptdb, route->navdb->navaiddb);
 		if (narpt == NULL)
 			return (ERR_ARPT_NOT_FOUND);
 	}
@@ -2534,16 +5677,16 @@ route_insert_proc_rlg(route_t *route, const navproc_t *proc,
 	route_leg_t *prev_rl;
 
 	rlg->proc = proc;
-	list_insert_after(&route->leg_groups, prev_rlg, rlg);
+	rlg_insert(route, prev_rlg, rlg);
 	prev_rl = last_leg_before_rlg(route, rlg);
 
 	/* Start inserting individual procedure legs */
 	for (unsigned i = 0; i < proc->num_segs; i++) {
-		route_leg_t *rl = calloc(sizeof (*rl), 1);
-		rl->seg = proc->segs[i];
+		route_leg_t *rl = rl_alloc(route);
+		rl->data->seg = proc->segs[i];
 		rl->rlg = rlg;
 		list_insert_tail(&rlg->legs, rl);
-		list_insert_after(&route->legs, prev_rl, rl);
+		rl_insert(route, prev_rl, rl);
 		prev_rl = rl;
 	}
 	ASSERT(!list_is_empty(&rlg->legs));
@@ -2973,36 +6116,350 @@ route_get_startr(const route_t *route)
 const navproc_t *
 route_get_appr(const route_t *route)
 {
-	return (route->appr);
+	return (route->appr);
+}
+
+/*
+ * Returns the route's final approach transition or NULL if none is set.
+ */
+const navproc_t *
+route_get_apprtr(const route_t *route)
+{
+	return (route->apprtr);
+}
+
+/*
+ * Returns the leg groups which constitute the route. This is a read-only
+ * list. To edit the route, use the route editing functions.
+ */
+const list_t *
+route_get_leg_groups(const route_t *route)
+{
+	return (&route->leg_groups);
+}
+
+/*
+ * Returns the individual legs which constitute the route. This is a
+ * read-only list. To edit the route, use the route editing functions.
+ */
+const list_t *
+route_get_legs(const route_t *route)
+{
+	return (&route->legs);
+}
+
+/*
+ * Returns the number of segments computed for the route by the last
+ * route_update.
+ */
+unsigned
+route_get_num_segs(const route_t *route)
+{
+	return (route->num_segs);
+}
+
+/*
+ * Returns the segment at position `idx' in the segments computed by the
+ * last route_update, or NULL if `idx' is past the end of the route.
+ */
+const route_seg_t *
+route_get_seg(const route_t *route, unsigned idx)
+{
+	if (idx >= route->num_segs)
+		return (NULL);
+	return (route->segs[idx]);
+}
+
+/*
+ * Returns the number of leg groups in the route.
+ */
+unsigned
+route_get_num_leg_groups(const route_t *route)
+{
+	return (route->num_rlg_idx);
+}
+
+/*
+ * Returns the leg group at position `idx' in the route, or NULL if `idx'
+ * is past the end of the route.
+ */
+const route_leg_group_t *
+route_get_leg_group(const route_t *route, unsigned idx)
+{
+	if (idx >= route->num_rlg_idx)
+		return (NULL);
+	return (route->rlg_idx[idx]);
+}
+
+/*
+ * Returns the position of `rlg' in the route's leg groups.
+ */
+unsigned
+route_lg_get_idx(const route_t *route, const route_leg_group_t *rlg)
+{
+	ASSERT(rlg->idx < route->num_rlg_idx &&
+	    route->rlg_idx[rlg->idx] == rlg);
+	return (rlg->idx);
+}
+
+/*
+ * Returns the number of legs in the route.
+ */
+unsigned
+route_get_num_legs(const route_t *route)
+{
+	return (route->num_rl_idx);
+}
+
+/*
+ * Returns the leg at position `idx' in the route, or NULL if `idx' is
+ * past the end of the route.
+ */
+const route_leg_t *
+route_get_leg(const route_t *route, unsigned idx)
+{
+	if (idx >= route->num_rl_idx)
+		return (NULL);
+	return (route->rl_idx[idx]);
+}
+
+/*
+ * Returns the position of `rl' in the route's legs.
+ */
+unsigned
+route_l_get_idx(const route_t *route, const route_leg_t *rl)
+{
+	ASSERT(rl->idx < route->num_rl_idx && route->rl_idx[rl->idx] == rl);
+	return (rl->idx);
+}
+
+/*
+ * Returns the angle in degrees that the arc segment `rs' turns through.
+ */
+static double
+arc_seg_get_angle(const route_seg_t *rs)
+{
+	fpp_t	fpp = gnomo_fpp_init(rs->arc.center, 0, NULL, B_TRUE);
+	double	start = dir2hdg(geo2fpp(rs->arc.start, &fpp));
+	double	end = dir2hdg(geo2fpp(rs->arc.end, &fpp));
+
+	ASSERT(rs->type == ROUTE_SEG_TYPE_ARC);
+	if (rs->arc.cw)
+		return (fmod(end - start + 360, 360));
+	return (fmod(start - end + 360, 360));
+}
+
+/*
+ * Returns the along-track length of route segment `rs' in meters.
+ */
+static double
+rs_get_len(const route_seg_t *rs)
+{
+	if (rs->type == ROUTE_SEG_TYPE_DIRECT)
+		return (gc_distance(rs->direct.start, rs->direct.end));
+	return (DEG2RAD(arc_seg_get_angle(rs)) * arc_seg_get_radius(rs));
+}
+
+/*
+ * Returns the position at fraction `frac' (0 to 1) of the length of route
+ * segment `rs'. Works in the same projection as the segment's length, so
+ * that the ends come out exactly on the segment's endpoints.
+ */
+static geo_pos2_t
+rs_get_pos(const route_seg_t *rs, double frac)
+{
+	fpp_t	fpp;
+	vect2_t	v;
+
+	if (rs->type == ROUTE_SEG_TYPE_DIRECT) {
+		/* great circles through the center are straight lines here */
+		fpp = gnomo_fpp_init(rs->direct.start, 0, NULL, B_TRUE);
+		v = geo2fpp(rs->direct.end, &fpp);
+		v = vect2_set_abs(v, EARTH_MSL * tan(frac *
+		    atan(vect2_abs(v) / EARTH_MSL)));
+		return (fpp2geo(v, &fpp));
+	}
+	fpp = gnomo_fpp_init(rs->arc.center, 0, NULL, B_TRUE);
+	v = geo2fpp(rs->arc.start, &fpp);
+	v = vect2_rot(v, (rs->arc.cw ? 1 : -1) * frac * arc_seg_get_angle(rs));
+	return (fpp2geo(v, &fpp));
+}
+
+/*
+ * Returns the distance in meters from `pos' to the closest point of route
+ * segment `rs' and sets `fracp' to the fraction of the segment's length
+ * at which that point lies (see rs_get_pos).
+ */
+static double
+rs_get_closest(const route_seg_t *rs, geo_pos2_t pos, double *fracp)
+{
+	fpp_t	fpp;
+	double	frac;
+
+	if (rs->type == ROUTE_SEG_TYPE_DIRECT) {
+		vect2_t	v, p;
+		double	len;
+
+		/*
+		 * Great circles crossing the segment at right angles are at
+		 * right angles to it here too, so the closest point is the
+		 * projection's foot of the perpendicular.
+		 */
+		fpp = gnomo_fpp_init(rs->direct.start, 0, NULL, B_TRUE);
+		v = geo2fpp(rs->direct.end, &fpp);
+		p = geo2fpp(pos, &fpp);
+		len = atan(vect2_abs(v) / EARTH_MSL);
+		frac = (len > 0 ? atan(vect2_dotprod(p, vect2_unit(v, NULL)) /
+		    EARTH_MSL) / len : 0);
+	} else {
+		double angle = arc_seg_get_angle(rs), a;
+
+		fpp = gnomo_fpp_init(rs->arc.center, 0, NULL, B_TRUE);
+		a = dir2hdg(geo2fpp(pos, &fpp)) -
+		    dir2hdg(geo2fpp(rs->arc.start, &fpp));
+		a = fmod((rs->arc.cw ? a : -a) + 720, 360);
+		/* beyond the end, but closer to the start going backwards */
+		if (a > angle + (360 - angle) / 2)
+			frac = 0;
+		else
+			frac = (angle > 0 ? a / angle : 0);
+	}
+	frac = MIN(MAX(frac, 0), 1);
+	*fracp = frac;
+
+	return (gc_distance(pos, rs_get_pos(rs, frac)));
+}
+
+/*
+ * Returns the along-track distance in meters from the start of the route
+ * to the end of its `idx'-th segment. The distances are summed up once by
+ * route_segs_publish, so this and the lookups below are O(1) & O(log n).
+ */
+static double
+route_seg_end_dist(const route_t *route, unsigned idx)
+{
+	ASSERT(idx < route->num_segs);
+	return (idx + 1 < route->num_segs ? route->segs[idx + 1]->dist :
+	    route->segs_dist);
+}
+
+/*
+ * Returns the along-track length of the route in meters, as computed by
+ * the last route_update.
+ */
+double
+route_get_dist(const route_t *route)
+{
+	return (route->segs_dist);
 }
 
 /*
- * Returns the route's final approach transition or NULL if none is set.
+ * Returns the along-track distance in meters from the start of the route
+ * to the point at fraction `frac' (0 to 1) of the length of `rs', which
+ * must be one of the route's segments.
  */
-const navproc_t *
-route_get_apprtr(const route_t *route)
+double
+route_seg_get_dist(const route_t *route, const route_seg_t *rs, double frac)
 {
-	return (route->apprtr);
+	ASSERT(rs->idx < route->num_segs && route->segs[rs->idx] == rs);
+	frac = MIN(MAX(frac, 0), 1);
+	/* exact at both ends, so adjacent segments meet at the same value */
+	return (rs->dist * (1 - frac) +
+	    route_seg_end_dist(route, rs->idx) * frac);
 }
 
 /*
- * Returns the leg groups which constitute the route. This is a read-only
- * list. To edit the route, use the route editing functions.
+ * Returns the position `dist' meters along the route from its start, or
+ * NULL_GEO_POS2 if that's not on the route. If `rsp' isn't NULL, it is
+ * set to the segment the position lies on (NULL if none).
  */
-const list_t *
-route_get_leg_groups(const route_t *route)
+geo_pos2_t
+route_get_pos_at_dist(const route_t *route, double dist,
+    const route_seg_t **rsp)
 {
-	return (&route->leg_groups);
+	unsigned	lo = 0, hi = route->num_segs;
+	double		len;
+
+	if (rsp != NULL)
+		*rsp = NULL;
+	if (hi == 0 || dist < 0 || dist > route->segs_dist)
+		return (NULL_GEO_POS2);
+	/* find the last segment starting at or before `dist' */
+	while (hi - lo > 1) {
+		unsigned mid = (lo + hi) / 2;
+
+		if (route->segs[mid]->dist <= dist)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (rsp != NULL)
+		*rsp = route->segs[lo];
+	len = route_seg_end_dist(route, lo) - route->segs[lo]->dist;
+
+	return (rs_get_pos(route->segs[lo], len > 0 ?
+	    (dist - route->segs[lo]->dist) / len : 0));
 }
 
 /*
- * Returns the individual legs which constitute the route. This is a
- * read-only list. To edit the route, use the route editing functions.
+ * Fills `dists' (one entry per leg, in route_get_leg order) with the
+ * along-track distance in meters from the start of the route to where the
+ * path computed by the last route_update passes the end of each leg. The
+ * path rounds off the corners at fly-by fixes, so a leg's end is matched
+ * to the closest point of the segments, searching forward from where the
+ * previous leg's end was found. The distances therefore never decrease.
+ * Legs whose end isn't on the path (discontinuities and legs ending
+ * without a position, such as manual terminations) get NAN.
  */
-const list_t *
-route_get_legs(const route_t *route)
+void
+route_get_leg_dists(const route_t *route, double *dists)
 {
-	return (&route->legs);
+#define	LEG_DIST_MAX_SCAN	32		/* segments per leg */
+#define	LEG_DIST_MATCH		NM2MET(3)	/* local minimum is it */
+	size_t	cur = 0;
+	double	last = 0;
+	unsigned i = 0;
+
+	for (const route_leg_t *rl = list_head(&route->legs); rl != NULL;
+	    rl = list_next(&route->legs, rl), i++) {
+		const route_leg_t	*rl_next = list_next(&route->legs, rl);
+		double			best = INFINITY, best_frac = 0;
+		size_t			best_idx = cur;
+
+		if (rl->disco || route->num_segs == 0) {
+			dists[i] = NAN;
+			continue;
+		}
+		if (rl_next == NULL) {
+			dists[i] = route->segs_dist;
+			continue;
+		}
+		/* our end is where route_update entered the next leg */
+		if (rl_next->upd == NULL ||
+		    IS_NULL_GEO_POS(rl_next->upd->pos)) {
+			dists[i] = NAN;
+			continue;
+		}
+		for (size_t j = cur; j < route->num_segs &&
+		    j < cur + LEG_DIST_MAX_SCAN; j++) {
+			double frac, d = rs_get_closest(route->segs[j],
+			    rl_next->upd->pos, &frac);
+
+			if (d < best) {
+				best = d;
+				best_idx = j;
+				best_frac = frac;
+			} else if (best < LEG_DIST_MATCH) {
+				break;
+			}
+		}
+		cur = best_idx;
+		last = MAX(last, route_seg_get_dist(route, route->segs[cur],
+		    best_frac));
+		dists[i] = last;
+	}
+#undef	LEG_DIST_MAX_SCAN
+#undef	LEG_DIST_MATCH
 }
 
 /*
@@ -3022,10 +6479,11 @@ route_lg_awy_insert(route_t *route, const char *awyname,
     const route_leg_group_t *x_prev_rlg, const route_leg_group_t **new_rlgpp)
 {
 	route_leg_group_t *prev_rlg = (route_leg_group_t *)x_prev_rlg;
-	route_leg_group_t *next_rlg = rlg_next_ndisc(route, prev_rlg);
+	route_leg_group_t *next_rlg;
 	route_leg_group_t *rlg;
 	const airway_t *awy;
 
+	next_rlg = rlg_next_ndisc(route, prev_rlg);
 	awy = airway_db_lookup(route->navdb->awydb, awyname, NULL, NULL, NULL);
 	if (!awy)
 		return (ERR_INVALID_AWY);
@@ -3039,7 +6497,7 @@ route_lg_awy_insert(route_t *route, const char *awyname,
 	rlg = rlg_new(ROUTE_LEG_GROUP_TYPE_AIRWAY, route);
 	rlg->awy = awy;
 
-	list_insert_after(&route->leg_groups, prev_rlg, rlg);
+	rlg_insert(route, prev_rlg, rlg);
 
 	rlg_update_awy_legs(route, rlg, B_FALSE);
 	rlg_connect_neigh(route, rlg, B_TRUE, B_TRUE);
@@ -3108,9 +6566,10 @@ route_lg_direct_insert(route_t *route, const wpt_t *fix,
     const route_leg_group_t *x_prev_rlg, const route_leg_group_t **new_rlgpp)
 {
 	route_leg_group_t *prev_rlg = (route_leg_group_t *)x_prev_rlg;
-	route_leg_group_t *next_rlg = rlg_next_ndisc(route, prev_rlg);
+	route_leg_group_t *next_rlg;
 	route_leg_group_t *rlg;
 
+	next_rlg = rlg_next_ndisc(route, prev_rlg);
 	if (next_rlg != NULL && next_rlg->type == ROUTE_LEG_GROUP_TYPE_PROC &&
 	    next_rlg->proc->type <= NAVPROC_TYPE_SID_TRANS)
 		return (ERR_INVALID_ENTRY);
@@ -3121,7 +6580,7 @@ route_lg_direct_insert(route_t *route, const wpt_t *fix,
 	rlg = rlg_new(ROUTE_LEG_GROUP_TYPE_DIRECT, route);
 	rlg->end_wpt = *fix;
 
-	list_insert_after(&route->leg_groups, prev_rlg, rlg);
+	rlg_insert(route, prev_rlg, rlg);
 	rlg_update_direct_leg(route, rlg);
 	rlg_connect_neigh(route, rlg, B_TRUE, B_FALSE);
 
@@ -3200,7 +6659,7 @@ rlg_append_direct(route_t *route, route_leg_group_t *rlg, const wpt_t *wpt,
 		route_leg_t *rl = rl_new_direct(wpt, rlg);
 		route_leg_t *rl_last = list_tail(&rlg->legs);
 		list_insert_tail(&rlg->legs, rl);
-		list_insert_after(&route->legs, rl_last, rl);
+		rl_insert(route, rl_last, rl);
 	}
 	rlg_connect_neigh(route, rlg, B_FALSE, B_FALSE);
 	if (rlpp)
@@ -3263,7 +6722,7 @@ awy_split(route_t *route, route_leg_group_t *awy1, route_leg_t *rl1,
 		awy2->awy = awy1->awy;
 		awy2->start_wpt = awy2_start_fix;
 		awy2->end_wpt = awy2_end_fix;
-		list_insert_after(&route->leg_groups, awy1, awy2);
+		rlg_insert(route, awy1, awy2);
 		rlg_update_awy_legs(route, awy2, B_FALSE);
 	} else {
 		awy2 = NULL;
@@ -3274,7 +6733,7 @@ awy_split(route_t *route, route_leg_group_t *awy1, route_leg_t *rl1,
 			dir = rlg_new(ROUTE_LEG_GROUP_TYPE_DIRECT, route);
 			dir->start_wpt = awy1_end_fix;
 			dir->end_wpt = awy2_start_fix;
-			list_insert_after(&route->leg_groups, awy1, dir);
+			rlg_insert(route, awy1, dir);
 			rlg_update_direct_leg(route, dir);
 		} else {
 			dir = NULL;
@@ -3304,7 +6763,7 @@ awy_split(route_t *route, route_leg_group_t *awy1, route_leg_t *rl1,
 static bool_t
 leg_check_dup(const route_leg_t *rl, const wpt_t *wpt)
 {
-	return (rl != NULL && rl->seg.type != NAVPROC_SEG_TYPE_INIT_FIX &&
+	return (rl != NULL && rl->data->seg.type != NAVPROC_SEG_TYPE_INIT_FIX &&
 	    WPT_EQ_POS(leg_get_end_wpt(rl), wpt));
 }
 
@@ -3335,9 +6794,10 @@ route_l_insert(route_t *route, const wpt_t *fix, const route_leg_t *x_prev_rl,
     const route_leg_t **rlpp)
 {
 	route_leg_t *prev_rl = (route_leg_t *)x_prev_rl;
-	route_leg_t *next_rl = (prev_rl != NULL ?
-	    list_next(&route->legs, prev_rl) : list_head(&route->legs));
+	route_leg_t *next_rl;
 
+	next_rl = (prev_rl != NULL ? list_next(&route->legs, prev_rl) :
+	    list_head(&route->legs));
 	ASSERT(!IS_NULL_WPT(fix));
 
 		/* Check for dups */
@@ -3401,7 +6861,7 @@ route_l_insert(route_t *route, const wpt_t *fix, const route_leg_t *x_prev_rl,
 			} else {
 				/* Procedures must be internally expanded */
 				route_leg_t *rl = rl_new_direct(fix, prev_rlg);
-				list_insert_after(&route->legs, prev_rl, rl);
+				rl_insert(route, prev_rl, rl);
 				list_insert_after(&prev_rlg->legs, prev_rl, rl);
 				if (rlpp != NULL)
 					*rlpp = rl;
@@ -3531,168 +6991,851 @@ route_l_move(route_t *route, const route_leg_t *x_target_rl,
 		ASSERT(prev_rlg->type != ROUTE_LEG_GROUP_TYPE_DISCO &&
 		    prev_rlg->type != ROUTE_LEG_GROUP_TYPE_DIRECT);
 
-		if (prev_rlg->type == ROUTE_LEG_GROUP_TYPE_AIRWAY) {
-			awy_split(route, prev_rl->rlg, prev_rl,
-			    list_next(&next_rlg->legs, next_rl), B_TRUE);
-		} else {
-			/*
-			 * Procedures legs are simply removed. The segment
-			 * generator will be able to deal with any BS we
-			 * throw at it and the pilot is responsible for
-			 * checking the sanity of the result.
-			 */
-			for (route_leg_t *rl = list_next(&route->legs, prev_rl);
-			    rl != next_rl; rl = list_next(&route->legs,
-			    prev_rl)) {
-				ASSERT(rl != NULL);
-				list_remove(&route->legs, rl);
-				list_remove(&prev_rlg->legs, rl);
-				free(rl);
-			}
-			route->segs_dirty = B_TRUE;
-		}
+		if (prev_rlg->type == ROUTE_LEG_GROUP_TYPE_AIRWAY) {
+			awy_split(route, prev_rl->rlg, prev_rl,
+			    list_next(&next_rlg->legs, next_rl), B_TRUE);
+		} else {
+			/*
+			 * Procedures legs are simply removed. The segment
+			 * generator will be able to deal with any BS we
+			 * throw at it and the pilot is responsible for
+			 * checking the sanity of the result.
+			 */
+			for (route_leg_t *rl = list_next(&route->legs, prev_rl);
+			    rl != next_rl; rl = list_next(&route->legs,
+			    prev_rl)) {
+				ASSERT(rl != NULL);
+				rl_remove(route, rl);
+				list_remove(&prev_rlg->legs, rl);
+				rl_destroy(route, rl);
+			}
+			route->segs_dirty = B_TRUE;
+		}
+	}
+
+#undef	NEXT_OR_HEAD
+
+	return (ERR_OK);
+}
+
+/*
+ * Deletes the route leg `x_rl' from `route'.
+ */
+void
+route_l_delete(route_t *route, const route_leg_t *x_rl)
+{
+	route_leg_t *rl = (route_leg_t *)x_rl;
+	route_leg_group_t *rlg = rl->rlg;
+	route_leg_group_t *rlg2;
+	route_leg_t *prev_rl = list_prev(&rlg->legs, rl);
+	route_leg_t *next_rl = list_next(&rlg->legs, rl);
+
+	switch (rlg->type) {
+	case ROUTE_LEG_GROUP_TYPE_AIRWAY:
+		if (prev_rl != NULL && next_rl != NULL) {
+			/* Split the airway and insert a disco */
+			awy_split(route, prev_rl->rlg, prev_rl, next_rl,
+			    B_FALSE);
+		} else if (prev_rl != NULL && next_rl == NULL) {
+			/* Shorten the airway from the right */
+			rlg->end_wpt = *leg_get_end_wpt(prev_rl);
+			rlg_update_awy_legs(route, rlg, B_FALSE);
+			rlg2 = rlg_next_ndisc(route, rlg);
+			rlg_connect(route, rlg, rlg2, B_FALSE, B_FALSE);
+		} else if (prev_rl == NULL && next_rl != NULL) {
+			/* Shorten the airway from the left */
+			rlg->start_wpt = *leg_get_end_wpt(rl);
+			rlg_update_awy_legs(route, rlg, B_FALSE);
+			rlg2 = rlg_prev_ndisc(route, rlg);
+			rlg_connect(route, rlg2, rlg, B_FALSE, B_FALSE);
+		} else {
+			/* Get rid of the whole thing */
+			rlg_bypass(route, rl->rlg, B_FALSE, B_FALSE);
+		}
+		break;
+	case ROUTE_LEG_GROUP_TYPE_PROC:
+		/* We're the last one */
+		if (prev_rl == NULL && next_rl == NULL) {
+			rlg_bypass(route, rl->rlg, B_FALSE, B_FALSE);
+		} else if (prev_rl == NULL) {
+			/* First leg, check if we can adjust start_wpt. */
+			wpt_t start_wpt;
+
+			list_remove(&rlg->legs, rl);
+			rl_remove(route, rl);
+			rl_destroy(route, rl);
+			start_wpt = rlg_find_start_fix(rlg);
+			if (!IS_NULL_WPT(&start_wpt)) {
+				rlg->start_wpt = start_wpt;
+				rlg_connect_neigh(route, rlg, B_FALSE, B_FALSE);
+			}
+		} else if (next_rl == NULL) {
+			/* Last leg, check if we can adjust end_wpt. */
+			wpt_t end_wpt;
+
+			list_remove(&rlg->legs, rl);
+			rl_remove(route, rl);
+			rl_destroy(route, rl);
+			end_wpt = rlg_find_end_wpt(rlg);
+			if (!IS_NULL_WPT(&end_wpt)) {
+				rlg->end_wpt = end_wpt;
+				rlg_connect_neigh(route, rlg, B_FALSE, B_FALSE);
+			}
+		} else {
+			/* Internal delete, just remove it */
+			list_remove(&rlg->legs, rl);
+			rl_remove(route, rl);
+			rl_destroy(route, rl);
+		}
+		break;
+	case ROUTE_LEG_GROUP_TYPE_DIRECT:
+		rlg_bypass(route, rl->rlg, B_FALSE, B_FALSE);
+		break;
+	case ROUTE_LEG_GROUP_TYPE_DISCO:
+		ASSERT(list_prev(&route->legs, rl) != NULL &&
+		    list_next(&route->legs, rl) != NULL);
+		rlg_bypass(route, rl->rlg, B_TRUE, B_FALSE);
+		break;
+	default:
+		assert(0);
+	}
+	route->segs_dirty = B_TRUE;
+}
+
+/*
+ * Overrides the leg's navproc seg's altitude constraint with `l'.
+ */
+void
+route_l_set_alt_lim(route_t *route, const route_leg_t *x_rl, alt_lim_t l)
+{
+	route_leg_t *rl = (route_leg_t *)x_rl;
+
+	if (!rl->data->alt_lim_ovrd ||
+	    memcmp(&rl->data->alt_lim, &l, sizeof (l)) != 0) {
+		route_leg_data_t *data = rl_own(route, rl);
+
+		data->alt_lim = l;
+		data->alt_lim_ovrd = B_TRUE;
+		rl_dirty(route, rl);
+	}
+}
+
+/*
+ * Returns the active alt constraint on the route leg. If the route leg has
+ * no overriding constraint, the leg's navproc seg's constraint is returned.
+ */
+alt_lim_t route_l_get_alt_lim(const route_leg_t *rl)
+{
+	if (rl->data->alt_lim_ovrd)
+		return (rl->data->alt_lim);
+	else
+		return (rl->data->seg.alt_lim);
+}
+
+/*
+ * Overrides the leg's navproc seg's speed constraint with `l'.
+ */
+void
+route_l_set_spd_lim(route_t *route, const route_leg_t *x_rl, spd_lim_t l)
+{
+	route_leg_t *rl = (route_leg_t *)x_rl;
+
+	if (!rl->data->spd_lim_ovrd ||
+	    memcmp(&rl->data->spd_lim, &l, sizeof (l)) != 0) {
+		route_leg_data_t *data = rl_own(route, rl);
+
+		data->spd_lim = l;
+		data->spd_lim_ovrd = B_TRUE;
+		rl_dirty(route, rl);
+	}
+}
+
+/*
+ * Returns the active speed constraint on the route leg. If the route leg has
+ * no overriding constraint, the leg's navproc seg's constraint is returned.
+ */
+spd_lim_t
+route_l_get_spd_lim(const route_leg_t *rl)
+{
+	if (rl->data->spd_lim_ovrd)
+		return (rl->data->spd_lim);
+	else
+		return (rl->data->seg.spd_lim);
+}
+
+/*
+ * Checks if route_update uses the wind on `rl' to lay out the path, which
+ * it only does for altitude-terminated legs and the legs following them.
+ */
+static bool_t
+rl_wind_sets_path(const route_t *route, const route_leg_t *rl)
+{
+	const route_leg_t *prev = list_prev(&route->legs, rl);
+
+	for (int i = 0; i < 2; i++, rl = prev) {
+		if (rl != NULL && !rl->disco &&
+		    (rl->data->seg.type == NAVPROC_SEG_TYPE_CRS_TO_ALT ||
+		    rl->data->seg.type == NAVPROC_SEG_TYPE_FIX_TO_ALT ||
+		    rl->data->seg.type == NAVPROC_SEG_TYPE_HDG_TO_ALT))
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Sets the forecast wind on the route leg. The wind vector's direction is
+ * the direction the wind blows towards and its magnitude the wind speed in
+ * knots. Except around altitude-terminated legs, winds don't change the
+ * lateral path, so they don't call for a new route_update either. Just
+ * the predictions need refreshing, see vnav_profile_update.
+ */
+void
+route_l_set_wind(route_t *route, const route_leg_t *x_rl, vect2_t wind)
+{
+	route_leg_t *rl = (route_leg_t *)x_rl;
+
+	if (rl->data->wind.x == wind.x && rl->data->wind.y == wind.y)
+		return;
+	rl_own(route, rl)->wind = wind;
+	if (rl_wind_sets_path(route, rl)) {
+		route_leg_t *prev = list_prev(&route->legs, rl);
+
+		/* the leg in front of us looks ahead to our wind */
+		rl_dirty(route, rl);
+		if (prev != NULL)
+			rl_dirty(route, prev);
+	}
+}
+
+vect2_t
+route_l_get_wind(const route_leg_t *rl)
+{
+	return (rl->data->wind);
+}
+
+/*
+ * Makes route_update and the predictions built on it (see vnav.c) take
+ * winds & ISA deviations from forecast `wx' (NULL to go back to ISA and
+ * the legs' own winds only). The forecast wind adds to the wind set on
+ * each leg. `dep_time' is the takeoff time in seconds since the UNIX
+ * epoch. route_update itself doesn't predict times, so it samples the
+ * forecast at `dep_time' for the altitude-terminated legs it lays out
+ * with the performance model, which are mostly the initial climb anyway.
+ * The forecast must stay around for as long as the route uses it.
+ */
+void
+route_set_wx(route_t *route, const wx_t *wx, double dep_time)
+{
+	if (wx == route->wx && (wx == NULL || dep_time == route->wx_time))
+		return;
+	route->wx = wx;
+	route->wx_time = dep_time;
+	for (route_leg_t *rl = list_head(&route->legs); rl != NULL;
+	    rl = list_next(&route->legs, rl)) {
+		if (rl_wind_sets_path(route, rl))
+			rl_dirty(route, rl);
+	}
+}
+
+/*
+ * Returns the forecast set by route_set_wx (or NULL) and the takeoff time
+ * it was set with in `dep_time'.
+ */
+const wx_t *
+route_get_wx(const route_t *route, double *dep_time)
+{
+	if (dep_time != NULL)
+		*dep_time = route->wx_time;
+	return (route->wx);
+}
+
+/*
+ * ICAO flight plan (FPL) Item 15 route ingestion.
+ *
+ * An Item 15 string is a whitespace-separated sequence of elements:
+ *	<spd/lvl> [SID] <point> [<airway>|DCT] <point> ... [STAR]
+ * Points may carry a "/<spd/lvl>" change suffix, which we ignore (the
+ * cruise speed & level are a matter for the performance model, not for
+ * the lateral route). Ingestion is done in three passes over the string:
+ *	1) lexing: split into elements and classify them (point, airway,
+ *	   SID, STAR) without touching the route.
+ *	2) resolution: resolve every point ident and validate every airway
+ *	   segment against the navdb. Ambiguous idents are resolved to the
+ *	   candidate nearest the preceding point (or to one that actually
+ *	   lies on the following airway).
+ *	3) construction: append the resolved elements as leg groups.
+ * This way a malformed plan is rejected before the route is modified.
+ */
+
+typedef enum {
+	FPL_ELEM_PT,		/* significant point */
+	FPL_ELEM_AWY,		/* ATS route */
+	FPL_ELEM_SID,		/* standard departure route designator */
+	FPL_ELEM_STAR		/* standard arrival route designator */
+} fpl_elem_type_t;
+
+typedef enum {
+	FPL_TOK_ELEM,		/* token produced a route element */
+	FPL_TOK_SKIP,		/* token carries no lateral route info */
+	FPL_TOK_BAD		/* malformed token */
+} fpl_tok_t;
+
+typedef struct {
+	fpl_elem_type_t	type;
+	unsigned	tok;		/* index of the source token */
+	char		name[NAV_NAME_LEN];
+	/*
+	 * For points, the resolved fix. For airways, the fix at which
+	 * the airway is left. Geographical points and points ending an
+	 * airway are resolved before the resolution pass gets to them.
+	 */
+	wpt_t		wpt;
+	bool_t		resolved;
+	bool_t		awy_end;	/* point terminates preceding airway */
+	/* Bearing/distance point: `name' is the reference ident */
+	bool_t		brg_dist;
+	unsigned	brg;
+	unsigned	dist;
+	const navproc_t	*proc;		/* SID or STAR */
+} fpl_elem_t;
+
+/*
+ * Checks that `str' starts with `n' decimal digits.
+ */
+static bool_t
+fpl_is_digits(const char *str, unsigned n)
+{
+	for (unsigned i = 0; i < n; i++) {
+		if (str[i] < '0' || str[i] > '9')
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Converts `n' decimal digits at `str' into a number. The caller must
+ * have checked them using fpl_is_digits.
+ */
+static unsigned
+fpl_digits(const char *str, unsigned n)
+{
+	unsigned val = 0;
+
+	for (unsigned i = 0; i < n; i++)
+		val = val * 10 + (str[i] - '0');
+	return (val);
+}
+
+/*
+ * Checks if `tok' is a cruising speed & level group, e.g. "N0450F350",
+ * "K0830S1130" or "M082F370".
+ */
+static bool_t
+fpl_is_spd_lvl(const char *tok, size_t len)
+{
+	unsigned spd_len, lvl_len;
+
+	switch (tok[0]) {
+	case 'N':
+	case 'K':
+		spd_len = 5;
+		break;
+	case 'M':
+		spd_len = 4;
+		break;
+	default:
+		return (B_FALSE);
+	}
+	if (len <= spd_len || !fpl_is_digits(&tok[1], spd_len - 1))
+		return (B_FALSE);
+	tok += spd_len;
+	len -= spd_len;
+	if (len == 3 && strncmp(tok, "VFR", 3) == 0)
+		return (B_TRUE);
+	switch (tok[0]) {
+	case 'F':
+	case 'A':
+		lvl_len = 4;
+		break;
+	case 'S':
+	case 'M':
+		lvl_len = 5;
+		break;
+	default:
+		return (B_FALSE);
+	}
+	return (len == lvl_len && fpl_is_digits(&tok[1], lvl_len - 1));
+}
+
+/*
+ * Parses an ICAO geographical point, either in whole degrees ("46N078W")
+ * or in degrees & minutes ("4620N07805W"). The point is named in the
+ * same style as FMS-entered coordinates (e.g. "N46W078").
+ */
+static bool_t
+fpl_parse_geo(const char *tok, size_t len, wpt_t *wpt)
+{
+	unsigned	lat_len;
+	const char	*lonstr;
+	char		ns, ew;
+	double		lat, lon;
+
+	if (len == 7)
+		lat_len = 2;
+	else if (len == 11)
+		lat_len = 4;
+	else
+		return (B_FALSE);
+	lonstr = &tok[lat_len + 1];
+	ns = tok[lat_len];
+	ew = tok[len - 1];
+	if (!fpl_is_digits(tok, lat_len) ||
+	    !fpl_is_digits(lonstr, lat_len + 1) ||
+	    (ns != 'N' && ns != 'S') || (ew != 'E' && ew != 'W'))
+		return (B_FALSE);
+
+	lat = fpl_digits(tok, 2);
+	lon = fpl_digits(lonstr, 3);
+	if (lat_len == 4) {
+		unsigned latmin = fpl_digits(&tok[2], 2);
+		unsigned lonmin = fpl_digits(&lonstr[3], 2);
+
+		if (latmin >= 60 || lonmin >= 60)
+			return (B_FALSE);
+		lat += latmin / 60.0;
+		lon += lonmin / 60.0;
 	}
+	if (ns == 'S')
+		lat = -lat;
+	if (ew == 'W')
+		lon = -lon;
+	if (!is_valid_lat(lat) || !is_valid_lon(lon))
+		return (B_FALSE);
 
-#undef	NEXT_OR_HEAD
+	memset(wpt, 0, sizeof (*wpt));
+	(void) snprintf(wpt->name, sizeof (wpt->name), "%c%.2s%c%.3s",
+	    ns, tok, ew, lonstr);
+	wpt->pos = GEO_POS2(lat, lon);
 
-	return (ERR_OK);
+	return (B_TRUE);
 }
 
 /*
- * Deletes the route leg `x_rl' from `route'.
+ * Looks for a procedure named `name' of type `type1' or `type2' (in this
+ * order of preference) at airport `arpt'. Since a filed plan carries no
+ * runway information, runway-specific procedures match on name only.
  */
-void
-route_l_delete(route_t *route, const route_leg_t *x_rl)
+static const navproc_t *
+fpl_find_proc(const airport_t *arpt, navproc_type_t type1,
+    navproc_type_t type2, const char *name)
 {
-	route_leg_t *rl = (route_leg_t *)x_rl;
-	route_leg_group_t *rlg = rl->rlg;
-	route_leg_group_t *rlg2;
-	route_leg_t *prev_rl = list_prev(&rlg->legs, rl);
-	route_leg_t *next_rl = list_next(&rlg->legs, rl);
+	const navproc_t *res = NULL;
 
-	switch (rlg->type) {
-	case ROUTE_LEG_GROUP_TYPE_AIRWAY:
-		if (prev_rl != NULL && next_rl != NULL) {
-			/* Split the airway and insert a disco */
-			awy_split(route, prev_rl->rlg, prev_rl, next_rl,
-			    B_FALSE);
-		} else if (prev_rl != NULL && next_rl == NULL) {
-			/* Shorten the airway from the right */
-			rlg->end_wpt = *leg_get_end_wpt(prev_rl);
-			rlg_update_awy_legs(route, rlg, B_FALSE);
-			rlg2 = rlg_next_ndisc(route, rlg);
-			rlg_connect(route, rlg, rlg2, B_FALSE, B_FALSE);
-		} else if (prev_rl == NULL && next_rl != NULL) {
-			/* Shorten the airway from the left */
-			rlg->start_wpt = *leg_get_end_wpt(rl);
-			rlg_update_awy_legs(route, rlg, B_FALSE);
-			rlg2 = rlg_prev_ndisc(route, rlg);
-			rlg_connect(route, rlg2, rlg, B_FALSE, B_FALSE);
-		} else {
-			/* Get rid of the whole thing */
-			rlg_bypass(route, rl->rlg, B_FALSE, B_FALSE);
+	if (arpt == NULL)
+		return (NULL);
+	for (unsigned i = 0; i < arpt->num_procs; i++) {
+		const navproc_t *proc = &arpt->procs[i];
+
+		if (strcmp(proc->name, name) != 0)
+			continue;
+		if (proc->type == type1)
+			return (proc);
+		if (proc->type == type2 && res == NULL)
+			res = proc;
+	}
+	return (res);
+}
+
+/*
+ * Lexes a single Item 15 token into `elem'.
+ *
+ * @param route The route into which we are ingesting.
+ * @param tok The token string (not NUL-terminated).
+ * @param len Length of the token.
+ * @param prev The previously lexed element, or NULL if this is the first.
+ * @param last Set if this is the last token in the string.
+ *
+ * @return FPL_TOK_ELEM if `elem' has been filled in, FPL_TOK_SKIP if the
+ *	token should be skipped or FPL_TOK_BAD if it is malformed.
+ */
+static fpl_tok_t
+fpl_lex_tok(const route_t *route, const char *tok, size_t len,
+    const fpl_elem_t *prev, bool_t last, fpl_elem_t *elem)
+{
+	const char *slash = memchr(tok, '/', len);
+
+	if ((len == 3 && (strncmp(tok, "DCT", 3) == 0 ||
+	    strncmp(tok, "IFR", 3) == 0 || strncmp(tok, "VFR", 3) == 0 ||
+	    strncmp(tok, "OAT", 3) == 0 || strncmp(tok, "GAT", 3) == 0)) ||
+	    (len > 2 && tok[0] == 'C' && tok[1] == '/'))
+		/* DCT is implied, flight rules & cruise climb are ignored */
+		return (FPL_TOK_SKIP);
+
+	if (slash != NULL) {
+		/* point with a speed/level change */
+		if (!fpl_is_spd_lvl(slash + 1, len - (slash + 1 - tok)))
+			return (FPL_TOK_BAD);
+		len = slash - tok;
+	}
+	if (len == 0)
+		return (FPL_TOK_BAD);
+
+	memset(elem, 0, sizeof (*elem));
+	elem->type = FPL_ELEM_PT;
+	if (fpl_parse_geo(tok, len, &elem->wpt)) {
+		elem->resolved = B_TRUE;
+		return (FPL_TOK_ELEM);
+	}
+	if (len > 6 && len - 6 < NAV_NAME_LEN &&
+	    fpl_is_digits(&tok[len - 6], 6)) {
+		/* bearing/distance from a reference point, e.g. DUB180040 */
+		elem->brg_dist = B_TRUE;
+		elem->brg = fpl_digits(&tok[len - 6], 3);
+		elem->dist = fpl_digits(&tok[len - 3], 3);
+		if (!is_valid_hdg(elem->brg) || elem->dist == 0)
+			return (FPL_TOK_BAD);
+		len -= 6;
+	}
+	if (len >= NAV_NAME_LEN)
+		return (FPL_TOK_BAD);
+	memcpy(elem->name, tok, len);
+	if (elem->brg_dist || slash != NULL)
+		return (FPL_TOK_ELEM);
+
+	if (prev == NULL && route->dep != NULL) {
+		elem->proc = fpl_find_proc(route->dep,
+		    NAVPROC_TYPE_SID_COMMON, NAVPROC_TYPE_SID, elem->name);
+		if (elem->proc != NULL) {
+			elem->type = FPL_ELEM_SID;
+			return (FPL_TOK_ELEM);
 		}
-		break;
-	case ROUTE_LEG_GROUP_TYPE_PROC:
-		/* We're the last one */
-		if (prev_rl == NULL && next_rl == NULL) {
-			rlg_bypass(route, rl->rlg, B_FALSE, B_FALSE);
-		} else if (prev_rl == NULL) {
-			/* First leg, check if we can adjust start_wpt. */
-			wpt_t start_wpt;
+	}
+	if (last && route->arr != NULL) {
+		elem->proc = fpl_find_proc(route->arr,
+		    NAVPROC_TYPE_STAR_COMMON, NAVPROC_TYPE_STAR, elem->name);
+		if (elem->proc != NULL) {
+			elem->type = FPL_ELEM_STAR;
+			return (FPL_TOK_ELEM);
+		}
+	}
+	if (prev != NULL && !last && airway_db_lookup(route->navdb->awydb,
+	    elem->name, NULL, NULL, NULL) != NULL)
+		elem->type = FPL_ELEM_AWY;
 
-			list_remove(&rlg->legs, rl);
-			list_remove(&route->legs, rl);
-			free(rl);
-			start_wpt = rlg_find_start_fix(rlg);
-			if (!IS_NULL_WPT(&start_wpt)) {
-				rlg->start_wpt = start_wpt;
-				rlg_connect_neigh(route, rlg, B_FALSE, B_FALSE);
-			}
-		} else if (next_rl == NULL) {
-			/* Last leg, check if we can adjust end_wpt. */
-			wpt_t end_wpt;
+	return (FPL_TOK_ELEM);
+}
 
-			list_remove(&rlg->legs, rl);
-			list_remove(&route->legs, rl);
-			free(rl);
-			end_wpt = rlg_find_end_wpt(rlg);
-			if (!IS_NULL_WPT(&end_wpt)) {
-				rlg->end_wpt = end_wpt;
-				rlg_connect_neigh(route, rlg, B_FALSE, B_FALSE);
-			}
-		} else {
-			/* Internal delete, just remove it */
-			list_remove(&rlg->legs, rl);
-			list_remove(&route->legs, rl);
-			free(rl);
+/*
+ * Considers `cand' (whose precomputed position vector is `cand_v') as a
+ * resolution candidate for a point. Candidates lying on the airway
+ * following the point win over those that don't, otherwise the candidate
+ * closest to `ref_v' wins.
+ */
+static void
+fpl_pick_cand(const route_t *route, const wpt_t *cand, vect3_t cand_v,
+    const char *next_awy, vect3_t ref_v, wpt_t *best, double *best_d,
+    bool_t *best_on_awy)
+{
+	bool_t	on_awy = (next_awy != NULL && airway_db_wpt_on_awy(
+	    route->navdb->awydb, cand, next_awy));
+	double	d = 0;
+
+	if (!IS_NULL_VECT(ref_v))
+		d = vect3_abs(vect3_sub(ref_v, cand_v));
+	if (IS_NULL_WPT(best) || (on_awy && !*best_on_awy) ||
+	    (on_awy == *best_on_awy && d < *best_d)) {
+		*best = *cand;
+		*best_d = d;
+		*best_on_awy = on_awy;
+	}
+}
+
+/*
+ * Resolves a point element's ident in the waypoint & navaid databases and
+ * fills in the element's `wpt'. For bearing/distance points, the ident is
+ * the reference point from which the result is displaced.
+ *
+ * @param ref Reference position used for disambiguation. Pass
+ *	NULL_GEO_POS2 if unknown, in which case the first match is used.
+ * @param next_awy Name of the airway following the point, or NULL.
+ *
+ * @return B_TRUE if the ident was found, B_FALSE otherwise.
+ */
+static bool_t
+fpl_resolve_pt(const route_t *route, fpl_elem_t *elem, geo_pos2_t ref,
+    const char *next_awy)
+{
+	const char	*name = elem->name;
+	wpt_t		*wpt = &elem->wpt;
+	vect3_t		ref_v = NULL_VECT3;
+	double		best_d = 0;
+	bool_t		best_on_awy = B_FALSE;
+	const list_t	*list;
+
+	if (!IS_NULL_GEO_POS(ref))
+		ref_v = sph2ecef(GEO2_TO_GEO3(ref, 0));
+	*wpt = null_wpt;
+
+	list = htbl_lookup_multi(&route->navdb->wptdb->by_name, name);
+	if (list != NULL) {
+		for (const void *mv = list_head(list); mv != NULL;
+		    mv = list_next(list, mv)) {
+			const wpt_ent_t *ent = HTBL_VALUE_MULTI(mv);
+
+			fpl_pick_cand(route, &ent->wpt, ent->pos_v, next_awy,
+			    ref_v, wpt, &best_d, &best_on_awy);
 		}
-		break;
-	case ROUTE_LEG_GROUP_TYPE_DIRECT:
-		rlg_bypass(route, rl->rlg, B_FALSE, B_FALSE);
-		break;
-	case ROUTE_LEG_GROUP_TYPE_DISCO:
-		ASSERT(list_prev(&route->legs, rl) != NULL &&
-		    list_next(&route->legs, rl) != NULL);
-		rlg_bypass(route, rl->rlg, B_TRUE, B_FALSE);
-		break;
-	default:
-		assert(0);
 	}
-	route->segs_dirty = B_TRUE;
+	list = htbl_lookup_multi(&route->navdb->navaiddb->by_id, name);
+	if (list != NULL) {
+		for (const void *mv = list_head(list); mv != NULL;
+		    mv = list_next(list, mv)) {
+			const navaid_t	*navaid = HTBL_VALUE_MULTI(mv);
+			wpt_t		cand;
+
+			memcpy(cand.name, name, sizeof (cand.name));
+			memcpy(cand.icao_country_code,
+			    navaid->icao_country_code,
+			    sizeof (cand.icao_country_code));
+			cand.pos = GEO3_TO_GEO2(navaid->pos);
+			fpl_pick_cand(route, &cand, navaid->pos_v, next_awy,
+			    ref_v, wpt, &best_d, &best_on_awy);
+		}
+	}
+
+	if (IS_NULL_WPT(wpt))
+		return (B_FALSE);
+	if (elem->brg_dist) {
+		geo_pos2_t pos = geo_displace_mag(&wgs84, route->navdb->wmm,
+		    wpt->pos, elem->brg, NM2MET(elem->dist));
+
+		memset(wpt, 0, sizeof (*wpt));
+		(void) snprintf(wpt->name, sizeof (wpt->name), "%.5s%02u",
+		    name, elem->tok % 100);
+		wpt->pos = pos;
+	}
+	return (B_TRUE);
 }
 
 /*
- * Overrides the leg's navproc seg's altitude constraint with `l'.
+ * Resolution pass: resolves all points and validates all airway segments.
+ * On failure returns the error and sets `*err_elem' to the index of the
+ * offending element.
  */
-void
-route_l_set_alt_lim(route_t *route, const route_leg_t *x_rl, alt_lim_t l)
+static err_t
+fpl_resolve(const route_t *route, fpl_elem_t *elems, unsigned num_elems,
+    unsigned *err_elem)
 {
-	route_leg_t *rl = (route_leg_t *)x_rl;
-	if (!rl->alt_lim_ovrd || memcmp(&rl->alt_lim, &l, sizeof (l)) != 0) {
-		rl->alt_lim = l;
-		rl->alt_lim_ovrd = B_TRUE;
-		route->segs_dirty = B_TRUE;
+	const airway_db_t	*awydb = route->navdb->awydb;
+	const wpt_t		*prev = NULL;
+
+	for (unsigned i = 0; i < num_elems; i++) {
+		fpl_elem_t	*elem = &elems[i];
+		fpl_elem_t	*next = (i + 1 < num_elems ? &elems[i + 1] :
+		    NULL);
+
+		*err_elem = i;
+		switch (elem->type) {
+		case FPL_ELEM_SID:
+			prev = navproc_get_end_wpt(elem->proc);
+			break;
+		case FPL_ELEM_STAR:
+			break;
+		case FPL_ELEM_AWY: {
+			const wpt_t *endfix;
+
+			if (prev == NULL || IS_NULL_WPT(prev) || next == NULL)
+				return (ERR_AWY_WPT_MISMATCH);
+			*err_elem = i + 1;
+			if (next->type == FPL_ELEM_AWY) {
+				/* AWY -> AWY, leave at the intersection */
+				endfix = airway_db_lookup_awy_intersection(
+				    awydb, elem->name, prev->name, next->name);
+				if (endfix == NULL)
+					return (ERR_AWY_AWY_MISMATCH);
+			} else if (next->type != FPL_ELEM_PT ||
+			    next->brg_dist || airway_db_lookup(awydb,
+			    elem->name, prev, next->wpt.name[0] != 0 ?
+			    next->wpt.name : next->name, &endfix) == NULL) {
+				return (ERR_AWY_WPT_MISMATCH);
+			} else {
+				next->wpt = *endfix;
+				next->resolved = B_TRUE;
+				next->awy_end = B_TRUE;
+			}
+			elem->wpt = *endfix;
+			prev = &elem->wpt;
+			break;
+		}
+		case FPL_ELEM_PT:
+			if (!elem->resolved) {
+				geo_pos2_t ref = NULL_GEO_POS2;
+
+				if (prev != NULL && !IS_NULL_WPT(prev))
+					ref = prev->pos;
+				else if (route->dep != NULL)
+					ref = GEO3_TO_GEO2(route->dep->refpt);
+				if (!fpl_resolve_pt(route, elem, ref,
+				    next != NULL && next->type ==
+				    FPL_ELEM_AWY ? next->name : NULL))
+					return (ERR_NOT_IN_DATABASE);
+				elem->resolved = B_TRUE;
+			}
+			prev = &elem->wpt;
+			break;
+		}
 	}
+
+	return (ERR_OK);
 }
 
 /*
- * Returns the active alt constraint on the route leg. If the route leg has
- * no overriding constraint, the leg's navproc seg's constraint is returned.
+ * Returns the leg group after which enroute elements should be appended,
+ * i.e. the last leg group which isn't part of the arrival.
  */
-alt_lim_t route_l_get_alt_lim(const route_leg_t *rl)
+static route_leg_group_t *
+fpl_enroute_tail(route_t *route)
 {
-	if (rl->alt_lim_ovrd)
-		return (rl->alt_lim);
-	else
-		return (rl->seg.alt_lim);
+	route_leg_group_t *rlg;
+
+	for (rlg = list_tail(&route->leg_groups); rlg != NULL;
+	    rlg = list_prev(&route->leg_groups, rlg)) {
+		if (rlg->type != ROUTE_LEG_GROUP_TYPE_DISCO &&
+		    (rlg->type != ROUTE_LEG_GROUP_TYPE_PROC ||
+		    rlg->proc->type < NAVPROC_TYPE_STAR))
+			break;
+	}
+	return (rlg);
 }
 
 /*
- * Overrides the leg's navproc seg's speed constraint with `l'.
+ * Construction pass: appends the resolved elements to the route.
  */
-void
-route_l_set_spd_lim(route_t *route, const route_leg_t *x_rl, spd_lim_t l)
+static err_t
+fpl_build(route_t *route, const fpl_elem_t *elems, unsigned num_elems,
+    unsigned *err_elem)
 {
-	route_leg_t *rl = (route_leg_t *)x_rl;
-	if (!rl->spd_lim_ovrd || memcmp(&rl->spd_lim, &l, sizeof (l)) != 0) {
-		rl->spd_lim = l;
-		rl->spd_lim_ovrd = B_TRUE;
-		route->segs_dirty = B_TRUE;
+	const route_leg_group_t	*rlg = fpl_enroute_tail(route);
+	err_t			err = ERR_OK;
+
+	for (unsigned i = 0; i < num_elems && err == ERR_OK; i++) {
+		const fpl_elem_t *elem = &elems[i];
+
+		*err_elem = i;
+		switch (elem->type) {
+		case FPL_ELEM_SID:
+			if (route->dep_rwy != NULL) {
+				err = route_set_sid(route, elem->name);
+				rlg = fpl_enroute_tail(route);
+			} else if (i + 1 < num_elems &&
+			    elems[i + 1].type == FPL_ELEM_AWY) {
+				/*
+				 * Without a runway we can't insert the SID
+				 * yet, but the airway still needs a place to
+				 * start from.
+				 */
+				err = route_lg_direct_insert(route,
+				    navproc_get_end_wpt(elem->proc), rlg,
+				    &rlg);
+			}
+			break;
+		case FPL_ELEM_STAR:
+			err = route_set_star(route, elem->name);
+			break;
+		case FPL_ELEM_AWY:
+			err = route_lg_awy_insert(route, elem->name, rlg, &rlg);
+			/* AWY -> AWY gets connected at the intersection */
+			if (err == ERR_OK && elems[i + 1].type == FPL_ELEM_PT) {
+				ASSERT(elems[i + 1].awy_end);
+				err = route_lg_awy_set_end_fix(route, rlg,
+				    elem->wpt.name);
+				i++;
+			}
+			break;
+		case FPL_ELEM_PT:
+			ASSERT(!elem->awy_end);
+			/* the first point after a SID is usually its end fix */
+			if (rlg != NULL && WPT_EQ(&rlg->end_wpt, &elem->wpt))
+				break;
+			err = route_lg_direct_insert(route, &elem->wpt, rlg,
+			    &rlg);
+			break;
+		}
 	}
+
+	return (err);
 }
 
 /*
- * Returns the active speed constraint on the route leg. If the route leg has
- * no overriding constraint, the leg's navproc seg's constraint is returned.
+ * Builds the enroute portion of a route from an ICAO flight plan Item 15
+ * route string, e.g. "N0450F350 MERIT J60 PSB DCT 4050N07000W". The
+ * elements are appended after any existing enroute leg groups & ahead of
+ * any arrival procedures. Set the departure & arrival airports first, as
+ * SID & STAR designators are only recognized against them. A SID is only
+ * inserted if the departure runway has already been selected (filed plans
+ * carry none). After a successful return, the route is ready for
+ * route_update.
+ *
+ * @param route The route to append to.
+ * @param item15 The Item 15 string. The leading cruising speed & level
+ *	group is optional.
+ * @param err_tok If not NULL and an error occurs, filled with the index
+ *	of the offending whitespace-separated token in `item15'.
+ *
+ * @return ERR_OK on success or an error code otherwise. Lexing and
+ *	resolution errors leave the route untouched. An error from one of
+ *	the route editing functions during construction can leave the
+ *	route partially built.
  */
-spd_lim_t
-route_l_get_spd_lim(const route_leg_t *rl)
+err_t
+route_fpl_ingest(route_t *route, const char *item15, unsigned *err_tok)
 {
-	if (rl->spd_lim_ovrd)
-		return (rl->spd_lim);
-	else
-		return (rl->seg.spd_lim);
+	fpl_elem_t	*elems;
+	unsigned	num_elems = 0, num_toks = 0, err_elem = 0;
+	err_t		err = ERR_OK;
+
+	/* every token is at least 1 char long plus a separator */
+	elems = malloc((strlen(item15) / 2 + 1) * sizeof (*elems));
+
+	for (const char *p = item15 + strspn(item15, " \t\r\n"); *p != 0;
+	    p += strspn(p, " \t\r\n"), num_toks++) {
+		size_t	len = strcspn(p, " \t\r\n");
+		bool_t	last = (p[len + strspn(&p[len], " \t\r\n")] == 0);
+		const fpl_elem_t *prev = (num_elems > 0 ?
+		    &elems[num_elems - 1] : NULL);
+
+		if (num_toks == 0 && fpl_is_spd_lvl(p, len)) {
+			p += len;
+			continue;
+		}
+		if (len == 1 && p[0] == 'T')
+			/* truncation indicator, the rest isn't for us */
+			break;
+		switch (fpl_lex_tok(route, p, len, prev, last,
+		    &elems[num_elems])) {
+		case FPL_TOK_ELEM:
+			elems[num_elems].tok = num_toks;
+			num_elems++;
+			break;
+		case FPL_TOK_SKIP:
+			break;
+		case FPL_TOK_BAD:
+			if (err_tok != NULL)
+				*err_tok = num_toks;
+			err = ERR_INVALID_ENTRY;
+			goto out;
+		}
+		p += len;
+	}
+
+	err = fpl_resolve(route, elems, num_elems, &err_elem);
+	if (err == ERR_OK)
+		err = fpl_build(route, elems, num_elems, &err_elem);
+	if (err != ERR_OK && err_tok != NULL)
+		*err_tok = elems[err_elem].tok;
+out:
+	free(elems);
+	return (err);
 }
 
 /*
@@ -3709,13 +7852,14 @@ calc_arc_radius(double speed, double turn_rate)
 	return (((360 / turn_rate) * KT2MPS(speed)) / (2 * M_PI));
 }
 
-static route_seg_t *rs_join_dir_reintcp_trk(list_t *seglist, route_seg_t *rs1,
-    route_seg_t *rs2, const fpp_t *fpp, double r, double rnp, vect2_t p1,
-    vect2_t p2, vect2_t p3, vect2_t leg1_dir, vect2_t leg2, double rhdg,
+static route_seg_t *rs_join_dir_reintcp_trk(route_pool_t *pool,
+    list_t *seglist, route_seg_t *rs1, route_seg_t *rs2, const fpp_t *fpp,
+    double r, double rnp, vect2_t p1, vect2_t p2, vect2_t p3,
+    vect2_t leg1_dir, vect2_t leg2, double rhdg, bool_t cw);
+static route_seg_t *rs_join_dir_reintcp_dir(route_pool_t *pool,
+    list_t *seglist, route_seg_t *rs1, route_seg_t *rs2, const fpp_t *fpp,
+    double r, double rnp, vect2_t p1, vect2_t p2, vect2_t p3, double rhdg,
     bool_t cw);
-static route_seg_t *rs_join_dir_reintcp_dir(list_t *seglist, route_seg_t *rs1,
-    route_seg_t *rs2, const fpp_t *fpp, double r, double rnp, vect2_t p1,
-    vect2_t p2, vect2_t p3, double rhdg, bool_t cw);
 
 static bool_t
 point_is_on_arc(vect2_t p, vect2_t c, vect2_t s, vect2_t e, bool_t cw)
@@ -3794,13 +7938,13 @@ point_is_on_arc(vect2_t p, vect2_t c, vect2_t s, vect2_t e, bool_t cw)
  *	rejoins rs2's track, or a direct-to-join.
  */
 static route_seg_t *
-rs_join_dir(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
-    double r, double rnp, bool_t follow_track)
+rs_join_dir(route_pool_t *pool, list_t *seglist, route_seg_t *rs1,
+    route_seg_t *rs2, double r, double rnp, bool_t follow_track)
 {
 	vect2_t p1, p2, p3, leg1_dir, leg2, dp1, dp2, c, i1, i2, p2_i2;
 	double rhdg, p2_i2_len, leg2_len;
 	geo_pos2_t i1_pos, i2_pos, c_pos;
-	route_seg_t *rs_arc;
+	route_seg_t *rs_arc, *rs;
 	fpp_t fpp;
 
 	ASSERT(list_next(seglist, rs1) == rs2);
@@ -3919,7 +8063,7 @@ rs_join_dir(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 	c_pos = fpp2geo(c, &fpp);
 
 	/* Create new arc segment to join them and insert it */
-	rs_arc = rs_new_arc(i1_pos, i2_pos, c_pos, rhdg >= 0,
+	rs_arc = rs_new_arc(pool, i1_pos, i2_pos, c_pos, rhdg >= 0,
 	    ROUTE_SEG_JOIN_SIMPLE);
 	list_insert_after(seglist, rs1, rs_arc);
 
@@ -3934,12 +8078,18 @@ rs_join_dir(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 
 	return (rs1);
 reintcp:
-	if (follow_track)
-		return (rs_join_dir_reintcp_trk(seglist, rs1, rs2, &fpp, r, rnp,
-		    p1, p2, p3, leg1_dir, leg2, rhdg, rhdg >= 0));
-	else
-		return (rs_join_dir_reintcp_dir(seglist, rs1, rs2, &fpp, r, rnp,
-		    p1, p2, p3, rhdg, rhdg >= 0));
+	if (follow_track) {
+		PROF_START(t0);
+		rs = rs_join_dir_reintcp_trk(pool, seglist, rs1, rs2, &fpp,
+		    r, rnp, p1, p2, p3, leg1_dir, leg2, rhdg, rhdg >= 0);
+		PROF_END(ROUTE_PROF_JOIN_REINTCP_TRK, t0);
+	} else {
+		PROF_START(t0);
+		rs = rs_join_dir_reintcp_dir(pool, seglist, rs1, rs2, &fpp,
+		    r, rnp, p1, p2, p3, rhdg, rhdg >= 0);
+		PROF_END(ROUTE_PROF_JOIN_REINTCP_DIR, t0);
+	}
+	return (rs);
 }
 
 /*
@@ -3949,9 +8099,10 @@ reintcp:
  * of rs_join_dir.
  */
 static route_seg_t *
-rs_join_dir_reintcp_trk(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
-    const fpp_t *fpp, double r, double rnp, vect2_t p1, vect2_t p2, vect2_t p3,
-    vect2_t leg1_dir, vect2_t leg2, double rhdg, bool_t cw)
+rs_join_dir_reintcp_trk(route_pool_t *pool, list_t *seglist, route_seg_t *rs1,
+    route_seg_t *rs2, const fpp_t *fpp, double r, double rnp, vect2_t p1,
+    vect2_t p2, vect2_t p3, vect2_t leg1_dir, vect2_t leg2, double rhdg,
+    bool_t cw)
 {
 	vect2_t i1, c1, t, t_i2_dir, i2, c1_t;
 	double leg2_len, p2_c_len, p2_i1_len, smooth_len;
@@ -4056,10 +8207,11 @@ rs_join_dir_reintcp_trk(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 		i4_pos = fpp2geo(i4, fpp);
 		c3_pos = fpp2geo(c3, fpp);
 
-		rs_arc1 = rs_new_arc(i1_pos, t_pos, c1_pos, cw,
+		rs_arc1 = rs_new_arc(pool, i1_pos, t_pos, c1_pos, cw,
 		    ROUTE_SEG_JOIN_SIMPLE);
-		rs_dir = rs_new_direct(t_pos, i3_pos, ROUTE_SEG_JOIN_SIMPLE);
-		rs_arc2 = rs_new_arc(i3_pos, i4_pos, c3_pos, !cw,
+		rs_dir = rs_new_direct(pool, t_pos, i3_pos,
+		    ROUTE_SEG_JOIN_SIMPLE);
+		rs_arc2 = rs_new_arc(pool, i3_pos, i4_pos, c3_pos, !cw,
 		    ROUTE_SEG_JOIN_SIMPLE);
 
 		list_insert_after(seglist, rs1, rs_arc1);
@@ -4081,9 +8233,9 @@ rs_join_dir_reintcp_trk(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 			 * we can't reintcp from there, no help.
 			 */
 			if (rnp != 0) {
-				return (rs_join_dir_reintcp_trk(seglist, rs1,
-				    rs2, fpp, r, 0, p1, p2, p3, leg1_dir, leg2,
-				    rhdg, cw));
+				return (rs_join_dir_reintcp_trk(pool, seglist,
+				    rs1, rs2, fpp, r, 0, p1, p2, p3, leg1_dir,
+				    leg2, rhdg, cw));
 			} else {
 				goto errout;
 			}
@@ -4102,9 +8254,9 @@ rs_join_dir_reintcp_trk(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 			t2_pos = fpp2geo(t2, fpp);
 			t3_pos = fpp2geo(t3, fpp);
 
-			rs_arc1 = rs_new_arc(i1_pos, t2_pos, c1_pos, cw,
+			rs_arc1 = rs_new_arc(pool, i1_pos, t2_pos, c1_pos, cw,
 			    ROUTE_SEG_JOIN_SIMPLE);
-			rs_arc2 = rs_new_arc(t2_pos, t3_pos, c2_pos, !cw,
+			rs_arc2 = rs_new_arc(pool, t2_pos, t3_pos, c2_pos, !cw,
 			    ROUTE_SEG_JOIN_SIMPLE);
 
 			list_insert_after(seglist, rs1, rs_arc1);
@@ -4134,7 +8286,7 @@ rs_join_dir_reintcp_trk(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 
 			t2_pos = fpp2geo(t2, fpp);
 			t3_pos = fpp2geo(t3, fpp);
-			rs_arc1 = rs_new_arc(i1_pos, t2_pos, c1_pos, cw,
+			rs_arc1 = rs_new_arc(pool, i1_pos, t2_pos, c1_pos, cw,
 			    ROUTE_SEG_JOIN_SIMPLE);
 			list_insert_after(seglist, rs1, rs_arc1);
 
@@ -4142,13 +8294,13 @@ rs_join_dir_reintcp_trk(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 				rs2->direct.start = t2_pos;
 			} else {
 				list_remove(seglist, rs2);
-				free(rs2);
+				rs_destroy(pool, rs2);
 			}
 		}
 	}
 	if (rs1_remove) {
 		list_remove(seglist, rs1);
-		free(rs1);
+		rs_destroy(pool, rs1);
 		rs1 = rs_arc1;
 	} else {
 		if (rs1->type == ROUTE_SEG_TYPE_DIRECT)
@@ -4169,9 +8321,9 @@ errout:
  * For a description of the arguments, see the internals of rs_join_dir.
  */
 static route_seg_t *
-rs_join_dir_reintcp_dir(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
-    const fpp_t *fpp, double r, double rnp, vect2_t p1, vect2_t p2, vect2_t p3,
-    double rhdg, bool_t cw)
+rs_join_dir_reintcp_dir(route_pool_t *pool, list_t *seglist, route_seg_t *rs1,
+    route_seg_t *rs2, const fpp_t *fpp, double r, double rnp, vect2_t p1,
+    vect2_t p2, vect2_t p3, double rhdg, bool_t cw)
 {
 	vect2_t c, i1, i2, vs[2], p3_c;
 	double p3_c_dist;
@@ -4242,7 +8394,7 @@ rs_join_dir_reintcp_dir(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 		goto errout;
 	} else if (p3_c_dist == r) {
 		list_remove(seglist, rs2);
-		free(rs2);
+		rs_destroy(pool, rs2);
 		rs2 = NULL;
 		i2 = p3;
 	} else {
@@ -4259,12 +8411,13 @@ rs_join_dir_reintcp_dir(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 	i1_pos = fpp2geo(i1, fpp);
 	c_pos = fpp2geo(c, fpp);
 	i2_pos = fpp2geo(i2, fpp);
-	rs_arc = rs_new_arc(i1_pos, i2_pos, c_pos, cw, ROUTE_SEG_JOIN_SIMPLE);
+	rs_arc = rs_new_arc(pool, i1_pos, i2_pos, c_pos, cw,
+	    ROUTE_SEG_JOIN_SIMPLE);
 	list_insert_after(seglist, rs1, rs_arc);
 
 	if (rs1_remove) {
 		list_remove(seglist, rs1);
-		free(rs1);
+		rs_destroy(pool, rs1);
 		rs1 = rs_arc;
 	} else {
 		if (rs1->type == ROUTE_SEG_TYPE_DIRECT) {
@@ -4328,8 +8481,8 @@ rs_join_arc_find_c1_i1(const fpp_t *fpp, vect2_t p1, vect2_t p2, double r,
 }
 
 static route_seg_t *
-rs_join_arc(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
-    double r, double rnp)
+rs_join_arc(route_pool_t *pool, list_t *seglist, route_seg_t *rs1,
+    route_seg_t *rs2, double r, double rnp)
 {
 	fpp_t fpp;
 	vect2_t leg1_dir, p1, p2, p3, c, c1, i1, vs[2];
@@ -4542,8 +8695,8 @@ rs_join_arc(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 		i1_pos = fpp2geo(i1, &fpp);
 		i2_pos = fpp2geo(i2, &fpp);
 		c1_pos = fpp2geo(c1, &fpp);
-		rs_arc1 = rs_new_arc(i1_pos, i2_pos, c1_pos, outer ? !cw : cw,
-		    ROUTE_SEG_JOIN_SIMPLE);
+		rs_arc1 = rs_new_arc(pool, i1_pos, i2_pos, c1_pos,
+		    outer ? !cw : cw, ROUTE_SEG_JOIN_SIMPLE);
 
 		list_insert_after(seglist, rs1, rs_arc1);
 		rs2->arc.start = i2_pos;
@@ -4631,10 +8784,10 @@ rs_join_arc(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 		c1_pos = fpp2geo(c1, &fpp);
 		c2_pos = fpp2geo(c2, &fpp);
 
-		rs_arc1 = rs_new_arc(i1_pos, i4_pos, c1_pos, outer ? !cw : cw,
-		    ROUTE_SEG_JOIN_SIMPLE);
-		rs_arc2 = rs_new_arc(i4_pos, i5_pos, c2_pos, outer ? cw : !cw,
-		    ROUTE_SEG_JOIN_SIMPLE);
+		rs_arc1 = rs_new_arc(pool, i1_pos, i4_pos, c1_pos,
+		    outer ? !cw : cw, ROUTE_SEG_JOIN_SIMPLE);
+		rs_arc2 = rs_new_arc(pool, i4_pos, i5_pos, c2_pos,
+		    outer ? cw : !cw, ROUTE_SEG_JOIN_SIMPLE);
 		list_insert_after(seglist, rs1, rs_arc1);
 		list_insert_after(seglist, rs_arc1, rs_arc2);
 
@@ -4645,7 +8798,7 @@ rs_join_arc(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
 
 	if (rs1_remove) {
 		list_remove(seglist, rs1);
-		free(rs1);
+		rs_destroy(pool, rs1);
 		rs1 = rs_arc1;
 	} else {
 		if (rs1->type == ROUTE_SEG_TYPE_DIRECT)
@@ -4661,6 +8814,37 @@ errout:
 	return (rs1);
 }
 
+/*
+ * Implementation of route_seg_join. Segments added to or removed from
+ * `seglist' are allocated from/returned to `pool' (NULL means malloc).
+ */
+static route_seg_t *
+rs_join(route_pool_t *pool, list_t *seglist, route_seg_t *rs1,
+    route_seg_t *rs2, double wpt_rnp, double spd, double turn_rate)
+{
+	double		r;
+	route_seg_t	*rs;
+
+	ASSERT(list_next(seglist, rs1) == rs2);
+
+	if (rs1->join_type == ROUTE_SEG_JOIN_SIMPLE)
+		return (rs1);
+	r = calc_arc_radius(spd, turn_rate);
+
+	if (rs2->type == ROUTE_SEG_TYPE_DIRECT) {
+		PROF_START(t0);
+		rs = rs_join_dir(pool, seglist, rs1, rs2, r, wpt_rnp,
+		    rs1->join_type == ROUTE_SEG_JOIN_TRACK);
+		PROF_END(ROUTE_PROF_JOIN_DIR, t0);
+	} else {
+		PROF_START(t0);
+		rs = rs_join_arc(pool, seglist, rs1, rs2, r, wpt_rnp);
+		PROF_END(ROUTE_PROF_JOIN_ARC, t0);
+	}
+
+	return (rs);
+}
+
 /*
  * Creates a smooth joint between two route segments. The joint type is
  * determined by the type of each route segment and the first segment's
@@ -4676,29 +8860,18 @@ route_seg_t *
 route_seg_join(list_t *seglist, route_seg_t *rs1, route_seg_t *rs2,
     double wpt_rnp, double spd, double turn_rate)
 {
-	double		r;
-
-	ASSERT(list_next(seglist, rs1) == rs2);
-
-	if (rs1->join_type == ROUTE_SEG_JOIN_SIMPLE)
-		return (rs1);
-	r = calc_arc_radius(spd, turn_rate);
-
-	if (rs2->type == ROUTE_SEG_TYPE_DIRECT) {
-		return (rs_join_dir(seglist, rs1, rs2, r, wpt_rnp,
-		    rs1->join_type == ROUTE_SEG_JOIN_TRACK));
-	} else {
-		return (rs_join_arc(seglist, rs1, rs2, r, wpt_rnp));
-	}
+	return (rs_join(NULL, seglist, rs1, rs2, wpt_rnp, spd, turn_rate));
 }
 
 /*
- * Constructs a new ROUTE_SEG_TYPE_DIRECT route segment and returns it.
+ * Constructs a new ROUTE_SEG_TYPE_DIRECT route segment from `pool' and
+ * returns it.
  */
 static route_seg_t *
-rs_new_direct(geo_pos2_t start, geo_pos2_t end, route_seg_join_type_t join_type)
+rs_new_direct(route_pool_t *pool, geo_pos2_t start, geo_pos2_t end,
+    route_seg_join_type_t join_type)
 {
-	route_seg_t *rs = calloc(sizeof (*rs), 1);
+	route_seg_t *rs = route_pool_alloc(pool, sizeof (*rs));
 
 	rs->type = ROUTE_SEG_TYPE_DIRECT;
 	rs->direct.start = start;
@@ -4709,13 +8882,14 @@ rs_new_direct(geo_pos2_t start, geo_pos2_t end, route_seg_join_type_t join_type)
 }
 
 /*
- * Constructs a new ROUTE_SEG_TYPE_ARC route segment and returns it.
+ * Constructs a new ROUTE_SEG_TYPE_ARC route segment from `pool' and
+ * returns it.
  */
 static route_seg_t *
-rs_new_arc(geo_pos2_t start, geo_pos2_t end, geo_pos2_t center, bool_t cw,
-    route_seg_join_type_t join_type)
+rs_new_arc(route_pool_t *pool, geo_pos2_t start, geo_pos2_t end,
+    geo_pos2_t center, bool_t cw, route_seg_join_type_t join_type)
 {
-	route_seg_t *rs = calloc(sizeof (*rs), 1);
+	route_seg_t *rs = route_pool_alloc(pool, sizeof (*rs));
 
 	rs->type = ROUTE_SEG_TYPE_ARC;
 	rs->arc.start = start;
@@ -32,8 +32,11 @@
 #include "airac.h"
 #include "err.h"
 #include "perf.h"
+#include "wx.h"
 
 typedef struct route_s route_t;
+typedef struct route_cache_s route_cache_t;
+typedef struct route_join_cache_s route_join_cache_t;
 
 typedef enum {
 	ROUTE_LEG_GROUP_TYPE_AIRWAY,
@@ -43,6 +46,65 @@ typedef enum {
 	ROUTE_LEG_GROUP_TYPES
 } route_leg_group_type_t;
 
+/*
+ * Route segments are actual individual pieces of a route that consititute
+ * a single maneuver.
+ */
+typedef enum {
+	ROUTE_SEG_TYPE_DIRECT,
+	ROUTE_SEG_TYPE_ARC,
+	ROUTE_SEG_TYPES
+} route_seg_type_t;
+
+typedef enum {
+	ROUTE_SEG_JOIN_SIMPLE,
+	ROUTE_SEG_JOIN_TRACK,
+	ROUTE_SEG_JOIN_DIRECT,
+	ROUTE_SEG_JOIN_TYPES
+} route_seg_join_type_t;
+
+typedef struct {
+	route_seg_type_t		type;
+	union {
+		struct {
+			geo_pos2_t	start;
+			geo_pos2_t	end;
+		} direct;
+		struct {
+			geo_pos2_t	start;
+			geo_pos2_t	end;
+			geo_pos2_t	center;
+			bool_t		cw;
+		} arc;
+	};
+	route_seg_join_type_t		join_type;
+	list_node_t			route_segs_node;
+	/*
+	 * Segments computed by route_update are immutable and shared by
+	 * reference between a route, its copies and the route cache. A
+	 * shared segment always sits at the same position in all of the
+	 * routes holding it, so its position in the route (`idx') and the
+	 * along-track distance from the start of the route to its start
+	 * (`dist', see route_seg_get_dist) are the same for all of them.
+	 */
+	unsigned			refcnt;
+	unsigned			idx;
+	double				dist;
+} route_seg_t;
+
+/*
+ * Free list of same-sized route objects. A route keeps one each for its
+ * leg groups, legs, leg data, checkpoints and segments, so that the objects
+ * freed by an edit or route_update are reused by the next one instead of
+ * going back to malloc.
+ */
+typedef struct {
+	void		*free;		/* linked via the objects' 1st word */
+	unsigned	num_free;
+	uint64_t	num_alloc;	/* objects handed out */
+	uint64_t	num_malloc;	/* ... of which had to be malloc'd */
+} route_pool_t;
+
 /*
  * Leg groups are very high level route elements that encapsulate several
  * route legs, an entire procedure or just even a single DIRECT-TO leg. This
@@ -59,11 +121,17 @@ typedef struct {
 	wpt_t			end_wpt;
 	list_t			legs;
 
+	unsigned		idx;	/* see route_lg_get_idx */
 	list_node_t		route_leg_groups_node;
 } route_leg_group_t;
 
+/*
+ * What a route leg flies. This is shared by reference between a route and
+ * its copies and is immutable while shared: a route about to modify it
+ * takes a private copy first (see rl_own).
+ */
 typedef struct {
-	bool_t			disco;
+	unsigned		refcnt;
 	navproc_seg_t		seg;
 
 	bool_t			alt_lim_ovrd;
@@ -74,48 +142,52 @@ typedef struct {
 
 	double			alt_est;
 	double			spd_est;
+} route_leg_data_t;
 
+/*
+ * Layout of a leg's hold or procedure turn as of the last route_update,
+ * along with what it was laid out for (see rl_pat_lookup). Shared and
+ * immutable like route_leg_data_t.
+ */
+typedef struct {
+	unsigned		refcnt;
+	bool_t			valid;
+	navproc_seg_type_t	type;
+	geo_pos2_t		fix;
+	double			crs;
+	double			len;
+	bool_t			turn_right;
+	double			spd;
+	double			turn_rate;
+	bool_t			ok;	/* proc turn fits its limits */
+	geo_pos2_t		pts[5];
+} route_leg_pat_t;
+
+/* route_update checkpoint of a leg, private to route.c */
+typedef struct route_leg_upd_s route_leg_upd_t;
+
+/*
+ * A leg of a route. The leg itself only places the leg in its route, what
+ * the leg flies and what route_update made of it is shared with the
+ * route's copies.
+ */
+typedef struct route_leg_s {
+	bool_t			disco;
+	route_leg_data_t	*data;
 	route_leg_group_t	*rlg;
+	/* NULL if the leg has no hold or procedure turn laid out */
+	route_leg_pat_t		*pat;
+	/*
+	 * route_update state on entry to this leg. NULL if route_update
+	 * can't resume here, see rl_dirty.
+	 */
+	route_leg_upd_t		*upd;
 
+	unsigned		idx;	/* see route_l_get_idx */
 	list_node_t		leg_group_legs_node;
 	list_node_t		route_legs_node;
 } route_leg_t;
 
-/*
- * Route segments are actual individual pieces of a route that consititute
- * a single maneuver.
- */
-typedef enum {
-	ROUTE_SEG_TYPE_DIRECT,
-	ROUTE_SEG_TYPE_ARC,
-	ROUTE_SEG_TYPES
-} route_seg_type_t;
-
-typedef enum {
-	ROUTE_SEG_JOIN_SIMPLE,
-	ROUTE_SEG_JOIN_TRACK,
-	ROUTE_SEG_JOIN_DIRECT,
-	ROUTE_SEG_JOIN_TYPES
-} route_seg_join_type_t;
-
-typedef struct {
-	route_seg_type_t		type;
-	union {
-		struct {
-			geo_pos2_t	start;
-			geo_pos2_t	end;
-		} direct;
-		struct {
-			geo_pos2_t	start;
-			geo_pos2_t	end;
-			geo_pos2_t	center;
-			bool_t		cw;
-		} arc;
-	};
-	route_seg_join_type_t		join_type;
-	list_node_t			route_segs_node;
-} route_seg_t;
-
 struct route_s {
 	const fms_navdb_t	*navdb;
 
@@ -162,10 +234,98 @@ struct route_s {
 	list_t			leg_groups;
 	list_t			legs;
 
+	/* Segments computed by route_update, see route_get_seg */
 	bool_t			segs_dirty;
-	list_t			segs;
+	route_seg_t		**segs;
+	unsigned		num_segs;
+	unsigned		segs_cap;
+	double			segs_dist;	/* see route_get_dist */
+
+	/* Inputs & result of the last route_update */
+	const acft_perf_t	*upd_acft;
+	flt_perf_t		upd_flt;
+	geo_pos3_t		upd_start_pos;
+	double			upd_start_hdg;
+	err_t			upd_err;
+	unsigned		upd_err_rl;	/* leg index + 1, 0 if none */
+	/* see route_set_update_threads */
+	unsigned		upd_threads;
+	/* see route_set_cache */
+	route_cache_t		*cache;
+	/* see rs_join_memo */
+	route_join_cache_t	*join_cache;
+	/* see route_set_wx */
+	const wx_t		*wx;
+	double			wx_time;
+
+	/*
+	 * Positional index of `leg_groups' & `legs', see route_get_leg.
+	 * Kept in sync with the lists by the insert & remove paths.
+	 */
+	route_leg_group_t	**rlg_idx;
+	size_t			num_rlg_idx;
+	size_t			rlg_idx_cap;
+	route_leg_t		**rl_idx;
+	size_t			num_rl_idx;
+	size_t			rl_idx_cap;
+
+	/* Recycled route objects, see route_pool_alloc */
+	route_pool_t		rlg_pool;
+	route_pool_t		rl_pool;
+	route_pool_t		rld_pool;
+	route_pool_t		upd_pool;
+	route_pool_t		rs_pool;
 };
 
+/*
+ * A route to compute using route_batch_compute. `dep', `arr' and `item15'
+ * may be NULL to leave the respective part of the route empty.
+ */
+typedef struct {
+	const char		*dep;		/* departure airport ICAO */
+	const char		*arr;		/* arrival airport ICAO */
+	const char		*item15;	/* see route_fpl_ingest */
+	const acft_perf_t	*acft;
+	const flt_perf_t	*flt;
+} route_batch_spec_t;
+
+typedef struct {
+	route_t			*route;
+	err_t			err;
+	unsigned		err_tok;	/* see route_fpl_ingest */
+	route_leg_t		*err_rl;	/* see route_update */
+} route_batch_res_t;
+
+typedef struct {
+	uint64_t		hits;
+	uint64_t		misses;
+	uint64_t		evictions;
+	size_t			num_entries;
+} route_cache_stats_t;
+
+/*
+ * Counters of route_update profiling, see route_prof_enable. The leg
+ * handler counters follow ROUTE_PROF_LEG, one per navproc_seg_type_t.
+ */
+typedef enum {
+	ROUTE_PROF_JOIN_DIR,		/* rs_join_dir, incl. reintercepts */
+	ROUTE_PROF_JOIN_REINTCP_TRK,
+	ROUTE_PROF_JOIN_REINTCP_DIR,
+	ROUTE_PROF_JOIN_ARC,
+	ROUTE_PROF_WMM,			/* wmm_true2mag & wmm_mag2true */
+	ROUTE_PROF_GEO_DISPLACE_MAG,
+	ROUTE_PROF_GC_DISTANCE,
+	ROUTE_PROF_FPP_INIT,
+	ROUTE_PROF_ACCELCLB2DIST,
+	ROUTE_PROF_LEG,
+	ROUTE_PROF_NUM_CTRS = ROUTE_PROF_LEG + NAVPROC_SEG_TYPES
+} route_prof_ctr_t;
+
+typedef struct {
+	uint64_t		count;
+	uint64_t		ns;	/* cumulative, incl. nested counters */
+} route_prof_stat_t;
+
 /* Constructor/destructor */
 route_t *route_create(const fms_navdb_t *navdb);
 void route_destroy(route_t *route);
@@ -176,7 +336,39 @@ void route_destroy(route_t *route);
 err_t route_update(route_t *route, const acft_perf_t *acft,
     const flt_perf_t *flt, route_leg_t **err_rl);
 bool_t route_update_needed(const route_t *route);
+void route_set_update_threads(route_t *route, unsigned num_threads);
 route_t *route_copy(const route_t *route);
+void *route_serialize(const route_t *route, bool_t with_segs, size_t *len);
+route_t *route_deserialize(const fms_navdb_t *navdb, const acft_perf_t *acft,
+    const void *buf, size_t len, err_t *err);
+size_t route_batch_compute(const fms_navdb_t *navdb,
+    const route_batch_spec_t *specs, route_batch_res_t *res, size_t num_specs,
+    unsigned num_threads);
+unsigned route_num_cpus(void);
+
+/*
+ * Caching route_update results
+ */
+route_cache_t *route_cache_create(size_t max_entries);
+void route_cache_destroy(route_cache_t *cache);
+route_cache_stats_t route_cache_get_stats(route_cache_t *cache);
+void route_set_cache(route_t *route, route_cache_t *cache);
+route_cache_stats_t route_get_join_stats(const route_t *route);
+
+/*
+ * Profiling route_update (only with ROUTE_PROF defined, see route.c)
+ */
+bool_t route_prof_enable(bool_t flag);
+void route_prof_reset(void);
+bool_t route_prof_get(route_prof_stat_t stats[ROUTE_PROF_NUM_CTRS]);
+const char *route_prof_ctr2str(route_prof_ctr_t ctr);
+char *route_prof_dump(void);
+
+/*
+ * Forecast winds & temperatures
+ */
+void route_set_wx(route_t *route, const wx_t *wx, double dep_time);
+const wx_t *route_get_wx(const route_t *route, double *dep_time);
 
 /*
  * Airport handling
@@ -218,6 +410,32 @@ const navproc_t *route_get_apprtr(const route_t *route);
  */
 const list_t *route_get_leg_groups(const route_t *route);
 const list_t *route_get_legs(const route_t *route);
+unsigned route_get_num_segs(const route_t *route);
+const route_seg_t *route_get_seg(const route_t *route, unsigned idx);
+
+/*
+ * Positional access to leg groups & legs, O(1). The index behind these is
+ * kept in sync by the edits themselves: inserting or removing a leg or leg
+ * group shifts and renumbers every entry behind it, so an edit costs O(n)
+ * in the number of legs (or leg groups) following it.
+ */
+unsigned route_get_num_leg_groups(const route_t *route);
+const route_leg_group_t *route_get_leg_group(const route_t *route,
+    unsigned idx);
+unsigned route_lg_get_idx(const route_t *route, const route_leg_group_t *rlg);
+unsigned route_get_num_legs(const route_t *route);
+const route_leg_t *route_get_leg(const route_t *route, unsigned idx);
+unsigned route_l_get_idx(const route_t *route, const route_leg_t *rl);
+
+/*
+ * Along-track distances & positions on the route.
+ */
+double route_get_dist(const route_t *route);
+double route_seg_get_dist(const route_t *route, const route_seg_t *rs,
+    double frac);
+geo_pos2_t route_get_pos_at_dist(const route_t *route, double dist,
+    const route_seg_t **rsp);
+void route_get_leg_dists(const route_t *route, double *dists);
 
 /*
  * Editing route leg groups.
@@ -242,6 +460,13 @@ void route_l_set_alt_lim(route_t *route, const route_leg_t *x_rl, alt_lim_t l);
 alt_lim_t route_l_get_alt_lim(const route_leg_t *rl);
 void route_l_set_spd_lim(route_t *route, const route_leg_t *x_rl, spd_lim_t l);
 spd_lim_t route_l_get_spd_lim(const route_leg_t *rl);
+void route_l_set_wind(route_t *route, const route_leg_t *x_rl, vect2_t wind);
+vect2_t route_l_get_wind(const route_leg_t *rl);
+
+/*
+ * Building routes from filed flight plans.
+ */
+err_t route_fpl_ingest(route_t *route, const char *item15, unsigned *err_tok);
 
 route_seg_t *route_seg_join(list_t *seglist, route_seg_t *rs1,
     route_seg_t *rs2, double wpt_rnp, double spd, double turn_rate);
@@ -0,0 +1,989 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "geom.h"
+#include "helpers.h"
+#include "vnav.h"
+
+/*
+ * Vertical navigation
+ *
+ * The vertical profile of a route is built in three steps:
+ *
+ * 1) The climb from the departure runway to the cruise level and the
+ *	descent from the cruise level to the arrival runway are each
+ *	simulated once with the aircraft's performance model, without any
+ *	constraints, and sampled into a table of altitude, speed, time &
+ *	fuel burned against the distance flown.
+ * 2) A forward pass over the legs walks along the climb table and a
+ *	backward pass from the end of the route walks back up the descent
+ *	table, both capping the altitude at each leg's altitude constraint.
+ *	After a cap, the walk carries on from the point in the table where
+ *	it passes the capped altitude, which gives the level-off.
+ * 3) The profile flown is the lower of the two, with T/C where the climb
+ *	reaches the cruise level and T/D where the descent leaves it.
+ *	Speed constraints then hold the speed down at & before the leg
+ *	they're on in the climb, at & after it in the descent.
+ *
+ * So the performance model only runs for the climb & descent, no matter
+ * how long the route is, and each leg costs just a binary search in a
+ * table. The simulation assumes no wind and a single ISA deviation each
+ * for the climb & descent: with a forecast attached to the route (see
+ * route_set_wx), the average over the air column above the departure
+ * airport at takeoff and the arrival airport at the estimated arrival.
+ *
+ * The time & fuel predictions then go over the legs in order. A leg that
+ * climbs or descends takes the fuel flow of the table for the part of it
+ * spent climbing or descending and holds the altitude with thrust equal
+ * to drag for the rest. Each leg's wind only changes its ground speed.
+ * With a forecast, the wind & ISA deviation are averaged over samples
+ * every VNAV_WX_STEP along the leg, taken at the altitude and time the
+ * aircraft is predicted to pass there, and added to the leg's own wind.
+ * Since every leg starts from the predictions of the one before, a
+ * change of wind only needs the legs from the one changed onwards
+ * recomputed, see vnav_profile_update.
+ */
+
+#define	VNAV_STEP	1	/* NM between table samples */
+#define	VNAV_MIN_STEP	0.001	/* NM, a step this short ends a stage */
+#define	VNAV_MAX_DIST	1000	/* NM, longest climb or descent simulated */
+#define	VNAV_V2_FACT	1.2	/* V2 as a multiple of the stall speed */
+#define	VNAV_VAPP_FACT	1.3	/* approach speed as a multiple of same */
+#define	VNAV_APPR_HT	3000	/* ft above the runway, start of the final */
+#define	VNAV_GP_ANGLE	3	/* final approach glide path in degrees */
+#define	VNAV_ALT_THRESH	1	/* ft */
+#define	VNAV_MIN_GS	0.1	/* lowest ground speed, times TAS */
+#define	VNAV_WX_STEP	1	/* NM between forecast samples on legs */
+#define	VNAV_WX_COL	8	/* forecast samples up climb & descent */
+#define	SECS_PER_HR	3600
+
+typedef struct {
+	double		dist;		/* meters from the table's start */
+	double		alt;		/* feet */
+	double		kcas;
+	double		time;		/* seconds from the table's start */
+	double		burn;		/* kg burned from the table's start */
+} vnav_pt_t;
+
+struct vnav_tbl_s {
+	vnav_pt_t	*pts;
+	unsigned	num;
+	unsigned	cap;
+	bool_t		des;		/* altitude decreases with distance */
+	double		isadev;		/* simulated at, degrees C */
+};
+
+/*
+ * One stage of a climb or descent simulation, see vnav_tbl_sim.
+ */
+typedef struct {
+	double		alt;
+	double		kcas;
+	double		mach;
+	double		flap;
+	accelclb_t	type;
+} vnav_stage_t;
+
+/*
+ * True airspeed in m/s at `alt' & `kcas' at ISA deviation `isadev'.
+ */
+static double
+vnav_tas(double alt, double kcas, double isadev)
+{
+	return (KT2MPS(kcas2ktas(kcas, alt2press(alt, ISA_SL_PRESS),
+	    isadev2sat(alt2fl(alt, ISA_SL_PRESS), isadev))));
+}
+
+static vnav_tbl_t *
+vnav_tbl_new(bool_t des, double isadev)
+{
+	vnav_tbl_t *tbl = calloc(sizeof (*tbl), 1);
+
+	tbl->des = des;
+	tbl->isadev = isadev;
+	return (tbl);
+}
+
+static void
+vnav_tbl_free(vnav_tbl_t *tbl)
+{
+	if (tbl == NULL)
+		return;
+	free(tbl->pts);
+	free(tbl);
+}
+
+static void
+vnav_tbl_copy(vnav_tbl_t *tbl, const vnav_tbl_t *src)
+{
+	ASSERT(tbl->num == 0);
+	tbl->cap = MAX(src->num, 1);
+	tbl->pts = realloc(tbl->pts, tbl->cap * sizeof (*tbl->pts));
+	tbl->num = src->num;
+	memcpy(tbl->pts, src->pts, src->num * sizeof (*tbl->pts));
+}
+
+/*
+ * Adds a sample to the table. The time to it from the previous sample
+ * comes from the average of their true airspeeds.
+ */
+static void
+vnav_tbl_add(vnav_tbl_t *tbl, double dist, double alt, double kcas,
+    double burn)
+{
+	vnav_pt_t *pt;
+
+	if (tbl->num == tbl->cap) {
+		tbl->cap = MAX(2 * tbl->cap, 256);
+		tbl->pts = realloc(tbl->pts, tbl->cap * sizeof (*tbl->pts));
+	}
+	pt = &tbl->pts[tbl->num++];
+	pt->dist = dist;
+	pt->alt = alt;
+	pt->kcas = kcas;
+	pt->burn = burn;
+	if (tbl->num == 1) {
+		pt->time = 0;
+	} else {
+		const vnav_pt_t *prev = pt - 1;
+
+		pt->time = prev->time + (dist - prev->dist) /
+		    AVG(vnav_tas(prev->alt, prev->kcas, tbl->isadev),
+		    vnav_tas(alt, kcas, tbl->isadev));
+	}
+}
+
+/*
+ * Interpolates the table `dist' meters from its start. Outside of the
+ * table, its first or last sample is returned.
+ */
+static vnav_pt_t
+vnav_tbl_at_dist(const vnav_tbl_t *tbl, double dist)
+{
+	unsigned		lo = 0, hi = tbl->num - 1;
+	const vnav_pt_t		*a, *b;
+	vnav_pt_t		pt;
+	double			f;
+
+	ASSERT(tbl->num != 0);
+	if (dist <= tbl->pts[lo].dist)
+		return (tbl->pts[lo]);
+	if (dist >= tbl->pts[hi].dist)
+		return (tbl->pts[hi]);
+	while (hi - lo > 1) {
+		unsigned mid = (lo + hi) / 2;
+
+		if (tbl->pts[mid].dist <= dist)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	a = &tbl->pts[lo];
+	b = &tbl->pts[hi];
+	f = (dist - a->dist) / (b->dist - a->dist);
+	pt.dist = dist;
+	pt.alt = wavg(a->alt, b->alt, f);
+	pt.kcas = wavg(a->kcas, b->kcas, f);
+	pt.time = wavg(a->time, b->time, f);
+	pt.burn = wavg(a->burn, b->burn, f);
+
+	return (pt);
+}
+
+/*
+ * Returns the distance from the start of the table at which it first
+ * reaches altitude `alt', or the distance of its first or last sample if
+ * `alt' is outside of the table.
+ */
+static double
+vnav_tbl_dist_at_alt(const vnav_tbl_t *tbl, double alt)
+{
+#define	REACHED(i)	\
+	(tbl->des ? tbl->pts[(i)].alt <= alt : tbl->pts[(i)].alt >= alt)
+	unsigned	lo = 0, hi = tbl->num - 1;
+	const vnav_pt_t	*a, *b;
+
+	ASSERT(tbl->num != 0);
+	if (REACHED(lo))
+		return (tbl->pts[lo].dist);
+	if (!REACHED(hi))
+		return (tbl->pts[hi].dist);
+	while (hi - lo > 1) {
+		unsigned mid = (lo + hi) / 2;
+
+		if (REACHED(mid))
+			hi = mid;
+		else
+			lo = mid;
+	}
+	a = &tbl->pts[lo];
+	b = &tbl->pts[hi];
+	return (wavg(a->dist, b->dist, (alt - a->alt) / (b->alt - a->alt)));
+#undef	REACHED
+}
+
+/*
+ * The table where it passes altitude `alt'.
+ */
+static vnav_pt_t
+vnav_tbl_at_alt(const vnav_tbl_t *tbl, double alt)
+{
+	return (vnav_tbl_at_dist(tbl, vnav_tbl_dist_at_alt(tbl, alt)));
+}
+
+/*
+ * Simulates the climb or descent `stages' one after the other starting
+ * from `alt' & `kcas', adding a sample to `tbl' every VNAV_STEP NM. On
+ * return, `alt', `kcas' & `fuel' hold the state at the end.
+ *
+ * @return B_FALSE if the aircraft can't fly the stages.
+ */
+static bool_t
+vnav_tbl_sim(vnav_tbl_t *tbl, const acft_perf_t *acft, const flt_perf_t *flt,
+    const vnav_stage_t *stages, unsigned num_stages, double *alt,
+    double *kcas, double *fuel)
+{
+	double dist = 0, burn_total = 0;
+
+	ASSERT(tbl->num == 0);
+	vnav_tbl_add(tbl, 0, *alt, *kcas, 0);
+	for (unsigned i = 0; i < num_stages; i++) {
+		const vnav_stage_t *st = &stages[i];
+
+		for (;;) {
+			double d, burn = 0;
+
+			if (tbl->des) {
+				d = dist2deceldes(flt, acft, tbl->isadev,
+				    ISA_SL_PRESS, ISA_TP_ALT, *fuel,
+				    VECT2(0, 1), st->flap, alt, kcas,
+				    ZERO_VECT2, MIN(st->alt, *alt), st->kcas,
+				    st->mach, VNAV_STEP, st->type, &burn);
+			} else {
+				d = dist2accelclb(flt, acft, tbl->isadev,
+				    ISA_SL_PRESS, ISA_TP_ALT, *fuel,
+				    VECT2(0, 1), st->flap, alt, kcas,
+				    ZERO_VECT2, MAX(st->alt, *alt),
+				    MAX(st->kcas, *kcas), st->mach, VNAV_STEP,
+				    st->type, &burn);
+			}
+			if (isnan(d) || dist + d > VNAV_MAX_DIST)
+				return (B_FALSE);
+			/*
+			 * A target speed beyond the Mach limit only gets
+			 * trimmed once there, after a last step of nothing.
+			 */
+			if (d < VNAV_MIN_STEP)
+				break;
+			dist += d;
+			*fuel -= burn;
+			burn_total += burn;
+			vnav_tbl_add(tbl, NM2MET(dist), *alt, *kcas,
+			    burn_total);
+		}
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Fuel flow in kg/hr to hold `alt' & `kcas' at `mass' and ISA deviation
+ * `isadev', on the takeoff flaps if too slow for a clean wing.
+ */
+static double
+vnav_level_ff(const vnav_profile_t *prof, double alt, double kcas,
+    double mass, double isadev)
+{
+	double ff = perf_level_ff(prof->acft, isadev, ISA_SL_PRESS, alt, kcas,
+	    mass, 0);
+
+	if (isnan(ff)) {
+		ff = perf_level_ff(prof->acft, isadev, ISA_SL_PRESS, alt,
+		    kcas, mass, prof->flt.to_flap);
+	}
+	return (isnan(ff) ? 0 : ff);
+}
+
+/*
+ * Average forecast ISA deviation over the air column from `alt1' to `alt2'
+ * above airport `arpt' at `time' seconds since takeoff. Zero without a
+ * forecast.
+ */
+static double
+vnav_wx_col(const vnav_profile_t *prof, const airport_t *arpt, double alt1,
+    double alt2, double time)
+{
+	geo_pos3_t	pos[VNAV_WX_COL];
+	double		times[VNAV_WX_COL];
+	wx_sample_t	smpl[VNAV_WX_COL];
+	double		isadev = 0;
+
+	if (prof->wx == NULL || arpt == NULL)
+		return (0);
+	for (int i = 0; i < VNAV_WX_COL; i++) {
+		pos[i] = GEO2_TO_GEO3(GEO3_TO_GEO2(arpt->refpt), wavg(alt1,
+		    alt2, (i + 0.5) / VNAV_WX_COL));
+		times[i] = prof->wx_time + time;
+	}
+	wx_sample_n(prof->wx, pos, times, VNAV_WX_COL, smpl);
+	for (int i = 0; i < VNAV_WX_COL; i++)
+		isadev += smpl[i].isadev;
+
+	return (isadev / VNAV_WX_COL);
+}
+
+/*
+ * (Re)builds the climb & descent tables for the current `prof->flt' and
+ * forecast. If `tmpl' (optional) simulated the same climb & descent, its
+ * tables are copied instead.
+ */
+static bool_t
+vnav_tbls_build(vnav_profile_t *prof, route_t *route,
+    const vnav_profile_t *tmpl)
+{
+	const acft_perf_t	*acft = prof->acft;
+	const flt_perf_t	*flt = &prof->flt;
+	double			crz = MAX(flt->crz_lvl, MAX(prof->dep_elev,
+	    prof->arr_elev));
+	double			vs = perf_TO_spd(flt, acft);
+	double			fuel = flt->fuel, alt, kcas, oat, len, t;
+	double			clb_dev, des_dev, eta;
+	const vnav_pt_t		*last;
+	const vnav_stage_t	clb_stages[] = {
+	    /* on the takeoff flaps, clear of the ground */
+	    { prof->dep_elev + flt->accel_height, VNAV_V2_FACT * vs,
+	    flt->clb_mach, flt->to_flap, ACCEL_AND_CLB },
+	    { prof->dep_elev + flt->accel_height, flt->spd_lim,
+	    flt->clb_mach, flt->to_flap, ACCEL_THEN_CLB },
+	    { crz, flt->clb_ias, flt->clb_mach, 0, ACCEL_THEN_CLB }
+	};
+	const vnav_stage_t	des_stages[] = {
+	    { MAX(flt->spd_lim_alt, prof->arr_elev + VNAV_APPR_HT),
+	    flt->des_ias, flt->des_mach, 0, ACCEL_THEN_CLB },
+	    { prof->arr_elev + VNAV_APPR_HT, flt->spd_lim, flt->des_mach, 0,
+	    ACCEL_THEN_CLB },
+	    /* slowing down to the approach speed before the final */
+	    { prof->arr_elev + VNAV_APPR_HT, VNAV_VAPP_FACT * vs,
+	    flt->des_mach, flt->to_flap, ACCEL_THEN_CLB }
+	};
+
+	clb_dev = vnav_wx_col(prof, route_get_dep_arpt(route),
+	    prof->dep_elev, crz, 0);
+	/* good enough a guess of the arrival time to sample a forecast at */
+	eta = route_get_dist(route) / vnav_tas(crz, flt->crz_ias, clb_dev);
+	des_dev = vnav_wx_col(prof, route_get_arr_arpt(route),
+	    prof->arr_elev, crz, eta);
+
+	vnav_tbl_free(prof->clb);
+	vnav_tbl_free(prof->des);
+	prof->clb = vnav_tbl_new(B_FALSE, clb_dev);
+	prof->des = vnav_tbl_new(B_TRUE, des_dev);
+	prof->crz_alt = crz;
+	oat = isadev2sat(alt2fl(crz, ISA_SL_PRESS), des_dev);
+	prof->crz_kcas = MIN(flt->crz_ias, ktas2kcas(mach2ktas(flt->crz_mach,
+	    oat), alt2press(crz, ISA_SL_PRESS), oat));
+
+	if (tmpl != NULL && tmpl->acft == acft &&
+	    memcmp(&tmpl->flt, flt, sizeof (*flt)) == 0 &&
+	    tmpl->dep_elev == prof->dep_elev &&
+	    tmpl->arr_elev == prof->arr_elev &&
+	    tmpl->clb->isadev == clb_dev && tmpl->des->isadev == des_dev) {
+		vnav_tbl_copy(prof->clb, tmpl->clb);
+		vnav_tbl_copy(prof->des, tmpl->des);
+		return (B_TRUE);
+	}
+
+	alt = prof->dep_elev;
+	kcas = VNAV_V2_FACT * vs;
+	if (!vnav_tbl_sim(prof->clb, acft, flt, clb_stages, 3, &alt, &kcas,
+	    &fuel))
+		return (B_FALSE);
+
+	alt = crz;
+	kcas = prof->crz_kcas;
+	if (!vnav_tbl_sim(prof->des, acft, flt, des_stages, 3, &alt, &kcas,
+	    &fuel))
+		return (B_FALSE);
+
+	/*
+	 * The final is flown on the glide path rather than at idle, which
+	 * takes about the thrust of level flight.
+	 */
+	last = &prof->des->pts[prof->des->num - 1];
+	len = FEET2MET(alt - prof->arr_elev) / tan(DEG2RAD(VNAV_GP_ANGLE));
+	t = len / vnav_tas(AVG(alt, prof->arr_elev), kcas, des_dev);
+	vnav_tbl_add(prof->des, last->dist + len, prof->arr_elev, kcas,
+	    last->burn + vnav_level_ff(prof, alt, kcas, flt->zfw + fuel,
+	    des_dev) * t / SECS_PER_HR);
+
+	return (B_TRUE);
+}
+
+/*
+ * Highest altitude `lim' allows.
+ */
+static double
+vnav_alt_cap(alt_lim_t lim)
+{
+	switch (lim.type) {
+	case ALT_LIM_AT:
+	case ALT_LIM_AT_OR_BLW:
+	case ALT_LIM_BETWEEN:
+		return (lim.alt1);
+	default:
+		return (INFINITY);
+	}
+}
+
+/*
+ * Computes the altitude, speed & phase at the end of each leg as well as
+ * T/C & T/D from the tables and the legs' `dist'.
+ */
+static void
+vnav_vert(vnav_profile_t *prof, route_t *route)
+{
+	const vnav_tbl_t	*clb = prof->clb, *des = prof->des;
+	unsigned		n = prof->num_legs;
+	double			crz = prof->crz_alt;
+	double			toc = NAN, tod = NAN, x, h, lim;
+	vnav_leg_t		*des_legs = calloc(MAX(n, 1),
+	    sizeof (*des_legs));
+
+	/* climb, forward from the departure runway */
+	x = 0;
+	h = prof->dep_elev;
+	for (unsigned i = 0; i < n; i++) {
+		vnav_leg_t	*vl = &prof->legs[i];
+		vnav_pt_t	pt;
+		double		s0, cap;
+
+		if (isnan(vl->dist))
+			continue;
+		s0 = vnav_tbl_dist_at_alt(clb, h);
+		pt = vnav_tbl_at_dist(clb, s0 + vl->dist - x);
+		cap = vnav_alt_cap(route_l_get_alt_lim(route_get_leg(route,
+		    i)));
+		if (pt.alt > cap) {
+			pt = vnav_tbl_at_alt(clb, cap);
+			pt.alt = cap;
+		} else if (isnan(toc) && pt.alt >= crz - VNAV_ALT_THRESH) {
+			toc = x + vnav_tbl_dist_at_alt(clb, crz) - s0;
+		}
+		vl->alt = pt.alt;
+		vl->kcas = pt.kcas;
+		h = vl->alt;
+		x = vl->dist;
+	}
+
+	/* descent, backward from the arrival runway */
+	x = route_get_dist(route);
+	h = prof->arr_elev;
+	for (unsigned i = n; i-- > 0;) {
+		vnav_leg_t	*vl = &des_legs[i];
+		vnav_pt_t	pt;
+		double		s1, s, cap;
+
+		if (isnan(prof->legs[i].dist))
+			continue;
+		s1 = vnav_tbl_dist_at_alt(des, h);
+		s = s1 - (x - prof->legs[i].dist);
+		pt = vnav_tbl_at_dist(des, s);
+		cap = vnav_alt_cap(route_l_get_alt_lim(route_get_leg(route,
+		    i)));
+		if (pt.alt > cap) {
+			pt = vnav_tbl_at_alt(des, cap);
+			pt.alt = cap;
+		} else if (isnan(tod) && s <= 0) {
+			tod = x - s1;
+		}
+		vl->alt = pt.alt;
+		vl->kcas = pt.kcas;
+		h = vl->alt;
+		x = prof->legs[i].dist;
+	}
+
+	if (isnan(toc) || isnan(tod) || tod < toc) {
+		/* cruise level out of reach, the climb meets the descent */
+		double top = -INFINITY;
+
+		for (unsigned i = 0; i < n; i++) {
+			double a = MIN(prof->legs[i].alt, des_legs[i].alt);
+
+			if (!isnan(prof->legs[i].dist) && a > top) {
+				top = a;
+				toc = tod = prof->legs[i].dist;
+			}
+		}
+		if (!isinf(top)) {
+			prof->crz_alt = top;
+			prof->crz_kcas = MIN(vnav_tbl_at_alt(clb, top).kcas,
+			    vnav_tbl_at_alt(des, top).kcas);
+		}
+	}
+	prof->toc = toc;
+	prof->tod = tod;
+
+	for (unsigned i = 0; i < n; i++) {
+		vnav_leg_t		*vl = &prof->legs[i];
+		const vnav_leg_t	*dl = &des_legs[i];
+
+		if (isnan(vl->dist)) {
+			vl->alt = NAN;
+			vl->kcas = NAN;
+			vl->phase = FLT_PHASE_CRZ;
+			continue;
+		}
+		if (vl->dist < toc) {
+			vl->phase = FLT_PHASE_CLB;
+		} else if (vl->dist < tod) {
+			vl->phase = FLT_PHASE_CRZ;
+			vl->kcas = prof->crz_kcas;
+		} else {
+			vl->phase = FLT_PHASE_DES;
+		}
+		if (dl->alt < vl->alt) {
+			vl->alt = dl->alt;
+			if (vl->phase != FLT_PHASE_CRZ)
+				vl->kcas = dl->kcas;
+		}
+	}
+
+	/* speed constraints, at & before the leg in the climb */
+	lim = INFINITY;
+	for (unsigned i = n; i-- > 0;) {
+		vnav_leg_t	*vl = &prof->legs[i];
+		spd_lim_t	sl;
+
+		if (isnan(vl->dist))
+			continue;
+		if (vl->phase != FLT_PHASE_CLB) {
+			lim = INFINITY;
+			continue;
+		}
+		sl = route_l_get_spd_lim(route_get_leg(route, i));
+		if (sl.type == SPD_LIM_AT)
+			lim = MIN(lim, sl.spd1);
+		vl->kcas = MIN(vl->kcas, lim);
+	}
+	/* ... and at & after it in the descent */
+	lim = INFINITY;
+	for (unsigned i = 0; i < n; i++) {
+		vnav_leg_t	*vl = &prof->legs[i];
+		spd_lim_t	sl;
+
+		if (isnan(vl->dist))
+			continue;
+		if (vl->phase != FLT_PHASE_DES) {
+			lim = INFINITY;
+			continue;
+		}
+		sl = route_l_get_spd_lim(route_get_leg(route, i));
+		if (sl.type == SPD_LIM_AT)
+			lim = MIN(lim, sl.spd1);
+		vl->kcas = MIN(vl->kcas, lim);
+	}
+
+	free(des_legs);
+}
+
+/*
+ * Ground speed in m/s at true airspeed `tas' (in m/s) along leg `vl'.
+ */
+static double
+vnav_gs(const vnav_leg_t *vl, double tas)
+{
+	return (MAX(tas + KT2MPS(vect2_dotprod(vect2_add(vl->wind,
+	    vl->wx_wind), vl->dir)), tas * VNAV_MIN_GS));
+}
+
+/*
+ * Predicts the time & fuel to fly leg `vl' from the end of the previous
+ * one at along-track distance `x', altitude `alt' & speed `kcas'.
+ * `timep' and `fuelp' are advanced by the leg.
+ */
+static void
+vnav_pred_leg(const vnav_profile_t *prof, const vnav_leg_t *vl, double x,
+    double alt, double kcas, double *timep, double *fuelp)
+{
+	const vnav_tbl_t	*tbl = NULL;
+	double			d = vl->dist - x, c = 0, t = 0, burn = 0;
+	double			lvl_alt = vl->alt, lvl_kcas = vl->kcas;
+
+	if (vl->alt > alt + VNAV_ALT_THRESH) {
+		/* climb first, then level off */
+		tbl = prof->clb;
+	} else if (vl->alt < alt - VNAV_ALT_THRESH) {
+		/* stay level, then descend */
+		tbl = prof->des;
+		lvl_alt = alt;
+		lvl_kcas = kcas;
+	}
+	if (tbl != NULL) {
+		vnav_pt_t a = vnav_tbl_at_alt(tbl, alt);
+		vnav_pt_t b = vnav_tbl_at_alt(tbl, vl->alt);
+
+		if (b.time > a.time) {
+			double tas = (b.dist - a.dist) / (b.time - a.time);
+
+			c = MIN(b.dist - a.dist, d);
+			t = c / vnav_gs(vl, tas);
+			burn = (b.burn - a.burn) / (b.time - a.time) * t;
+		}
+	}
+	if (d > c) {
+		double dt = (d - c) / vnav_gs(vl, vnav_tas(lvl_alt, lvl_kcas,
+		    vl->isadev));
+
+		t += dt;
+		burn += vnav_level_ff(prof, lvl_alt, lvl_kcas, prof->flt.zfw +
+		    *fuelp - burn, vl->isadev) * dt / SECS_PER_HR;
+	}
+	*timep += t;
+	*fuelp -= burn;
+}
+
+/*
+ * Sets up the forecast sample points along the path: every VNAV_WX_STEP
+ * along each leg, in the middle of each stretch, and at least one per
+ * leg. These only depend on the lateral path, so they're set up once, on
+ * first use.
+ */
+static void
+vnav_wx_pts(vnav_profile_t *prof, route_t *route)
+{
+	unsigned	n = prof->num_legs, num = 0, cap = 0;
+	double		x = 0;
+
+	prof->wx_idx = calloc(n + 1, sizeof (*prof->wx_idx));
+	for (unsigned i = 0; i < n; i++) {
+		const vnav_leg_t	*vl = &prof->legs[i];
+		unsigned		cnt;
+		double			d;
+
+		prof->wx_idx[i] = num;
+		if (isnan(vl->dist))
+			continue;
+		d = vl->dist - x;
+		cnt = MAX(ceil(MET2NM(d) / VNAV_WX_STEP), 1);
+		if (num + cnt > cap) {
+			cap = MAX(2 * cap, num + cnt);
+			prof->wx_pos = realloc(prof->wx_pos, cap *
+			    sizeof (*prof->wx_pos));
+		}
+		for (unsigned j = 0; j < cnt; j++) {
+			prof->wx_pos[num++] = route_get_pos_at_dist(route,
+			    x + d * (j + 0.5) / cnt, NULL);
+		}
+		x = vl->dist;
+	}
+	prof->wx_idx[n] = num;
+}
+
+/*
+ * Averages the forecast over leg `i', flown from along-track distance `x'
+ * & altitude `alt' at the end of the previous leg, starting `time'
+ * seconds after takeoff. `pos', `times' & `smpl' are scratch space for
+ * the leg's sample points.
+ */
+static void
+vnav_wx_leg(vnav_profile_t *prof, unsigned i, double x, double alt,
+    double time, geo_pos3_t *pos, double *times, wx_sample_t *smpl)
+{
+	vnav_leg_t	*vl = &prof->legs[i];
+	unsigned	first = prof->wx_idx[i];
+	unsigned	cnt = prof->wx_idx[i + 1] - first;
+	/* at the leg's speed is close enough to place the samples in time */
+	double		dt = (vl->dist - x) / vnav_tas(vl->alt, vl->kcas, 0);
+	vect2_t		wind = ZERO_VECT2;
+	double		isadev = 0;
+
+	if (cnt == 0)
+		return;
+	for (unsigned j = 0; j < cnt; j++) {
+		double f = (j + 0.5) / cnt;
+
+		pos[j] = GEO2_TO_GEO3(prof->wx_pos[first + j],
+		    wavg(alt, vl->alt, f));
+		times[j] = prof->wx_time + time + f * dt;
+	}
+	wx_sample_n(prof->wx, pos, times, cnt, smpl);
+	for (unsigned j = 0; j < cnt; j++) {
+		wind = vect2_add(wind, smpl[j].wind);
+		isadev += smpl[j].isadev;
+	}
+	vl->wx_wind = vect2_scmul(wind, 1.0 / cnt);
+	vl->isadev = isadev / cnt;
+}
+
+/*
+ * Predicts the time & fuel at the end of the legs from leg `first' on,
+ * picking up from the predictions of the leg before it.
+ */
+static void
+vnav_pred(vnav_profile_t *prof, route_t *route, unsigned first)
+{
+	double		x = 0, alt = prof->clb->pts[0].alt;
+	double		kcas = prof->clb->pts[0].kcas;
+	double		time = 0, fuel = prof->flt.fuel;
+	geo_pos3_t	*pos = NULL;
+	double		*times = NULL;
+	wx_sample_t	*smpl = NULL;
+
+	if (prof->wx != NULL) {
+		unsigned max_cnt = 1;
+
+		if (prof->wx_idx == NULL)
+			vnav_wx_pts(prof, route);
+		for (unsigned i = first; i < prof->num_legs; i++) {
+			max_cnt = MAX(max_cnt, prof->wx_idx[i + 1] -
+			    prof->wx_idx[i]);
+		}
+		pos = malloc(max_cnt * sizeof (*pos));
+		times = malloc(max_cnt * sizeof (*times));
+		smpl = malloc(max_cnt * sizeof (*smpl));
+	}
+
+	for (unsigned i = first; i-- > 0;) {
+		const vnav_leg_t *vl = &prof->legs[i];
+
+		if (!isnan(vl->dist)) {
+			x = vl->dist;
+			alt = vl->alt;
+			kcas = vl->kcas;
+			time = vl->time;
+			fuel = vl->fuel;
+			break;
+		}
+	}
+	for (unsigned i = first; i < prof->num_legs; i++) {
+		vnav_leg_t *vl = &prof->legs[i];
+
+		vl->wind = route_l_get_wind(route_get_leg(route, i));
+		vl->wx_wind = ZERO_VECT2;
+		vl->isadev = 0;
+		if (isnan(vl->dist)) {
+			vl->time = NAN;
+			vl->fuel = NAN;
+			continue;
+		}
+		if (prof->wx != NULL)
+			vnav_wx_leg(prof, i, x, alt, time, pos, times, smpl);
+		vnav_pred_leg(prof, vl, x, alt, kcas, &time, &fuel);
+		vl->time = time;
+		vl->fuel = fuel;
+		x = vl->dist;
+		alt = vl->alt;
+		kcas = vl->kcas;
+	}
+	prof->pred_first = first;
+
+	free(pos);
+	free(times);
+	free(smpl);
+}
+
+static vnav_profile_t *
+vnav_profile_new(route_t *route, const acft_perf_t *acft,
+    const flt_perf_t *flt, const vnav_profile_t *tmpl, err_t *err)
+{
+	const airport_t	*dep = route_get_dep_arpt(route);
+	const airport_t	*arr = route_get_arr_arpt(route);
+	vnav_profile_t	*prof = calloc(sizeof (*prof), 1);
+	unsigned	n = route_get_num_legs(route);
+	double		*dists = calloc(MAX(n, 1), sizeof (*dists));
+	double		x = 0;
+
+	prof->acft = acft;
+	prof->flt = *flt;
+	prof->dep_elev = (dep != NULL ? dep->refpt.elev : 0);
+	prof->arr_elev = (arr != NULL ? arr->refpt.elev : 0);
+	prof->wx = route_get_wx(route, &prof->wx_time);
+	if (!vnav_tbls_build(prof, route, tmpl)) {
+		free(dists);
+		vnav_profile_destroy(prof);
+		*err = ERR_UNABLE_NEXT_ALT;
+		return (NULL);
+	}
+
+	prof->num_legs = n;
+	prof->legs = calloc(MAX(n, 1), sizeof (*prof->legs));
+	route_get_leg_dists(route, dists);
+	for (unsigned i = 0; i < n; i++) {
+		vnav_leg_t	*vl = &prof->legs[i];
+		geo_pos2_t	start, end;
+		fpp_t		fpp;
+
+		vl->dist = dists[i];
+		if (isnan(vl->dist))
+			continue;
+		/* the straight line between the leg's ends will do */
+		start = route_get_pos_at_dist(route, x, NULL);
+		end = route_get_pos_at_dist(route, vl->dist, NULL);
+		if (vl->dist > x && !IS_NULL_GEO_POS(start) &&
+		    !IS_NULL_GEO_POS(end)) {
+			fpp = gnomo_fpp_init(start, 0, NULL, B_TRUE);
+			vl->dir = vect2_unit(geo2fpp(end, &fpp), NULL);
+		}
+		x = vl->dist;
+	}
+	free(dists);
+
+	vnav_vert(prof, route);
+	vnav_pred(prof, route, 0);
+	*err = ERR_OK;
+
+	return (prof);
+}
+
+/*
+ * Builds the vertical profile & predictions of `route' as computed by its
+ * last route_update, flown by aircraft `acft' with the settings in `flt'
+ * in the route's forecast (see route_set_wx). The profile doesn't
+ * reference the route, which can be edited or destroyed afterwards, but
+ * it does reference the forecast.
+ *
+ * @return The profile or NULL with `err' set if the aircraft's performance
+ *	doesn't allow it to fly the climb or descent.
+ */
+vnav_profile_t *
+vnav_profile_create(route_t *route, const acft_perf_t *acft,
+    const flt_perf_t *flt, err_t *err)
+{
+	return (vnav_profile_new(route, acft, flt, NULL, err));
+}
+
+/*
+ * Like vnav_profile_create with the aircraft & settings of `tmpl', for
+ * another route between the same airports, e.g. one with different
+ * procedures. Unless the forecast gives the other route a different
+ * climb or descent, the tables of `tmpl' are copied rather than
+ * simulated again, which is most of the work of creating a profile.
+ * `tmpl' is only read, so any number of threads can use the same one.
+ */
+vnav_profile_t *
+vnav_profile_create_like(const vnav_profile_t *tmpl, route_t *route,
+    err_t *err)
+{
+	return (vnav_profile_new(route, tmpl->acft, &tmpl->flt, tmpl, err));
+}
+
+/*
+ * Refreshes `prof' after the settings in `flt', the winds on the legs of
+ * `route' or its forecast changed, without recomputing the lateral path.
+ * `route' must still have the legs & path the profile was created from,
+ * so after a route_update, create a new profile instead. A change to
+ * `flt' or the forecast rebuilds the vertical profile. Either way, time &
+ * fuel are only recomputed from the first leg whose altitude, speed or
+ * wind changed onwards, or for the whole route if the aircraft's weight
+ * or the forecast changed. A forecast mustn't be modified while in use,
+ * attach a new one instead.
+ *
+ * @return ERR_OK or ERR_UNABLE_NEXT_ALT if the aircraft's performance
+ *	doesn't allow it to fly the climb or descent. The profile is left
+ *	unchanged in that case.
+ */
+err_t
+vnav_profile_update(vnav_profile_t *prof, route_t *route,
+    const acft_perf_t *acft, const flt_perf_t *flt)
+{
+	unsigned	n = prof->num_legs, first = n;
+	double		wx_time;
+	const wx_t	*wx = route_get_wx(route, &wx_time);
+	bool_t		wx_chg = (wx != prof->wx ||
+	    (wx != NULL && wx_time != prof->wx_time));
+
+	ASSERT(route_get_num_legs(route) == n);
+	if (acft != prof->acft || memcmp(flt, &prof->flt, sizeof (*flt)) != 0 ||
+	    wx_chg) {
+		vnav_profile_t	old = *prof;
+		vnav_leg_t	*old_legs = calloc(MAX(n, 1),
+		    sizeof (*old_legs));
+
+		memcpy(old_legs, prof->legs, n * sizeof (*old_legs));
+		prof->acft = acft;
+		prof->flt = *flt;
+		prof->wx = wx;
+		prof->wx_time = wx_time;
+		prof->clb = NULL;
+		prof->des = NULL;
+		if (!vnav_tbls_build(prof, route, NULL)) {
+			vnav_tbl_free(prof->clb);
+			vnav_tbl_free(prof->des);
+			*prof = old;
+			free(old_legs);
+			return (ERR_UNABLE_NEXT_ALT);
+		}
+		vnav_tbl_free(old.clb);
+		vnav_tbl_free(old.des);
+		vnav_vert(prof, route);
+
+		if (acft != old.acft || flt->zfw != old.flt.zfw ||
+		    flt->fuel != old.flt.fuel || wx_chg) {
+			first = 0;
+		} else {
+			for (unsigned i = 0; i < n && first == n; i++) {
+				const vnav_leg_t *vl = &prof->legs[i];
+				const vnav_leg_t *ol = &old_legs[i];
+
+				if (isnan(vl->dist))
+					continue;
+				if (vl->alt != ol->alt ||
+				    vl->kcas != ol->kcas ||
+				    vl->phase != ol->phase)
+					first = i;
+			}
+		}
+		free(old_legs);
+	}
+	for (unsigned i = 0; i < first; i++) {
+		vect2_t wind = route_l_get_wind(route_get_leg(route, i));
+
+		if (wind.x != prof->legs[i].wind.x ||
+		    wind.y != prof->legs[i].wind.y)
+			first = i;
+	}
+	if (first < n)
+		vnav_pred(prof, route, first);
+	else
+		prof->pred_first = n;
+
+	return (ERR_OK);
+}
+
+void
+vnav_profile_destroy(vnav_profile_t *prof)
+{
+	vnav_tbl_free(prof->clb);
+	vnav_tbl_free(prof->des);
+	free(prof->wx_pos);
+	free(prof->wx_idx);
+	free(prof->legs);
+	free(prof);
+}
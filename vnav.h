@@ -0,0 +1,104 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+
+#ifndef	_OPENFMC_VNAV_H_
+#define	_OPENFMC_VNAV_H_
+
+#include "err.h"
+#include "fms.h"
+#include "perf.h"
+#include "route.h"
+#include "wx.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct vnav_tbl_s vnav_tbl_t;
+
+/*
+ * Predictions at the end of one route leg. Legs whose end isn't on the
+ * path (see route_get_leg_dists) have all of these set to NAN.
+ */
+typedef struct {
+	double		dist;	/* along-track from the route's start, meters */
+	double		alt;	/* feet AMSL */
+	double		kcas;	/* knots */
+	flt_phase_t	phase;	/* CLB, CRZ or DES */
+	double		time;	/* seconds since takeoff */
+	double		fuel;	/* fuel remaining in kg */
+
+	/* Forecast averaged over the leg, zero without one */
+	vect2_t		wx_wind;
+	double		isadev;
+
+	/* Prediction inputs, see vnav_profile_update */
+	vect2_t		dir;	/* ground track over the leg, unit vector */
+	vect2_t		wind;	/* route_l_get_wind */
+} vnav_leg_t;
+
+/*
+ * Vertical profile & predictions of a route. When the route is too short
+ * to reach the cruise level, T/C & T/D coincide at the highest point
+ * reached, which is then also `crz_alt'.
+ */
+typedef struct {
+	double		toc;		/* T/C along-track distance, meters */
+	double		tod;		/* T/D along-track distance, meters */
+	double		crz_alt;	/* feet AMSL */
+	double		crz_kcas;	/* knots */
+	unsigned	num_legs;
+	vnav_leg_t	*legs;		/* in route_get_leg order */
+	/* first leg whose time & fuel the last create/update recomputed */
+	unsigned	pred_first;
+
+	/* Inputs of the last vnav_profile_create/update */
+	const acft_perf_t *acft;
+	flt_perf_t	flt;
+	double		dep_elev;
+	double		arr_elev;
+	const wx_t	*wx;
+	double		wx_time;
+	vnav_tbl_t	*clb;
+	vnav_tbl_t	*des;
+	/* forecast sample points along the path, see vnav_wx_pts */
+	geo_pos2_t	*wx_pos;
+	unsigned	*wx_idx;	/* num_legs + 1 entries */
+} vnav_profile_t;
+
+vnav_profile_t *vnav_profile_create(route_t *route, const acft_perf_t *acft,
+    const flt_perf_t *flt, err_t *err);
+vnav_profile_t *vnav_profile_create_like(const vnav_profile_t *tmpl,
+    route_t *route, err_t *err);
+err_t vnav_profile_update(vnav_profile_t *prof, route_t *route,
+    const acft_perf_t *acft, const flt_perf_t *flt);
+void vnav_profile_destroy(vnav_profile_t *prof);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _OPENFMC_VNAV_H_ */
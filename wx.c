@@ -0,0 +1,624 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "helpers.h"
+#include "log.h"
+#include "perf.h"
+#include "wx.h"
+
+/*
+ * Gridded wind & temperature forecast
+ *
+ * A forecast is a regular grid of latitude x longitude x pressure level x
+ * time. The file format is meant to be trivial to produce from GRIB data
+ * (e.g. the UGRD, VGRD & TMP fields of a GFS run) with any GRIB decoder.
+ * All numbers are little-endian, integers unsigned 32-bit, doubles &
+ * floats IEEE 754:
+ *
+ *	"OFWX"			magic
+ *	uint32			version (WX_VERSION)
+ *	uint32 x 4		number of latitudes, longitudes, levels & times
+ *	double x 4		first latitude & its step, first longitude & its
+ *				step, in degrees. The latitude step may be
+ *				negative (north to south, as in GRIB).
+ *	double[levels]		pressure levels in hPa, highest pressure (i.e.
+ *				lowest altitude) first
+ *	double[times]		valid times in seconds since the UNIX epoch,
+ *				in ascending order
+ *	float[times][levels][lats][lons][3]
+ *				wind component towards east & towards north
+ *				in m/s and the temperature in Kelvin
+ *
+ * A grid spanning 360 degrees of longitude wraps around the antimeridian.
+ * Outside of the grid, conditions at its nearest edge are used.
+ *
+ * In memory, the cells keep the same order but hold the wind in knots &
+ * the ISA deviation, so sampling a point is just a weighted sum of the
+ * 16 cells around it: the 4 corners of its latitude/longitude square on
+ * the levels above & below it, at the valid times before & after it. The
+ * corners along the longitude axis are adjacent in memory and those along
+ * the latitude axis a row apart.
+ */
+
+#define	WX_MAGIC	"OFWX"
+#define	WX_VERSION	1
+#define	WX_HDR_LEN	(4 + 5 * 4 + 4 * 8)
+#define	WX_LON_WRAP_EPS	1e-6	/* degrees */
+
+/*
+ * A grid cell. The padding to 16 bytes keeps cells from straddling cache
+ * lines and lets the compiler interpolate all of a cell's values at once
+ * with vector instructions.
+ */
+enum { WX_WIND_X, WX_WIND_Y, WX_ISADEV, WX_NUM_VALS = 4 };
+typedef struct {
+	float		v[WX_NUM_VALS];	/* knots, knots, degrees C, unused */
+} wx_cell_t;
+
+struct wx_s {
+	unsigned	num_lat;
+	unsigned	num_lon;
+	unsigned	num_lvl;
+	unsigned	num_times;
+	double		lat0;
+	double		dlat;
+	double		lon0;
+	double		dlon;
+	bool_t		lon_wrap;	/* spans all longitudes */
+	double		*lvls;		/* hPa, as in the file */
+	double		*lvl_alt;	/* pressure altitudes of `lvls', feet */
+	double		*times;
+	wx_cell_t	*cells;
+
+	/* Reciprocals of the steps along the axes, see wx_sample_n */
+	double		inv_dlat;
+	double		inv_dlon;
+	double		*inv_lvl;
+	double		*inv_times;
+
+	uint64_t	serial;		/* renewed by wx_set, see serial_next */
+};
+
+/*
+ * Interpolation weights along one axis of the grid: the sample lies
+ * between the points `i0' & `i1', `f' of the way from `i0'.
+ */
+typedef struct {
+	unsigned	i0;
+	unsigned	i1;
+	double		f;
+} wx_axis_t;
+
+static inline size_t
+wx_cell_idx(const wx_t *wx, unsigned lat, unsigned lon, unsigned lvl,
+    unsigned t)
+{
+	return ((((size_t)t * wx->num_lvl + lvl) * wx->num_lat + lat) *
+	    wx->num_lon + lon);
+}
+
+/*
+ * Creates a grid of `num_lat' latitudes starting at `lat0' in steps of
+ * `dlat' degrees by `num_lon' longitudes starting at `lon0' in steps of
+ * `dlon' degrees, with pressure levels `lvls' (in hPa, decreasing) and
+ * valid times `times' (in seconds, increasing). All cells start out with
+ * no wind at ISA temperature. Fill them in with wx_set.
+ *
+ * @return The new grid or NULL if the dimensions aren't valid.
+ */
+wx_t *
+wx_create(unsigned num_lat, double lat0, double dlat, unsigned num_lon,
+    double lon0, double dlon, unsigned num_lvl, const double *lvls,
+    unsigned num_times, const double *times)
+{
+	wx_t	*wx;
+	size_t	num_cells;
+
+	if (num_lat == 0 || num_lon == 0 || num_lvl == 0 || num_times == 0 ||
+	    !isfinite(lat0) || !isfinite(dlat) || !isfinite(lon0) ||
+	    !isfinite(dlon) || dlat == 0 || dlon <= 0)
+		return (NULL);
+	num_cells = (size_t)num_lat * num_lon;
+	if (num_cells / num_lon != num_lat ||
+	    num_cells > SIZE_MAX / sizeof (wx_cell_t) / num_lvl / num_times)
+		return (NULL);
+	for (unsigned i = 0; i < num_lvl; i++) {
+		if (!(lvls[i] > 0) || (i > 0 && lvls[i] >= lvls[i - 1]))
+			return (NULL);
+	}
+	for (unsigned i = 0; i < num_times; i++) {
+		if (!isfinite(times[i]) || (i > 0 && times[i] <= times[i - 1]))
+			return (NULL);
+	}
+
+	wx = calloc(sizeof (*wx), 1);
+	wx->num_lat = num_lat;
+	wx->num_lon = num_lon;
+	wx->num_lvl = num_lvl;
+	wx->num_times = num_times;
+	wx->lat0 = lat0;
+	wx->dlat = dlat;
+	wx->lon0 = lon0;
+	wx->dlon = dlon;
+	wx->lon_wrap = (num_lon * dlon >= 360 - WX_LON_WRAP_EPS);
+	wx->inv_dlat = 1 / dlat;
+	wx->inv_dlon = 1 / dlon;
+	wx->lvls = malloc(num_lvl * sizeof (*wx->lvls));
+	wx->lvl_alt = malloc(num_lvl * sizeof (*wx->lvl_alt));
+	wx->inv_lvl = calloc(num_lvl, sizeof (*wx->inv_lvl));
+	for (unsigned i = 0; i < num_lvl; i++) {
+		wx->lvls[i] = lvls[i];
+		wx->lvl_alt[i] = press2alt(lvls[i] * 100, ISA_SL_PRESS);
+		if (i > 0) {
+			wx->inv_lvl[i - 1] = 1 / (wx->lvl_alt[i] -
+			    wx->lvl_alt[i - 1]);
+		}
+	}
+	wx->times = malloc(num_times * sizeof (*wx->times));
+	wx->inv_times = calloc(num_times, sizeof (*wx->inv_times));
+	for (unsigned i = 0; i < num_times; i++) {
+		wx->times[i] = times[i];
+		if (i > 0)
+			wx->inv_times[i - 1] = 1 / (times[i] - times[i - 1]);
+	}
+	wx->cells = calloc(num_cells * num_lvl * num_times,
+	    sizeof (*wx->cells));
+	wx->serial = serial_next();
+
+	return (wx);
+}
+
+void
+wx_close(wx_t *wx)
+{
+	free(wx->lvls);
+	free(wx->lvl_alt);
+	free(wx->inv_lvl);
+	free(wx->times);
+	free(wx->inv_times);
+	free(wx->cells);
+	free(wx);
+}
+
+/*
+ * Sets the cell at the given grid indices to wind `wind' (towards where it
+ * blows, in knots) and temperature `temp' (in degrees C).
+ */
+void
+wx_set(wx_t *wx, unsigned lat, unsigned lon, unsigned lvl, unsigned t,
+    vect2_t wind, double temp)
+{
+	wx_cell_t *cell;
+
+	ASSERT(lat < wx->num_lat && lon < wx->num_lon);
+	ASSERT(lvl < wx->num_lvl && t < wx->num_times);
+	cell = &wx->cells[wx_cell_idx(wx, lat, lon, lvl, t)];
+	cell->v[WX_WIND_X] = wind.x;
+	cell->v[WX_WIND_Y] = wind.y;
+	cell->v[WX_ISADEV] = sat2isadev(alt2fl(wx->lvl_alt[lvl],
+	    ISA_SL_PRESS), temp);
+	wx->serial = serial_next();
+}
+
+/*
+ * Returns a number which identifies the current contents of the grid: it
+ * changes whenever a cell is set and is never shared with another grid.
+ */
+uint64_t
+wx_get_serial(const wx_t *wx)
+{
+	return (wx->serial);
+}
+
+static uint32_t
+wx_get_u32(const uint8_t **pp)
+{
+	const uint8_t *p = *pp;
+
+	*pp += 4;
+	return ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static double
+wx_get_f64(const uint8_t **pp)
+{
+	uint64_t	u = wx_get_u32(pp);
+	double		d;
+
+	u |= (uint64_t)wx_get_u32(pp) << 32;
+	memcpy(&d, &u, sizeof (d));
+	return (d);
+}
+
+static float
+wx_get_f32(const uint8_t **pp)
+{
+	uint32_t	u = wx_get_u32(pp);
+	float		f;
+
+	memcpy(&f, &u, sizeof (f));
+	return (f);
+}
+
+/*
+ * Reads the whole of file `filename' into a malloc'd buffer.
+ */
+static uint8_t *
+wx_read_file(const char *filename, size_t *len)
+{
+	FILE	*fp = fopen(filename, "rb");
+	uint8_t	*buf = NULL;
+	size_t	cap = 0;
+
+	if (fp == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't open %s: %s", filename,
+		    strerror(errno));
+		return (NULL);
+	}
+	*len = 0;
+	for (;;) {
+		size_t n;
+
+		if (*len == cap) {
+			cap = MAX(2 * cap, 1 << 16);
+			buf = realloc(buf, cap);
+		}
+		n = fread(&buf[*len], 1, cap - *len, fp);
+		if (n == 0)
+			break;
+		*len += n;
+	}
+	if (ferror(fp)) {
+		openfmc_log(OPENFMC_LOG_ERR, "Error reading %s: %s", filename,
+		    strerror(errno));
+		free(buf);
+		buf = NULL;
+	}
+	fclose(fp);
+
+	return (buf);
+}
+
+/*
+ * Loads a forecast grid from file `filename' (see the format above).
+ *
+ * @return The grid or NULL if the file can't be read or is malformed.
+ */
+wx_t *
+wx_open(const char *filename)
+{
+	uint8_t		*buf;
+	const uint8_t	*p;
+	size_t		len, num_cells;
+	unsigned	num_lat, num_lon, num_lvl, num_times;
+	double		lat0, dlat, lon0, dlon;
+	double		*lvls = NULL, *times = NULL;
+	wx_t		*wx = NULL;
+
+	buf = wx_read_file(filename, &len);
+	if (buf == NULL)
+		return (NULL);
+	p = buf;
+	if (len < WX_HDR_LEN || memcmp(p, WX_MAGIC, 4) != 0)
+		goto errout;
+	p += 4;
+	if (wx_get_u32(&p) != WX_VERSION)
+		goto errout;
+	num_lat = wx_get_u32(&p);
+	num_lon = wx_get_u32(&p);
+	num_lvl = wx_get_u32(&p);
+	num_times = wx_get_u32(&p);
+	lat0 = wx_get_f64(&p);
+	dlat = wx_get_f64(&p);
+	lon0 = wx_get_f64(&p);
+	dlon = wx_get_f64(&p);
+	if (((uint64_t)num_lvl + num_times) * 8 > len - WX_HDR_LEN)
+		goto errout;
+	lvls = malloc(MAX(num_lvl, 1) * sizeof (*lvls));
+	times = malloc(MAX(num_times, 1) * sizeof (*times));
+	for (unsigned i = 0; i < num_lvl; i++)
+		lvls[i] = wx_get_f64(&p);
+	for (unsigned i = 0; i < num_times; i++)
+		times[i] = wx_get_f64(&p);
+
+	wx = wx_create(num_lat, lat0, dlat, num_lon, lon0, dlon, num_lvl, lvls,
+	    num_times, times);
+	if (wx == NULL)
+		goto errout;
+	num_cells = (size_t)num_lat * num_lon * num_lvl * num_times;
+	if ((size_t)(&buf[len] - p) / (3 * 4) != num_cells ||
+	    (size_t)(&buf[len] - p) % (3 * 4) != 0)
+		goto errout;
+	for (unsigned t = 0; t < num_times; t++) {
+		for (unsigned lvl = 0; lvl < num_lvl; lvl++) {
+			for (unsigned lat = 0; lat < num_lat; lat++) {
+				for (unsigned lon = 0; lon < num_lon; lon++) {
+					double u = wx_get_f32(&p);
+					double v = wx_get_f32(&p);
+					double temp = wx_get_f32(&p);
+
+					wx_set(wx, lat, lon, lvl, t,
+					    VECT2(MPS2KT(u), MPS2KT(v)),
+					    KELVIN2C(temp));
+				}
+			}
+		}
+	}
+	free(lvls);
+	free(times);
+	free(buf);
+
+	return (wx);
+errout:
+	openfmc_log(OPENFMC_LOG_ERR, "Error reading %s: malformed forecast "
+	    "file", filename);
+	if (wx != NULL)
+		wx_close(wx);
+	free(lvls);
+	free(times);
+	free(buf);
+	return (NULL);
+}
+
+static void
+wx_put_u32(FILE *fp, uint32_t u)
+{
+	uint8_t b[4] = { u & 0xff, (u >> 8) & 0xff, (u >> 16) & 0xff,
+	    (u >> 24) & 0xff };
+
+	(void) fwrite(b, 1, sizeof (b), fp);
+}
+
+static void
+wx_put_f64(FILE *fp, double d)
+{
+	uint64_t u;
+
+	memcpy(&u, &d, sizeof (u));
+	wx_put_u32(fp, u & 0xffffffffu);
+	wx_put_u32(fp, u >> 32);
+}
+
+static void
+wx_put_f32(FILE *fp, float f)
+{
+	uint32_t u;
+
+	memcpy(&u, &f, sizeof (u));
+	wx_put_u32(fp, u);
+}
+
+/*
+ * Writes the grid to file `filename' in the format wx_open reads.
+ *
+ * @return B_TRUE on success, B_FALSE if the file couldn't be written.
+ */
+bool_t
+wx_write(const wx_t *wx, const char *filename)
+{
+	FILE	*fp = fopen(filename, "wb");
+	bool_t	ok;
+
+	if (fp == NULL) {
+		openfmc_log(OPENFMC_LOG_ERR, "Can't open %s: %s", filename,
+		    strerror(errno));
+		return (B_FALSE);
+	}
+	(void) fwrite(WX_MAGIC, 1, 4, fp);
+	wx_put_u32(fp, WX_VERSION);
+	wx_put_u32(fp, wx->num_lat);
+	wx_put_u32(fp, wx->num_lon);
+	wx_put_u32(fp, wx->num_lvl);
+	wx_put_u32(fp, wx->num_times);
+	wx_put_f64(fp, wx->lat0);
+	wx_put_f64(fp, wx->dlat);
+	wx_put_f64(fp, wx->lon0);
+	wx_put_f64(fp, wx->dlon);
+	for (unsigned i = 0; i < wx->num_lvl; i++)
+		wx_put_f64(fp, wx->lvls[i]);
+	for (unsigned i = 0; i < wx->num_times; i++)
+		wx_put_f64(fp, wx->times[i]);
+	for (unsigned t = 0; t < wx->num_times; t++) {
+		for (unsigned lvl = 0; lvl < wx->num_lvl; lvl++) {
+			double fl = alt2fl(wx->lvl_alt[lvl], ISA_SL_PRESS);
+
+			for (size_t i = wx_cell_idx(wx, 0, 0, lvl, t),
+			    n = i + (size_t)wx->num_lat * wx->num_lon;
+			    i < n; i++) {
+				const wx_cell_t *cell = &wx->cells[i];
+
+				wx_put_f32(fp, KT2MPS(cell->v[WX_WIND_X]));
+				wx_put_f32(fp, KT2MPS(cell->v[WX_WIND_Y]));
+				wx_put_f32(fp, C2KELVIN(isadev2sat(fl,
+				    cell->v[WX_ISADEV])));
+			}
+		}
+	}
+	ok = !ferror(fp);
+	if (fclose(fp) != 0 || !ok) {
+		openfmc_log(OPENFMC_LOG_ERR, "Error writing %s: %s", filename,
+		    strerror(errno));
+		return (B_FALSE);
+	}
+
+	return (B_TRUE);
+}
+
+/*
+ * Weights along an evenly spaced axis of `n' points, the first at `x0',
+ * 1 / `inv_dx' apart. Beyond the ends, the end point is used.
+ */
+static inline wx_axis_t
+wx_axis_even(double x, double x0, double inv_dx, unsigned n)
+{
+	double		i = (x - x0) * inv_dx;
+	wx_axis_t	a;
+
+	if (!(i > 0)) {
+		a.i0 = a.i1 = 0;
+		a.f = 0;
+	} else if (i >= n - 1) {
+		a.i0 = a.i1 = n - 1;
+		a.f = 0;
+	} else {
+		a.i0 = i;
+		a.i1 = a.i0 + 1;
+		a.f = i - a.i0;
+	}
+	return (a);
+}
+
+/*
+ * Same as wx_axis_even for the longitude axis, wrapping around if the grid
+ * spans all longitudes.
+ */
+static inline wx_axis_t
+wx_axis_lon(const wx_t *wx, double lon)
+{
+	double		i;
+	wx_axis_t	a;
+
+	if (!wx->lon_wrap)
+		return (wx_axis_even(lon, wx->lon0, wx->inv_dlon, wx->num_lon));
+	i = (lon - wx->lon0) * wx->inv_dlon;
+	/* fmod is slow and longitudes are mostly in range already */
+	if (i < 0 || i >= wx->num_lon)
+		i -= floor(i / wx->num_lon) * wx->num_lon;
+	a.i0 = MIN((unsigned)i, wx->num_lon - 1);
+	a.i1 = (a.i0 + 1) % wx->num_lon;
+	a.f = MIN(MAX(i - a.i0, 0), 1);
+	return (a);
+}
+
+/*
+ * Weights along an axis of `n' increasing values `tbl', with `inv' the
+ * reciprocals of the intervals between them. `hint' is the interval found
+ * last time, from which the search starts, as consecutive samples are
+ * usually close to each other.
+ */
+static inline wx_axis_t
+wx_axis_tbl(double x, const double *tbl, const double *inv, unsigned n,
+    unsigned *hint)
+{
+	unsigned	i = MIN(*hint, n - 1);
+	wx_axis_t	a;
+
+	if (!(x > tbl[0])) {
+		a.i0 = a.i1 = 0;
+		a.f = 0;
+		return (a);
+	}
+	if (x >= tbl[n - 1]) {
+		a.i0 = a.i1 = n - 1;
+		a.f = 0;
+		return (a);
+	}
+	while (i > 0 && tbl[i] > x)
+		i--;
+	while (i + 1 < n - 1 && tbl[i + 1] <= x)
+		i++;
+	*hint = i;
+	a.i0 = i;
+	a.i1 = i + 1;
+	a.f = (x - tbl[i]) * inv[i];
+	return (a);
+}
+
+/*
+ * Samples the forecast at `n' points `pos' (altitudes in feet AMSL) at
+ * times `times' (in seconds since the UNIX epoch). See the comment at the
+ * top of the file for how. The 16 cells are blended in a tree, 4 layers
+ * (2 levels at 2 times) of 4 cells each, which keeps the chains of
+ * dependent arithmetic short.
+ */
+void
+wx_sample_n(const wx_t *wx, const geo_pos3_t *pos, const double *times,
+    size_t n, wx_sample_t *out)
+{
+	size_t		row = wx->num_lon;
+	size_t		lvl_stride = row * wx->num_lat;
+	size_t		t_stride = lvl_stride * wx->num_lvl;
+	unsigned	lvl_hint = 0, t_hint = 0;
+
+	for (size_t k = 0; k < n; k++) {
+		wx_axis_t	la = wx_axis_even(pos[k].lat, wx->lat0,
+		    wx->inv_dlat, wx->num_lat);
+		wx_axis_t	lo = wx_axis_lon(wx, pos[k].lon);
+		wx_axis_t	lv = wx_axis_tbl(pos[k].elev, wx->lvl_alt,
+		    wx->inv_lvl, wx->num_lvl, &lvl_hint);
+		wx_axis_t	ti = wx_axis_tbl(times[k], wx->times,
+		    wx->inv_times, wx->num_times, &t_hint);
+		float		w[4] = {
+		    (1 - la.f) * (1 - lo.f), (1 - la.f) * lo.f,
+		    la.f * (1 - lo.f), la.f * lo.f
+		};
+		float		wl[4] = {
+		    (1 - ti.f) * (1 - lv.f), (1 - ti.f) * lv.f,
+		    ti.f * (1 - lv.f), ti.f * lv.f
+		};
+		size_t		off[4] = {
+		    ti.i0 * t_stride + lv.i0 * lvl_stride,
+		    ti.i0 * t_stride + lv.i1 * lvl_stride,
+		    ti.i1 * t_stride + lv.i0 * lvl_stride,
+		    ti.i1 * t_stride + lv.i1 * lvl_stride
+		};
+		float		l[4][WX_NUM_VALS], v[WX_NUM_VALS];
+
+		for (int i = 0; i < 4; i++) {
+			const wx_cell_t *r0 = &wx->cells[off[i] + la.i0 * row];
+			const wx_cell_t *r1 = &wx->cells[off[i] + la.i1 * row];
+
+			for (int j = 0; j < WX_NUM_VALS; j++) {
+				l[i][j] = (w[0] * r0[lo.i0].v[j] +
+				    w[1] * r0[lo.i1].v[j]) +
+				    (w[2] * r1[lo.i0].v[j] +
+				    w[3] * r1[lo.i1].v[j]);
+			}
+		}
+		for (int j = 0; j < WX_NUM_VALS; j++) {
+			v[j] = (wl[0] * l[0][j] + wl[1] * l[1][j]) +
+			    (wl[2] * l[2][j] + wl[3] * l[3][j]);
+		}
+		out[k].wind = VECT2(v[WX_WIND_X], v[WX_WIND_Y]);
+		out[k].isadev = v[WX_ISADEV];
+	}
+}
+
+wx_sample_t
+wx_sample(const wx_t *wx, geo_pos3_t pos, double time)
+{
+	wx_sample_t s;
+
+	wx_sample_n(wx, &pos, &time, 1, &s);
+	return (s);
+}
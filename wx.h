@@ -0,0 +1,70 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license in the file COPYING
+ * or http://www.opensource.org/licenses/CDDL-1.0.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file COPYING.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2015 Saso Kiselkov. All rights reserved.
+ */
+
+
+#ifndef	_OPENFMC_WX_H_
+#define	_OPENFMC_WX_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "geom.h"
+#include "types.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct wx_s wx_t;
+
+/*
+ * Forecast conditions at one point, see wx_sample.
+ */
+typedef struct {
+	vect2_t		wind;	/* towards where it blows, knots */
+	double		isadev;	/* ISA deviation in degrees C */
+} wx_sample_t;
+
+wx_t *wx_open(const char *filename);
+wx_t *wx_create(unsigned num_lat, double lat0, double dlat,
+    unsigned num_lon, double lon0, double dlon,
+    unsigned num_lvl, const double *lvls, unsigned num_times,
+    const double *times);
+void wx_close(wx_t *wx);
+bool_t wx_write(const wx_t *wx, const char *filename);
+
+void wx_set(wx_t *wx, unsigned lat, unsigned lon, unsigned lvl,
+    unsigned t, vect2_t wind, double temp);
+uint64_t wx_get_serial(const wx_t *wx);
+
+wx_sample_t wx_sample(const wx_t *wx, geo_pos3_t pos, double time);
+void wx_sample_n(const wx_t *wx, const geo_pos3_t *pos, const double *times,
+    size_t n, wx_sample_t *out);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _OPENFMC_WX_H_ */